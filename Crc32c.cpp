@@ -0,0 +1,67 @@
+#include "Crc32c.h"
+#include <string.h>
+#if defined(__x86_64__)
+#include <immintrin.h>
+#define XTEN_CRC_X86 1
+#endif
+namespace xten
+{
+    // Castagnoli多项式(反射)
+#define CRC32C_POLY 0x82F63B78u
+    struct Crc32cTable
+    {
+        uint32_t table[256];
+        Crc32cTable()
+        {
+            for (uint32_t i = 0; i < 256; i++)
+            {
+                uint32_t crc = i;
+                for (int j = 0; j < 8; j++)
+                    crc = (crc & 1) ? (crc >> 1) ^ CRC32C_POLY : crc >> 1;
+                table[i] = crc;
+            }
+        }
+    };
+    static uint32_t crc32cSoftware(const unsigned char *data, size_t len, uint32_t crc)
+    {
+        // c++11后静态局部变量的初始化是线程安全的
+        static Crc32cTable t;
+        for (size_t i = 0; i < len; i++)
+            crc = t.table[(crc ^ data[i]) & 0xFF] ^ (crc >> 8);
+        return crc;
+    }
+#ifdef XTEN_CRC_X86
+    __attribute__((target("sse4.2"))) static uint32_t crc32cHardware(const unsigned char *data, size_t len, uint32_t crc)
+    {
+        uint64_t crc64 = crc;
+        for (; len >= 8; len -= 8, data += 8)
+        {
+            uint64_t v;
+            memcpy(&v, data, sizeof(v));
+            crc64 = _mm_crc32_u64(crc64, v);
+        }
+        uint32_t crc32 = (uint32_t)crc64;
+        for (; len > 0; len--, data++)
+            crc32 = _mm_crc32_u8(crc32, *data);
+        return crc32;
+    }
+#endif
+    bool Crc32cHardware()
+    {
+#ifdef XTEN_CRC_X86
+        static bool hw = __builtin_cpu_supports("sse4.2");
+        return hw;
+#else
+        return false;
+#endif
+    }
+    uint32_t Crc32c(const void *data, size_t len, uint32_t crc)
+    {
+        crc = ~crc;
+#ifdef XTEN_CRC_X86
+        if (Crc32cHardware())
+            return ~crc32cHardware((const unsigned char *)data, len, crc);
+#endif
+        return ~crc32cSoftware((const unsigned char *)data, len, crc);
+    }
+} // namespace xten
@@ -0,0 +1,14 @@
+#ifndef __XTEN_CRC32C_H__
+#define __XTEN_CRC32C_H__
+#include <stdint.h>
+#include <stddef.h>
+// crc32c(Castagnoli)校验
+// x86上运行时检测SSE4.2,使用crc32指令; 否则退化为查表实现
+namespace xten
+{
+    // 计算data的crc32c, crc为上一段数据的结果(可以分段计算)
+    uint32_t Crc32c(const void *data, size_t len, uint32_t crc = 0);
+    // 是否使用了硬件crc32指令
+    bool Crc32cHardware();
+} // namespace xten
+#endif
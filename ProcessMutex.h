@@ -0,0 +1,20 @@
+#ifndef __XTEN_PROCESS_MUTEX_H__
+#define __XTEN_PROCESS_MUTEX_H__
+#include "nocopyable.hpp"
+// 进程间互斥锁接口---队列只需要写锁(互斥)语义
+// 实现: SemRWMutex(System V信号量,按key查找) / ShmMutex(放在共享内存中的robust mutex)
+namespace xten
+{
+    class ProcessMutex : public nocopyable
+    {
+    public:
+        virtual ~ProcessMutex() {}
+        // 阻塞加锁
+        virtual void WLock() = 0;
+        // 解锁
+        virtual void WUnLock() = 0;
+        // 非阻塞加锁
+        virtual bool TryWLock() = 0;
+    };
+} // namespace xten
+#endif
@@ -7,6 +7,9 @@
 #include <stdexcept>
 #include <string.h>
 #include <stdio.h>
+#include <signal.h>
+#include <unistd.h>
+#include <time.h>
 namespace xten
 {
     union semun
@@ -43,7 +46,7 @@ namespace xten
     {
         semun arg;
         // 创建读写信号量
-        _semId = semget(key, 2, IPC_CREAT | IPC_EXCL | 0666);
+        _semId = semget(key, 3, IPC_CREAT | IPC_EXCL | 0666);
         if (_semId == -1)
         {
             printf("semget called failed, errno=%d,errstr=%s\n", errno, strerror(errno));
@@ -52,7 +55,7 @@ namespace xten
                 // 因为已经存在了一个信号量
                 printf("sem which key=%d has been exists\n", key);
                 // 链接信号量---括号优先级问题
-                if ((_semId = semget(key, 2, IPC_CREAT | 0666)) == -1) // 链接失败
+                if ((_semId = semget(key, 3, IPC_CREAT | 0666)) == -1) // 链接失败
                     throw std::runtime_error("semget error: " + std::string(strerror(errno)));
                 // 链接成功
             }
@@ -61,7 +64,7 @@ namespace xten
         }
         else
         {
-            unsigned short array[2] = {0, 0};
+            unsigned short array[3] = {0, 0, 1}; // 恢复锁初始可用
             arg.array = array;
             // 此处创建信号量集---对信号量进行初始化
             if (semctl(_semId, 0, SETALL, arg) == -1)
@@ -96,17 +99,29 @@ namespace xten
             printf("RLock failed: errstr=%s\n", strerror(errno));
     }
     // 写加锁
+    // 写锁的操作不带SEM_UNDO(每次semop都要维护内核的undo链表),持锁进程崩溃后由等待者检测并恢复
     void SemRWMutex::WLock()
     {
         // 等待读信号量为0 并且写信号量为0  写信号量+1
-        struct sembuf sops[3] = {{1, 0, SEM_UNDO}, {0, 0, SEM_UNDO}, {1, 1, SEM_UNDO}};
+        struct sembuf sops[3] = {{1, 0, 0}, {0, 0, 0}, {1, 1, 0}};
+        struct timespec timeout = {0, SEM_OWNER_CHECK_INTERVAL_MS * 1000000L};
         int ret = -1;
-        do
+        while (true)
         {
-            ret = semop(_semId, sops, 3);
-        } while (ret == -1 && errno == EINTR);
-        if (ret == -1 && errno != EINTR)
+            ret = semtimedop(_semId, sops, 3, &timeout);
+            if (ret == 0)
+                return;
+            if (errno == EINTR)
+                continue;
+            if (errno == EAGAIN)
+            {
+                // 等待超时---检查持锁进程是否已经退出
+                recoverDeadWriter();
+                continue;
+            }
             printf("WLock failed: errstr=%s\n", strerror(errno));
+            return;
+        }
     }
     // 读解锁
     void SemRWMutex::RUnLock()
@@ -125,7 +140,7 @@ namespace xten
     void SemRWMutex::WUnLock()
     {
         // 写信号量--
-        struct sembuf sops[1] = {{1, -1, SEM_UNDO}};
+        struct sembuf sops[1] = {{1, -1, 0}};
         int ret = -1;
         do
         {
@@ -154,13 +169,13 @@ namespace xten
     }
     bool SemRWMutex::TryWLock()
     {
-        struct sembuf sops[3] = {{1, 0, SEM_UNDO | IPC_NOWAIT}, {0, 0, SEM_UNDO | IPC_NOWAIT}, {1, 1, SEM_UNDO | IPC_NOWAIT}};
+        struct sembuf sops[3] = {{1, 0, IPC_NOWAIT}, {0, 0, IPC_NOWAIT}, {1, 1, IPC_NOWAIT}};
         int ret = -1;
         ret = semop(_semId, sops, 3);
         if (ret == -1)
         {
             // 尝试加锁失败
-            if (ret == EAGAIN)
+            if (errno == EAGAIN)
             {
                 return false;
             }
@@ -169,6 +184,42 @@ namespace xten
         }
         return true;
     }
+    // 写锁持有者进程已经退出时恢复写锁
+    // 写锁被持有期间读者和写者的semop都无法完成,所以1号信号量的sempid就是持锁进程
+    bool SemRWMutex::recoverDeadWriter()
+    {
+        int val = semctl(_semId, 1, GETVAL);
+        int owner = semctl(_semId, 1, GETPID);
+        if (val <= 0 || owner <= 0 || owner == getpid() || kill(owner, 0) == 0 || errno != ESRCH)
+            return false;
+        // 恢复过程串行化: 否则两个等待者可能先后"恢复",把新持有者的锁也释放掉
+        // 恢复锁很少使用,带SEM_UNDO防止恢复者自己崩溃
+        struct sembuf lockOp = {2, -1, SEM_UNDO};
+        int ret = -1;
+        do
+        {
+            ret = semop(_semId, &lockOp, 1);
+        } while (ret == -1 && errno == EINTR);
+        if (ret == -1)
+        {
+            printf("recoverDeadWriter failed: errstr=%s\n", strerror(errno));
+            return false;
+        }
+        bool recovered = false;
+        // 持有恢复锁后再次确认---其他等待者可能已经完成了恢复
+        val = semctl(_semId, 1, GETVAL);
+        owner = semctl(_semId, 1, GETPID);
+        if (val > 0 && owner > 0 && kill(owner, 0) == -1 && errno == ESRCH)
+        {
+            struct sembuf releaseOp = {1, -1, IPC_NOWAIT};
+            recovered = semop(_semId, &releaseOp, 1) == 0;
+            if (recovered)
+                printf("SemRWMutex key=%d recover write lock from dead pid=%d\n", _key, owner);
+        }
+        struct sembuf unlockOp = {2, 1, SEM_UNDO};
+        semop(_semId, &unlockOp, 1);
+        return recovered;
+    }
     // 获取key值
     int SemRWMutex::GetKey() const
     {
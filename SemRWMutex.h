@@ -2,12 +2,17 @@
 #define __XTEN_SEM_RWMTX_H__
 #include <sys/sem.h>
 #include <memory>
-#include "nocopyable.hpp"
+#include <string>
+#include "ProcessMutex.h"
 // 基于System V信号量实现的进程读写锁
+// 信号量集: 0号=读者计数 1号=写锁 2号=持锁进程崩溃后的恢复锁
+// 读锁仍带SEM_UNDO(读者计数无法对应到持有进程); 写锁不带,由等待者检测持锁进程退出后恢复
 namespace xten
 {
+// 写锁等待超时后检查持锁进程是否存活的间隔
+#define SEM_OWNER_CHECK_INTERVAL_MS 100
     // 读写锁
-    class SemRWMutex : public nocopyable
+    class SemRWMutex : public ProcessMutex
     {
     public:
         typedef std::shared_ptr<SemRWMutex> ptr;
@@ -18,14 +23,14 @@ namespace xten
         // 读加锁
         void RLock();
         // 写加锁
-        void WLock();
+        void WLock() override;
         // 读解锁
         void RUnLock();
         // 写解锁
-        void WUnLock();
+        void WUnLock() override;
         // 非阻塞加锁接口
         bool TryRLock();
-        bool TryWLock();
+        bool TryWLock() override;
         // 获取key值
         int GetKey() const;
         // 获取semid
@@ -33,6 +38,8 @@ namespace xten
 
     private:
         void init(key_t key);
+        // 写锁持有者进程已经退出时恢复写锁 on recovered ret=true
+        bool recoverDeadWriter();
 
     private:
         int _key;   // 生成id的唯一key
@@ -94,7 +101,7 @@ namespace xten
             : _mtx(nullptr), _isLocked(false)
         {
         }
-        WLockGuard(SemRWMutex *mtx)
+        WLockGuard(ProcessMutex *mtx)
             : _mtx(mtx), _isLocked(false)
         {
             if (_mtx)
@@ -130,8 +137,8 @@ namespace xten
             }
         }
     private:
-        bool _isLocked;   // 是否上锁
-        SemRWMutex *_mtx; // 锁指针
+        bool _isLocked;     // 是否上锁
+        ProcessMutex *_mtx; // 锁指针
     };
 } // namespace xten
 #endif
\ No newline at end of file
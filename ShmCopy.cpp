@@ -0,0 +1,160 @@
+#include "ShmCopy.h"
+#include <string.h>
+#include <stdint.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define XTEN_COPY_X86 1
+#endif
+namespace xten
+{
+    typedef void (*StreamCopyFunc)(unsigned char *dst, const unsigned char *src, size_t len);
+#ifdef XTEN_COPY_X86
+    // 先用memcpy把dst对齐到align字节,返回对齐部分的长度
+    static inline size_t alignHead(unsigned char *dst, const unsigned char *src, size_t len, size_t align)
+    {
+        size_t head = (align - ((uintptr_t)dst & (align - 1))) & (align - 1);
+        if (head > len)
+            head = len;
+        memcpy(dst, src, head);
+        return head;
+    }
+    __attribute__((target("sse2"))) static void streamCopySSE2(unsigned char *dst, const unsigned char *src, size_t len)
+    {
+        size_t head = alignHead(dst, src, len, 16);
+        dst += head, src += head, len -= head;
+        for (; len >= 64; len -= 64, dst += 64, src += 64)
+        {
+            __m128i a = _mm_loadu_si128((const __m128i *)(src));
+            __m128i b = _mm_loadu_si128((const __m128i *)(src + 16));
+            __m128i c = _mm_loadu_si128((const __m128i *)(src + 32));
+            __m128i d = _mm_loadu_si128((const __m128i *)(src + 48));
+            _mm_stream_si128((__m128i *)(dst), a);
+            _mm_stream_si128((__m128i *)(dst + 16), b);
+            _mm_stream_si128((__m128i *)(dst + 32), c);
+            _mm_stream_si128((__m128i *)(dst + 48), d);
+        }
+        for (; len >= 16; len -= 16, dst += 16, src += 16)
+        {
+            _mm_stream_si128((__m128i *)dst, _mm_loadu_si128((const __m128i *)src));
+        }
+        memcpy(dst, src, len);
+    }
+    __attribute__((target("avx2"))) static void streamCopyAVX2(unsigned char *dst, const unsigned char *src, size_t len)
+    {
+        size_t head = alignHead(dst, src, len, 32);
+        dst += head, src += head, len -= head;
+        for (; len >= 128; len -= 128, dst += 128, src += 128)
+        {
+            __m256i a = _mm256_loadu_si256((const __m256i *)(src));
+            __m256i b = _mm256_loadu_si256((const __m256i *)(src + 32));
+            __m256i c = _mm256_loadu_si256((const __m256i *)(src + 64));
+            __m256i d = _mm256_loadu_si256((const __m256i *)(src + 96));
+            _mm256_stream_si256((__m256i *)(dst), a);
+            _mm256_stream_si256((__m256i *)(dst + 32), b);
+            _mm256_stream_si256((__m256i *)(dst + 64), c);
+            _mm256_stream_si256((__m256i *)(dst + 96), d);
+        }
+        for (; len >= 32; len -= 32, dst += 32, src += 32)
+        {
+            _mm256_stream_si256((__m256i *)dst, _mm256_loadu_si256((const __m256i *)src));
+        }
+        memcpy(dst, src, len);
+    }
+    __attribute__((target("avx512f"))) static void streamCopyAVX512(unsigned char *dst, const unsigned char *src, size_t len)
+    {
+        size_t head = alignHead(dst, src, len, 64);
+        dst += head, src += head, len -= head;
+        for (; len >= 256; len -= 256, dst += 256, src += 256)
+        {
+            __m512i a = _mm512_loadu_si512((const void *)(src));
+            __m512i b = _mm512_loadu_si512((const void *)(src + 64));
+            __m512i c = _mm512_loadu_si512((const void *)(src + 128));
+            __m512i d = _mm512_loadu_si512((const void *)(src + 192));
+            _mm512_stream_si512((__m512i *)(dst), a);
+            _mm512_stream_si512((__m512i *)(dst + 64), b);
+            _mm512_stream_si512((__m512i *)(dst + 128), c);
+            _mm512_stream_si512((__m512i *)(dst + 192), d);
+        }
+        for (; len >= 64; len -= 64, dst += 64, src += 64)
+        {
+            _mm512_stream_si512((__m512i *)dst, _mm512_loadu_si512((const void *)src));
+        }
+        memcpy(dst, src, len);
+    }
+#endif
+    static void plainCopy(unsigned char *dst, const unsigned char *src, size_t len)
+    {
+        memcpy(dst, src, len);
+    }
+    // 运行时检测cpu特性
+    static EnumCopyKernel detectKernel()
+    {
+#ifdef XTEN_COPY_X86
+        __builtin_cpu_init();
+        if (__builtin_cpu_supports("avx512f"))
+            return EnumCopyKernel::AVX512;
+        if (__builtin_cpu_supports("avx2"))
+            return EnumCopyKernel::AVX2;
+        if (__builtin_cpu_supports("sse2"))
+            return EnumCopyKernel::SSE2;
+#endif
+        return EnumCopyKernel::Memcpy;
+    }
+    static StreamCopyFunc kernel2Func(EnumCopyKernel kernel)
+    {
+        switch (kernel)
+        {
+#ifdef XTEN_COPY_X86
+        case EnumCopyKernel::SSE2:
+            return streamCopySSE2;
+        case EnumCopyKernel::AVX2:
+            return streamCopyAVX2;
+        case EnumCopyKernel::AVX512:
+            return streamCopyAVX512;
+#endif
+        default:
+            break;
+        }
+        return plainCopy;
+    }
+    EnumCopyKernel GetStreamCopyKernel()
+    {
+        // c++11后静态局部变量的初始化是线程安全的
+        static EnumCopyKernel kernel = detectKernel();
+        return kernel;
+    }
+    const char *CopyKernel2String(EnumCopyKernel kernel)
+    {
+        switch (kernel)
+        {
+#define XX(name)                 \
+    case EnumCopyKernel::name: \
+        return #name;            \
+        break;
+            XX(Memcpy)
+            XX(SSE2)
+            XX(AVX2)
+            XX(AVX512)
+#undef XX
+        default:
+            break;
+        }
+        return "UnKnownKernel";
+    }
+    void ShmCopyToQueue(void *dst, const void *src, size_t len, bool streaming)
+    {
+        if (!streaming)
+        {
+            memcpy(dst, src, len);
+            return;
+        }
+        static StreamCopyFunc func = kernel2Func(GetStreamCopyKernel());
+        func((unsigned char *)dst, (const unsigned char *)src, len);
+    }
+    void ShmStreamFence()
+    {
+#ifdef XTEN_COPY_X86
+        _mm_sfence();
+#endif
+    }
+} // namespace xten
@@ -0,0 +1,40 @@
+#ifndef __XTEN_SHM_COPY_H__
+#define __XTEN_SHM_COPY_H__
+#include <stddef.h>
+// 按消息大小分级的拷贝内核
+// 小消息直接memcpy; 大消息写入队列时使用非临时存储(streaming store)绕过cache,
+// 避免一次性写入的大帧把生产者进程的工作集挤出cache
+namespace xten
+{
+    // 运行时根据cpu特性选择的流式拷贝内核
+    enum class EnumCopyKernel : unsigned char
+    {
+        Memcpy = 0, // 不支持流式存储---退化为memcpy
+        SSE2 = 1,   // 16字节 movntdq
+        AVX2 = 2,   // 32字节 vmovntdq
+        AVX512 = 3, // 64字节 vmovntdq
+    };
+    // 默认使用非临时存储的消息长度阈值
+#define DEFAULT_NT_COPY_THRESHOLD (64 * 1024)
+    // 消费端默认预取下一条记录的缓存行数
+#define DEFAULT_PREFETCH_LINES 2
+
+    // 获取当前cpu上选中的流式拷贝内核(首次调用时检测)
+    EnumCopyKernel GetStreamCopyKernel();
+    // 内核名称
+    const char *CopyKernel2String(EnumCopyKernel kernel);
+    // 向队列写入数据 streaming=true时使用非临时存储
+    // 非临时存储是弱序的,发布索引之前必须调用ShmStreamFence()
+    void ShmCopyToQueue(void *dst, const void *src, size_t len, bool streaming);
+    // 非临时存储的写屏障(普通memcpy之后不需要)
+    void ShmStreamFence();
+    // 预取从addr开始的lines个缓存行(只读)
+    inline void ShmPrefetch(const void *addr, int lines)
+    {
+        for (int i = 0; i < lines; i++)
+        {
+            __builtin_prefetch((const char *)addr + i * 64, 0, 3);
+        }
+    }
+} // namespace xten
+#endif
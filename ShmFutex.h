@@ -0,0 +1,46 @@
+#ifndef __XTEN_SHM_FUTEX_H__
+#define __XTEN_SHM_FUTEX_H__
+#include <atomic>
+#include <climits>
+#include <errno.h>
+#include <stdint.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+// 共享内存中的futex---等待/唤醒段中的32位原子字
+// 不使用FUTEX_PRIVATE_FLAG: 内核按物理页定位等待队列,不同进程映射到不同地址也能互相唤醒
+namespace xten
+{
+    static_assert(sizeof(std::atomic<uint32_t>) == sizeof(uint32_t), "futex word should be 32 bits");
+    // 自旋等待时让出流水线---超线程的另一个线程可以使用执行单元
+    inline void ShmCpuRelax()
+    {
+#if defined(__x86_64__) || defined(__i386__)
+        __builtin_ia32_pause();
+#elif defined(__aarch64__)
+        asm volatile("yield" ::: "memory");
+#endif
+    }
+    // *word==expected时睡眠,直到被唤醒或者超时 timeoutMs<0一直等待
+    // ret=true被唤醒(或者值已经变化/被信号打断,调用者需要重新检查条件) ; ret=false超时
+    inline bool ShmFutexWait(std::atomic<uint32_t> *word, uint32_t expected, int timeoutMs)
+    {
+        struct timespec ts;
+        struct timespec *pts = nullptr;
+        if (timeoutMs >= 0)
+        {
+            ts.tv_sec = timeoutMs / 1000;
+            ts.tv_nsec = (long)(timeoutMs % 1000) * 1000000;
+            pts = &ts;
+        }
+        long ret = syscall(SYS_futex, (uint32_t *)word, FUTEX_WAIT, expected, pts, nullptr, 0);
+        return !(ret == -1 && errno == ETIMEDOUT);
+    }
+    // 唤醒在word上等待的最多count个等待者
+    inline void ShmFutexWake(std::atomic<uint32_t> *word, int count = INT_MAX)
+    {
+        syscall(SYS_futex, (uint32_t *)word, FUTEX_WAKE, count, nullptr, nullptr, 0);
+    }
+} // namespace xten
+#endif
@@ -0,0 +1,233 @@
+#include "ShmLatestTable.h"
+#include <iostream>
+#include <sstream>
+#include <string.h>
+#include <unistd.h>
+#include <sys/ipc.h>
+#include <sys/shm.h>
+#include <thread>
+namespace xten
+{
+// 链接者等待创建者完成初始化的最长时间
+#define SHM_LATEST_TABLE_INIT_WAIT_MS 1000
+// 读者连续重试多少次后让出cpu(生产者可能被调度走,停在写入中)
+#define SHM_LATEST_TABLE_SPIN_COUNT 64
+    // 脏位图占用的字节数---按缓存行对齐
+    static size_t dirtyBitmapSize(uint32_t slotCount)
+    {
+        size_t bytes = ((size_t)slotCount + 63) / 64 * sizeof(uint64_t);
+        return (bytes + CPU_CACHELINE_SIZE - 1) & ~(size_t)(CPU_CACHELINE_SIZE - 1);
+    }
+    ShmLatestTable::ShmLatestTable(void *shmPtr, EnumCreateModel newOrLink)
+        : _header((LatestTableHeader *)shmPtr),
+          _dirty((std::atomic<uint64_t> *)((BYTE *)shmPtr + sizeof(LatestTableHeader))),
+          _slots(nullptr),
+          _newOrLink(newOrLink)
+    {
+    }
+    ShmLatestTable::~ShmLatestTable()
+    {
+        if (_header)
+        {
+            key_t key = _header->key;
+            ShmQueue::destroySharedMemory((void *)_header, key);
+        }
+    }
+    // 获取一个最新值表实例
+    ShmLatestTable *ShmLatestTable::GetShmLatestTable(const std::string &pathname, int proj_id,
+                                                      uint32_t slotCount, size_t valueSize, bool dirtyBitmap)
+    {
+        if (slotCount == 0 || valueSize == 0)
+        {
+            std::cout << "GetShmLatestTable failed, slotCount and valueSize must > 0" << std::endl;
+            return nullptr;
+        }
+        // 1.生成key
+        key_t key = ftok(pathname.c_str(), proj_id);
+        if (key == -1)
+        {
+            std::cout << "GetShmLatestTable ftok failed,errstr=" << strerror(errno) << std::endl;
+            return nullptr;
+        }
+        // 2.获取共享内存---每个槽位按缓存行对齐,不同槽位的写入不会互相false sharing
+        size_t slotStride = (sizeof(LatestSlot) + valueSize + CPU_CACHELINE_SIZE - 1) & ~(size_t)(CPU_CACHELINE_SIZE - 1);
+        size_t bitmapSize = dirtyBitmap ? dirtyBitmapSize(slotCount) : 0;
+        size_t segSize = sizeof(LatestTableHeader) + bitmapSize + slotStride * slotCount;
+        EnumCreateModel createM;
+        int shmid = -1;
+        void *shmPtr = ShmQueue::getSharedMemory(key, shmid, createM, segSize);
+        if (shmPtr == nullptr)
+        {
+            std::cout << "GetShmLatestTable getSharedMemory failed" << std::endl;
+            return nullptr;
+        }
+        ShmLatestTable *table = new ShmLatestTable(shmPtr, createM);
+        LatestTableHeader *header = table->_header;
+        if (createM == EnumCreateModel::NewShmQue)
+        {
+            // 3.创建者初始化---新段已经被内核清零,所有槽位seq=0(从未写入),脏位图为空
+            new (header) LatestTableHeader();
+            header->slotCount = slotCount;
+            header->valueSize = valueSize;
+            header->slotStride = slotStride;
+            header->key = key;
+            header->shmId = shmid;
+            header->dirtyBitmap = dirtyBitmap;
+            header->magic.store(SHM_LATEST_TABLE_MAGIC, std::memory_order_release);
+        }
+        else
+        {
+            // 3.链接者等待创建者初始化完成
+            int waitMs = 0;
+            while (header->magic.load(std::memory_order_acquire) != SHM_LATEST_TABLE_MAGIC)
+            {
+                if (waitMs++ >= SHM_LATEST_TABLE_INIT_WAIT_MS)
+                {
+                    std::cout << "GetShmLatestTable failed, segment is not a ShmLatestTable" << std::endl;
+                    shmdt(shmPtr);
+                    table->_header = nullptr;
+                    delete table;
+                    return nullptr;
+                }
+                usleep(1000);
+            }
+        }
+        table->_slots = (BYTE *)table->_dirty + (header->dirtyBitmap ? dirtyBitmapSize(header->slotCount) : 0);
+        return table;
+    }
+    ShmLatestTable::ptr ShmLatestTable::GetShmLatestTablePtr(const std::string &pathname, int proj_id,
+                                                             uint32_t slotCount, size_t valueSize, bool dirtyBitmap)
+    {
+        return std::shared_ptr<ShmLatestTable>(ShmLatestTable::GetShmLatestTable(pathname, proj_id, slotCount, valueSize, dirtyBitmap));
+    }
+    // 生产者覆盖一个槽位
+    int ShmLatestTable::Update(uint32_t slot, const void *value, size_t length)
+    {
+        if (slot >= _header->slotCount || !value || length == 0 || length > _header->valueSize)
+        {
+            std::cout << "ShmLatestTable Update failed, invalid parameter, slot=" << slot << ", length=" << length << std::endl;
+            return (int)(ShmQueErrorCode::QueueParameterInvaild);
+        }
+        LatestSlot *s = slotAt(slot);
+        // 单生产者---seq只有自己修改
+        uint64_t seq = s->seq.load(std::memory_order_relaxed);
+        // 1.seq变为奇数: 读者看到奇数或者读完后seq变化都会重试
+        //   release fence保证seq的修改在写入值之前对读者可见
+        s->seq.store(seq + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        // 2.写入值
+        s->length = length;
+        memcpy((BYTE *)s + sizeof(LatestSlot), value, length);
+        // 3.seq变为偶数---release发布完整的值
+        s->seq.store(seq + 2, std::memory_order_release);
+        // 4.标记脏位---在值发布之后,取走脏位的读者一定能读到这次更新
+        if (_header->dirtyBitmap)
+        {
+            _dirty[slot / 64].fetch_or(1ull << (slot % 64), std::memory_order_release);
+        }
+        return (int)(ShmQueErrorCode::QueueOk);
+    }
+    // 读取一个槽位的一致快照
+    int ShmLatestTable::Read(uint32_t slot, void *buffer, size_t bufLength, uint64_t *version) const
+    {
+        if (slot >= _header->slotCount || !buffer)
+        {
+            std::cout << "ShmLatestTable Read failed, invalid parameter, slot=" << slot << std::endl;
+            return (int)(ShmQueErrorCode::QueueParameterInvaild);
+        }
+        const LatestSlot *s = slotAt(slot);
+        for (int retry = 1;; retry++)
+        {
+            uint64_t seq1 = s->seq.load(std::memory_order_acquire);
+            if (seq1 == 0)
+            {
+                // 从未写入
+                if (version)
+                    *version = 0;
+                return 0;
+            }
+            if ((seq1 & 1) == 0)
+            {
+                // 长度可能是写入中的值---拷贝前先检查范围,不一致时下面的seq检查会重试
+                size_t length = s->length;
+                if (length <= _header->valueSize)
+                {
+                    if (length <= bufLength)
+                        memcpy(buffer, (const BYTE *)s + sizeof(LatestSlot), length);
+                    // acquire fence保证拷贝在重新读seq之前完成
+                    std::atomic_thread_fence(std::memory_order_acquire);
+                    if (s->seq.load(std::memory_order_relaxed) == seq1)
+                    {
+                        if (length > bufLength)
+                        {
+                            std::cout << "ShmLatestTable Read failed, buffer length insufficient, need=" << length << std::endl;
+                            return (int)(ShmQueErrorCode::QueueBufferLengthInsufficient);
+                        }
+                        if (version)
+                            *version = seq1 / 2;
+                        return (int)length;
+                    }
+                }
+            }
+            // 生产者正在写入---自旋一段时间后让出cpu
+            if (retry % SHM_LATEST_TABLE_SPIN_COUNT == 0)
+                std::this_thread::yield();
+        }
+    }
+    // 获取槽位的版本号
+    uint64_t ShmLatestTable::GetVersion(uint32_t slot) const
+    {
+        if (slot >= _header->slotCount)
+            return 0;
+        return slotAt(slot)->seq.load(std::memory_order_acquire) / 2;
+    }
+    // 取走脏位图并读取变化的槽位
+    int ShmLatestTable::ReadChanged(const ReadCallback &cb)
+    {
+        if (!_header->dirtyBitmap || !cb)
+        {
+            return (int)(ShmQueErrorCode::QueueNotSupported);
+        }
+        std::string value(_header->valueSize, '\0');
+        int count = 0;
+        size_t words = ((size_t)_header->slotCount + 63) / 64;
+        for (size_t w = 0; w < words; w++)
+        {
+            // 没有变化的字只读不写,不会使生产者的缓存行失效
+            if (_dirty[w].load(std::memory_order_relaxed) == 0)
+                continue;
+            // exchange取走这一个字的所有脏位---之后的更新会重新置位,不会丢失
+            uint64_t bits = _dirty[w].exchange(0, std::memory_order_acquire);
+            while (bits)
+            {
+                uint32_t slot = (uint32_t)(w * 64 + __builtin_ctzll(bits));
+                bits &= bits - 1;
+                int ret = Read(slot, &value[0], value.size());
+                if (ret > 0)
+                {
+                    cb(slot, value.data(), (size_t)ret);
+                    count++;
+                }
+            }
+        }
+        return count;
+    }
+    std::string ShmLatestTable::PrintLatestTableInfo() const
+    {
+        std::stringstream ss;
+        ss << "=== 共享内存最新值表信息 ===" << std::endl;
+        ss << "Key: " << _header->key << ", shmid=" << _header->shmId << std::endl;
+        ss << "创建模式: " << ((_newOrLink == EnumCreateModel::NewShmQue) ? "NewShmQue" : "LinkShmQue") << std::endl;
+        ss << "槽位个数: " << _header->slotCount << ", 值最大长度: " << _header->valueSize
+           << " bytes, 槽位间隔: " << _header->slotStride << " bytes" << std::endl;
+        ss << "脏位图: " << (_header->dirtyBitmap ? "on" : "off") << std::endl;
+        uint32_t written = 0;
+        for (uint32_t i = 0; i < _header->slotCount; i++)
+        {
+            if (slotAt(i)->seq.load(std::memory_order_relaxed) != 0)
+                written++;
+        }
+        ss << "已写入槽位: " << written << std::endl;
+        return ss.str();
+    }
+} // namespace xten
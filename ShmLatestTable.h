@@ -0,0 +1,88 @@
+#ifndef __XTEN_SHM_LATEST_TABLE_H__
+#define __XTEN_SHM_LATEST_TABLE_H__
+#include <memory>
+#include <string>
+#include <atomic>
+#include <functional>
+#include <stdint.h>
+#include "ShmQueue.h"
+// 共享内存最新值表(conflating channel)---每个key只保留最新的值
+// 固定K个槽位,每个槽位由一个seqlock保护:
+// 单生产者直接覆盖槽位,不阻塞; 任意多个读者无锁读取一致的快照(读到写入中的数据时重试)
+// 可选的脏位图: 读者只取上次之后有更新的槽位
+namespace xten
+{
+// 最新值表初始化完成标记
+#define SHM_LATEST_TABLE_MAGIC 0x4C544D53u
+    class ALIGNED_CACHELINE_SIZE ShmLatestTable : public nocopyable
+    {
+    private:
+        // 表头部---在段的起始位置
+        struct LatestTableHeader
+        {
+            std::atomic<uint32_t> magic{0}; // 初始化完成后由创建者最后写入
+            uint32_t slotCount = 0;         // 槽位个数
+            size_t valueSize = 0;           // 每个槽位的最大值长度/Byte
+            size_t slotStride = 0;          // 槽位间隔(按缓存行对齐)
+            key_t key = -1;                 // key值
+            int shmId = -1;                 // key对应的shmid
+            bool dirtyBitmap = false;       // 是否维护脏位图
+        } ALIGNED_CACHELINE_SIZE;
+        // 槽位头部---后面紧跟valueSize字节的值
+        struct LatestSlot
+        {
+            std::atomic<uint64_t> seq{0}; // 奇数表示正在写入 0表示从未写入 写入次数=seq/2
+            uint64_t length = 0;          // 当前值的长度
+        };
+
+    public:
+        typedef std::shared_ptr<ShmLatestTable> ptr;
+        // 读取变化槽位的回调 slot:槽位 value/length:值的快照(只在回调期间有效)
+        typedef std::function<void(uint32_t slot, const void *value, size_t length)> ReadCallback;
+
+        // 获取一个最新值表实例(非单例)---不存在时创建,已经存在时链接(此时以段中的参数为准)
+        // slotCount: 槽位个数 valueSize: 每个值的最大长度 dirtyBitmap: 是否维护脏位图
+        static ShmLatestTable *GetShmLatestTable(const std::string &pathname, int proj_id,
+                                                 uint32_t slotCount, size_t valueSize, bool dirtyBitmap = false);
+        static std::shared_ptr<ShmLatestTable> GetShmLatestTablePtr(const std::string &pathname, int proj_id,
+                                                                    uint32_t slotCount, size_t valueSize, bool dirtyBitmap = false);
+        // 析构---和ShmQueue一样detach并标记删除
+        ~ShmLatestTable();
+
+        // 一些获取属性接口
+        uint32_t GetSlotCount() const { return _header->slotCount; }
+        size_t GetValueSize() const { return _header->valueSize; }
+        int GetShmId() const { return _header->shmId; }
+        EnumCreateModel GetCreateModel() const { return _newOrLink; }
+        bool GetDirtyBitmap() const { return _header->dirtyBitmap; }
+
+        // 生产者覆盖一个槽位的值 on success ret=0 ; on failed ret<0
+        // 只允许一个生产者(进程/线程)写入,多个生产者需要自己串行化
+        int Update(uint32_t slot, const void *value, size_t length);
+        // 读取一个槽位的一致快照 on success ret=sizeof(value) 从未写入过ret=0 ; on failed ret<0
+        // version非空时返回快照的版本号(写入次数),读者可以据此判断值是否变化
+        int Read(uint32_t slot, void *buffer, size_t bufLength, uint64_t *version = nullptr) const;
+        // 不拷贝值,只获取槽位当前的版本号
+        uint64_t GetVersion(uint32_t slot) const;
+        // 取走脏位图中的所有槽位并逐个读取快照 ret=读取的槽位个数 ; on failed ret<0
+        // 脏位图在所有读者之间共享(取走即清除),适合一个负责增量同步的读者
+        int ReadChanged(const ReadCallback &cb);
+        // 打印最新值表的属性信息
+        std::string PrintLatestTableInfo() const;
+
+    private:
+        ShmLatestTable(void *shmPtr, EnumCreateModel newOrLink);
+        // 槽位地址
+        LatestSlot *slotAt(uint32_t slot) const
+        {
+            return (LatestSlot *)(_slots + (size_t)slot * _header->slotStride);
+        }
+
+    private:
+        LatestTableHeader *_header;     // 表头部
+        std::atomic<uint64_t> *_dirty;  // 脏位图 每个bit对应一个槽位
+        BYTE *_slots;                   // 第一个槽位的地址
+        EnumCreateModel _newOrLink;     // 创建或者链接
+    };
+} // namespace xten
+#endif
@@ -0,0 +1,222 @@
+#include "ShmLz.h"
+#include <string.h>
+namespace xten
+{
+    typedef unsigned char BYTE;
+    // 哈希表大小 2^12个位置
+    static const int LZ_HASH_BITS = 12;
+    static const size_t LZ_MIN_MATCH = 4;
+    // 最后LZ_LAST_LITERALS字节总是字面量,距离结尾LZ_MF_LIMIT字节以内不再开始新的匹配
+    static const size_t LZ_LAST_LITERALS = 5;
+    static const size_t LZ_MF_LIMIT = SHM_LZ_MF_LIMIT;
+    static const size_t LZ_MAX_OFFSET = 65535;
+
+    static inline uint32_t read32(const BYTE *p)
+    {
+        uint32_t v;
+        memcpy(&v, p, sizeof(v));
+        return v;
+    }
+    static inline uint64_t read64(const BYTE *p)
+    {
+        uint64_t v;
+        memcpy(&v, p, sizeof(v));
+        return v;
+    }
+    static inline uint32_t hash4(uint32_t v)
+    {
+        return (v * 2654435761u) >> (32 - LZ_HASH_BITS);
+    }
+    // 写入扩展长度 ret=写入后的位置 ; 放不下时ret=nullptr
+    static inline BYTE *writeLength(BYTE *op, BYTE *oend, size_t len)
+    {
+        while (len >= 255)
+        {
+            if (op >= oend)
+                return nullptr;
+            *op++ = 255;
+            len -= 255;
+        }
+        if (op >= oend)
+            return nullptr;
+        *op++ = (BYTE)len;
+        return op;
+    }
+    // 写入一个序列 matchLen=0表示最后一个只有字面量的序列
+    static inline BYTE *writeSequence(BYTE *op, BYTE *oend, const BYTE *literal, size_t litLen, size_t offset, size_t matchLen)
+    {
+        if (op >= oend)
+            return nullptr;
+        BYTE *token = op++;
+        *token = (BYTE)((litLen >= 15 ? 15 : litLen) << 4);
+        if (litLen >= 15 && !(op = writeLength(op, oend, litLen - 15)))
+            return nullptr;
+        if ((size_t)(oend - op) < litLen)
+            return nullptr;
+        if (litLen > 0)
+            memcpy(op, literal, litLen);
+        op += litLen;
+        if (matchLen == 0)
+            return op;
+        if (oend - op < 2)
+            return nullptr;
+        *op++ = (BYTE)(offset & 0xFF);
+        *op++ = (BYTE)(offset >> 8);
+        size_t code = matchLen - LZ_MIN_MATCH;
+        *token |= (BYTE)(code >= 15 ? 15 : code);
+        if (code >= 15 && !(op = writeLength(op, oend, code - 15)))
+            return nullptr;
+        return op;
+    }
+    size_t ShmLzCompress(const void *src, size_t srcLen, void *dst, size_t dstCap)
+    {
+        const BYTE *base = (const BYTE *)src;
+        const BYTE *ip = base;
+        const BYTE *anchor = base;
+        const BYTE *iend = base + srcLen;
+        BYTE *op = (BYTE *)dst;
+        BYTE *oend = op + dstCap;
+        if (srcLen > LZ_MF_LIMIT + 1)
+        {
+            const BYTE *mflimit = iend - LZ_MF_LIMIT;
+            const BYTE *matchlimit = iend - LZ_LAST_LITERALS;
+            uint32_t table[1 << LZ_HASH_BITS];
+            memset(table, 0, sizeof(table));
+            ip++;
+            while (ip < mflimit)
+            {
+                // 1.用哈希表找到上一次出现相同4字节的位置
+                uint32_t seq = read32(ip);
+                uint32_t h = hash4(seq);
+                const BYTE *ref = base + table[h];
+                table[h] = (uint32_t)(ip - base);
+                if (ref >= ip || (size_t)(ip - ref) > LZ_MAX_OFFSET || read32(ref) != seq)
+                {
+                    // 连续没有匹配时步长逐渐加大---不可压缩的数据很快扫描完
+                    ip += 1 + ((ip - anchor) >> 6);
+                    continue;
+                }
+                // 2.向前后扩展匹配
+                while (ip > anchor && ref > base && ip[-1] == ref[-1])
+                {
+                    ip--;
+                    ref--;
+                }
+                // 每次比较8字节,第一个不同的字节由异或结果的末尾0个数得到(小端)
+                const BYTE *mp = ip + LZ_MIN_MATCH;
+                const BYTE *rp = ref + LZ_MIN_MATCH;
+                while (mp + 8 <= matchlimit)
+                {
+                    uint64_t diff = read64(mp) ^ read64(rp);
+                    if (diff)
+                    {
+                        mp += __builtin_ctzll(diff) >> 3;
+                        goto matched;
+                    }
+                    mp += 8;
+                    rp += 8;
+                }
+                while (mp < matchlimit && *mp == *rp)
+                {
+                    mp++;
+                    rp++;
+                }
+            matched:
+                op = writeSequence(op, oend, anchor, ip - anchor, ip - ref, mp - ip);
+                if (!op)
+                    return 0;
+                ip = mp;
+                anchor = ip;
+                if (ip < mflimit)
+                    table[hash4(read32(ip - 2))] = (uint32_t)(ip - 2 - base);
+            }
+        }
+        // 3.剩余数据作为最后一个序列的字面量
+        op = writeSequence(op, oend, anchor, iend - anchor, 0, 0);
+        if (!op)
+            return 0;
+        return op - (BYTE *)dst;
+    }
+    int64_t ShmLzDecompress(const void *src, size_t srcLen, void *dst, size_t dstCap)
+    {
+        const BYTE *ip = (const BYTE *)src;
+        const BYTE *iend = ip + srcLen;
+        BYTE *op = (BYTE *)dst;
+        BYTE *oend = op + dstCap;
+        while (ip < iend)
+        {
+            // 1.字面量
+            BYTE token = *ip++;
+            size_t litLen = token >> 4;
+            if (litLen == 15)
+            {
+                BYTE b;
+                do
+                {
+                    if (ip >= iend)
+                        return -1;
+                    b = *ip++;
+                    litLen += b;
+                } while (b == 255);
+            }
+            if (litLen > (size_t)(iend - ip) || litLen > (size_t)(oend - op))
+                return -1;
+            // 短字面量在输入输出都有余量时固定复制16字节(多复制的部分之后会被覆盖)
+            if (litLen <= 16 && iend - ip >= 16 && oend - op >= 16)
+                memcpy(op, ip, 16);
+            else
+                memcpy(op, ip, litLen);
+            ip += litLen;
+            op += litLen;
+            if (ip == iend)
+                break; // 最后一个序列
+            // 2.匹配
+            if (iend - ip < 2)
+                return -1;
+            size_t offset = ip[0] | ((size_t)ip[1] << 8);
+            ip += 2;
+            if (offset == 0 || offset > (size_t)(op - (BYTE *)dst))
+                return -1;
+            size_t matchLen = token & 15;
+            if (matchLen == 15)
+            {
+                BYTE b;
+                do
+                {
+                    if (ip >= iend)
+                        return -1;
+                    b = *ip++;
+                    matchLen += b;
+                } while (b == 255);
+            }
+            matchLen += LZ_MIN_MATCH;
+            if (matchLen > (size_t)(oend - op))
+                return -1;
+            const BYTE *ref = op - offset;
+            if (offset >= 8 && (size_t)(oend - op) >= matchLen + 8)
+            {
+                // 源和目的至少相距8字节,每次复制8字节(最多多写7字节,已经确认输出空间足够)
+                BYTE *end = op + matchLen;
+                while (op < end)
+                {
+                    memcpy(op, ref, 8);
+                    op += 8;
+                    ref += 8;
+                }
+                op = end;
+            }
+            else if (offset >= matchLen)
+            {
+                memcpy(op, ref, matchLen);
+                op += matchLen;
+            }
+            else
+            {
+                // 重复的短模式---逐字节复制
+                for (size_t i = 0; i < matchLen; i++)
+                    *op++ = ref[i];
+            }
+        }
+        return op - (BYTE *)dst;
+    }
+} // namespace xten
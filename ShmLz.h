@@ -0,0 +1,19 @@
+#ifndef __XTEN_SHM_LZ_H__
+#define __XTEN_SHM_LZ_H__
+#include <stddef.h>
+#include <stdint.h>
+// 自带的LZ77块压缩---不依赖外部库,格式和LZ4 block相同的思路
+// 序列: [token: 字面量长度4位|匹配长度-4 4位][扩展字面量长度][字面量][2字节偏移][扩展匹配长度]
+// 长度为15时后面跟扩展字节(每个字节累加,255表示继续); 最后一个序列只有字面量
+// 压缩: 4字节哈希表(16KB,放在栈上)单遍扫描,连续没有匹配时加大步长,不可压缩的数据很快放弃
+// 解压: 每一步都检查输入输出边界,损坏(或者被覆盖)的数据只会返回失败,不会越界
+// 距离结尾这么多字节以内不再开始新的匹配---不超过这个长度的输入只能原样作为字面量
+#define SHM_LZ_MF_LIMIT 12
+namespace xten
+{
+    // 压缩src到dst ret=压缩后的长度 ; 输出超过dstCap(数据不可压缩)时ret=0
+    size_t ShmLzCompress(const void *src, size_t srcLen, void *dst, size_t dstCap);
+    // 解压src到dst on success ret=解压后的长度 ; 数据损坏或者dst放不下时ret<0
+    int64_t ShmLzDecompress(const void *src, size_t srcLen, void *dst, size_t dstCap);
+} // namespace xten
+#endif
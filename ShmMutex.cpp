@@ -0,0 +1,64 @@
+#include "ShmMutex.h"
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+namespace xten
+{
+    bool ShmMutex::Init(pthread_mutex_t *mem)
+    {
+        pthread_mutexattr_t attr;
+        pthread_mutexattr_init(&attr);
+        pthread_mutexattr_setpshared(&attr, PTHREAD_PROCESS_SHARED);
+        pthread_mutexattr_setrobust(&attr, PTHREAD_MUTEX_ROBUST);
+        int ret = pthread_mutex_init(mem, &attr);
+        pthread_mutexattr_destroy(&attr);
+        if (ret != 0)
+        {
+            printf("ShmMutex init failed: errstr=%s\n", strerror(ret));
+            return false;
+        }
+        return true;
+    }
+    ShmMutex::ShmMutex(pthread_mutex_t *mem)
+        : _mtx(mem)
+    {
+    }
+    void ShmMutex::WLock()
+    {
+        int ret = pthread_mutex_lock(_mtx);
+        if (ret == EOWNERDEAD)
+        {
+            recoverOwnerDead();
+        }
+        else if (ret != 0)
+        {
+            printf("ShmMutex WLock failed: errstr=%s\n", strerror(ret));
+        }
+    }
+    void ShmMutex::WUnLock()
+    {
+        int ret = pthread_mutex_unlock(_mtx);
+        if (ret != 0)
+            printf("ShmMutex WUnLock failed: errstr=%s\n", strerror(ret));
+    }
+    bool ShmMutex::TryWLock()
+    {
+        int ret = pthread_mutex_trylock(_mtx);
+        if (ret == EOWNERDEAD)
+        {
+            recoverOwnerDead();
+            return true;
+        }
+        return ret == 0;
+    }
+    // 持锁者崩溃---锁已经转给当前线程
+    // ring索引只在数据写完后才发布,崩溃者未发布的写入会被直接覆盖; 锁保护的其他状态由修复回调恢复
+    void ShmMutex::recoverOwnerDead()
+    {
+        printf("ShmMutex recover lock from dead owner, pid=%d\n", getpid());
+        if (_recover)
+            _recover();
+        pthread_mutex_consistent(_mtx);
+    }
+} // namespace xten
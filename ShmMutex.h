@@ -0,0 +1,39 @@
+#ifndef __XTEN_SHM_MUTEX_H__
+#define __XTEN_SHM_MUTEX_H__
+#include <functional>
+#include <pthread.h>
+#include "ProcessMutex.h"
+// 放在共享内存中的进程间互斥锁(PTHREAD_PROCESS_SHARED + PTHREAD_MUTEX_ROBUST)
+// 1.不需要ftok key,锁的状态随共享内存一起释放
+// 2.无竞争时加解锁只是用户态的原子操作,不进入内核
+// 3.持锁进程崩溃后,下一个加锁者收到EOWNERDEAD,先调用修复回调再把锁恢复为可用
+//   只有队列的ring索引天然崩溃安全(数据写完后才发布); 锁内修改的其他共享状态(保留日志的seqlock、
+//   时间轮的槽位链表等)可能停在一半,使用者需要用SetRecoverHandler登记修复函数
+namespace xten
+{
+    class ShmMutex : public ProcessMutex
+    {
+    public:
+        // 修复回调---在持有锁、标记为一致之前调用,把崩溃者改了一半的共享状态恢复一致
+        typedef std::function<void()> RecoverHandler;
+        // 在共享内存mem处初始化一把新锁---只能由创建者调用一次
+        static bool Init(pthread_mutex_t *mem);
+        // 使用已经初始化过的锁
+        ShmMutex(pthread_mutex_t *mem);
+        ~ShmMutex() {}
+        void WLock() override;
+        void WUnLock() override;
+        bool TryWLock() override;
+        // 登记修复回调(每个句柄各自登记,由收到EOWNERDEAD的句柄调用)
+        void SetRecoverHandler(const RecoverHandler &cb) { _recover = cb; }
+
+    private:
+        // 收到EOWNERDEAD: 修复后标记为一致
+        void recoverOwnerDead();
+
+    private:
+        pthread_mutex_t *_mtx;   // 共享内存中的锁
+        RecoverHandler _recover; // 修复回调
+    };
+} // namespace xten
+#endif
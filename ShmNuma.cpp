@@ -0,0 +1,180 @@
+#include "ShmNuma.h"
+#include <errno.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sstream>
+#include <vector>
+#include <sys/syscall.h>
+#include <linux/mempolicy.h>
+namespace xten
+{
+    // 节点位图---和内核的nodemask_t布局相同
+    static const size_t NODE_MASK_WORDS = SHM_NUMA_MAX_NODES / (8 * sizeof(unsigned long));
+
+    // 解析 "0-3,8,10-11" 格式的列表
+    static std::vector<int> parseList(const std::string &text)
+    {
+        std::vector<int> result;
+        const char *p = text.c_str();
+        while (*p)
+        {
+            char *end;
+            long begin = strtol(p, &end, 10);
+            if (end == p)
+                break;
+            long last = begin;
+            p = end;
+            if (*p == '-')
+            {
+                last = strtol(p + 1, &end, 10);
+                p = end;
+            }
+            for (long i = begin; i <= last; i++)
+                result.push_back((int)i);
+            if (*p == ',')
+                p++;
+            else
+                break;
+        }
+        return result;
+    }
+    // 读取sysfs文件的第一行
+    static std::string readLine(const char *path)
+    {
+        char buf[4096] = {0};
+        FILE *fp = fopen(path, "r");
+        if (!fp)
+            return "";
+        if (!fgets(buf, sizeof(buf), fp))
+            buf[0] = 0;
+        fclose(fp);
+        return buf;
+    }
+    static std::vector<int> onlineNodes()
+    {
+        std::vector<int> nodes = parseList(readLine("/sys/devices/system/node/online"));
+        if (nodes.empty())
+            nodes.push_back(0);
+        return nodes;
+    }
+    int ShmNumaNodeCount()
+    {
+        static int count = (int)onlineNodes().size();
+        return count;
+    }
+    int ShmNumaCurrentNode()
+    {
+        unsigned cpu = 0, node = 0;
+        if (syscall(SYS_getcpu, &cpu, &node, nullptr) == -1)
+            return -1;
+        return (int)node;
+    }
+    int ShmNumaBind(void *addr, size_t len, EnumNumaPolicy policy, int node)
+    {
+        if (policy == EnumNumaPolicy::Default || ShmNumaNodeCount() <= 1)
+            return 0;
+        unsigned long mask[NODE_MASK_WORDS];
+        memset(mask, 0, sizeof(mask));
+        int mode;
+        if (policy == EnumNumaPolicy::Interleave)
+        {
+            mode = MPOL_INTERLEAVE;
+            for (int n : onlineNodes())
+            {
+                if (n >= 0 && n < SHM_NUMA_MAX_NODES)
+                    mask[n / (8 * sizeof(unsigned long))] |= 1ul << (n % (8 * sizeof(unsigned long)));
+            }
+        }
+        else
+        {
+            if (node < 0 || node >= SHM_NUMA_MAX_NODES)
+                return -EINVAL;
+            mode = policy == EnumNumaPolicy::Bind ? MPOL_BIND : MPOL_PREFERRED;
+            mask[node / (8 * sizeof(unsigned long))] |= 1ul << (node % (8 * sizeof(unsigned long)));
+        }
+        // maxnode是位数+1(内核会先减一)
+        if (syscall(SYS_mbind, addr, len, mode, mask, SHM_NUMA_MAX_NODES + 1, MPOL_MF_MOVE) == -1)
+            return -errno;
+        return 0;
+    }
+    int ShmNumaPinThread(int node)
+    {
+        if (node < 0 || ShmNumaNodeCount() <= 1)
+            return 0;
+        char path[128];
+        snprintf(path, sizeof(path), "/sys/devices/system/node/node%d/cpulist", node);
+        std::vector<int> cpus = parseList(readLine(path));
+        if (cpus.empty())
+            return -ENOENT;
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        for (int cpu : cpus)
+        {
+            if (cpu >= 0 && cpu < CPU_SETSIZE)
+                CPU_SET(cpu, &set);
+        }
+        // pid=0: 只影响调用线程
+        if (sched_setaffinity(0, sizeof(set), &set) == -1)
+            return -errno;
+        return 0;
+    }
+    std::string ShmNumaDescribe(void *addr)
+    {
+        int mode = 0;
+        unsigned long mask[NODE_MASK_WORDS];
+        memset(mask, 0, sizeof(mask));
+        if (syscall(SYS_get_mempolicy, &mode, mask, SHM_NUMA_MAX_NODES + 1, addr, MPOL_F_ADDR) == -1)
+            return std::string("unknown(") + strerror(errno) + ")";
+        std::stringstream ss;
+        switch (mode)
+        {
+        case MPOL_BIND:
+            ss << "bind";
+            break;
+        case MPOL_PREFERRED:
+            ss << "preferred";
+            break;
+        case MPOL_INTERLEAVE:
+            ss << "interleave";
+            break;
+        case MPOL_DEFAULT:
+            return "default";
+        default:
+            ss << "mode" << mode;
+            break;
+        }
+        ss << "{";
+        bool first = true;
+        for (int n = 0; n < SHM_NUMA_MAX_NODES; n++)
+        {
+            if (mask[n / (8 * sizeof(unsigned long))] & (1ul << (n % (8 * sizeof(unsigned long)))))
+            {
+                ss << (first ? "" : ",") << n;
+                first = false;
+            }
+        }
+        ss << "}";
+        return ss.str();
+    }
+    const char *NumaPolicy2String(EnumNumaPolicy policy)
+    {
+        switch (policy)
+        {
+#define XX(policy)               \
+    case EnumNumaPolicy::policy: \
+        return #policy;          \
+        break;
+            XX(Default)
+            XX(Bind)
+            XX(Preferred)
+            XX(Interleave)
+#undef XX
+        default:
+            break;
+        }
+        return "UnKnownNumaPolicy";
+    }
+} // namespace xten
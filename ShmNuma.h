@@ -0,0 +1,38 @@
+#ifndef __XTEN_SHM_NUMA_H__
+#define __XTEN_SHM_NUMA_H__
+#include <stddef.h>
+#include <string>
+// NUMA内存放置---直接使用mbind/getcpu/sched_setaffinity系统调用,不依赖libnuma
+// 段的内存默认由第一个写入的cpu所在节点分配(first touch),创建者和消费者不在同一个节点时每条消息都跨节点读取
+// 创建队列时把段绑定到消费者所在的节点(或者在所有节点之间交错),消费者线程再用ShmNumaPinThread固定到该节点
+// 单节点机器上所有接口都是空操作并返回成功
+namespace xten
+{
+    // 段的内存放置策略
+    enum class EnumNumaPolicy : unsigned char
+    {
+        Default = 0,    // 不设置---first touch
+        Bind = 1,       // 只从指定节点分配 (MPOL_BIND)
+        Preferred = 2,  // 优先指定节点,内存不足时退回其他节点 (MPOL_PREFERRED)
+        Interleave = 3, // 按页在所有在线节点之间交错 (MPOL_INTERLEAVE)
+    };
+// 支持的最大节点数
+#define SHM_NUMA_MAX_NODES 1024
+
+    // 在线的NUMA节点个数 (读取失败或者内核不支持NUMA时为1)
+    int ShmNumaNodeCount();
+    // 调用线程当前所在的节点 失败返回-1
+    int ShmNumaCurrentNode();
+    // 把[addr, addr+len)的内存按policy放置到node(Interleave忽略node) on success ret=0 ; on failed ret<0(-errno)
+    // 已经分配的页会被迁移(MPOL_MF_MOVE); 共享内存(System V/memfd)的策略记录在共享对象上,对所有attach的进程有效
+    // 单节点机器或者Default策略时不做任何事,返回0
+    int ShmNumaBind(void *addr, size_t len, EnumNumaPolicy policy, int node);
+    // 把调用线程固定到node的cpu上 on success ret=0 ; on failed ret<0(-errno)
+    // node<0或者单节点机器时不做任何事,返回0
+    int ShmNumaPinThread(int node);
+    // 读取addr所在页实际生效的策略,用于诊断输出
+    std::string ShmNumaDescribe(void *addr);
+    // 策略名称
+    const char *NumaPolicy2String(EnumNumaPolicy policy);
+} // namespace xten
+#endif
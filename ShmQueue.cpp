@@ -5,10 +5,35 @@
 #include <assert.h>
 #include <sys/shm.h>
 #include <sstream>
+#include <stddef.h>
+#include <chrono>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/file.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <poll.h>
+#include <errno.h>
+#include <limits.h>
+#include "Crc32c.h"
+#include "ShmLz.h"
+#include "ShmQueuePoller.h"
+#include "ShmSpill.h"
 namespace xten
 {
+// 控制块初始化完成标记---控制块格式变化时修改,旧格式的文件会被重新初始化
+#define SHM_QUEUE_MAGIC 0x58514D57u
+// 保留日志区域初始化完成标记
+#define SHM_LOG_MAGIC 0x474F4C53u
+// 流分片的最小长度---队列放不下剩余数据时,至少等到这么多空闲空间再切分片
+#define SHM_STREAM_MIN_FRAGMENT 4096
+// 流式放入等待空间时先yield多少次,之后每次sleep
+#define SHM_STREAM_SPIN_COUNT 64
+#define SHM_STREAM_SLEEP_US 100
     // 大小对齐到2的n次幂
-    static size_t roundUpToPowerOfTwo(size_t v)
+    size_t ShmQueue::roundUpToPowerOfTwo(size_t v)
     {
         if (v == 0)
             return 1;
@@ -25,6 +50,91 @@ namespace xten
         v++;
         return v;
     }
+    // 记录是否带有提交标记(普通记录或者大消息描述符)
+    static inline bool recordCommitted(uint32_t commit)
+    {
+        return commit == RECORD_COMMIT_MAGIC || commit == RECORD_DESC_MAGIC || commit == RECORD_FRAG_MAGIC ||
+               commit == RECORD_LZ_MAGIC;
+    }
+    // 紧凑头部只保存提交标记的低8位---所有标记的高24位必须相同
+    static_assert((RECORD_COMMIT_MAGIC & 0xFFFFFF00u) == (RECORD_DESC_MAGIC & 0xFFFFFF00u) &&
+                      (RECORD_COMMIT_MAGIC & 0xFFFFFF00u) == (RECORD_FRAG_MAGIC & 0xFFFFFF00u) &&
+                      (RECORD_COMMIT_MAGIC & 0xFFFFFF00u) == (RECORD_LZ_MAGIC & 0xFFFFFF00u),
+                  "record magics should share the high 24 bits");
+    // 压缩/解压的临时缓冲区---每个线程各自一组,同一个句柄可以被多个线程同时使用
+    // 0: 压缩输出/拼接分布在头尾的压缩数据/覆盖模式PushFromFd的读缓冲区  1: 需要整块交给调用者的解压输出
+    static std::vector<BYTE> &lzScratch(int index)
+    {
+        static thread_local std::vector<BYTE> scratch[2];
+        return scratch[index];
+    }
+    static inline uint64_t elapsedNs(std::chrono::steady_clock::time_point begin)
+    {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - begin).count();
+    }
+    static inline uint64_t compactHeaderEncode(const ShmRecordHeader &header)
+    {
+        return (uint64_t)(header.commit & 0xFFu) | ((uint64_t)(header.length & SHM_COMPACT_MAX_LENGTH) << 8) |
+               ((uint64_t)header.topic << 32) | ((uint64_t)(header.crc & 0xFFFFu) << 48);
+    }
+    // 解码没有分支: 全0的头部还原出的标记是0x51534D00,不是合法的提交标记
+    static inline void compactHeaderDecode(uint64_t word, ShmRecordHeader &header)
+    {
+        header.commit = (RECORD_COMMIT_MAGIC & 0xFFFFFF00u) | (uint32_t)(word & 0xFFu);
+        header.length = (uint32_t)(word >> 8) & SHM_COMPACT_MAX_LENGTH;
+        header.topic = (uint16_t)(word >> 32);
+        header.reserved = 0;
+        header.crc = (uint32_t)(word >> 48);
+    }
+    // ring之后需要为slab分配的大小
+    static size_t slabSegmentSize(const ShmQueOptions &options)
+    {
+        return (options.slabSize > 0 && !options.overwrite && !options.retainedLog) ? ShmSlab::AlignSize(options.slabSize) : 0;
+    }
+    // 保留日志的索引间隔
+    static uint32_t logIndexInterval(const ShmQueOptions &options)
+    {
+        return options.logIndexInterval ? (uint32_t)options.logIndexInterval : SHM_LOG_INDEX_INTERVAL;
+    }
+    // 保留日志的索引槽位个数---ring中最多能放下的记录(每条至少头部+1字节)都在索引覆盖的范围内
+    static uint64_t logIndexCapacity(const ShmQueOptions &options, size_t quesize)
+    {
+        size_t headerSize = options.compactHeader ? SHM_COMPACT_HEADER_SIZE : sizeof(ShmRecordHeader);
+        uint64_t need = quesize / (headerSize + 1) / logIndexInterval(options) + 2;
+        uint64_t capacity = 1;
+        while (capacity < need)
+            capacity <<= 1;
+        return capacity;
+    }
+    // ring之后需要为保留日志分配的大小
+    static size_t logSegmentSize(const ShmQueOptions &options, size_t quesize)
+    {
+        if (!options.retainedLog)
+            return 0;
+        size_t size = sizeof(ShmLogHeader) + logIndexCapacity(options, quesize) * sizeof(ShmLogIndexEntry);
+        return (size + CPU_CACHELINE_SIZE - 1) & ~(size_t)(CPU_CACHELINE_SIZE - 1);
+    }
+    // 之后需要为延迟消息时间轮分配的大小
+    static size_t timerSegmentSize(const ShmQueOptions &options)
+    {
+        return options.timerSlots > 0 ? ShmTimerWheel::AlignSize(options.timerSlots, options.timerMaxMsgSize) : 0;
+    }
+    // ring之后所有区域的总大小
+    static size_t extraSegmentSize(const ShmQueOptions &options, size_t quesize)
+    {
+        return slabSegmentSize(options) + logSegmentSize(options, quesize) + timerSegmentSize(options);
+    }
+    // 请求的区域都能初始化---区域按 slab/保留日志 -> 时间轮 依次排列,attach时按控制块中的标记定位,
+    // 某个区域初始化失败时后面区域的位置就和创建时对不上,所以参数不合法时直接拒绝创建
+    static bool checkSegmentOptions(const ShmQueOptions &options)
+    {
+        if (slabSegmentSize(options) > 0 && !ShmSlab::CheckSize(options.slabSize))
+            return false;
+        if (timerSegmentSize(options) > 0 &&
+            !ShmTimerWheel::CheckParams(options.timerSlots, options.timerMaxMsgSize, (uint64_t)options.timerTickUs * 1000))
+            return false;
+        return true;
+    }
     // 错误码转string
     static const char *errorCode2String(ShmQueErrorCode code)
     {
@@ -41,6 +151,13 @@ namespace xten
             XX(QueueDataError)
             XX(QueueDataLengthError)
             XX(QueueBufferLengthInsufficient)
+            XX(QueueRecordUncommitted)
+            XX(QueueRecordCrcError)
+            XX(QueueNotSupported)
+            XX(QueueTimeout)
+            XX(QueueSeqNotRetained)
+            XX(QueueFdError)
+            XX(QueueFdClosed)
 #undef XX
         default:
             break;
@@ -68,16 +185,88 @@ namespace xten
     }
     // 构造函数
     ShmQueue::ShmQueue(key_t key, size_t quesize, int shmId, void *shmPtr,
-                       EnumCreateModel newOrLink, EnumVisitModel visitModule)
+                       EnumCreateModel newOrLink, EnumVisitModel visitModule, const ShmQueOptions &options)
         : _shmPtr(shmPtr), _newOrLink(newOrLink)
     {
+        // NUMA放置在第一次写入之前设置,页直接在目标节点上分配
+        int numaNode = -1;
+        bool numaApplied = false;
+        if (options.numaPolicy != EnumNumaPolicy::Default)
+        {
+            if (options.numaPolicy != EnumNumaPolicy::Interleave)
+                numaNode = options.numaNode >= 0 ? options.numaNode : std::max(ShmNumaCurrentNode(), 0);
+            int ret = ShmNumaBind(shmPtr, sizeof(ShmQueControlBlock) + quesize + extraSegmentSize(options, quesize), options.numaPolicy, numaNode);
+            if (ret != 0)
+                std::cout << "ShmQueue numa bind failed,errstr=" << strerror(-ret) << std::endl;
+            numaApplied = ret == 0 && ShmNumaNodeCount() > 1;
+        }
         _controlBlock = new (shmPtr) ShmQueControlBlock();
+        _controlBlock->numaPolicy = options.numaPolicy;
+        _controlBlock->numaNode = (int16_t)numaNode;
+        _controlBlock->numaApplied = numaApplied;
         _quePtr = (BYTE *)shmPtr + sizeof(ShmQueControlBlock);
         _controlBlock->key = key;
         _controlBlock->queSize = quesize;
         _controlBlock->shmId = shmId;
         _controlBlock->vtModule = visitModule;
+        _controlBlock->headerCrc = options.headerCrc;
+        _controlBlock->compactHeader = options.compactHeader;
+        _controlBlock->compressThreshold.store(clampCompressThreshold(options.compressThreshold), std::memory_order_relaxed);
+        _controlBlock->inlineLock = options.inlineLock;
+        _controlBlock->overwrite = options.overwrite && !options.retainedLog;
+        if (slabSegmentSize(options) > 0)
+        {
+            // 大消息slab紧跟在ring之后
+            size_t threshold = options.largeMsgThreshold ? options.largeMsgThreshold : quesize / 8;
+            _controlBlock->slab = ShmSlab::Init(_quePtr + quesize, options.slabSize, threshold);
+        }
+        if (logSegmentSize(options, quesize) > 0)
+        {
+            // 保留日志区域紧跟在ring之后---所有索引项初始化为无效
+            ShmLogHeader *log = new (_quePtr + quesize) ShmLogHeader();
+            log->indexInterval = logIndexInterval(options);
+            log->indexCapacity = logIndexCapacity(options, quesize);
+            log->totalSize = logSegmentSize(options, quesize);
+            ShmLogIndexEntry *index = (ShmLogIndexEntry *)(log + 1);
+            for (uint64_t i = 0; i < log->indexCapacity; i++)
+            {
+                index[i].seq.store(SHM_LOG_INVALID_SEQ, std::memory_order_relaxed);
+                index[i].pos.store(0, std::memory_order_relaxed);
+            }
+            log->magic = SHM_LOG_MAGIC;
+            _controlBlock->retained = true;
+        }
+        if (timerSegmentSize(options) > 0)
+        {
+            // 时间轮紧跟在slab/保留日志之后
+            _controlBlock->timerWheel = ShmTimerWheel::Init(_quePtr + quesize + slabSegmentSize(options) + logSegmentSize(options, quesize),
+                                                           options.timerSlots, options.timerMaxMsgSize,
+                                                           (uint64_t)options.timerTickUs * 1000, ShmTimerWheel::NowNs());
+        }
+        if (options.inlineLock)
+        {
+            ShmMutex::Init(&_controlBlock->headLock);
+            ShmMutex::Init(&_controlBlock->tailLock);
+        }
+        _controlBlock->headShmId.store(shmId, std::memory_order_relaxed);
+        _controlBlock->tailShmId.store(shmId, std::memory_order_relaxed);
+        _controlBlock->curQueSize.store(quesize, std::memory_order_relaxed);
+        _controlBlock->magic = SHM_QUEUE_MAGIC;
         initLock();
+        initRingView();
+        if (_controlBlock->slab)
+            _slab = new ShmSlab(_quePtr + _controlBlock->queSize);
+        if (_controlBlock->retained)
+        {
+            _log = (ShmLogHeader *)(_quePtr + _controlBlock->queSize);
+            _logIndex = (ShmLogIndexEntry *)(_log + 1);
+        }
+        if (_controlBlock->timerWheel)
+        {
+            size_t offset = _controlBlock->queSize + (_slab ? ShmSlab::TotalSize(_quePtr + _controlBlock->queSize) : 0) +
+                            (_log ? _log->totalSize : 0);
+            _timer = new ShmTimerWheel(_quePtr + offset);
+        }
     }
     // 如果是link链接到一个已经启动的消息队列,应该调用这个构造函数---防止 [控制块] 的值被重置
     ShmQueue::ShmQueue(ShmQueControlBlock *cblock, EnumCreateModel newOrLink)
@@ -86,16 +275,71 @@ namespace xten
         _controlBlock = cblock;
         _quePtr = (BYTE *)cblock + sizeof(ShmQueControlBlock);
         initLock();
+        initRingView();
+        if (_controlBlock->slab)
+            _slab = new ShmSlab(_quePtr + _controlBlock->queSize);
+        if (_controlBlock->retained)
+        {
+            _log = (ShmLogHeader *)(_quePtr + _controlBlock->queSize);
+            _logIndex = (ShmLogIndexEntry *)(_log + 1);
+        }
+        if (_controlBlock->timerWheel)
+        {
+            size_t offset = _controlBlock->queSize + (_slab ? ShmSlab::TotalSize(_quePtr + _controlBlock->queSize) : 0) +
+                            (_log ? _log->totalSize : 0);
+            _timer = new ShmTimerWheel(_quePtr + offset);
+        }
     }
     ShmQueue::~ShmQueue()
     {
-        if (_controlBlock)
+        // 先停止溢出层的后台线程---它会回放到这个队列
+        _spill.reset();
+        if (_pollerSeg)
+            shmdt(_pollerSeg);
+        if (_spacePollerSeg)
+            shmdt(_spacePollerSeg);
+        if (_controlBlock && _backend == EnumShmBackend::FileMmap)
         {
+            // 文件后端不删除文件---刷盘后解除映射,下次启动直接复用
+            stopMsync();
+            msync(_shmPtr, _mapSize, MS_SYNC);
+            munmap(_shmPtr, _mapSize);
+            close(_fd);
+        }
+        else if (_controlBlock && _backend == EnumShmBackend::Memfd)
+        {
+            // memfd随最后一个fd/映射释放
+            munmap(_shmPtr, _mapSize);
+            close(_fd);
+        }
+        else if (_controlBlock && _backend == EnumShmBackend::Registry)
+        {
+            // 内存属于registry段/RPC通道段,由所属对象释放
+        }
+        else if (_controlBlock)
+        {
+            // 扩缩容产生的ring和根ring一样标记删除后detach
+            if (_tailCb != _controlBlock)
+                shmctl(_tailCb->shmId, IPC_RMID, NULL);
+            if (_headCb != _controlBlock)
+                shmctl(_headCb->shmId, IPC_RMID, NULL);
+            detachRing(_tailCb);
+            detachRing(_headCb);
             key_t key = _controlBlock->key;
             _controlBlock->~ShmQueControlBlock();
             // 销毁占用的那块共享内存
             destroySharedMemory(_shmPtr, key);
         }
+        if (_slab)
+        {
+            delete _slab;
+            _slab = nullptr;
+        }
+        if (_timer)
+        {
+            delete _timer;
+            _timer = nullptr;
+        }
         // 锁的销毁
         if (_headMtx)
         {
@@ -109,48 +353,452 @@ namespace xten
         }
     }
     // 放入消息
-    int ShmQueue::PushMessage(const void *msg, DATA_SIZE_TYPE msglength)
+    int ShmQueue::PushMessage(const void *msg, DATA_SIZE_TYPE msglength, uint16_t topic)
+    {
+        if (!msg || msglength <= 0)
+        {
+            std::cout << errorCode2String(ShmQueErrorCode::QueueParameterInvaild) << std::endl;
+            return (int)(ShmQueErrorCode::QueueParameterInvaild);
+        }
+        // 单生产者模式: 顺便放入到期的延迟消息
+        deliverTimers(true);
+        if (!_spill)
+            return pushMessage(msg, msglength, topic);
+        // 溢出层中还有更早的消息---排在它们后面
+        if (_spill->Active())
+            return _spill->Append(msg, msglength, topic);
+        int ret = pushMessage(msg, msglength, topic);
+        if (ret == (int)(ShmQueErrorCode::QueueNoFreeSize))
+            ret = _spill->Append(msg, msglength, topic);
+        return ret;
+    }
+    // 放入延迟消息
+    int ShmQueue::PushMessageAt(const void *msg, DATA_SIZE_TYPE msglength, std::chrono::steady_clock::time_point deliverAt,
+                                uint16_t topic)
     {
         if (!msg || msglength <= 0)
         {
             std::cout << errorCode2String(ShmQueErrorCode::QueueParameterInvaild) << std::endl;
             return (int)(ShmQueErrorCode::QueueParameterInvaild);
         }
+        if (!_timer)
+        {
+            return (int)(ShmQueErrorCode::QueueNotSupported);
+        }
+        // steady_clock和时间轮都使用CLOCK_MONOTONIC
+        int64_t deadlineNs = std::chrono::duration_cast<std::chrono::nanoseconds>(deliverAt.time_since_epoch()).count();
+        int ret = _timer->Insert(msg, msglength, topic, deadlineNs > 0 ? (uint64_t)deadlineNs : 0, ShmTimerWheel::NowNs());
+        switch (ret)
+        {
+        case SHM_TIMER_OK:
+            deliverTimers(true);
+            return 0;
+        case SHM_TIMER_DUE:
+            // 已经到期---和普通消息一样直接放入
+            return PushMessage(msg, msglength, topic);
+        case SHM_TIMER_NO_NODE:
+            return (int)(ShmQueErrorCode::QueueNoFreeSize);
+        default:
+            std::cout << errorCode2String(ShmQueErrorCode::QueueParameterInvaild) << std::endl;
+            return (int)(ShmQueErrorCode::QueueParameterInvaild);
+        }
+    }
+    // 推进时间轮
+    int ShmQueue::AdvanceTimers()
+    {
+        if (!_timer)
+        {
+            return (int)(ShmQueErrorCode::QueueNotSupported);
+        }
+        return advanceTimers(true);
+    }
+    int ShmQueue::advanceTimers(bool wait)
+    {
+        return _timer->Advance(ShmTimerWheel::NowNs(), [this](const void *msg, size_t length, uint16_t topic)
+                               {
+                                   int ret = pushRecord(msg, length, RECORD_COMMIT_MAGIC, topic);
+                                   // 队列满---留在时间轮中,下次检查时重试
+                                   if (ret == (int)(ShmQueErrorCode::QueueNoFreeSize))
+                                       return false;
+                                   if (ret != 0)
+                                       std::cout << "deliver delayed message failed," << errorCode2String((ShmQueErrorCode)ret) << std::endl;
+                                   return true; }, wait);
+    }
+    // 放入消息(不经过溢出层)
+    int ShmQueue::pushMessage(const void *msg, DATA_SIZE_TYPE msglength, uint16_t topic)
+    {
+        // 大消息放入slab,队列中只放一个描述符
+        if (_slab && msglength >= _slab->GetThreshold())
+        {
+            void *data = _slab->Alloc(msglength);
+            if (data)
+            {
+                bool streaming = msglength >= _controlBlock->ntCopyThreshold;
+                ShmCopyToQueue(data, msg, (size_t)msglength, streaming);
+                if (streaming)
+                    ShmStreamFence();
+                ShmLargeDesc desc;
+                desc.offset = _slab->Offset(data);
+                desc.length = msglength;
+                int ret = pushRecord(&desc, sizeof(desc), RECORD_DESC_MAGIC, topic);
+                if (ret != 0)
+                    _slab->Free(data);
+                return ret;
+            }
+            // slab已满---ring放得下时退回到ring中
+        }
+        // 超过阈值的消息先压缩---在tail锁之外进行; 至少节省1/8才使用压缩结果,否则按原样放入
+        // 阈值已经限制了最小值,这里再检查一次长度: 链接的旧控制块中可能是更小的值,limit不能下溢
+        uint32_t threshold = _controlBlock->compressThreshold.load(std::memory_order_relaxed);
+        if (threshold > 0 && msglength >= threshold && msglength >= SHM_COMPRESS_MIN_THRESHOLD && msglength <= UINT32_MAX)
+        {
+            std::vector<BYTE> &zip = lzScratch(0);
+            size_t limit = msglength - msglength / 8 - sizeof(uint32_t);
+            zip.resize(limit);
+            auto begin = std::chrono::steady_clock::now();
+            size_t zipLength = ShmLzCompress(msg, msglength, zip.data(), limit);
+            _zip.compressNs.fetch_add(elapsedNs(begin), std::memory_order_relaxed);
+            if (zipLength > 0)
+            {
+                uint32_t rawLength = (uint32_t)msglength;
+                int ret = pushRecord(zip.data(), zipLength, RECORD_LZ_MAGIC, topic, &rawLength, sizeof(rawLength));
+                if (ret == 0)
+                {
+                    _zip.compressed.fetch_add(1, std::memory_order_relaxed);
+                    _zip.rawBytes.fetch_add(msglength, std::memory_order_relaxed);
+                    _zip.storedBytes.fetch_add(zipLength + sizeof(rawLength), std::memory_order_relaxed);
+                }
+                return ret;
+            }
+            _zip.skipped.fetch_add(1, std::memory_order_relaxed);
+        }
+        return pushRecord(msg, msglength, RECORD_COMMIT_MAGIC, topic);
+    }
+    // 加锁后放入一条记录
+    int ShmQueue::pushRecord(const void *msg, DATA_SIZE_TYPE msglength, uint32_t commit, uint16_t topic,
+                             const void *prefix, size_t prefixLength)
+    {
+        DATA_SIZE_TYPE recordLength = prefixLength + msglength;
+        if (recordLength > recordMaxLength())
+        {
+            std::cout << errorCode2String(ShmQueErrorCode::QueueParameterInvaild) << std::endl;
+            return (int)(ShmQueErrorCode::QueueParameterInvaild);
+        }
         // 0.根据访问模式判断是否加锁
         WLockGuard lock(_tailMtx); // 空不加锁
-        // 1.获取空闲空间大小
-        size_t freeSize = getFreeSize();
-        if (freeSize < msglength + sizeof(DATA_SIZE_TYPE))
+        // 1.预留空间
+        uint64_t tmptail;
+        int ret = reserveTail(recordLength + recordHeaderSize(), tmptail);
+        if (ret != 0)
         {
             // log
             // std::cout << "PushMessage failed ," << errorCode2String(ShmQueErrorCode::QueueNoFreeSize)<<std::endl;
-            return (int)(ShmQueErrorCode::QueueNoFreeSize);
+            return ret;
         }
         // 2.确保了空间足够，开始放数据
-        // 2.1放入固定长度的length字段
-        BYTE *tmpDst = _quePtr;
-        int tmptail = _controlBlock->tailIdx;
-        BYTE *tmpLen = (BYTE *)(&msglength);
-        for (int i = 0; i < sizeof(DATA_SIZE_TYPE); i++)
+        uint64_t dataPos = tmptail + recordHeaderSize();
+        // 2.1放msg----有两种情况  连续 or 头尾
+        // 大消息使用非临时存储,不污染生产者的cache
+        bool streaming = msglength >= _controlBlock->ntCopyThreshold;
+        if (prefixLength > 0)
+            copyToQueue(dataPos, prefix, prefixLength, false);
+        copyToQueue(dataPos + prefixLength, msg, msglength, streaming);
+        // 2.2数据写完后再写入带提交标记的头部
+        ShmRecordHeader header;
+        header.commit = commit;
+        header.length = (uint32_t)recordLength;
+        header.topic = topic;
+        header.reserved = 0;
+        header.crc = recordHeaderCrc(header);
+        writeRecordHeader(tmptail, header);
+        // 3.数据拷贝完---更新索引位置 [在更新索引位置之前，需要保证数据全部写入完毕]
+        // 普通store由release语义保证顺序; 非临时存储是弱序的,需要额外的sfence
+        if (streaming)
+            ShmStreamFence();
+        publishRecord(tmptail, dataPos + recordLength);
+        return (int)(ShmQueErrorCode::QueueOk);
+    }
+    // 持有tail锁时调用: 预留need字节 on success ret=0 tail=记录开始的位置 ; on failed ret<0
+    int ShmQueue::reserveTail(size_t need, uint64_t &tail)
+    {
+        // 当前ring已经被扩缩容替换---切换到最新的ring
+        if (_tailCb->nextShmId.load(std::memory_order_acquire) != -1 && !followTailRing())
         {
-            tmpDst[tmptail] = tmpLen[i];
-            tmptail = (tmptail + 1) & (_controlBlock->queSize - 1); // 存长度空间可能在头尾
+            return (int)(ShmQueErrorCode::QueueFailedSharedMemory);
         }
-        // 2.2放msg----有两种情况  连续 or 头尾
-        DATA_SIZE_TYPE part1Size = std::min(msglength, _controlBlock->queSize - tmptail);
-        memcpy((void *)(tmpDst + tmptail), msg, (size_t)part1Size);
-        DATA_SIZE_TYPE part2Size = msglength - part1Size;
-        if (part2Size > 0)
+        // 获取空闲空间大小
+        // tail只有持有tail锁的生产者修改---relaxed即可
+        // head用acquire读: 与消费者的release写配对,保证消费者已经读完的空间才会被覆盖
+        // 保留日志的seqlock停在奇数: 上一个生产者在修改中间崩溃(System V信号量/单生产者没有EOWNERDEAD通知)
+        if (_log && (_log->version.load(std::memory_order_relaxed) & 1))
+            logRecover();
+        tail = _tailCb->tailIdx.load(std::memory_order_relaxed);
+        uint64_t tmphead = _tailCb->headIdx.load(std::memory_order_acquire);
+        if (getFreeSize(tmphead, tail) < need)
         {
-            // 数据在头尾----直接在队列起始位置放下剩余数据
-            memcpy((void *)(tmpDst), (const void *)((BYTE *)msg + part1Size), (size_t)(part2Size));
+            // 覆盖模式: 丢弃最老的记录腾出空间,生产者不等待消费者
+            // 保留日志: 只回收保留水位之前的记录
+            if (_log ? !reclaimLog(tmphead, tail, need)
+                     : (!_controlBlock->overwrite || !dropOldest(tmphead, tail, need)))
+            {
+                return (int)(ShmQueErrorCode::QueueNoFreeSize);
+            }
         }
-        // 3.数据拷贝完---更新索引位置 [在更新索引位置之前，需要保证数据全部写入完毕，使用写内存屏障保障]
-        sfence();
-        // 更新tail索引
-        _controlBlock->tailIdx = (tmptail + msglength) & (_controlBlock->queSize - 1);
         return (int)(ShmQueErrorCode::QueueOk);
     }
+    // 持有tail锁时调用: 发布[pos, end)处的一条记录
+    void ShmQueue::publishRecord(uint64_t pos, uint64_t end)
+    {
+        // 更新tail位置---release发布,消费者acquire读到新tail后一定能看到完整数据
+        if (_log)
+        {
+            // 保留日志: 序号和tail一起在seqlock中更新
+            uint64_t seq = _log->tailSeq.load(std::memory_order_relaxed);
+            logIndex(seq, pos);
+            logWriteBegin();
+            _log->tailSeq.store(seq + 1, std::memory_order_relaxed);
+            _tailCb->tailIdx.store(end, std::memory_order_release);
+            logWriteEnd();
+        }
+        else
+            _tailCb->tailIdx.store(end, std::memory_order_release);
+        // 注册了poller时标记就绪---和tail在同一个缓存行,没有注册时只多一次读
+        if (_controlBlock->pollerShmId.load(std::memory_order_acquire) != -1)
+            notifyPoller();
+        // 文件后端按字节数触发刷盘---只在跨过阈值时唤醒后台线程
+        if (_msyncBytes > 0)
+        {
+            size_t bytes = end - pos;
+            size_t prev = _unsyncedBytes.fetch_add(bytes, std::memory_order_relaxed);
+            if (prev < _msyncBytes && prev + bytes >= _msyncBytes)
+                _msyncCond.notify_one();
+        }
+    }
+    // 开启溢出层
+    int ShmQueue::EnableSpill(const std::string &filepath, size_t maxSpillBytes)
+    {
+        if (_spill)
+        {
+            return (int)(ShmQueErrorCode::QueueParameterInvaild);
+        }
+        if (_controlBlock->overwrite)
+        {
+            // 覆盖模式的ring永远不满
+            return (int)(ShmQueErrorCode::QueueNotSupported);
+        }
+        if (!_tailMtx)
+        {
+            // 单生产者模式没有tail锁---回放线程和生产者线程会同时写tail
+            return (int)(ShmQueErrorCode::QueueNotSupported);
+        }
+        std::unique_ptr<ShmSpill> spill(new ShmSpill(this, filepath, maxSpillBytes));
+        if (!spill->Open())
+        {
+            return (int)(ShmQueErrorCode::QueueFailedSharedMemory);
+        }
+        _spill = std::move(spill);
+        return (int)(ShmQueErrorCode::QueueOk);
+    }
+    // 加锁后放入多条记录
+    int ShmQueue::pushBlock(const void *block, size_t length)
+    {
+        WLockGuard lock(_tailMtx);
+        uint64_t tmptail;
+        int ret = reserveTail(length, tmptail);
+        if (ret != 0)
+            return ret;
+        // 记录头部已经带着提交标记---消费者只有在tail发布之后才会读到这块数据
+        bool streaming = length >= _controlBlock->ntCopyThreshold;
+        copyToQueue(tmptail, block, length, streaming);
+        if (streaming)
+            ShmStreamFence();
+        if (_log)
+        {
+            // 保留日志: 逐条登记块中记录的序号
+            uint64_t seq = _log->tailSeq.load(std::memory_order_relaxed);
+            for (size_t offset = 0; offset + recordHeaderSize() <= length; seq++)
+            {
+                ShmRecordHeader header;
+                decodeRecordHeader((const BYTE *)block + offset, header);
+                logIndex(seq, tmptail + offset);
+                offset += recordHeaderSize() + header.length;
+            }
+            logWriteBegin();
+            _log->tailSeq.store(seq, std::memory_order_relaxed);
+            _tailCb->tailIdx.store(tmptail + length, std::memory_order_release);
+            logWriteEnd();
+        }
+        else
+            _tailCb->tailIdx.store(tmptail + length, std::memory_order_release);
+        if (_controlBlock->pollerShmId.load(std::memory_order_acquire) != -1)
+            notifyPoller();
+        if (_msyncBytes > 0)
+        {
+            size_t prev = _unsyncedBytes.fetch_add(length, std::memory_order_relaxed);
+            if (prev < _msyncBytes && prev + length >= _msyncBytes)
+                _msyncCond.notify_one();
+        }
+        return (int)(ShmQueErrorCode::QueueOk);
+    }
+    // 覆盖模式: 从head开始丢弃最老的记录,直到空闲空间>=need
+    bool ShmQueue::dropOldest(uint64_t head, uint64_t tail, size_t need)
+    {
+        if (need + REMAIN_SIZE > _tailCb->queSize)
+        {
+            // 整个队列都放不下这条消息
+            return false;
+        }
+        // 覆盖模式不支持扩缩容,生产者和消费者一定在同一个ring上
+        while (getFreeSize(head, tail) < need)
+        {
+            ShmRecordHeader header;
+            readRecordHeader(head, header);
+            uint64_t next = head + recordHeaderSize() + header.length;
+            bool corrupt = !recordCommitted(header.commit) || header.length == 0 || next > tail;
+            if (corrupt)
+            {
+                // 记录头部损坏---长度不可信,丢弃剩余的全部数据(其中的记录数未知,计数只加1)
+                next = tail;
+            }
+            // CAS推进head: 失败说明消费者刚刚取走了记录,head已经更新为最新值,重新判断
+            if (_tailCb->headIdx.compare_exchange_weak(head, next, std::memory_order_acq_rel, std::memory_order_acquire))
+            {
+                _controlBlock->droppedRecords.fetch_add(1, std::memory_order_relaxed);
+                if (corrupt)
+                    std::cout << "ShmQueue overwrite dropped corrupt data, bytes=" << next - head << std::endl;
+                head = next;
+            }
+        }
+        return true;
+    }
+    // 保留日志: 从head开始回收保留水位之前的记录,直到空闲空间>=need
+    // 只有生产者(持有tail锁)推进head,不需要CAS
+    bool ShmQueue::reclaimLog(uint64_t head, uint64_t tail, size_t need)
+    {
+        if (need + REMAIN_SIZE > _tailCb->queSize)
+        {
+            return false;
+        }
+        uint64_t retainSeq = _log->retainSeq.load(std::memory_order_acquire);
+        uint64_t headSeq = _log->headSeq.load(std::memory_order_relaxed);
+        uint64_t tailSeq = _log->tailSeq.load(std::memory_order_relaxed);
+        while (getFreeSize(head, tail) < need)
+        {
+            if (headSeq >= retainSeq)
+            {
+                // 水位之后的记录还没有被所有消费者处理完
+                return false;
+            }
+            ShmRecordHeader header;
+            readRecordHeader(head, header);
+            uint64_t next = head + recordHeaderSize() + header.length;
+            uint64_t nextSeq = headSeq + 1;
+            if (!recordCommitted(header.commit) || header.length == 0 || next > tail)
+            {
+                // 记录头部损坏---长度不可信,回收剩余的全部数据
+                next = tail;
+                nextSeq = tailSeq;
+            }
+            logWriteBegin();
+            _log->headSeq.store(nextSeq, std::memory_order_relaxed);
+            _tailCb->headIdx.store(next, std::memory_order_release);
+            logWriteEnd();
+            head = next;
+            headSeq = nextSeq;
+        }
+        return true;
+    }
+    // 保留日志: 登记索引点---先把槽位标记为无效再写位置,读者读到前后一致的序号才使用位置
+    void ShmQueue::logIndex(uint64_t seq, uint64_t pos)
+    {
+        if (seq % _log->indexInterval != 0)
+            return;
+        ShmLogIndexEntry &entry = _logIndex[(seq / _log->indexInterval) & (_log->indexCapacity - 1)];
+        entry.seq.store(SHM_LOG_INVALID_SEQ, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        entry.pos.store(pos, std::memory_order_relaxed);
+        entry.seq.store(seq, std::memory_order_release);
+    }
+    // 保留日志的seqlock---只有一个生产者(持有tail锁)修改
+    void ShmQueue::logWriteBegin()
+    {
+        _log->version.store(_log->version.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+    }
+    void ShmQueue::logWriteEnd()
+    {
+        _log->version.store(_log->version.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+    }
+    // head/tail位置各自只有一次原子写,崩溃后仍然可信; head/tail处的序号可能只更新了一个
+    // 发布时先写tailSeq,回收时先写headSeq: 序号差大于[head, tail)中的记录数说明发布到一半,小于说明回收到一半
+    // 修复后重新登记范围内所有的索引点(覆盖崩溃时可能写到一半的槽位),最后把version恢复为偶数
+    void ShmQueue::logRecover()
+    {
+        uint64_t head = _tailCb->headIdx.load(std::memory_order_relaxed);
+        uint64_t tail = _tailCb->tailIdx.load(std::memory_order_relaxed);
+        uint64_t headSeq = _log->headSeq.load(std::memory_order_relaxed);
+        uint64_t tailSeq = _log->tailSeq.load(std::memory_order_relaxed);
+        uint64_t count = 0;
+        uint64_t pos = head;
+        while (pos < tail)
+        {
+            ShmRecordHeader header;
+            readRecordHeader(pos, header);
+            if (tail - pos <= recordHeaderSize() || !recordCommitted(header.commit) || header.length == 0 ||
+                header.length > tail - pos - recordHeaderSize())
+            {
+                break;
+            }
+            pos += recordHeaderSize() + header.length;
+            count++;
+        }
+        if ((_log->version.load(std::memory_order_relaxed) & 1) == 0)
+            logWriteBegin();
+        if (pos != tail)
+        {
+            // 记录头部损坏---记录数不可信,回收全部数据
+            head = tail;
+            headSeq = tailSeq;
+            count = 0;
+            _tailCb->headIdx.store(head, std::memory_order_release);
+        }
+        else if (tailSeq >= headSeq && tailSeq - headSeq > count)
+            tailSeq = headSeq + count; // 发布到一半
+        else
+            headSeq = tailSeq - count; // 回收到一半(一致时不变)
+        _log->headSeq.store(headSeq, std::memory_order_relaxed);
+        _log->tailSeq.store(tailSeq, std::memory_order_relaxed);
+        logWriteEnd();
+        pos = head;
+        for (uint64_t seq = headSeq; seq < tailSeq; seq++)
+        {
+            ShmRecordHeader header;
+            readRecordHeader(pos, header);
+            logIndex(seq, pos);
+            pos += recordHeaderSize() + header.length;
+        }
+        printf("ShmQueue retained log recovered: headSeq=%lu tailSeq=%lu\n", (unsigned long)headSeq, (unsigned long)tailSeq);
+    }
+    void ShmQueue::logSnapshot(uint64_t &head, uint64_t &headSeq, uint64_t &tail, uint64_t &tailSeq) const
+    {
+        for (int retry = 1;; retry++)
+        {
+            uint64_t version = _log->version.load(std::memory_order_acquire);
+            if ((version & 1) == 0)
+            {
+                head = _controlBlock->headIdx.load(std::memory_order_relaxed);
+                headSeq = _log->headSeq.load(std::memory_order_relaxed);
+                tail = _controlBlock->tailIdx.load(std::memory_order_relaxed);
+                tailSeq = _log->tailSeq.load(std::memory_order_relaxed);
+                std::atomic_thread_fence(std::memory_order_acquire);
+                if (_log->version.load(std::memory_order_relaxed) == version)
+                    return;
+            }
+            // 生产者正在修改---自旋一段时间后让出cpu(生产者可能被调度走)
+            if (retry % 64 == 0)
+                std::this_thread::yield();
+        }
+    }
     // 取出消息
     int ShmQueue::PopMessage(void *buffer, size_t bufLength)
     {
@@ -159,67 +807,72 @@ namespace xten
             std::cout << errorCode2String(ShmQueErrorCode::QueueParameterInvaild) << std::endl;
             return (int)(ShmQueErrorCode::QueueParameterInvaild);
         }
+        // 到期的延迟消息先放入ring---在拿head锁之前,不和生产者的tail锁形成嵌套
+        deliverTimers(false);
         // 锁
         WLockGuard lock(_headMtx);
-        size_t dataSize = getDataSize();
-        if (dataSize == 0)
+        if (_controlBlock->retained)
         {
-            // 没有数据
-            return (int)(ShmQueErrorCode::QueueOk);
+            // 保留日志只能用游标读取
+            return (int)(ShmQueErrorCode::QueueNotSupported);
         }
-        if (dataSize <= sizeof(DATA_SIZE_TYPE))
+        if (_controlBlock->overwrite)
         {
-            // 数据长度小于存储长度的固定字段
-            //  log
-            std::cout << "PopMessage failed ," << errorCode2String(ShmQueErrorCode::QueueDataError) << std::endl;
-            // 打印一下队列的info
-            std::cout << PrintShmQueInfo();
-            // 修复一下错误---清空数据进行修复
-            _controlBlock->headIdx = _controlBlock->tailIdx;
-            return (int)(ShmQueErrorCode::QueueDataError);
+            return readHeadOverwrite(buffer, bufLength, true);
         }
-        // 1.拿到长度字段
-        DATA_SIZE_TYPE tmpLength;
-        BYTE *tmpSrc = _quePtr;
-        int tmphead = _controlBlock->headIdx;
-        for (int i = 0; i < sizeof(DATA_SIZE_TYPE); i++)
+        // tail用acquire读: 与生产者的release写配对,读到的tail之前的数据都已经写入完毕
+        // head只有持有head锁的消费者修改---relaxed即可
+        uint64_t tmptail = _headCb->tailIdx.load(std::memory_order_acquire);
+        uint64_t tmphead = _headCb->headIdx.load(std::memory_order_relaxed);
+        while (tmphead == tmptail)
         {
-            // 生产消费一定在同一台主机上---不需要考虑大小端问题
-            ((BYTE *)(&tmpLength))[i] = tmpSrc[tmphead];
-            tmphead = (tmphead + 1) & (_controlBlock->queSize - 1); // 可能在头尾
+            // 没有数据---旧ring读完后跟随到扩缩容产生的新ring
+            if (!followHeadRing(tmphead))
+                return (int)(ShmQueErrorCode::QueueOk);
+            tmptail = _headCb->tailIdx.load(std::memory_order_acquire);
+            tmphead = _headCb->headIdx.load(std::memory_order_relaxed);
         }
-        // 2.判断长度字段是否合法
-        if (tmpLength <= 0 || tmpLength > dataSize - sizeof(DATA_SIZE_TYPE))
+        // 1.拿到并校验记录头部
+        ShmRecordHeader header;
+        int ret = checkHeadRecord(tmphead, tmptail, header, tmphead);
+        if (ret != 0)
         {
-            // log
-            std::cout << "PopMessage failed ," << errorCode2String(ShmQueErrorCode::QueueDataLengthError) << std::endl;
-            // 打印队列信息
-            std::cout << PrintShmQueInfo();
-            // 非法长度---清空数据进行修复
-            _controlBlock->headIdx = _controlBlock->tailIdx;
-            return (int)(ShmQueErrorCode::QueueDataLengthError);
+            return ret;
+        }
+        if (header.commit == RECORD_DESC_MAGIC)
+        {
+            // 大消息---从slab拷贝出数据后释放块
+            ShmLargeDesc desc;
+            ret = readLarge(tmphead, header.length, buffer, bufLength, desc);
+            if (ret == (int)(ShmQueErrorCode::QueueBufferLengthInsufficient))
+                return ret;
+            _headCb->headIdx.store(tmphead + header.length, std::memory_order_release);
+            notifySpace();
+            if (ret > 0)
+                _slab->Free(_slab->Ptr(desc.offset));
+            return ret;
         }
-        if (tmpLength > bufLength)
+        // 流分片只返回分片数据(帧信息通过PopStream获取),压缩记录解压到buffer
+        ret = readRecordData(header, tmphead, buffer, bufLength);
+        if (ret == (int)(ShmQueErrorCode::QueueBufferLengthInsufficient))
         {
             // 传入缓冲区大小不足
             // log
             std::cout << "PopMessage failed ," << errorCode2String(ShmQueErrorCode::QueueBufferLengthInsufficient) << std::endl;
-            return (int)(ShmQueErrorCode::QueueBufferLengthInsufficient);
+            return ret;
         }
-        // 缓冲区大小足够---开始获取data
-        DATA_SIZE_TYPE part1Size = std::min(tmpLength, _controlBlock->queSize - tmphead);
-        memcpy(buffer, (const void *)(tmpSrc + tmphead), (size_t)part1Size);
-        DATA_SIZE_TYPE part2Size = tmpLength - part1Size;
-        if (part2Size > 0)
+        // 消息Pop完毕(解压失败的损坏记录同样跳过)，修改head位置---release保证数据读取完毕之后生产者才能覆盖这块空间
+        tmphead += header.length;
+        _headCb->headIdx.store(tmphead, std::memory_order_release);
+        notifySpace();
+        // 预取下一条记录的头部和消息开头,下一次Pop时大概率已经在cache中
+        if (_controlBlock->prefetchLines > 0 && tmphead != tmptail)
         {
-            // 数据分布在头尾
-            memcpy((void *)((BYTE *)(buffer) + part1Size), (const void *)(tmpSrc), part2Size);
+            size_t idx = tmphead & (_headCb->queSize - 1);
+            ShmPrefetch(_headQue + idx, std::min(_controlBlock->prefetchLines,
+                                                 (int)((_headCb->queSize - idx + CPU_CACHELINE_SIZE - 1) / CPU_CACHELINE_SIZE)));
         }
-        // 消息Pop完毕，修改head索引前先要保证数据全部Pop完毕，使用写内存屏障保证
-        sfence();
-        // 修改head索引
-        _controlBlock->headIdx = (tmphead + tmpLength) & (_controlBlock->queSize - 1);
-        return tmpLength;
+        return ret;
     }
     // 获取消息拷贝---不改变索引位置
     int ShmQueue::PeekHeadMessage(void *buffer, size_t bufLength)
@@ -229,113 +882,1190 @@ namespace xten
             std::cout << errorCode2String(ShmQueErrorCode::QueueParameterInvaild) << std::endl;
             return (int)(ShmQueErrorCode::QueueParameterInvaild);
         }
+        deliverTimers(false);
+        // 锁
+        WLockGuard lock(_headMtx);
+        if (_controlBlock->retained)
+        {
+            // 保留日志只能用游标读取
+            return (int)(ShmQueErrorCode::QueueNotSupported);
+        }
+        if (_controlBlock->overwrite)
+        {
+            return readHeadOverwrite(buffer, bufLength, false);
+        }
+        uint64_t tmptail = _headCb->tailIdx.load(std::memory_order_acquire);
+        uint64_t tmphead = _headCb->headIdx.load(std::memory_order_relaxed);
+        while (tmphead == tmptail)
+        {
+            // 没有数据---旧ring读完后跟随到扩缩容产生的新ring
+            if (!followHeadRing(tmphead))
+                return (int)(ShmQueErrorCode::QueueOk);
+            tmptail = _headCb->tailIdx.load(std::memory_order_acquire);
+            tmphead = _headCb->headIdx.load(std::memory_order_relaxed);
+        }
+        // 1.拿到并校验记录头部
+        ShmRecordHeader header;
+        int ret = checkHeadRecord(tmphead, tmptail, header, tmphead);
+        if (ret != 0)
+        {
+            return ret;
+        }
+        if (header.commit == RECORD_DESC_MAGIC)
+        {
+            // 大消息---只拷贝,不释放块
+            ShmLargeDesc desc;
+            ret = readLarge(tmphead, header.length, buffer, bufLength, desc);
+            if (ret == (int)(ShmQueErrorCode::QueueDataLengthError))
+            {
+                _headCb->headIdx.store(tmphead + header.length, std::memory_order_release); // 跳过损坏的描述符
+                notifySpace();
+            }
+            return ret;
+        }
+        ret = readRecordData(header, tmphead, buffer, bufLength);
+        if (ret == (int)(ShmQueErrorCode::QueueBufferLengthInsufficient))
+        {
+            // 传入缓冲区大小不足
+            // log
+            std::cout << "PopMessage failed ," << errorCode2String(ShmQueErrorCode::QueueBufferLengthInsufficient) << std::endl;
+        }
+        else if (ret == (int)(ShmQueErrorCode::QueueDataLengthError))
+        {
+            _headCb->headIdx.store(tmphead + header.length, std::memory_order_release); // 跳过解压失败的记录
+            notifySpace();
+        }
+        return ret;
+    }
+    // 删除头部消息---改变索引位置
+    int ShmQueue::DelHeadMessage()
+    {
+        // 锁
+        WLockGuard lock(_headMtx);
+        if (_controlBlock->retained)
+        {
+            return (int)(ShmQueErrorCode::QueueNotSupported);
+        }
+        if (_controlBlock->overwrite)
+        {
+            return readHeadOverwrite(nullptr, 0, true);
+        }
+        uint64_t tmptail = _headCb->tailIdx.load(std::memory_order_acquire);
+        uint64_t tmphead = _headCb->headIdx.load(std::memory_order_relaxed);
+        while (tmphead == tmptail)
+        {
+            // 没有数据---旧ring读完后跟随到扩缩容产生的新ring
+            if (!followHeadRing(tmphead))
+                return (int)(ShmQueErrorCode::QueueOk);
+            tmptail = _headCb->tailIdx.load(std::memory_order_acquire);
+            tmphead = _headCb->headIdx.load(std::memory_order_relaxed);
+        }
+        // 1.拿到并校验记录头部
+        ShmRecordHeader header;
+        int ret = checkHeadRecord(tmphead, tmptail, header, tmphead);
+        if (ret != 0)
+        {
+            return ret;
+        }
+        if (header.commit == RECORD_DESC_MAGIC)
+        {
+            // 大消息---先读出描述符再移动head,然后释放slab中的块
+            ShmLargeDesc desc;
+            ret = readLarge(tmphead, header.length, nullptr, 0, desc);
+            _headCb->headIdx.store(tmphead + header.length, std::memory_order_release);
+            notifySpace();
+            if (ret > 0)
+                _slab->Free(_slab->Ptr(desc.offset));
+            return ret;
+        }
+        // 修改head位置代替删除操作
+        ret = (int)recordMessageLength(header, tmphead);
+        _headCb->headIdx.store(tmphead + header.length, std::memory_order_release);
+        notifySpace();
+        return ret;
+    }
+    // 零拷贝取出消息
+    int ShmQueue::PopMessageView(ShmMsgView &view)
+    {
+        // 复用视图时先释放上一条消息
+        ReleaseView(view);
+        if (_controlBlock->overwrite || _controlBlock->retained)
+        {
+            // 覆盖模式下ring中的数据随时可能被覆盖,不能提供视图; 保留日志只能用游标读取
+            return (int)(ShmQueErrorCode::QueueNotSupported);
+        }
+        deliverTimers(false);
+        // 锁
+        WLockGuard lock(_headMtx);
+        uint64_t tmptail = _headCb->tailIdx.load(std::memory_order_acquire);
+        uint64_t tmphead = _headCb->headIdx.load(std::memory_order_relaxed);
+        while (tmphead == tmptail)
+        {
+            // 没有数据---旧ring读完后跟随到扩缩容产生的新ring
+            if (!followHeadRing(tmphead))
+                return (int)(ShmQueErrorCode::QueueOk);
+            tmptail = _headCb->tailIdx.load(std::memory_order_acquire);
+            tmphead = _headCb->headIdx.load(std::memory_order_relaxed);
+        }
+        // 1.拿到并校验记录头部
+        ShmRecordHeader header;
+        int ret = checkHeadRecord(tmphead, tmptail, header, tmphead);
+        if (ret != 0)
+        {
+            return ret;
+        }
+        if (header.commit == RECORD_DESC_MAGIC)
+        {
+            // 大消息---视图直接指向slab中的数据,块在ReleaseView时释放
+            ShmLargeDesc desc;
+            ret = readLarge(tmphead, header.length, nullptr, 0, desc);
+            if (ret > 0)
+            {
+                view.data = _slab->Ptr(desc.offset);
+                view.length = desc.length;
+                view.block = desc.offset;
+            }
+        }
+        else
+        {
+            // 小消息---拷贝(解压)到视图自己的缓冲区,ring中的空间马上归还给生产者
+            view.inlineBuf.resize(recordMessageLength(header, tmphead));
+            ret = readRecordData(header, tmphead, view.inlineBuf.data(), view.inlineBuf.size());
+            if (ret >= 0)
+            {
+                view.data = view.inlineBuf.data();
+                view.length = ret;
+            }
+        }
+        _headCb->headIdx.store(tmphead + header.length, std::memory_order_release);
+        notifySpace();
+        return ret;
+    }
+    // 释放视图
+    void ShmQueue::ReleaseView(ShmMsgView &view)
+    {
+        if (view.block && _slab)
+            _slab->Free(_slab->Ptr(view.block));
+        view.data = nullptr;
+        view.length = 0;
+        view.block = 0;
+    }
+    // 从fd读取一条消息
+    int ShmQueue::PushFromFd(int fd, size_t maxLen, uint16_t topic)
+    {
+        if (fd < 0 || maxLen <= 0 || maxLen > recordMaxLength())
+        {
+            std::cout << errorCode2String(ShmQueErrorCode::QueueParameterInvaild) << std::endl;
+            return (int)(ShmQueErrorCode::QueueParameterInvaild);
+        }
+        // 返回值是读到的字节数---超过INT_MAX会和错误码混淆
+        maxLen = std::min(maxLen, (size_t)INT_MAX);
+        deliverTimers(true);
+        if (_spill && _spill->Active())
+        {
+            // 溢出层中还有更早的消息---数据留在fd中,等溢出层回放完
+            return (int)(ShmQueErrorCode::QueueNoFreeSize);
+        }
+        ssize_t n;
+        if (_controlBlock->overwrite)
+        {
+            // 覆盖模式: 按maxLen预留会在读之前丢弃旧记录(即使最后没有读到数据)
+            // 先读到本线程的临时缓冲区,再按实际长度放入,只为读到的数据腾出空间
+            maxLen = std::min(maxLen, _controlBlock->queSize - REMAIN_SIZE - recordHeaderSize());
+            std::vector<BYTE> &buf = lzScratch(0);
+            buf.resize(maxLen);
+            do
+            {
+                n = read(fd, buf.data(), maxLen);
+            } while (n < 0 && errno == EINTR);
+            if (n < 0)
+                return (errno == EAGAIN || errno == EWOULDBLOCK) ? (int)(ShmQueErrorCode::QueueOk) : (int)(ShmQueErrorCode::QueueFdError);
+            if (n == 0)
+                return (int)(ShmQueErrorCode::QueueFdClosed);
+            int ret = pushRecord(buf.data(), n, RECORD_COMMIT_MAGIC, topic);
+            return ret == 0 ? (int)n : ret;
+        }
+        WLockGuard lock(_tailMtx);
+        // 1.预留空间---最多预留当前的空闲空间,ring快满时读一条短一些的消息而不是失败
+        //   没有空闲空间时按maxLen预留(保留日志模式下可以回收水位之前的记录)
+        size_t freeSize = getFreeSize(_tailCb->headIdx.load(std::memory_order_acquire),
+                                      _tailCb->tailIdx.load(std::memory_order_relaxed));
+        if (freeSize > recordHeaderSize())
+            maxLen = std::min(maxLen, freeSize - recordHeaderSize());
+        uint64_t tmptail;
+        int ret = reserveTail(maxLen + recordHeaderSize(), tmptail);
+        if (ret != 0)
+            return ret;
+        // 2.直接读入ring---预留的空间可能分布在头尾
+        uint64_t dataPos = tmptail + recordHeaderSize();
+        size_t idx = dataPos & (_tailCb->queSize - 1);
+        size_t part1Size = std::min(maxLen, _tailCb->queSize - idx);
+        struct iovec iov[2];
+        iov[0].iov_base = _tailQue + idx;
+        iov[0].iov_len = part1Size;
+        iov[1].iov_base = _tailQue;
+        iov[1].iov_len = maxLen - part1Size;
+        do
+        {
+            n = readv(fd, iov, part1Size < maxLen ? 2 : 1);
+        } while (n < 0 && errno == EINTR);
+        if (n < 0)
+        {
+            if (errno == EAGAIN || errno == EWOULDBLOCK)
+                return (int)(ShmQueErrorCode::QueueOk);
+            return (int)(ShmQueErrorCode::QueueFdError);
+        }
+        if (n == 0)
+            return (int)(ShmQueErrorCode::QueueFdClosed);
+        // 3.按实际读到的长度写入头部并发布---预留但没有用到的空间留给下一条记录
+        ShmRecordHeader header;
+        header.commit = RECORD_COMMIT_MAGIC;
+        header.length = (uint32_t)n;
+        header.topic = topic;
+        header.reserved = 0;
+        header.crc = recordHeaderCrc(header);
+        writeRecordHeader(tmptail, header);
+        publishRecord(tmptail, dataPos + n);
+        return (int)n;
+    }
+    // 把iov中的数据全部写到fd on success ret=0 ; on failed ret<0 written是已经写出的字节数
+    static int writevAll(int fd, struct iovec *iov, int iovcnt, size_t &written)
+    {
+        written = 0;
+        while (iovcnt > 0)
+        {
+            ssize_t n = writev(fd, iov, iovcnt);
+            if (n < 0)
+            {
+                if (errno == EINTR)
+                    continue;
+                if ((errno == EAGAIN || errno == EWOULDBLOCK) && written > 0)
+                {
+                    // 已经写出一部分---等待可写,不能在字节流中留下半条消息
+                    // 等待期间持有head锁: 对端一直不读时超时返回,不让所有消费者无限期阻塞
+                    struct pollfd pfd = {fd, POLLOUT, 0};
+                    int ready;
+                    do
+                    {
+                        ready = poll(&pfd, 1, SHM_FD_WRITE_TIMEOUT_MS);
+                    } while (ready < 0 && errno == EINTR);
+                    if (ready == 0)
+                        return (int)(ShmQueErrorCode::QueueTimeout);
+                    continue;
+                }
+                return (int)(ShmQueErrorCode::QueueFdError);
+            }
+            written += n;
+            // 跳过已经写完的段
+            while (iovcnt > 0 && (size_t)n >= iov->iov_len)
+            {
+                n -= iov->iov_len;
+                iov++;
+                iovcnt--;
+            }
+            if (iovcnt > 0)
+            {
+                iov->iov_base = (BYTE *)iov->iov_base + n;
+                iov->iov_len -= n;
+            }
+        }
+        return (int)(ShmQueErrorCode::QueueOk);
+    }
+    // 取出一条消息写到fd
+    int ShmQueue::PopToFd(int fd)
+    {
+        if (fd < 0)
+        {
+            std::cout << errorCode2String(ShmQueErrorCode::QueueParameterInvaild) << std::endl;
+            return (int)(ShmQueErrorCode::QueueParameterInvaild);
+        }
+        if (_controlBlock->overwrite || _controlBlock->retained)
+        {
+            // 覆盖模式下写出期间数据可能被覆盖; 保留日志只能用游标读取
+            return (int)(ShmQueErrorCode::QueueNotSupported);
+        }
+        deliverTimers(false);
+        // 锁
+        WLockGuard lock(_headMtx);
+        uint64_t tmptail = _headCb->tailIdx.load(std::memory_order_acquire);
+        uint64_t tmphead = _headCb->headIdx.load(std::memory_order_relaxed);
+        while (tmphead == tmptail)
+        {
+            // 没有数据---旧ring读完后跟随到扩缩容产生的新ring
+            if (!followHeadRing(tmphead))
+                return (int)(ShmQueErrorCode::QueueOk);
+            tmptail = _headCb->tailIdx.load(std::memory_order_acquire);
+            tmphead = _headCb->headIdx.load(std::memory_order_relaxed);
+        }
+        // 1.拿到并校验记录头部
+        ShmRecordHeader header;
+        int ret = checkHeadRecord(tmphead, tmptail, header, tmphead);
+        if (ret != 0)
+        {
+            return ret;
+        }
+        // 2.消息数据所在的位置: slab中的一段,或者ring中的一段/头尾两段
+        struct iovec iov[2];
+        int iovcnt = 1;
+        ShmLargeDesc desc;
+        bool large = header.commit == RECORD_DESC_MAGIC;
+        if (large)
+        {
+            ret = readLarge(tmphead, header.length, nullptr, 0, desc);
+            if (ret < 0)
+                return ret;
+            iov[0].iov_base = _slab->Ptr(desc.offset);
+            iov[0].iov_len = desc.length;
+        }
+        else if (header.commit == RECORD_LZ_MAGIC)
+        {
+            // 压缩记录---解压到临时缓冲区后写出
+            std::vector<BYTE> &raw = lzScratch(1);
+            raw.resize(recordMessageLength(header, tmphead));
+            ret = readRecordData(header, tmphead, raw.data(), raw.size());
+            iov[0].iov_base = raw.data();
+            iov[0].iov_len = ret > 0 ? ret : 0;
+        }
+        else
+        {
+            // 流分片---只写出分片数据
+            size_t frameLength = header.commit == RECORD_FRAG_MAGIC ? sizeof(ShmFrameHeader) : 0;
+            size_t length = header.length - frameLength;
+            size_t idx = (tmphead + frameLength) & (_headCb->queSize - 1);
+            size_t part1Size = std::min(length, _headCb->queSize - idx);
+            iov[0].iov_base = _headQue + idx;
+            iov[0].iov_len = part1Size;
+            iov[1].iov_base = _headQue;
+            iov[1].iov_len = length - part1Size;
+            if (part1Size < length)
+                iovcnt = 2;
+            ret = (int)length;
+        }
+        // 3.写出---一个字节都没有写出时消息留在队列中; 解压失败的损坏记录直接跳过
+        size_t written = 0;
+        int wret = ret > 0 ? writevAll(fd, iov, iovcnt, written) : 0;
+        if (wret != 0 && written == 0)
+        {
+            return wret;
+        }
+        // 写出一部分后fd出错或者等待超时---字节流已经不完整,丢弃这条消息
+        // 4.写完之后才归还空间---release保证写出期间生产者不会覆盖
+        _headCb->headIdx.store(tmphead + header.length, std::memory_order_release);
+        notifySpace();
+        if (large)
+            _slab->Free(_slab->Ptr(desc.offset));
+        if (ret < 0)
+            return ret;
+        return wret == 0 ? ret : wret;
+    }
+    // 生产者在slab中分配消息
+    int ShmQueue::AllocMessageView(size_t length, ShmMsgView &view)
+    {
+        if (!_slab)
+        {
+            return (int)(ShmQueErrorCode::QueueNotSupported);
+        }
+        if (length == 0)
+        {
+            std::cout << errorCode2String(ShmQueErrorCode::QueueParameterInvaild) << std::endl;
+            return (int)(ShmQueErrorCode::QueueParameterInvaild);
+        }
+        ReleaseView(view);
+        void *data = _slab->Alloc(length);
+        if (!data)
+        {
+            return (int)(ShmQueErrorCode::QueueNoFreeSize);
+        }
+        view.data = data;
+        view.length = length;
+        view.block = _slab->Offset(data);
+        return (int)(ShmQueErrorCode::QueueOk);
+    }
+    // 把slab中的消息放入队列
+    int ShmQueue::PushMessageView(ShmMsgView &view, uint16_t topic)
+    {
+        if (!_slab || !view.block || view.length == 0)
+        {
+            std::cout << errorCode2String(ShmQueErrorCode::QueueParameterInvaild) << std::endl;
+            return (int)(ShmQueErrorCode::QueueParameterInvaild);
+        }
+        // 溢出层中还有更早的消息---描述符不能越过它们,视图仍归调用者,稍后重试
+        if (_spill && _spill->Active())
+            return (int)(ShmQueErrorCode::QueueNoFreeSize);
+        ShmLargeDesc desc;
+        desc.offset = view.block;
+        desc.length = view.length;
+        int ret = pushRecord(&desc, sizeof(desc), RECORD_DESC_MAGIC, topic);
+        if (ret == 0)
+        {
+            // 块的所有权交给消费者
+            view.data = nullptr;
+            view.length = 0;
+            view.block = 0;
+        }
+        return ret;
+    }
+    // 流式放入大消息
+    int ShmQueue::PushStream(uint32_t streamId, const void *data, size_t length, uint32_t flags, int timeoutMs)
+    {
+        if (streamId == SHM_STREAM_NONE || (!data && length > 0))
+        {
+            std::cout << errorCode2String(ShmQueErrorCode::QueueParameterInvaild) << std::endl;
+            return (int)(ShmQueErrorCode::QueueParameterInvaild);
+        }
+        if (_controlBlock->overwrite || _controlBlock->retained)
+        {
+            // 覆盖模式会丢弃中间的分片,流无法重组; 保留日志没有消费者腾出空间,分片大小无法按空闲空间切分
+            return (int)(ShmQueErrorCode::QueueNotSupported);
+        }
+        const size_t overhead = recordHeaderSize() + sizeof(ShmFrameHeader);
+        auto start = std::chrono::steady_clock::now();
+        size_t sent = 0;
+        int idle = 0;
+        while (true)
+        {
+            // 1.按生产者ring当前的空闲空间决定分片大小---扩缩容后pushRecord会切换ring,这里只是估计
+            size_t queSize = _tailCb->queSize;
+            size_t freeSize = getFreeSize(_tailCb->headIdx.load(std::memory_order_acquire),
+                                          _tailCb->tailIdx.load(std::memory_order_acquire));
+            size_t remain = length - sent;
+            size_t chunk = freeSize > overhead ? std::min(remain, freeSize - overhead) : 0;
+            chunk = std::min(chunk, recordMaxLength() - sizeof(ShmFrameHeader));
+            // 放不下剩余数据时至少等到一个最小分片的空间,避免切出大量很小的分片
+            size_t minChunk = std::min((size_t)SHM_STREAM_MIN_FRAGMENT, (queSize - REMAIN_SIZE - overhead) / 2);
+            if (chunk < remain && chunk < minChunk)
+                chunk = 0;
+            // 溢出层中还有更早的消息---分片不能越过它们,和ring满一样等待回放
+            bool spilled = _spill && _spill->Active();
+            if (!spilled && (chunk > 0 || remain == 0))
+            {
+                ShmFrameHeader frame;
+                frame.streamId = streamId;
+                frame.flags = (sent == 0 ? (flags & SHM_FRAME_FIRST) : 0) | (chunk == remain ? (flags & SHM_FRAME_LAST) : 0);
+                int ret = pushRecord((const BYTE *)data + sent, chunk, RECORD_FRAG_MAGIC, SHM_TOPIC_NONE, &frame, sizeof(frame));
+                if (ret == 0)
+                {
+                    sent += chunk;
+                    idle = 0;
+                    if (sent == length)
+                        return (int)(ShmQueErrorCode::QueueOk);
+                    continue;
+                }
+                // 空间被其他生产者抢先占用---继续等待
+                if (ret != (int)(ShmQueErrorCode::QueueNoFreeSize))
+                    return ret;
+            }
+            // 2.背压: 等待消费者腾出空间
+            if (timeoutMs >= 0 && std::chrono::steady_clock::now() - start >= std::chrono::milliseconds(timeoutMs))
+            {
+                return (int)(ShmQueErrorCode::QueueNoFreeSize);
+            }
+            if (++idle < SHM_STREAM_SPIN_COUNT)
+                std::this_thread::yield();
+            else
+                usleep(SHM_STREAM_SLEEP_US);
+        }
+    }
+    // 取出一条记录交给回调
+    int ShmQueue::PopStream(const ShmStreamCallback &cb)
+    {
+        if (!cb)
+        {
+            std::cout << errorCode2String(ShmQueErrorCode::QueueParameterInvaild) << std::endl;
+            return (int)(ShmQueErrorCode::QueueParameterInvaild);
+        }
+        if (_controlBlock->overwrite || _controlBlock->retained)
+        {
+            // 覆盖模式下ring中的数据随时可能被覆盖,不能原地交给回调; 保留日志只能用游标读取
+            return (int)(ShmQueErrorCode::QueueNotSupported);
+        }
+        deliverTimers(false);
         // 锁
         WLockGuard lock(_headMtx);
-        size_t dataSize = getDataSize();
-        if (dataSize == 0)
+        uint64_t tmptail = _headCb->tailIdx.load(std::memory_order_acquire);
+        uint64_t tmphead = _headCb->headIdx.load(std::memory_order_relaxed);
+        while (tmphead == tmptail)
+        {
+            // 没有数据---旧ring读完后跟随到扩缩容产生的新ring
+            if (!followHeadRing(tmphead))
+                return (int)(ShmQueErrorCode::QueueOk);
+            tmptail = _headCb->tailIdx.load(std::memory_order_acquire);
+            tmphead = _headCb->headIdx.load(std::memory_order_relaxed);
+        }
+        // 1.拿到并校验记录头部
+        ShmRecordHeader header;
+        int ret = checkHeadRecord(tmphead, tmptail, header, tmphead);
+        if (ret != 0)
+        {
+            return ret;
+        }
+        ShmFrameInfo info;
+        if (header.commit == RECORD_DESC_MAGIC)
+        {
+            // 大消息---slab中的数据交给回调后释放块
+            ShmLargeDesc desc;
+            ret = readLarge(tmphead, header.length, nullptr, 0, desc);
+            if (ret > 0)
+                cb(info, _slab->Ptr(desc.offset), desc.length);
+            _headCb->headIdx.store(tmphead + header.length, std::memory_order_release);
+            notifySpace();
+            if (ret > 0)
+                _slab->Free(_slab->Ptr(desc.offset));
+            return ret;
+        }
+        if (header.commit == RECORD_LZ_MAGIC)
+        {
+            // 压缩记录---解压后一次交给回调
+            std::vector<BYTE> &raw = lzScratch(1);
+            raw.resize(recordMessageLength(header, tmphead));
+            ret = readRecordData(header, tmphead, raw.data(), raw.size());
+            if (ret > 0)
+                cb(info, raw.data(), ret);
+            _headCb->headIdx.store(tmphead + header.length, std::memory_order_release);
+            notifySpace();
+            return ret;
+        }
+        uint64_t dataPos = tmphead;
+        size_t length = header.length;
+        if (header.commit == RECORD_FRAG_MAGIC)
         {
-            // 没有数据
+            ShmFrameHeader frame;
+            copyFromQueue(&frame, dataPos, sizeof(frame));
+            info.streamId = frame.streamId;
+            info.flags = frame.flags;
+            dataPos += sizeof(frame);
+            length -= sizeof(frame);
+        }
+        // 2.数据原地交给回调---分布在头尾时拆成两个分片,FIRST/LAST分别只留在前/后一个分片上
+        size_t idx = dataPos & (_headCb->queSize - 1);
+        size_t part1Size = std::min(length, _headCb->queSize - idx);
+        if (part1Size < length)
+        {
+            ShmFrameInfo part = info;
+            part.flags &= ~SHM_FRAME_LAST;
+            cb(part, _headQue + idx, part1Size);
+            part.flags = info.flags & ~SHM_FRAME_FIRST;
+            cb(part, _headQue, length - part1Size);
+        }
+        else
+        {
+            cb(info, _headQue + idx, length);
+        }
+        // 3.回调返回后才归还空间给生产者
+        _headCb->headIdx.store(tmphead + header.length, std::memory_order_release);
+        notifySpace();
+        return (int)length;
+    }
+    // 取出记录并重组流
+    int ShmQueue::PopStreamMessage(std::vector<BYTE> &message, uint32_t &streamId)
+    {
+        while (true)
+        {
+            bool popped = false;
+            bool done = false;
+            int ret = PopStream([&](const ShmFrameInfo &info, const void *data, size_t length)
+                                {
+                popped = true;
+                std::vector<BYTE> &buf = _streams[info.streamId];
+                // 新的流开始---丢弃同一个streamId上没有结束的旧数据(生产者中途放弃)
+                if (info.flags & SHM_FRAME_FIRST)
+                    buf.clear();
+                buf.insert(buf.end(), (const BYTE *)data, (const BYTE *)data + length);
+                if (info.flags & SHM_FRAME_LAST)
+                {
+                    message.swap(buf);
+                    _streams.erase(info.streamId);
+                    streamId = info.streamId;
+                    done = true;
+                } });
+            if (ret < 0)
+                return ret;
+            if (done)
+                return (int)message.size();
+            // 没有更多记录,流还没有完整
+            if (!popped)
+                return (int)(ShmQueErrorCode::QueueOk);
+        }
+    }
+    // 打开广播游标
+    int ShmQueue::OpenCursor(ShmCursor &cursor, bool fromHead)
+    {
+        if (_controlBlock->nextShmId.load(std::memory_order_acquire) != -1)
+        {
+            // 扩缩容后位置在不同的ring之间不连续
+            return (int)(ShmQueErrorCode::QueueNotSupported);
+        }
+        cursor = ShmCursor();
+        if (_log)
+        {
+            // 保留日志: 位置和序号一起取
+            uint64_t head, headSeq, tail, tailSeq;
+            logSnapshot(head, headSeq, tail, tailSeq);
+            cursor.pos = fromHead ? head : tail;
+            cursor.seq = fromHead ? headSeq : tailSeq;
             return (int)(ShmQueErrorCode::QueueOk);
         }
-        if (dataSize <= sizeof(DATA_SIZE_TYPE))
+        cursor.pos = fromHead ? _controlBlock->headIdx.load(std::memory_order_acquire)
+                              : _controlBlock->tailIdx.load(std::memory_order_acquire);
+        return (int)(ShmQueErrorCode::QueueOk);
+    }
+    // 保留日志: 移动游标到序号seq
+    // 先从稀疏索引取seq之前最近的索引点,索引点不可用(在head之前或者正在被覆盖)时从head开始,
+    // 再逐条跳过记录头部; 最后和ReadCursor一样检查head没有越过起始位置
+    int ShmQueue::Seek(ShmCursor &cursor, uint64_t seq)
+    {
+        if (!_log)
         {
-            // 数据长度小于存储长度的固定字段
-            //  log
-            std::cout << "PopMessage failed ," << errorCode2String(ShmQueErrorCode::QueueDataError) << std::endl;
-            // 打印一下队列的info
-            std::cout << PrintShmQueInfo();
-            // 修复一下错误---清空数据进行修复
-            _controlBlock->headIdx = _controlBlock->tailIdx;
-            return (int)(ShmQueErrorCode::QueueDataError);
+            return (int)(ShmQueErrorCode::QueueNotSupported);
+        }
+        while (true)
+        {
+            uint64_t head, headSeq, tail, tailSeq;
+            logSnapshot(head, headSeq, tail, tailSeq);
+            if (seq < headSeq || seq > tailSeq)
+            {
+                return (int)(ShmQueErrorCode::QueueSeqNotRetained);
+            }
+            // 1.索引定位
+            uint64_t pos = head;
+            uint64_t curSeq = headSeq;
+            uint64_t indexSeq = seq - seq % _log->indexInterval;
+            if (indexSeq > headSeq)
+            {
+                const ShmLogIndexEntry &entry = _logIndex[(indexSeq / _log->indexInterval) & (_log->indexCapacity - 1)];
+                uint64_t entrySeq = entry.seq.load(std::memory_order_acquire);
+                uint64_t entryPos = entry.pos.load(std::memory_order_relaxed);
+                std::atomic_thread_fence(std::memory_order_acquire);
+                if (entrySeq == indexSeq && entry.seq.load(std::memory_order_relaxed) == entrySeq &&
+                    entryPos >= head && entryPos <= tail)
+                {
+                    pos = entryPos;
+                    curSeq = indexSeq;
+                }
+            }
+            // 2.跳过不到indexInterval条记录---只读头部
+            uint64_t start = pos;
+            bool corrupt = false;
+            while (curSeq < seq)
+            {
+                ShmRecordHeader header;
+                readRecordHeader(pos, header);
+                if (tail - pos <= recordHeaderSize() || !recordCommitted(header.commit) || header.length == 0 ||
+                    header.length > tail - pos - recordHeaderSize())
+                {
+                    corrupt = true;
+                    break;
+                }
+                pos += recordHeaderSize() + header.length;
+                curSeq++;
+            }
+            // 3.扫描期间起始位置之后的记录被回收---重新定位
+            std::atomic_thread_fence(std::memory_order_acquire);
+            if (_controlBlock->headIdx.load(std::memory_order_relaxed) > start)
+                continue;
+            if (corrupt)
+            {
+                std::cout << "Seek failed ," << errorCode2String(ShmQueErrorCode::QueueDataLengthError) << std::endl;
+                return (int)(ShmQueErrorCode::QueueDataLengthError);
+            }
+            cursor.pos = pos;
+            cursor.seq = seq;
+            return (int)(ShmQueErrorCode::QueueOk);
+        }
+    }
+    // 保留日志: 推进保留水位
+    int ShmQueue::SetRetainSeq(uint64_t seq)
+    {
+        if (!_log)
+        {
+            return (int)(ShmQueErrorCode::QueueNotSupported);
+        }
+        uint64_t cur = _log->retainSeq.load(std::memory_order_relaxed);
+        while (cur < seq && !_log->retainSeq.compare_exchange_weak(cur, seq, std::memory_order_release, std::memory_order_relaxed))
+        {
+        }
+        return (int)(ShmQueErrorCode::QueueOk);
+    }
+    int ShmQueue::GetLogRange(uint64_t &headSeq, uint64_t &tailSeq) const
+    {
+        if (!_log)
+        {
+            return (int)(ShmQueErrorCode::QueueNotSupported);
+        }
+        uint64_t head, tail;
+        logSnapshot(head, headSeq, tail, tailSeq);
+        return (int)(ShmQueErrorCode::QueueOk);
+    }
+    // 用游标读取下一条订阅主题的消息
+    // 游标不持有任何锁: 先扫描/拷贝,最后检查head没有越过游标的起始位置---
+    // 生产者只会覆盖head之前的空间,head<=起始位置说明读到的头部和数据都没有被覆盖(和覆盖模式的校验相同)
+    int ShmQueue::ReadCursor(ShmCursor &cursor, void *buffer, size_t bufLength, const ShmTopicSet *topics, uint16_t *topic)
+    {
+        if (!buffer || bufLength <= 0)
+        {
+            std::cout << errorCode2String(ShmQueErrorCode::QueueParameterInvaild) << std::endl;
+            return (int)(ShmQueErrorCode::QueueParameterInvaild);
+        }
+        if (_controlBlock->nextShmId.load(std::memory_order_acquire) != -1)
+        {
+            return (int)(ShmQueErrorCode::QueueNotSupported);
+        }
+        deliverTimers(false);
+        while (true)
+        {
+            uint64_t tmphead = _controlBlock->headIdx.load(std::memory_order_acquire);
+            uint64_t tmptail = _controlBlock->tailIdx.load(std::memory_order_acquire);
+            if (cursor.pos < tmphead)
+            {
+                // 被套圈---游标之后的数据已经被覆盖,跳到最老的数据
+                cursor.pos = tmphead;
+                cursor.lapped++;
+                if (_log)
+                {
+                    // 保留日志: 位置和序号一起取
+                    uint64_t tailSeq;
+                    logSnapshot(cursor.pos, cursor.seq, tmptail, tailSeq);
+                }
+            }
+            else if (cursor.pos > tmptail)
+            {
+                // 游标不属于这个队列(或者队列被重新初始化)
+                cursor.pos = tmptail;
+                if (_log)
+                {
+                    uint64_t headSeq;
+                    logSnapshot(tmphead, headSeq, tmptail, cursor.seq);
+                    cursor.pos = tmptail;
+                }
+            }
+            // 1.批量扫描记录头部: 跳过不订阅的记录,直到找到匹配的记录或者扫描到tail
+            uint64_t pos = cursor.pos;
+            uint64_t skipped = 0;
+            ShmRecordHeader header;
+            bool found = false;
+            bool corrupt = false;
+            while (pos != tmptail)
+            {
+                readRecordHeader(pos, header);
+                if (tmptail - pos <= recordHeaderSize() || !recordCommitted(header.commit) || header.length == 0 ||
+                    header.length > tmptail - pos - recordHeaderSize() || header.crc != recordHeaderCrc(header))
+                {
+                    corrupt = true;
+                    break;
+                }
+                if (!topics || topics->Test(header.topic))
+                {
+                    found = true;
+                    break;
+                }
+                pos += recordHeaderSize() + header.length;
+                skipped++;
+                // 预取下一条记录的头部
+                ShmPrefetch(_headQue + (pos & (_headCb->queSize - 1)), 1);
+            }
+            // 2.拷贝匹配记录的数据
+            int ret = 0;
+            uint64_t dataPos = pos + recordHeaderSize();
+            if (found && header.commit == RECORD_DESC_MAGIC)
+            {
+                // 大消息---slab中的块在普通消费者取走之前一直有效
+                ShmLargeDesc desc;
+                desc.length = 0;
+                if (header.length == sizeof(ShmLargeDesc))
+                    copyFromQueue(&desc, dataPos, sizeof(desc));
+                if (!_slab || desc.length == 0 || !_slab->Check(desc.offset, desc.length))
+                    ret = (int)(ShmQueErrorCode::QueueDataLengthError);
+                else if (desc.length > bufLength)
+                    ret = (int)(ShmQueErrorCode::QueueBufferLengthInsufficient);
+                else
+                {
+                    memcpy(buffer, _slab->Ptr(desc.offset), desc.length);
+                    ret = (int)desc.length;
+                }
+            }
+            else if (found)
+            {
+                // 解压有边界检查---被覆盖的数据只会解压失败,下面确认被套圈后丢弃结果
+                ret = readRecordData(header, dataPos, buffer, bufLength);
+            }
+            // 3.校验扫描和拷贝期间没有被套圈---fence保证读取在重新读head之前完成
+            std::atomic_thread_fence(std::memory_order_acquire);
+            if (_controlBlock->headIdx.load(std::memory_order_relaxed) > cursor.pos)
+                continue;
+            cursor.skipped += skipped;
+            cursor.seq += skipped;
+            if (corrupt)
+            {
+                // 没有被覆盖但是记录损坏---长度不可信,游标跳到tail
+                std::cout << "ReadCursor failed ," << errorCode2String(ShmQueErrorCode::QueueDataLengthError) << std::endl;
+                cursor.pos = tmptail;
+                return (int)(ShmQueErrorCode::QueueDataLengthError);
+            }
+            if (!found)
+            {
+                cursor.pos = pos;
+                return (int)(ShmQueErrorCode::QueueOk);
+            }
+            if (ret == (int)(ShmQueErrorCode::QueueBufferLengthInsufficient))
+            {
+                // 游标停在这条记录上,调用者换更大的缓冲区后重新读取
+                cursor.pos = pos;
+                std::cout << "ReadCursor failed ," << errorCode2String(ShmQueErrorCode::QueueBufferLengthInsufficient) << std::endl;
+                return ret;
+            }
+            cursor.pos = dataPos + header.length;
+            cursor.seq++;
+            if (topic)
+                *topic = header.topic;
+            return ret;
+        }
+    }
+    // 向生产者ring拷贝数据---数据可能分布在头尾
+    void ShmQueue::copyToQueue(uint64_t pos, const void *data, size_t length, bool streaming)
+    {
+        size_t idx = pos & (_tailCb->queSize - 1);
+        size_t part1Size = std::min(length, _tailCb->queSize - idx);
+        ShmCopyToQueue((void *)(_tailQue + idx), data, part1Size, streaming);
+        if (part1Size < length)
+        {
+            // 数据在头尾----直接在队列起始位置放下剩余数据
+            ShmCopyToQueue((void *)(_tailQue), (const void *)((const BYTE *)data + part1Size), length - part1Size, streaming);
+        }
+    }
+    // 读取并校验大消息描述符
+    int ShmQueue::readLarge(uint64_t dataPos, size_t recordLength, void *buffer, size_t bufLength, ShmLargeDesc &desc)
+    {
+        if (recordLength == sizeof(ShmLargeDesc))
+            copyFromQueue(&desc, dataPos, sizeof(desc));
+        if (recordLength != sizeof(ShmLargeDesc) || !_slab || desc.length == 0 || !_slab->Check(desc.offset, desc.length))
+        {
+            // 描述符损坏---块不可信,跳过这条记录但不释放
+            std::cout << "PopMessage failed ," << errorCode2String(ShmQueErrorCode::QueueDataLengthError) << std::endl;
+            return (int)(ShmQueErrorCode::QueueDataLengthError);
+        }
+        if (buffer)
+        {
+            if (desc.length > bufLength)
+            {
+                std::cout << "PopMessage failed ," << errorCode2String(ShmQueErrorCode::QueueBufferLengthInsufficient) << std::endl;
+                return (int)(ShmQueErrorCode::QueueBufferLengthInsufficient);
+            }
+            memcpy(buffer, _slab->Ptr(desc.offset), desc.length);
+        }
+        return (int)desc.length;
+    }
+    // 覆盖模式下读取head处的记录
+    // 生产者随时可能推进head覆盖最老的记录: 拷贝完成后用head的CAS(Peek时重新读head)验证数据没有被覆盖,
+    // 被套圈时从新的head(当前最老的合法记录)重新读取; 位置单调递增,CAS不存在ABA问题
+    int ShmQueue::readHeadOverwrite(void *buffer, size_t bufLength, bool remove)
+    {
+        while (true)
+        {
+            // 先读head再读tail: 生产者推进head之前tail已经发布,一定有head<=tail
+            uint64_t tmphead = _headCb->headIdx.load(std::memory_order_acquire);
+            uint64_t tmptail = _headCb->tailIdx.load(std::memory_order_acquire);
+            if (tmphead == tmptail)
+            {
+                // 没有数据
+                return (int)(ShmQueErrorCode::QueueOk);
+            }
+            ShmRecordHeader header;
+            readRecordHeader(tmphead, header);
+            uint64_t dataPos = tmphead + recordHeaderSize();
+            if (tmptail - tmphead <= recordHeaderSize() || !recordCommitted(header.commit) ||
+                header.length == 0 || header.length > tmptail - dataPos || header.crc != recordHeaderCrc(header))
+            {
+                // 读头部时被套圈,读到的是正在覆盖的数据---重新读取
+                if (_headCb->headIdx.load(std::memory_order_acquire) != tmphead)
+                    continue;
+                // 没有被套圈,记录本身损坏---和普通模式一样跳过
+                int ret = checkHeadRecord(tmphead, tmptail, header, dataPos);
+                if (ret != 0)
+                    return ret;
+            }
+            int length;
+            if (buffer)
+            {
+                // 解压有边界检查---被覆盖的数据只会解压失败,由下面的head检查/CAS丢弃
+                length = readRecordData(header, dataPos, buffer, bufLength);
+                if (length == (int)(ShmQueErrorCode::QueueBufferLengthInsufficient))
+                {
+                    if (_headCb->headIdx.load(std::memory_order_acquire) != tmphead)
+                        continue;
+                    std::cout << "PopMessage failed ," << errorCode2String(ShmQueErrorCode::QueueBufferLengthInsufficient) << std::endl;
+                    return length;
+                }
+            }
+            else
+                length = (int)recordMessageLength(header, dataPos);
+            if (!remove)
+            {
+                // 拷贝期间head没有变化说明数据完整---fence保证拷贝在重新读head之前完成
+                std::atomic_thread_fence(std::memory_order_acquire);
+                if (_headCb->headIdx.load(std::memory_order_relaxed) == tmphead)
+                    return length;
+                continue;
+            }
+            // CAS成功说明拷贝期间生产者没有覆盖这条记录
+            if (_headCb->headIdx.compare_exchange_strong(tmphead, dataPos + header.length,
+                                                        std::memory_order_acq_rel, std::memory_order_acquire))
+                return length;
+        }
+    }
+    // 从队列拷贝消息数据---数据可能分布在头尾
+    void ShmQueue::copyFromQueue(void *buffer, uint64_t pos, size_t length) const
+    {
+        size_t idx = pos & (_headCb->queSize - 1);
+        size_t part1Size = std::min(length, _headCb->queSize - idx);
+        memcpy(buffer, (const void *)(_headQue + idx), part1Size);
+        if (part1Size < length)
+        {
+            // 数据分布在头尾
+            memcpy((void *)((BYTE *)(buffer) + part1Size), (const void *)(_headQue), length - part1Size);
+        }
+    }
+    // 记录中消息的长度
+    size_t ShmQueue::recordMessageLength(const ShmRecordHeader &header, uint64_t dataPos) const
+    {
+        if (header.commit == RECORD_LZ_MAGIC)
+        {
+            uint32_t rawLength = 0;
+            if (header.length > sizeof(rawLength))
+                copyFromQueue(&rawLength, dataPos, sizeof(rawLength));
+            return rawLength;
+        }
+        if (header.commit == RECORD_FRAG_MAGIC)
+            return header.length > sizeof(ShmFrameHeader) ? header.length - sizeof(ShmFrameHeader) : 0;
+        return header.length;
+    }
+    // 读取(解压)记录中的消息
+    int ShmQueue::readRecordData(const ShmRecordHeader &header, uint64_t dataPos, void *buffer, size_t bufLength)
+    {
+        if (header.commit != RECORD_LZ_MAGIC)
+        {
+            size_t frameLength = header.commit == RECORD_FRAG_MAGIC ? sizeof(ShmFrameHeader) : 0;
+            if (header.length < frameLength)
+                return (int)(ShmQueErrorCode::QueueDataLengthError);
+            if (header.length - frameLength > bufLength)
+                return (int)(ShmQueErrorCode::QueueBufferLengthInsufficient);
+            copyFromQueue(buffer, dataPos + frameLength, header.length - frameLength);
+            return (int)(header.length - frameLength);
+        }
+        // 压缩记录: [原始长度][压缩数据]
+        uint32_t rawLength;
+        if (header.length <= sizeof(rawLength))
+            return (int)(ShmQueErrorCode::QueueDataLengthError);
+        copyFromQueue(&rawLength, dataPos, sizeof(rawLength));
+        if (rawLength > bufLength)
+            return (int)(ShmQueErrorCode::QueueBufferLengthInsufficient);
+        // 压缩数据连续时直接从ring解压,分布在头尾时先拼接
+        uint64_t zipPos = dataPos + sizeof(rawLength);
+        size_t zipLength = header.length - sizeof(rawLength);
+        size_t idx = zipPos & (_headCb->queSize - 1);
+        const BYTE *zip = _headQue + idx;
+        if (idx + zipLength > _headCb->queSize)
+        {
+            std::vector<BYTE> &joined = lzScratch(0);
+            joined.resize(zipLength);
+            copyFromQueue(joined.data(), zipPos, zipLength);
+            zip = joined.data();
+        }
+        auto begin = std::chrono::steady_clock::now();
+        int64_t n = ShmLzDecompress(zip, zipLength, buffer, rawLength);
+        _zip.decompressNs.fetch_add(elapsedNs(begin), std::memory_order_relaxed);
+        if (n != (int64_t)rawLength)
+            return (int)(ShmQueErrorCode::QueueDataLengthError);
+        _zip.decompressed.fetch_add(1, std::memory_order_relaxed);
+        return (int)rawLength;
+    }
+    // 读取记录头部
+    void ShmQueue::readRecordHeader(uint64_t pos, ShmRecordHeader &header) const
+    {
+        // 生产消费一定在同一台主机上---不需要考虑大小端问题
+        size_t idx = pos & (_headCb->queSize - 1);
+        if (_controlBlock->compactHeader)
+        {
+            // 紧凑头部: 不跨越ring尾部时一次8字节读取
+            uint64_t word;
+            if (idx + sizeof(word) <= _headCb->queSize)
+                memcpy(&word, _headQue + idx, sizeof(word));
+            else
+            {
+                size_t part1Size = _headCb->queSize - idx;
+                memcpy(&word, _headQue + idx, part1Size);
+                memcpy((BYTE *)&word + part1Size, _headQue, sizeof(word) - part1Size);
+            }
+            compactHeaderDecode(word, header);
+            return;
         }
-        // 1.拿到长度字段
-        DATA_SIZE_TYPE tmpLength;
-        BYTE *tmpSrc = _quePtr;
-        int tmphead = _controlBlock->headIdx;
-        for (int i = 0; i < sizeof(DATA_SIZE_TYPE); i++)
+        size_t part1Size = std::min(sizeof(ShmRecordHeader), _headCb->queSize - idx);
+        memcpy(&header, _headQue + idx, part1Size);
+        if (part1Size < sizeof(ShmRecordHeader))
         {
-            // 生产消费一定在同一台主机上---不需要考虑大小端问题
-            ((BYTE *)(&tmpLength))[i] = tmpSrc[tmphead];
-            tmphead = (tmphead + 1) & (_controlBlock->queSize - 1); // 可能在头尾
+            // 头部分布在头尾
+            memcpy((BYTE *)&header + part1Size, _headQue, sizeof(ShmRecordHeader) - part1Size);
         }
-        // 2.判断长度字段是否合法
-        if (tmpLength <= 0 || tmpLength > dataSize - sizeof(DATA_SIZE_TYPE))
+    }
+    // 写入记录头部
+    void ShmQueue::writeRecordHeader(uint64_t pos, const ShmRecordHeader &header)
+    {
+        BYTE buf[sizeof(ShmRecordHeader)];
+        size_t size = encodeRecordHeader(header, buf);
+        size_t idx = pos & (_tailCb->queSize - 1);
+        size_t part1Size = std::min(size, _tailCb->queSize - idx);
+        memcpy(_tailQue + idx, buf, part1Size);
+        if (part1Size < size)
         {
-            // log
-            std::cout << "PopMessage failed ," << errorCode2String(ShmQueErrorCode::QueueDataLengthError) << std::endl;
-            // 打印队列信息
-            std::cout << PrintShmQueInfo();
-            // 非法长度---清空数据进行修复
-            _controlBlock->headIdx = _controlBlock->tailIdx;
-            return (int)(ShmQueErrorCode::QueueDataLengthError);
+            memcpy(_tailQue, buf + part1Size, size - part1Size);
         }
-        if (tmpLength > bufLength)
+    }
+    // 按ring中的格式编码/解码头部
+    size_t ShmQueue::encodeRecordHeader(const ShmRecordHeader &header, BYTE *out) const
+    {
+        if (_controlBlock->compactHeader)
         {
-            // 传入缓冲区大小不足
-            // log
-            std::cout << "PopMessage failed ," << errorCode2String(ShmQueErrorCode::QueueBufferLengthInsufficient) << std::endl;
-            return (int)(ShmQueErrorCode::QueueBufferLengthInsufficient);
+            uint64_t word = compactHeaderEncode(header);
+            memcpy(out, &word, sizeof(word));
+            return sizeof(word);
         }
-        // 缓冲区大小足够---开始获取data
-        DATA_SIZE_TYPE part1Size = std::min(tmpLength, _controlBlock->queSize - tmphead);
-        memcpy(buffer, (const void *)(tmpSrc + tmphead), (size_t)part1Size);
-        DATA_SIZE_TYPE part2Size = tmpLength - part1Size;
-        if (part2Size > 0)
+        memcpy(out, &header, sizeof(header));
+        return sizeof(header);
+    }
+    void ShmQueue::decodeRecordHeader(const BYTE *in, ShmRecordHeader &header) const
+    {
+        if (_controlBlock->compactHeader)
         {
-            // 数据分布在头尾
-            memcpy((void *)((BYTE *)(buffer) + part1Size), (const void *)(tmpSrc), part2Size);
+            uint64_t word;
+            memcpy(&word, in, sizeof(word));
+            compactHeaderDecode(word, header);
         }
-        return tmpLength;
+        else
+            memcpy(&header, in, sizeof(header));
     }
-    // 删除头部消息---改变索引位置
-    int ShmQueue::DelHeadMessage()
+    // 通知poller
+    void ShmQueue::notifyPoller()
     {
-        // 锁
-        WLockGuard lock(_headMtx);
-        size_t dataSize = getDataSize();
-        if (dataSize == 0)
+        int shmId = _controlBlock->pollerShmId.load(std::memory_order_acquire);
+        if (shmId == -1)
+            return;
+        if (attachPoller(shmId, _pollerSeg, _pollerShmId))
+            ShmQueuePoller::NotifyReady(_pollerSeg, _controlBlock->pollerSlot);
+    }
+    void ShmQueue::notifySpacePoller()
+    {
+        int shmId = _controlBlock->spacePollerShmId.load(std::memory_order_acquire);
+        if (shmId == -1)
+            return;
+        if (attachPoller(shmId, _spacePollerSeg, _spacePollerShmId))
+            ShmQueuePoller::NotifyReady(_spacePollerSeg, _controlBlock->spacePollerSlot);
+    }
+    void *ShmQueue::attachPoller(int shmId, void *&seg, int &segShmId)
+    {
+        if (shmId != segShmId)
         {
-            // 没有数据
-            return (int)(ShmQueErrorCode::QueueOk);
+            // 队列注册到了新的poller---切换attach的段
+            if (seg)
+                shmdt(seg);
+            segShmId = shmId;
+            seg = shmat(shmId, NULL, 0);
+            if (seg == (void *)-1 || ((ShmQueuePoller::PollerHeader *)seg)->magic != SHM_POLLER_MAGIC)
+            {
+                // poller已经退出---直到重新注册之前不再尝试
+                std::cout << "ShmQueue attach poller failed, shmid=" << shmId << std::endl;
+                if (seg != (void *)-1)
+                    shmdt(seg);
+                seg = nullptr;
+            }
         }
-        if (dataSize <= sizeof(DATA_SIZE_TYPE))
+        return seg;
+    }
+    // 头部crc覆盖commit和crc字段之后的部分
+    uint32_t ShmQueue::recordHeaderCrc(const ShmRecordHeader &header) const
+    {
+        if (!_controlBlock->headerCrc)
+            return 0;
+        const size_t offset = offsetof(ShmRecordHeader, length);
+        uint32_t crc = Crc32c((const BYTE *)&header + offset, sizeof(ShmRecordHeader) - offset);
+        // 紧凑头部只有16位crc字段
+        return _controlBlock->compactHeader ? (crc & 0xFFFFu) : crc;
+    }
+    // 校验head处的记录
+    int ShmQueue::checkHeadRecord(uint64_t head, uint64_t tail, ShmRecordHeader &header, uint64_t &dataPos)
+    {
+        size_t dataSize = getDataSize(head, tail);
+        if (dataSize <= recordHeaderSize())
         {
-            // 数据长度小于存储长度的固定字段
+            // 数据长度小于记录头部---剩余数据中不可能有完整记录
             //  log
             std::cout << "PopMessage failed ," << errorCode2String(ShmQueErrorCode::QueueDataError) << std::endl;
             // 打印一下队列的info
             std::cout << PrintShmQueInfo();
-            // 修复一下错误---清空数据进行修复
-            _controlBlock->headIdx = _controlBlock->tailIdx;
+            // 修复一下错误---丢弃这段残缺数据
+            advanceHead(head, tail);
             return (int)(ShmQueErrorCode::QueueDataError);
         }
-        // 1.拿到长度字段
-        DATA_SIZE_TYPE tmpLength;
-        BYTE *tmpSrc = _quePtr;
-        int tmphead = _controlBlock->headIdx;
-        for (int i = 0; i < sizeof(DATA_SIZE_TYPE); i++)
+        readRecordHeader(head, header);
+        // 流分片至少要有帧头部
+        size_t minLength = header.commit == RECORD_FRAG_MAGIC ? sizeof(ShmFrameHeader) : header.commit == RECORD_LZ_MAGIC ? sizeof(uint32_t) + 1 : 1;
+        bool lengthOk = header.length >= minLength && header.length <= dataSize - recordHeaderSize();
+        bool crcOk = header.crc == recordHeaderCrc(header);
+        if (recordCommitted(header.commit) && crcOk && lengthOk)
         {
-            // 生产消费一定在同一台主机上---不需要考虑大小端问题
-            ((BYTE *)(&tmpLength))[i] = tmpSrc[tmphead];
-            tmphead = (tmphead + 1) & (_controlBlock->queSize - 1); // 可能在头尾
+            dataPos = head + recordHeaderSize();
+            return (int)(ShmQueErrorCode::QueueOk);
         }
-        // 2.判断长度字段是否合法
-        if (tmpLength <= 0 || tmpLength > dataSize - sizeof(DATA_SIZE_TYPE))
+        // 未开启crc时crc字段不为0说明整个头部都是脏数据
+        ShmQueErrorCode code = ShmQueErrorCode::QueueRecordUncommitted;
+        if (!crcOk)
+            code = _controlBlock->headerCrc ? ShmQueErrorCode::QueueRecordCrcError : ShmQueErrorCode::QueueDataLengthError;
+        else if (!lengthOk)
+            code = ShmQueErrorCode::QueueDataLengthError;
+        // log
+        std::cout << "PopMessage failed ," << errorCode2String(code) << std::endl;
+        // 打印队列信息
+        std::cout << PrintShmQueInfo();
+        if (code == ShmQueErrorCode::QueueRecordUncommitted)
         {
-            // log
-            std::cout << "PopMessage failed ," << errorCode2String(ShmQueErrorCode::QueueDataLengthError) << std::endl;
-            // 打印队列信息
-            std::cout << PrintShmQueInfo();
-            // 非法长度---清空数据进行修复
-            _controlBlock->headIdx = _controlBlock->tailIdx;
-            return (int)(ShmQueErrorCode::QueueDataLengthError);
+            // 头部可信只是没有提交---长度可信,准确跳过这一条记录
+            advanceHead(head, head + recordHeaderSize() + header.length);
         }
-
-        // 修改head索引前先要保证数据全部Pop完毕，使用写内存屏障保证
-        sfence();
-        // 修改head索引代替删除操作
-        _controlBlock->headIdx = (tmphead + tmpLength) & (_controlBlock->queSize - 1);
-        return tmpLength;
+        else
+        {
+            // 长度不可信---重新同步到下一条合法记录
+            resyncHead(head, tail);
+        }
+        return (int)(code);
+    }
+    // 从head之后查找下一条合法记录
+    void ShmQueue::resyncHead(uint64_t head, uint64_t tail)
+    {
+        size_t dataSize = getDataSize(head, tail);
+        ShmRecordHeader header;
+        // 合法记录至少要有头部+1字节数据
+        for (size_t skip = 1; skip + recordHeaderSize() < dataSize; skip++)
+        {
+            readRecordHeader(head + skip, header);
+            if (recordCommitted(header.commit) && header.length > 0 &&
+                header.length <= dataSize - skip - recordHeaderSize() &&
+                header.crc == recordHeaderCrc(header))
+            {
+                std::cout << "ShmQueue resync, skip " << skip << " bytes" << std::endl;
+                advanceHead(head, head + skip);
+                return;
+            }
+        }
+        // 剩余数据中没有合法记录
+        std::cout << "ShmQueue resync, skip " << dataSize << " bytes" << std::endl;
+        advanceHead(head, tail);
+    }
+    // 移动head---覆盖模式下生产者也会推进head,只能CAS(失败说明生产者已经把head推到更后面)
+    void ShmQueue::advanceHead(uint64_t from, uint64_t to)
+    {
+        if (_controlBlock->overwrite)
+            _headCb->headIdx.compare_exchange_strong(from, to, std::memory_order_acq_rel, std::memory_order_acquire);
+        else
+            _headCb->headIdx.store(to, std::memory_order_release);
+        notifySpace();
     }
     // 根据访问模式决定锁的init
     void ShmQueue::initLock()
@@ -345,32 +2075,170 @@ namespace xten
             _controlBlock->vtModule == EnumVisitModel::MulitPushSinglePop)
         {
             // 多线程push
-            _tailMtx = new SemRWMutex(_controlBlock->key + 1);
+            if (_controlBlock->inlineLock)
+            {
+                ShmMutex *mtx = new ShmMutex(&_controlBlock->tailLock);
+                // 生产者崩溃时保留日志可能停在seqlock中间
+                mtx->SetRecoverHandler([this]()
+                                       {
+                    if (_log)
+                        logRecover(); });
+                _tailMtx = mtx;
+            }
+            else
+                _tailMtx = new SemRWMutex(_controlBlock->key + 1);
         }
         if (_controlBlock->vtModule == EnumVisitModel::MulitPushMulitPop ||
             _controlBlock->vtModule == EnumVisitModel::SinglePushMulitPop)
         {
             // 多线程pop
-            _headMtx = new SemRWMutex(_controlBlock->key + 2);
+            if (_controlBlock->inlineLock)
+                _headMtx = new ShmMutex(&_controlBlock->headLock);
+            else
+                _headMtx = new SemRWMutex(_controlBlock->key + 2);
         }
     }
-    // 获取空闲空间大小
-    size_t ShmQueue::getFreeSize() const
+    // 定位生产/消费所在的ring---新建的队列和没有扩缩容过的队列都在根ring
+    void ShmQueue::initRingView()
     {
-        if (_controlBlock->headIdx <= _controlBlock->tailIdx)
+        _headCb = _tailCb = _controlBlock;
+        _headQue = _tailQue = _quePtr;
+        if (_controlBlock->headShmId.load(std::memory_order_acquire) != _controlBlock->shmId)
+        {
+            // 持锁定位,防止消费者同时把这个ring读完释放
+            WLockGuard lock(_headMtx);
+            ShmQueControlBlock *cblock = attachRing(_controlBlock->headShmId.load(std::memory_order_acquire));
+            if (cblock)
+            {
+                _headCb = cblock;
+                _headQue = (BYTE *)cblock + sizeof(ShmQueControlBlock);
+            }
+        }
+        if (_controlBlock->tailShmId.load(std::memory_order_acquire) != _controlBlock->shmId)
         {
-            return _controlBlock->queSize - (_controlBlock->tailIdx - _controlBlock->headIdx) - REMAIN_SIZE;
+            WLockGuard lock(_tailMtx);
+            followTailRing();
         }
-        return _controlBlock->headIdx - _controlBlock->tailIdx - REMAIN_SIZE;
     }
-    // 获取数据大小
-    size_t ShmQueue::getDataSize() const
+    // attach一个扩缩容产生的ring
+    ShmQueue::ShmQueControlBlock *ShmQueue::attachRing(int shmId)
     {
-        if (_controlBlock->tailIdx >= _controlBlock->headIdx)
+        void *ptr = shmat(shmId, nullptr, 0);
+        if (ptr == (void *)-1)
         {
-            return _controlBlock->tailIdx - _controlBlock->headIdx;
+            std::cout << "attachRing failed, shmid=" << shmId << ", errstr=" << strerror(errno) << std::endl;
+            return nullptr;
+        }
+        return (ShmQueControlBlock *)ptr;
+    }
+    // detach一个扩缩容产生的ring---根ring随队列一起销毁
+    void ShmQueue::detachRing(ShmQueControlBlock *cblock)
+    {
+        if (cblock && cblock != _controlBlock && shmdt((void *)cblock) == -1)
+        {
+            std::cout << "detachRing failed,errstr=" << strerror(errno) << std::endl;
+        }
+    }
+    // 生产者切换到最新的ring---调用者持有tail锁
+    bool ShmQueue::followTailRing()
+    {
+        ShmQueControlBlock *cblock = attachRing(_controlBlock->tailShmId.load(std::memory_order_acquire));
+        if (!cblock)
+            return false;
+        detachRing(_tailCb);
+        _tailCb = cblock;
+        _tailQue = (BYTE *)cblock + sizeof(ShmQueControlBlock);
+        return true;
+    }
+    // 消费者跟随到新ring---调用者持有head锁 ret=true时调用者需要重新读取索引
+    bool ShmQueue::followHeadRing(uint64_t head)
+    {
+        int next = _headCb->nextShmId.load(std::memory_order_acquire);
+        if (next == -1)
+            return false;
+        // next发布之后旧ring不会再写入---重新读tail,确认旧ring真的读完了
+        if (_headCb->tailIdx.load(std::memory_order_acquire) != head)
+            return true;
+        int shmId = _controlBlock->headShmId.load(std::memory_order_acquire);
+        if (shmId == _headCb->shmId)
+        {
+            // 第一个读完旧ring的消费者负责推进根控制块,旧ring没有人再需要了
+            shmId = next;
+            _controlBlock->headShmId.store(next, std::memory_order_release);
+            if (_headCb != _controlBlock)
+                shmctl(_headCb->shmId, IPC_RMID, NULL);
+        }
+        // 其他消费者已经推进过---直接跳到当前的ring,中间的ring可能已经释放
+        ShmQueControlBlock *cblock = attachRing(shmId);
+        if (!cblock)
+            return false;
+        detachRing(_headCb);
+        _headCb = cblock;
+        _headQue = (BYTE *)cblock + sizeof(ShmQueControlBlock);
+        return true;
+    }
+    // 在线扩缩容
+    int ShmQueue::Resize(size_t newQuesize)
+    {
+        if (_backend != EnumShmBackend::SysVShm || _controlBlock->overwrite || _controlBlock->slab || _controlBlock->retained)
+        {
+            return (int)(ShmQueErrorCode::QueueNotSupported);
+        }
+        if (newQuesize == 0)
+        {
+            std::cout << errorCode2String(ShmQueErrorCode::QueueParameterInvaild) << std::endl;
+            return (int)(ShmQueErrorCode::QueueParameterInvaild);
         }
-        return _controlBlock->queSize - (_controlBlock->headIdx - _controlBlock->tailIdx);
+        newQuesize = roundUpToPowerOfTwo(newQuesize);
+        // 持有tail锁---生产者在记录边界切换
+        WLockGuard lock(_tailMtx);
+        if (_tailCb->nextShmId.load(std::memory_order_acquire) != -1 && !followTailRing())
+        {
+            return (int)(ShmQueErrorCode::QueueFailedSharedMemory);
+        }
+        // 1.新ring使用私有段,通过shmid链接---由读完它的消费者或者销毁队列时标记删除
+        int shmId = shmget(IPC_PRIVATE, newQuesize + sizeof(ShmQueControlBlock), 0666 | IPC_CREAT);
+        if (shmId == -1)
+        {
+            std::cout << "Resize shmget failed,errstr=" << strerror(errno) << std::endl;
+            return (int)(ShmQueErrorCode::QueueFailedSharedMemory);
+        }
+        ShmQueControlBlock *cblock = attachRing(shmId);
+        if (!cblock)
+        {
+            shmctl(shmId, IPC_RMID, NULL);
+            return (int)(ShmQueErrorCode::QueueFailedSharedMemory);
+        }
+        // 2.新ring的控制块只使用索引部分,锁和配置仍以根控制块为准
+        new (cblock) ShmQueControlBlock();
+        cblock->key = _controlBlock->key;
+        cblock->queSize = newQuesize;
+        cblock->shmId = shmId;
+        cblock->vtModule = _controlBlock->vtModule;
+        cblock->headerCrc = _controlBlock->headerCrc;
+        cblock->compactHeader = _controlBlock->compactHeader;
+        cblock->inlineLock = _controlBlock->inlineLock;
+        cblock->magic = SHM_QUEUE_MAGIC;
+        // 3.先在根控制块发布新ring,再链接到旧ring---看到nextShmId的句柄一定能找到新ring
+        _controlBlock->curQueSize.store(newQuesize, std::memory_order_relaxed);
+        _controlBlock->tailShmId.store(shmId, std::memory_order_release);
+        _tailCb->nextShmId.store(shmId, std::memory_order_release);
+        std::cout << "ShmQueue resize " << _tailCb->queSize << " -> " << newQuesize
+                  << " bytes, new ring shmid=" << shmId << std::endl;
+        detachRing(_tailCb);
+        _tailCb = cblock;
+        _tailQue = (BYTE *)cblock + sizeof(ShmQueControlBlock);
+        return (int)(ShmQueErrorCode::QueueOk);
+    }
+    // 获取空闲空间大小
+    size_t ShmQueue::getFreeSize(uint64_t head, uint64_t tail) const
+    {
+        return _tailCb->queSize - (tail - head) - REMAIN_SIZE;
+    }
+    // 获取数据大小
+    size_t ShmQueue::getDataSize(uint64_t head, uint64_t tail) const
+    {
+        return tail - head;
     }
     // 删除共享内存--detach
     bool ShmQueue::destroySharedMemory(void *shmPtr, key_t key)
@@ -501,9 +2369,156 @@ namespace xten
         // attach成功
         return shmptr;
     }
+    // 映射文件
+    void *ShmQueue::getFileMemory(const std::string &filepath, int &fd, EnumCreateModel &newOrLink, size_t &size)
+    {
+        fd = open(filepath.c_str(), O_RDWR | O_CREAT, 0666);
+        if (fd == -1)
+        {
+            std::cout << "getFileMemory open failed,errstr=" << strerror(errno) << std::endl;
+            return nullptr;
+        }
+        // 文件锁保证多个进程同时打开时只有一个进行初始化,调用方构造完队列后解锁
+        flock(fd, LOCK_EX);
+        struct stat st;
+        if (fstat(fd, &st) == -1)
+        {
+            std::cout << "getFileMemory fstat failed,errstr=" << strerror(errno) << std::endl;
+            close(fd);
+            return nullptr;
+        }
+        if ((size_t)st.st_size > sizeof(ShmQueControlBlock))
+        {
+            // 文件中已经有数据---控制块合法则直接复用,不拷贝任何数据
+            void *ptr = mmap(nullptr, st.st_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+            if (ptr != MAP_FAILED)
+            {
+                ShmQueControlBlock *cblock = (ShmQueControlBlock *)ptr;
+                if (cblock->magic == SHM_QUEUE_MAGIC && cblock->queSize + sizeof(ShmQueControlBlock) == (size_t)st.st_size)
+                {
+                    std::cout << "Link exists queue file success" << std::endl;
+                    newOrLink = EnumCreateModel::LinkShmQue;
+                    size = st.st_size;
+                    return ptr;
+                }
+                munmap(ptr, st.st_size);
+            }
+            std::cout << "Queue file is invalid, reinitialize it" << std::endl;
+        }
+        // 创建---截断到需要的大小,旧内容清零
+        if (ftruncate(fd, 0) == -1 || ftruncate(fd, size) == -1)
+        {
+            std::cout << "getFileMemory ftruncate failed,errstr=" << strerror(errno) << std::endl;
+            close(fd);
+            return nullptr;
+        }
+        void *ptr = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        if (ptr == MAP_FAILED)
+        {
+            std::cout << "getFileMemory mmap failed,errstr=" << strerror(errno) << std::endl;
+            close(fd);
+            return nullptr;
+        }
+        std::cout << "Create a new queue file success" << std::endl;
+        newOrLink = EnumCreateModel::NewShmQue;
+        return ptr;
+    }
+    // 启动后台msync线程
+    void ShmQueue::startMsync(const ShmQueOptions &options)
+    {
+        if (options.msyncIntervalMs == 0 && options.msyncBytes == 0)
+            return;
+        _msyncIntervalMs = options.msyncIntervalMs;
+        _msyncBytes = options.msyncBytes;
+        _msyncThread = std::thread(&ShmQueue::msyncLoop, this);
+    }
+    // 停止后台msync线程
+    void ShmQueue::stopMsync()
+    {
+        if (!_msyncThread.joinable())
+            return;
+        {
+            std::lock_guard<std::mutex> lock(_msyncMtx);
+            _msyncStop = true;
+        }
+        _msyncCond.notify_one();
+        _msyncThread.join();
+    }
+    // 后台msync线程---只刷上次刷盘之后新写入的区域和控制块
+    void ShmQueue::msyncLoop()
+    {
+        uint64_t syncedHead = _controlBlock->headIdx.load(std::memory_order_acquire);
+        uint64_t syncedTail = _controlBlock->tailIdx.load(std::memory_order_acquire);
+        std::unique_lock<std::mutex> lock(_msyncMtx);
+        while (!_msyncStop)
+        {
+            // 只按字节数触发时也定期醒来,把消费者移动的head刷盘
+            _msyncCond.wait_for(lock, std::chrono::milliseconds(_msyncIntervalMs ? _msyncIntervalMs : 1000));
+            if (_msyncStop)
+                break;
+            uint64_t head = _controlBlock->headIdx.load(std::memory_order_acquire);
+            uint64_t tail = _controlBlock->tailIdx.load(std::memory_order_acquire);
+            size_t written = _unsyncedBytes.exchange(0, std::memory_order_relaxed);
+            if (head == syncedHead && tail == syncedTail && written == 0)
+                continue;
+            lock.unlock();
+            msyncRing(syncedTail, tail);
+            msyncRange(0, sizeof(ShmQueControlBlock));
+            syncedHead = head;
+            syncedTail = tail;
+            lock.lock();
+        }
+    }
+    // msync队列中[begin,end)的区域
+    void ShmQueue::msyncRing(uint64_t begin, uint64_t end)
+    {
+        const size_t ringOffset = sizeof(ShmQueControlBlock);
+        const size_t mask = _controlBlock->queSize - 1;
+        if (end - begin >= _controlBlock->queSize)
+        {
+            // 两次刷盘之间写入超过一圈时整个队列都是脏的
+            msyncRange(ringOffset, _controlBlock->queSize);
+        }
+        else if ((begin & mask) < (end & mask))
+        {
+            msyncRange(ringOffset + (begin & mask), end - begin);
+        }
+        else if (begin != end)
+        {
+            // 脏数据分布在头尾
+            msyncRange(ringOffset + (begin & mask), _controlBlock->queSize - (begin & mask));
+            msyncRange(ringOffset, end & mask);
+        }
+    }
+    // msync映射中的一段区域
+    void ShmQueue::msyncRange(size_t offset, size_t len)
+    {
+        static const size_t pageSize = sysconf(_SC_PAGESIZE);
+        if (len == 0)
+            return;
+        size_t alignedOffset = offset & ~(pageSize - 1);
+        if (msync((BYTE *)_shmPtr + alignedOffset, offset + len - alignedOffset, MS_SYNC) == -1)
+        {
+            std::cout << "msync failed,errstr=" << strerror(errno) << std::endl;
+        }
+    }
+    // 同步刷盘
+    int ShmQueue::SyncFile()
+    {
+        if (_backend != EnumShmBackend::FileMmap)
+        {
+            return (int)(ShmQueErrorCode::QueueNotSupported);
+        }
+        if (msync(_shmPtr, _mapSize, MS_SYNC) == -1)
+        {
+            std::cout << "SyncFile failed,errstr=" << strerror(errno) << std::endl;
+            return (int)(ShmQueErrorCode::QueueFailedSharedMemory);
+        }
+        return (int)(ShmQueErrorCode::QueueOk);
+    }
     // 获取一个进程安全共享内存消息队列实例(非单例)
     ShmQueue *ShmQueue::GetShmQueue(const std::string &pathname, int proj_id,
-                                    size_t size, EnumVisitModel visitModule)
+                                    size_t size, EnumVisitModel visitModule, const ShmQueOptions &options)
     {
         // 1.生成key
         key_t key = ftok(pathname.c_str(), proj_id);
@@ -513,12 +2528,17 @@ namespace xten
             std::cout << errorCode2String(ShmQueErrorCode::QueueFailedKey) << std::endl;
             return nullptr;
         }
+        if (!checkSegmentOptions(options))
+        {
+            std::cout << errorCode2String(ShmQueErrorCode::QueueParameterInvaild) << std::endl;
+            return nullptr;
+        }
         // 2.获取共享内存
         EnumCreateModel createM;
         int shmid = -1;
         //// 2.1将quesize对齐到2的n次方
         size = roundUpToPowerOfTwo(size);
-        void *shmPtr = ShmQueue::getSharedMemory(key, shmid, createM, size + sizeof(ShmQueControlBlock));
+        void *shmPtr = ShmQueue::getSharedMemory(key, shmid, createM, size + sizeof(ShmQueControlBlock) + extraSegmentSize(options, size));
         if (shmPtr == nullptr)
         {
             // 获取失败
@@ -530,7 +2550,7 @@ namespace xten
         switch (createM)
         {
         case EnumCreateModel::NewShmQue:
-            shmque = new ShmQueue(key, size, shmid, shmPtr, createM, visitModule);
+            shmque = new ShmQueue(key, size, shmid, shmPtr, createM, visitModule, options);
             break;
         case EnumCreateModel::LinkShmQue:
             shmque = new ShmQueue((ShmQueue::ShmQueControlBlock *)shmPtr, createM);
@@ -540,9 +2560,301 @@ namespace xten
         return shmque;
     }
     ShmQueue::ptr ShmQueue::GetShmQueuePtr(const std::string &pathname, int proj_id,
-                                           size_t size, EnumVisitModel visitModule)
+                                           size_t size, EnumVisitModel visitModule, const ShmQueOptions &options)
+    {
+        return std::shared_ptr<ShmQueue>(ShmQueue::GetShmQueue(pathname, proj_id, size, visitModule, options));
+    }
+    // 获取一个文件映射的持久化消息队列实例
+    // 文件后端: 每个句柄在文件的第0字节上持有OFD读锁,直到关闭fd(进程崩溃时由内核释放)
+    static void holdFileInUse(int fd)
+    {
+        struct flock lk = {};
+        lk.l_type = F_RDLCK;
+        lk.l_whence = SEEK_SET;
+        lk.l_len = 1;
+        if (fcntl(fd, F_OFD_SETLK, &lk) == -1)
+            std::cout << "queue file OFD lock failed,errstr=" << strerror(errno) << std::endl;
+    }
+    // 是否有其他存活的句柄打开着这个文件 (查询失败时按有处理,不清除任何状态)
+    static bool fileInUse(int fd)
+    {
+        struct flock lk = {};
+        lk.l_type = F_WRLCK;
+        lk.l_whence = SEEK_SET;
+        lk.l_len = 1;
+        if (fcntl(fd, F_OFD_GETLK, &lk) == -1)
+            return true;
+        return lk.l_type != F_UNLCK;
+    }
+    ShmQueue *ShmQueue::GetFileShmQueue(const std::string &filepath, int proj_id,
+                                        size_t size, EnumVisitModel visitModule, const ShmQueOptions &options)
+    {
+        // 1.映射文件
+        EnumCreateModel createM;
+        int fd = -1;
+        size = roundUpToPowerOfTwo(size);
+        size_t mapSize = size + sizeof(ShmQueControlBlock);
+        void *filePtr = ShmQueue::getFileMemory(filepath, fd, createM, mapSize);
+        if (filePtr == nullptr)
+        {
+            std::cout << errorCode2String(ShmQueErrorCode::QueueFailedSharedMemory) << std::endl;
+            return nullptr;
+        }
+        // 2.生成锁的key---文件此时一定存在
+        key_t key = ftok(filepath.c_str(), proj_id);
+        if (key == -1)
+        {
+            std::cout << errorCode2String(ShmQueErrorCode::QueueFailedKey) << std::endl;
+            munmap(filePtr, mapSize);
+            close(fd);
+            return nullptr;
+        }
+        // 3.创建该消息队列---分情况调用不同构造函数
+        // 主机重启后robust mutex的状态不可信,文件后端只使用信号量锁
+        ShmQueOptions fileOptions = options;
+        fileOptions.inlineLock = false;
+        // 文件后端不支持slab(重启后块的分配状态不可信)、保留日志和时间轮(映射中只有控制块和ring)
+        // NUMA策略对页缓存不生效
+        fileOptions.slabSize = 0;
+        fileOptions.retainedLog = false;
+        fileOptions.timerSlots = 0;
+        fileOptions.numaPolicy = EnumNumaPolicy::Default;
+        ShmQueue *shmque = nullptr;
+        switch (createM)
+        {
+        case EnumCreateModel::NewShmQue:
+            shmque = new ShmQueue(key, size, -1, filePtr, createM, visitModule, fileOptions);
+            break;
+        case EnumCreateModel::LinkShmQue:
+        {
+            ShmQueue::ShmQueControlBlock *cblock = (ShmQueue::ShmQueControlBlock *)filePtr;
+            // 文件可能被移动过,锁的key以当前路径为准
+            cblock->key = key;
+            if (!fileInUse(fd))
+            {
+                // 没有其他存活的句柄(主机重启或者所有进程都已经退出): 文件中记录的poller shmid
+                // 可能已经不存在或者被其他段复用,通知会写到无关的段中---清除,由poller重新注册
+                cblock->pollerShmId.store(-1, std::memory_order_relaxed);
+                cblock->spacePollerShmId.store(-1, std::memory_order_relaxed);
+            }
+            shmque = new ShmQueue(cblock, createM);
+            break;
+        }
+        default:
+            break;
+        }
+        holdFileInUse(fd);
+        flock(fd, LOCK_UN);
+        shmque->_backend = EnumShmBackend::FileMmap;
+        shmque->_fd = fd;
+        shmque->_mapSize = mapSize;
+        shmque->_filepath = filepath;
+        shmque->startMsync(options);
+        return shmque;
+    }
+    ShmQueue::ptr ShmQueue::GetFileShmQueuePtr(const std::string &filepath, int proj_id,
+                                               size_t size, EnumVisitModel visitModule, const ShmQueOptions &options)
+    {
+        return std::shared_ptr<ShmQueue>(ShmQueue::GetFileShmQueue(filepath, proj_id, size, visitModule, options));
+    }
+    // 创建一个匿名(memfd)消息队列
+    ShmQueue *ShmQueue::CreateMemfdShmQueue(const std::string &name, size_t size,
+                                            EnumVisitModel visitModule, const ShmQueOptions &options)
+    {
+        if (!checkSegmentOptions(options))
+        {
+            std::cout << errorCode2String(ShmQueErrorCode::QueueParameterInvaild) << std::endl;
+            return nullptr;
+        }
+        // 1.创建memfd---允许封印(seal)
+        int fd = memfd_create(name.c_str(), MFD_ALLOW_SEALING);
+        if (fd == -1)
+        {
+            std::cout << "memfd_create failed,errstr=" << strerror(errno) << std::endl;
+            return nullptr;
+        }
+        size = roundUpToPowerOfTwo(size);
+        size_t mapSize = size + sizeof(ShmQueControlBlock) + extraSegmentSize(options, size);
+        if (ftruncate(fd, mapSize) == -1)
+        {
+            std::cout << "memfd ftruncate failed,errstr=" << strerror(errno) << std::endl;
+            close(fd);
+            return nullptr;
+        }
+        // 2.封印大小---拿到fd的进程不能截断内存导致其他进程访问时SIGBUS
+        if (fcntl(fd, F_ADD_SEALS, F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_SEAL) == -1)
+        {
+            std::cout << "memfd add seals failed,errstr=" << strerror(errno) << std::endl;
+        }
+        void *ptr = mmap(nullptr, mapSize, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        if (ptr == MAP_FAILED)
+        {
+            std::cout << "memfd mmap failed,errstr=" << strerror(errno) << std::endl;
+            close(fd);
+            return nullptr;
+        }
+        // 3.没有key---锁内联在控制块中
+        ShmQueOptions memfdOptions = options;
+        memfdOptions.inlineLock = true;
+        ShmQueue *shmque = new ShmQueue(-1, size, -1, ptr, EnumCreateModel::NewShmQue, visitModule, memfdOptions);
+        shmque->_backend = EnumShmBackend::Memfd;
+        shmque->_fd = fd;
+        shmque->_mapSize = mapSize;
+        shmque->_filepath = name;
+        return shmque;
+    }
+    ShmQueue::ptr ShmQueue::CreateMemfdShmQueuePtr(const std::string &name, size_t size,
+                                                   EnumVisitModel visitModule, const ShmQueOptions &options)
+    {
+        return std::shared_ptr<ShmQueue>(ShmQueue::CreateMemfdShmQueue(name, size, visitModule, options));
+    }
+    // 通过memfd attach
+    ShmQueue *ShmQueue::AttachMemfdShmQueue(int fd)
+    {
+        struct stat st;
+        if (fd < 0 || fstat(fd, &st) == -1 || (size_t)st.st_size <= sizeof(ShmQueControlBlock))
+        {
+            std::cout << errorCode2String(ShmQueErrorCode::QueueParameterInvaild) << std::endl;
+            return nullptr;
+        }
+        void *ptr = mmap(nullptr, st.st_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        if (ptr == MAP_FAILED)
+        {
+            std::cout << "memfd mmap failed,errstr=" << strerror(errno) << std::endl;
+            return nullptr;
+        }
+        ShmQueControlBlock *cblock = (ShmQueControlBlock *)ptr;
+        size_t expectSize = cblock->queSize + sizeof(ShmQueControlBlock);
+        if (cblock->magic == SHM_QUEUE_MAGIC && cblock->slab && expectSize + sizeof(ShmSlabHeader) <= (size_t)st.st_size)
+            expectSize += ShmSlab::TotalSize((BYTE *)ptr + expectSize);
+        else if (cblock->magic == SHM_QUEUE_MAGIC && cblock->retained && expectSize + sizeof(ShmLogHeader) <= (size_t)st.st_size)
+            expectSize += ((ShmLogHeader *)((BYTE *)ptr + expectSize))->totalSize;
+        if (cblock->magic == SHM_QUEUE_MAGIC && cblock->timerWheel && expectSize + sizeof(ShmTimerHeader) <= (size_t)st.st_size)
+            expectSize += ShmTimerWheel::TotalSize((BYTE *)ptr + expectSize);
+        if (cblock->magic != SHM_QUEUE_MAGIC || expectSize != (size_t)st.st_size)
+        {
+            std::cout << "AttachMemfdShmQueue failed, fd is not a ShmQueue" << std::endl;
+            munmap(ptr, st.st_size);
+            return nullptr;
+        }
+        ShmQueue *shmque = new ShmQueue(cblock, EnumCreateModel::LinkShmQue);
+        shmque->_backend = EnumShmBackend::Memfd;
+        shmque->_fd = fd;
+        shmque->_mapSize = st.st_size;
+        return shmque;
+    }
+    ShmQueue::ptr ShmQueue::AttachMemfdShmQueuePtr(int fd)
+    {
+        return std::shared_ptr<ShmQueue>(ShmQueue::AttachMemfdShmQueue(fd));
+    }
+    // 通过unix domain socket发送memfd
+    int ShmQueue::SendFd(int sockfd) const
+    {
+        if (_backend != EnumShmBackend::Memfd)
+        {
+            return (int)(ShmQueErrorCode::QueueNotSupported);
+        }
+        char data = 'Q';
+        struct iovec iov = {&data, 1};
+        char control[CMSG_SPACE(sizeof(int))];
+        memset(control, 0, sizeof(control));
+        struct msghdr msg;
+        memset(&msg, 0, sizeof(msg));
+        msg.msg_iov = &iov;
+        msg.msg_iovlen = 1;
+        msg.msg_control = control;
+        msg.msg_controllen = sizeof(control);
+        struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+        cmsg->cmsg_level = SOL_SOCKET;
+        cmsg->cmsg_type = SCM_RIGHTS;
+        cmsg->cmsg_len = CMSG_LEN(sizeof(int));
+        memcpy(CMSG_DATA(cmsg), &_fd, sizeof(int));
+        ssize_t ret = -1;
+        do
+        {
+            ret = sendmsg(sockfd, &msg, 0);
+        } while (ret == -1 && errno == EINTR);
+        if (ret == -1)
+        {
+            std::cout << "SendFd failed,errstr=" << strerror(errno) << std::endl;
+            return (int)(ShmQueErrorCode::QueueFailedSharedMemory);
+        }
+        return (int)(ShmQueErrorCode::QueueOk);
+    }
+    // 从unix domain socket接收memfd并attach
+    ShmQueue *ShmQueue::RecvMemfdShmQueue(int sockfd)
+    {
+        char data;
+        struct iovec iov = {&data, 1};
+        char control[CMSG_SPACE(sizeof(int))];
+        struct msghdr msg;
+        memset(&msg, 0, sizeof(msg));
+        msg.msg_iov = &iov;
+        msg.msg_iovlen = 1;
+        msg.msg_control = control;
+        msg.msg_controllen = sizeof(control);
+        ssize_t ret = -1;
+        do
+        {
+            ret = recvmsg(sockfd, &msg, MSG_CMSG_CLOEXEC);
+        } while (ret == -1 && errno == EINTR);
+        struct cmsghdr *cmsg = ret > 0 ? CMSG_FIRSTHDR(&msg) : nullptr;
+        if (!cmsg || cmsg->cmsg_level != SOL_SOCKET || cmsg->cmsg_type != SCM_RIGHTS)
+        {
+            std::cout << "RecvMemfdShmQueue failed,errstr=" << (ret == -1 ? strerror(errno) : "no fd received") << std::endl;
+            return nullptr;
+        }
+        int fd = -1;
+        memcpy(&fd, CMSG_DATA(cmsg), sizeof(int));
+        ShmQueue *shmque = AttachMemfdShmQueue(fd);
+        if (!shmque)
+            close(fd);
+        return shmque;
+    }
+    // 获取统计信息
+    ShmQueStats ShmQueue::GetStats() const
     {
-        return std::shared_ptr<ShmQueue>(ShmQueue::GetShmQueue(pathname, proj_id, size, visitModule));
+        ShmQueStats stats;
+        uint64_t head = _headCb->headIdx.load(std::memory_order_acquire);
+        stats.dataSize = getDataSize(head, _headCb->tailIdx.load(std::memory_order_acquire));
+        if (_headCb->shmId != _tailCb->shmId)
+        {
+            // 扩缩容中---新ring中的数据也要算上
+            stats.dataSize += getDataSize(_tailCb->headIdx.load(std::memory_order_acquire), _tailCb->tailIdx.load(std::memory_order_acquire));
+        }
+        stats.freeSize = getFreeSize(_tailCb->headIdx.load(std::memory_order_acquire), _tailCb->tailIdx.load(std::memory_order_acquire));
+        stats.droppedRecords = _controlBlock->droppedRecords.load(std::memory_order_relaxed);
+        if (_slab)
+        {
+            stats.largeMessages = _slab->GetAllocCount();
+            stats.slabUsedBytes = _slab->GetUsedBytes();
+            stats.slabAllocFailed = _slab->GetAllocFailed();
+        }
+        if (_log)
+        {
+            uint64_t head, tail;
+            logSnapshot(head, stats.logHeadSeq, tail, stats.logTailSeq);
+            stats.logRetainSeq = _log->retainSeq.load(std::memory_order_relaxed);
+        }
+        if (_timer)
+        {
+            stats.timerPending = _timer->GetPending();
+            stats.timerDelivered = _timer->GetDelivered();
+        }
+        if (_spill)
+        {
+            stats.spillDepthBytes = _spill->GetDepthBytes();
+            stats.spillDepthRecords = _spill->GetDepthRecords();
+            stats.spilledBytes = _spill->GetSpilledBytes();
+        }
+        stats.compressedMessages = _zip.compressed.load(std::memory_order_relaxed);
+        stats.compressSkipped = _zip.skipped.load(std::memory_order_relaxed);
+        stats.compressRawBytes = _zip.rawBytes.load(std::memory_order_relaxed);
+        stats.compressStoredBytes = _zip.storedBytes.load(std::memory_order_relaxed);
+        stats.compressNs = _zip.compressNs.load(std::memory_order_relaxed);
+        stats.decompressedMessages = _zip.decompressed.load(std::memory_order_relaxed);
+        stats.decompressNs = _zip.decompressNs.load(std::memory_order_relaxed);
+        return stats;
     }
     std::string ShmQueue::PrintShmQueInfo() const
     {
@@ -550,17 +2862,79 @@ namespace xten
         // 基本信息
         ss << "=== 共享内存队列信息 ===" << std::endl;
         ss << "Key: " << _controlBlock->key << std::endl;
-        ss << "队列大小: " << _controlBlock->queSize << " bytes" << std::endl;
-        ss << "Head索引: " << _controlBlock->headIdx << std::endl;
-        ss << "Tail索引: " << _controlBlock->tailIdx << std::endl;
+        ss << "队列大小: " << _tailCb->queSize << " bytes" << std::endl;
+        // 诊断信息---不需要和生产消费者同步
+        // 扩缩容中消费者和生产者可能在不同的ring上---状态图显示生产者所在的ring
+        // head/tail是单调递增的位置,索引=位置&(queSize-1)
+        uint64_t headPos = _tailCb->headIdx.load(std::memory_order_acquire);
+        uint64_t tailPos = _tailCb->tailIdx.load(std::memory_order_acquire);
+        size_t head = headPos & (_tailCb->queSize - 1);
+        size_t tail = tailPos & (_tailCb->queSize - 1);
+        ss << "Head索引: " << head << " (位置=" << headPos << ")" << std::endl;
+        ss << "Tail索引: " << tail << " (位置=" << tailPos << ")" << std::endl;
         ss << "访问模式: " << vtModel2String(_controlBlock->vtModule) << std::endl;
         ss << "创建模式: " << ((_newOrLink == EnumCreateModel::NewShmQue) ? "NewShmQue" : "LinkShmQue") << std::endl;
+        if (_backend == EnumShmBackend::FileMmap)
+            ss << "内存后端: FileMmap " << _filepath << std::endl;
+        else if (_backend == EnumShmBackend::Memfd)
+            ss << "内存后端: Memfd fd=" << _fd << std::endl;
+        else if (_backend == EnumShmBackend::Registry)
+            ss << "内存后端: Registry " << _filepath << std::endl;
+        else
+            ss << "内存后端: SysVShm shmid=" << _controlBlock->shmId << std::endl;
+        ss << "流式拷贝: " << CopyKernel2String(GetStreamCopyKernel()) << ", 阈值=" << _controlBlock->ntCopyThreshold
+           << " bytes, 预取=" << _controlBlock->prefetchLines << " lines" << std::endl;
+        ss << "头部校验: " << (_controlBlock->headerCrc ? (Crc32cHardware() ? "crc32c(sse4.2)" : "crc32c(table)") : "none")
+           << ", 记录头部=" << recordHeaderSize() << " bytes" << std::endl;
+        ss << "锁: " << (_controlBlock->inlineLock ? "inline robust mutex" : "SysV semaphore") << std::endl;
+        ss << "NUMA: " << NumaPolicy2String(_controlBlock->numaPolicy);
+        if (_controlBlock->numaNode >= 0)
+            ss << " node=" << _controlBlock->numaNode;
+        if (_controlBlock->numaPolicy != EnumNumaPolicy::Default && !_controlBlock->numaApplied)
+            ss << " (未生效)";
+        ss << ", 实际策略=" << ShmNumaDescribe(_quePtr) << ", 节点数=" << ShmNumaNodeCount()
+           << ", 当前线程在node " << ShmNumaCurrentNode() << std::endl;
+        if (_slab)
+            ss << "大消息slab: " << _slab->GetUsedBytes() << "/" << _slab->GetTotalSize() << " bytes, 阈值="
+               << _slab->GetThreshold() << " bytes" << std::endl;
+        if (_controlBlock->overwrite)
+            ss << "覆盖模式: 已丢弃 " << _controlBlock->droppedRecords.load(std::memory_order_relaxed) << " 次" << std::endl;
+        if (_log)
+            ss << "保留日志: 序号[" << _log->headSeq.load(std::memory_order_relaxed) << ", "
+               << _log->tailSeq.load(std::memory_order_relaxed) << "), 保留水位=" << _log->retainSeq.load(std::memory_order_relaxed)
+               << ", 索引间隔=" << _log->indexInterval << ", 索引槽位=" << _log->indexCapacity << std::endl;
+        if (_timer)
+            ss << "延迟消息: 未到期 " << _timer->GetPending() << "/" << _timer->GetNodeCount() << " 条, 累计到期 "
+               << _timer->GetDelivered() << " 条, 精度=" << _timer->GetTickNs() / 1000 << " us, 最大长度="
+               << _timer->GetMaxMsgSize() << " bytes" << std::endl;
+        if (_spill)
+            ss << "溢出层: " << _spill->GetFilePath() << ", 深度=" << _spill->GetDepthRecords() << " 条/"
+               << _spill->GetDepthBytes() << " bytes, 累计溢出=" << _spill->GetSpilledBytes() << " bytes" << std::endl;
+        if (GetCompressThreshold() > 0 || _zip.decompressed.load(std::memory_order_relaxed) > 0)
+        {
+            uint64_t raw = _zip.rawBytes.load(std::memory_order_relaxed);
+            uint64_t stored = _zip.storedBytes.load(std::memory_order_relaxed);
+            ss << "压缩: 阈值=" << GetCompressThreshold() << " bytes, 本句柄压缩 "
+               << _zip.compressed.load(std::memory_order_relaxed) << " 条(" << raw << " -> " << stored << " bytes, 压缩率="
+               << (stored ? (double)raw / stored : 0.0) << "), 不可压缩 " << _zip.skipped.load(std::memory_order_relaxed)
+               << " 条, 压缩耗时=" << _zip.compressNs.load(std::memory_order_relaxed) / 1000 << " us, 解压 "
+               << _zip.decompressed.load(std::memory_order_relaxed) << " 条, 解压耗时="
+               << _zip.decompressNs.load(std::memory_order_relaxed) / 1000 << " us" << std::endl;
+        }
+        int pollerShmId = _controlBlock->pollerShmId.load(std::memory_order_relaxed);
+        if (pollerShmId != -1)
+            ss << "poller: shmid=" << pollerShmId << ", 槽位=" << _controlBlock->pollerSlot << std::endl;
+        bool resizing = _headCb->shmId != _tailCb->shmId;
+        if (resizing)
+            ss << "扩缩容中: 消费者ring shmid=" << _headCb->shmId << "(剩余"
+               << getDataSize(_headCb->headIdx.load(std::memory_order_acquire), _headCb->tailIdx.load(std::memory_order_acquire))
+               << " bytes), 生产者ring shmid=" << _tailCb->shmId << std::endl;
 
         // 图形化显示队列状态
         ss << "=== 队列状态图 ===" << std::endl;
         // 计算数据大小和空闲空间
-        size_t dataSize = getDataSize();
-        size_t freeSize = getFreeSize();
+        size_t dataSize = getDataSize(headPos, tailPos);
+        size_t freeSize = getFreeSize(headPos, tailPos);
         ss << "数据大小: " << dataSize << " bytes" << std::endl;
         ss << "空闲空间: " << freeSize << " bytes" << std::endl;
         ss << "保留空间: " << REMAIN_SIZE << " bytes" << std::endl;
@@ -571,15 +2945,17 @@ namespace xten
         ss << "[";
         for (size_t i = 0; i < displayWidth; ++i)
         {
-            size_t pos = (i * _controlBlock->queSize) / displayWidth;
-            if (pos == _controlBlock->headIdx)
+            size_t pos = (i * _tailCb->queSize) / displayWidth;
+            if (pos == head)
                 ss << "H"; // Head位置
-            else if (pos == _controlBlock->tailIdx)
+            else if (pos == tail)
                 ss << "T"; // Tail位置
-            else if ((_controlBlock->headIdx < _controlBlock->tailIdx &&
-                      pos > _controlBlock->headIdx && pos < _controlBlock->tailIdx) ||
-                     (_controlBlock->headIdx > _controlBlock->tailIdx &&
-                      (pos > _controlBlock->headIdx || pos < _controlBlock->tailIdx)))
+            else if (dataSize == 0)
+                ss << "."; // 空闲区域
+            else if ((head < tail &&
+                      pos > head && pos < tail) ||
+                     (head >= tail &&
+                      (pos > head || pos < tail)))
                 ss << "#"; // 数据区域
             else
                 ss << "."; // 空闲区域
@@ -2,23 +2,29 @@
 #define __XTEN_SHM_QUEUE_H__
 #include <memory>
 #include <string>
+#include <atomic>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <stdint.h>
+#include <vector>
+#include <functional>
+#include <unordered_map>
+#include <algorithm>
+#include <chrono>
 #include "SemRWMutex.h"
+#include "ShmMutex.h"
+#include "ShmCopy.h"
+#include "ShmSlab.h"
+#include "ShmTimerWheel.h"
+#include "ShmNuma.h"
+#include "ShmLz.h"
 #include "nocopyable.hpp"
 // 线程安全的共享内存消息队列
 
 // cpu缓存行大小
 #define CPU_CACHELINE_SIZE 64
 
-// 定义编译器屏障---仅禁止编译器的指令重排
-#define compiler_barrier() __asm__ __volatile__("" ::: "memory")
-
-// 定义cpu内存屏障
-// 1.mfence 全屏障 （读写操作都静止重排序，都可见）
-#define mfence() __asm__ __volatile__("mfence" ::: "memory")
-// 2.sfence 写屏障  (写操作在屏障前完成，并且写操作对其他核心可见)
-#define sfence() __asm__ __volatile__("sfence" ::: "memory")
-// 3.lfence 读屏障  (读操作在屏障后完成，并且读操作读到的是最新的值)
-#define lfence() __asm__ __volatile__("lfence" ::: "memory")
 namespace xten
 {
 // 进行内存对齐
@@ -30,6 +36,119 @@ namespace xten
     typedef size_t DATA_SIZE_TYPE;
 // 定义固定大小的额外空间
 #define REMAIN_SIZE 8
+// 记录提交标记---记录完整写入后才会带上这个标记
+#define RECORD_COMMIT_MAGIC 0x51534D43u
+// 大消息描述符记录的提交标记---记录数据是ShmLargeDesc,消息本身在slab中
+#define RECORD_DESC_MAGIC 0x51534D44u
+// 流分片记录的提交标记---记录数据是ShmFrameHeader+分片数据
+#define RECORD_FRAG_MAGIC 0x51534D46u
+// 压缩记录的提交标记---记录数据是uint32_t原始长度+ShmLz压缩数据
+#define RECORD_LZ_MAGIC 0x51534D5Au
+// 压缩阈值的最小值---压缩记录多一个uint32_t原始长度,更短的消息LZ找不到匹配
+#define SHM_COMPRESS_MIN_THRESHOLD (sizeof(uint32_t) + SHM_LZ_MF_LIMIT + 1)
+// 分片标记
+#define SHM_FRAME_FIRST 0x1u // 流的第一个分片
+#define SHM_FRAME_LAST 0x2u  // 流的最后一个分片
+// 普通消息的流id---PushStream的streamId不能使用
+#define SHM_STREAM_NONE 0u
+// 主题id个数---主题id是记录头部中的16位整数,默认主题为0
+#define SHM_TOPIC_COUNT 65536
+#define SHM_TOPIC_NONE 0
+// 保留日志: 默认每隔多少条记录登记一个索引
+#define SHM_LOG_INDEX_INTERVAL 64
+#define SHM_LOG_INVALID_SEQ UINT64_MAX
+// 一条记录的最大长度 (头部中的长度字段为32位)
+#define SHM_RECORD_MAX_LENGTH 0xFFFFFFFFu
+    // 每条记录的头部 [commit|crc|length|topic] + 消息数据
+    struct ShmRecordHeader
+    {
+        uint32_t commit;   // 提交标记 RECORD_COMMIT_MAGIC
+        uint32_t crc;      // commit和crc之后头部字段的crc32c,未开启校验时为0
+        uint32_t length;   // 消息长度
+        uint16_t topic;    // 主题id---消费者只读头部就能过滤
+        uint16_t reserved; // 保留
+    };
+    static_assert(sizeof(ShmRecordHeader) == 16, "ShmRecordHeader should be 16 bytes");
+// 紧凑记录头部(创建时选择)---8字节 [提交标记低8位|长度24位|topic16位|crc低16位]
+// 小消息的头部开销减半; ring中的记录长度不超过SHM_COMPACT_MAX_LENGTH(更大的消息放slab或者用PushStream)
+// 解码只有一次8字节读取和移位,提交标记的高24位是固定值,由标记的低8位还原
+#define SHM_COMPACT_HEADER_SIZE 8
+#define SHM_COMPACT_MAX_LENGTH 0xFFFFFFu
+// PopToFd写出一部分之后等待fd可写的最长时间---等待期间持有head锁
+#define SHM_FD_WRITE_TIMEOUT_MS 1000
+    // 大消息描述符---slab中的数据偏移和消息长度
+    struct ShmLargeDesc
+    {
+        uint64_t offset; // 数据相对slab起始位置的偏移
+        uint64_t length; // 消息长度
+    };
+    // 保留日志区域头部---紧跟在ring之后,后面是稀疏索引数组
+    // 记录的序号不写入记录本身: head/tail处记录的序号和head/tail位置一起由seqlock保护,
+    // 每indexInterval条记录在索引中登记一次 序号->位置,索引槽位=序号/indexInterval&(capacity-1)
+    struct ShmLogHeader
+    {
+        uint32_t magic;         // 初始化完成标记
+        uint32_t indexInterval; // 每隔多少条记录登记一个索引
+        uint64_t indexCapacity; // 索引槽位个数(2的n次幂)
+        uint64_t totalSize;     // 区域总大小(包含头部和索引)
+        // 生产者的seqlock: 奇数表示正在修改head/tail位置和序号
+        alignas(64) std::atomic<uint64_t> version{0};
+        std::atomic<uint64_t> headSeq{0}; // head处记录的序号(最老的保留记录)
+        std::atomic<uint64_t> tailSeq{0}; // 下一条放入的记录的序号
+        // 保留水位: 序号>=retainSeq的记录不会被生产者回收---消费者推进
+        alignas(64) std::atomic<uint64_t> retainSeq{0};
+    };
+    // 稀疏索引项---seq为SHM_LOG_INVALID_SEQ时表示正在被覆盖
+    struct ShmLogIndexEntry
+    {
+        std::atomic<uint64_t> seq;
+        std::atomic<uint64_t> pos;
+    };
+    // 流分片的帧头部---在分片记录数据的开头
+    struct ShmFrameHeader
+    {
+        uint32_t streamId; // 流id
+        uint32_t flags;    // SHM_FRAME_FIRST/SHM_FRAME_LAST
+    };
+    // 交给流回调的分片信息---普通消息是streamId=SHM_STREAM_NONE且FIRST|LAST的单个分片
+    struct ShmFrameInfo
+    {
+        uint32_t streamId = SHM_STREAM_NONE;
+        uint32_t flags = SHM_FRAME_FIRST | SHM_FRAME_LAST;
+    };
+    // 流回调 data/length:分片数据,直接指向队列中的内存,只在回调期间有效
+    typedef std::function<void(const ShmFrameInfo &info, const void *data, size_t length)> ShmStreamCallback;
+    // 主题订阅集合---每个主题id一个bit
+    class ShmTopicSet
+    {
+    public:
+        ShmTopicSet() : _bits(SHM_TOPIC_COUNT / 64, 0) {}
+        void Add(uint16_t topic) { _bits[topic >> 6] |= 1ull << (topic & 63); }
+        void Remove(uint16_t topic) { _bits[topic >> 6] &= ~(1ull << (topic & 63)); }
+        bool Test(uint16_t topic) const { return (_bits[topic >> 6] >> (topic & 63)) & 1; }
+        void Clear() { std::fill(_bits.begin(), _bits.end(), 0); }
+
+    private:
+        std::vector<uint64_t> _bits;
+    };
+    // 广播读取游标---每个消费者私有的读取位置,读取不移动队列的head,也不阻止生产者覆盖
+    struct ShmCursor
+    {
+        uint64_t pos = 0;     // 下一条记录的位置
+        uint64_t lapped = 0;  // 落后太多被生产者套圈(数据被覆盖)的次数
+        uint64_t skipped = 0; // 按主题过滤跳过的记录数
+        uint64_t seq = 0;     // 保留日志模式: 下一条记录的序号
+    };
+    // 零拷贝的消息视图
+    // 消费者: PopMessageView得到,大消息直接指向slab中的数据,小消息拷贝到inlineBuf; 用完后ReleaseView
+    // 生产者: AllocMessageView在slab中分配,原地写入数据后PushMessageView只把描述符放入队列
+    struct ShmMsgView
+    {
+        void *data = nullptr;       // 消息数据
+        size_t length = 0;          // 消息长度
+        uint64_t block = 0;         // 数据所在slab块的偏移 0表示数据在inlineBuf中
+        std::vector<BYTE> inlineBuf; // 小消息的拷贝
+    };
     // 读写访问模式---元素大小1字节
     enum class EnumVisitModel : unsigned char
     {
@@ -38,6 +157,14 @@ namespace xten
         MulitPushSinglePop = 2,  // 多push单pop
         MulitPushMulitPop = 3,   // 多push多pop
     };
+    // 队列所在内存的来源
+    enum class EnumShmBackend : unsigned char
+    {
+        SysVShm = 0,   // System V共享内存 (ftok key)
+        FileMmap = 1,  // mmap一个文件(tmpfs或磁盘),进程/主机重启后数据仍在
+        Memfd = 2,     // 匿名memfd,通过fd继承或unix socket传递,最后一个fd关闭后自动释放
+        Registry = 3,  // 嵌在其他段(ShmQueueRegistry/ShmRpcChannel)中的队列,内存由所属对象管理
+    };
     // 首次创建 or 链接已经存在
     enum class EnumCreateModel : unsigned char
     {
@@ -55,26 +182,153 @@ namespace xten
         QueueDataError = -5,                // 数据长度字段不足
         QueueDataLengthError = -6,          // 数据长度字段有错
         QueueBufferLengthInsufficient = -7, // 获取消息时缓冲区长度不足
+        QueueRecordUncommitted = -8,        // 记录没有提交标记(生产者写入未完成)
+        QueueRecordCrcError = -9,           // 记录头部crc校验失败
+        QueueNotSupported = -10,            // 当前后端/模式不支持该操作
+        QueueTimeout = -11,                 // 等待超时
+        QueueSeqNotRetained = -12,          // 保留日志中没有这个序号(已经被回收或者还没有写入)
+        QueueFdError = -13,                 // 读写文件描述符失败(errno保留系统调用的错误)
+        QueueFdClosed = -14,                // 文件描述符已经读到结尾(对端关闭)
     };
+    // 创建队列时的可选参数---只在创建新队列时生效,链接已有队列时以控制块中的为准
+    struct ShmQueOptions
+    {
+        bool headerCrc = false; // 记录头部是否带crc32c校验(SSE4.2硬件指令)
+        // 紧凑记录头部: 8字节代替16字节,适合大量十几字节的小消息; 开启crc时只保留crc32c的低16位
+        // ring中单条记录不能超过SHM_COMPACT_MAX_LENGTH(16MB-1)
+        bool compactHeader = false;
+        // 使用放在控制块中的robust mutex代替key+1/key+2的System V信号量
+        // memfd后端总是使用; 文件后端不支持(重启后锁状态不可信)
+        bool inlineLock = false;
+        // 文件后端的批量msync---每个打开文件的句柄各自生效,由后台线程执行,不在生产者路径上
+        size_t msyncIntervalMs = 0; // 每隔多少毫秒把脏数据刷到文件 0不按时间刷
+        size_t msyncBytes = 0;      // 本句柄写入多少字节后触发一次刷盘 0不按字节数刷
+        // 覆盖模式(遥测/调试日志): 队列满时生产者丢弃最老的记录而不是返回QueueNoFreeSize,不等待消费者腾出空间
+        // 丢弃时用CAS推进head,不获取消费者的head锁; 多生产者模式(MulitPush*)下生产者之间仍然要获取tail锁,
+        // 所以一个生产者仍然可能等待另一个生产者; 消费者被套圈时自动重新同步到最老的合法记录; 不支持Resize
+        bool overwrite = false;
+        // 大消息slab(System V/memfd后端): 队列ring之后再分配slabSize字节的slab
+        // 长度>=largeMsgThreshold的消息放入slab,队列中只放一个描述符 (0表示queSize/8)
+        // 不能和覆盖模式一起使用,使用slab的队列不支持Resize; slab或时间轮的参数不合法(slab放不下一个最小块等)时创建失败
+        size_t slabSize = 0;
+        size_t largeMsgThreshold = 0;
+        // 保留日志模式(System V/memfd后端): 每条记录有一个递增的64位序号,取出消息不释放空间
+        // 消费者用游标读取,可以Seek到任意还在保留范围内的序号重新读; 生产者只回收保留水位之前的记录,
+        // 水位之后的空间用完时返回QueueNoFreeSize; 不能和覆盖模式/slab一起使用(以保留日志为准),不支持Resize
+        // 生产者在更新序号的中间崩溃时,由下一个放入的生产者修复(在此之前读取序号范围的游标会等待)
+        bool retainedLog = false;
+        size_t logIndexInterval = 0; // 每隔多少条记录登记一个索引 0表示SHM_LOG_INDEX_INTERVAL
+        // 延迟消息时间轮(System V/memfd后端): 队列之后再分配一个分层时间轮,PushMessageAt的消息到期前放在这里
+        // timerSlots: 最多同时有多少条未到期的消息 0不使用; timerMaxMsgSize: 延迟消息的最大长度
+        // timerTickUs: 时间轮精度,消息在到期后的一个tick内被消费者看到
+        size_t timerSlots = 0;
+        size_t timerMaxMsgSize = 256;
+        size_t timerTickUs = 1000;
+        // NUMA放置(System V/memfd后端): 创建时把整个段(控制块+ring+slab/保留日志/时间轮)按策略放置
+        // Bind/Preferred的numaNode<0表示创建者当前所在的节点---由消费者创建队列时就是消费者本地的内存
+        // 单节点机器上不生效; 文件后端不支持(页缓存不受映射的策略控制)
+        EnumNumaPolicy numaPolicy = EnumNumaPolicy::Default;
+        int numaNode = -1;
+        // 压缩: 长度>=compressThreshold的消息放入时用自带的LZ算法压缩,取出时自动解压 0不压缩
+        // 非0的阈值至少是SHM_COMPRESS_MIN_THRESHOLD(更小的值按这个值处理)
+        // 压缩后没有节省至少1/8时按原样放入; 放入slab的消息、延迟消息、合并写句柄暂存的小消息和PushFromFd不压缩
+        // 之后可以用SetCompressThreshold修改
+        size_t compressThreshold = 0;
+    };
+    // 队列统计信息
+    struct ShmQueStats
+    {
+        size_t dataSize = 0;         // 当前数据大小/Byte
+        size_t freeSize = 0;         // 当前空闲空间/Byte
+        // 覆盖模式下生产者丢弃的次数: 正常情况下每次丢弃一条记录,等于丢弃的记录数;
+        // 遇到损坏的记录头部时head之后的全部数据一起丢弃(记录数未知),只计1次
+        uint64_t droppedRecords = 0;
+        uint64_t largeMessages = 0;  // 累计放入slab的大消息数
+        uint64_t slabUsedBytes = 0;  // slab当前已经分配的字节数
+        uint64_t slabAllocFailed = 0; // slab分配失败次数(退回到ring中或者返回QueueNoFreeSize)
+        // 溢出层(本句柄)
+        uint64_t spillDepthBytes = 0;   // 溢出层中还没有回放的消息字节数
+        uint64_t spillDepthRecords = 0; // 溢出层中还没有回放的消息数
+        uint64_t spilledBytes = 0;      // 累计溢出的消息字节数
+        // 保留日志
+        uint64_t logHeadSeq = 0;   // 最老的保留记录的序号
+        uint64_t logTailSeq = 0;   // 下一条记录的序号
+        uint64_t logRetainSeq = 0; // 保留水位
+        // 延迟消息
+        uint64_t timerPending = 0;   // 时间轮中还没有到期的消息数
+        uint64_t timerDelivered = 0; // 累计到期放入队列的消息数
+        // 压缩(本句柄) 压缩率=compressRawBytes/compressStoredBytes
+        uint64_t compressedMessages = 0;   // 压缩后放入的消息数
+        uint64_t compressSkipped = 0;      // 超过阈值但是不可压缩,按原样放入的消息数
+        uint64_t compressRawBytes = 0;     // 压缩前的字节数
+        uint64_t compressStoredBytes = 0;  // 压缩后的字节数
+        uint64_t compressNs = 0;           // 压缩花费的时间(包括放弃的尝试)
+        uint64_t decompressedMessages = 0; // 解压的消息数
+        uint64_t decompressNs = 0;         // 解压花费的时间
+    };
+    class ShmSpill;
     class ALIGNED_CACHELINE_SIZE ShmQueue : public nocopyable
     {
     private:
         // 这个共享内存消息队列对应的头部控制块---记录一些信息
-        // 1) 这里读写索引用int类型,cpu可以保证对float,double和long除外的基本类型的读写是原子的,保证一个线程不会读到另外一个线程写到一半的值
+        // 1) 读写索引是无锁的std::atomic<int>,在共享内存中跨进程同样有效
+        //    发布方(生产者写tail/消费者写head)使用release写,观察方使用acquire读:
+        //    x86上release/acquire就是普通的mov,不需要额外的fence; ARM64上编译为stlr/ldar
         struct ShmQueControlBlock
         {
-            volatile int headIdx = 0;               // 队列头部索引
-            char memoryInsert1[CPU_CACHELINE_SIZE]; // 填充缓存行 防止false sharing
-            volatile int tailIdx = 0;               // 队列尾部索引
-            char memoryInsert2[CPU_CACHELINE_SIZE];
-            size_t queSize = 0; // 队列空间大小/Byte
-            char memoryInsert3[CPU_CACHELINE_SIZE];
-            key_t key = -1; // key值
-            char memoryInsert4[CPU_CACHELINE_SIZE];
-            int shmId = -1; // key对应的shmid
-            char memoryInsert5[CPU_CACHELINE_SIZE];
-            EnumVisitModel vtModule; // 访问模式
+            // 每组字段独占一个缓存行(alignas),整个控制块只有3个缓存行,防止false sharing
+            // [消费者: head+锁][生产者: tail+锁][创建后只读的配置]
+            // head/tail是单调递增的字节位置(不回绕),索引=位置&(queSize-1),数据大小=tail-head
+            alignas(CPU_CACHELINE_SIZE) std::atomic<uint64_t> headIdx{0}; // 队列头部位置
+            pthread_mutex_t headLock;                                      // 内联的头部锁---和head在同一缓存行
+            std::atomic<int> spacePollerShmId{-1};                         // 等待空闲空间的poller段 -1表示没有
+            uint32_t spacePollerSlot = 0;                                  // 在该poller就绪位图中的槽位
+            std::atomic<uint32_t> compressThreshold{0};                    // 压缩阈值---生产者放入时本来就要读这个缓存行中的head
+            alignas(CPU_CACHELINE_SIZE) std::atomic<uint64_t> tailIdx{0}; // 队列尾部位置
+            pthread_mutex_t tailLock;                                      // 内联的尾部锁
+            std::atomic<uint64_t> droppedRecords{0};                       // 覆盖模式下生产者丢弃的次数(见ShmQueStats)
+            std::atomic<int> pollerShmId{-1};                              // 注册到的poller段 -1表示没有
+            uint32_t pollerSlot = 0;                                       // 在poller就绪位图中的槽位
+            alignas(CPU_CACHELINE_SIZE) size_t queSize = 0;           // 队列空间大小/Byte
+            key_t key = -1;                                           // key值
+            int shmId = -1;                                           // key对应的shmid
+            EnumVisitModel vtModule;                                  // 访问模式
+            // 2) 创建时确定的记录格式
+            bool headerCrc = false;  // 记录头部是否带crc32c
+            bool inlineLock = false; // 锁是否内联在控制块中
+            bool overwrite = false;  // 覆盖模式
+            bool slab = false;       // ring之后是否有大消息slab
+            bool retained = false;   // 保留日志模式---ring之后是保留日志区域
+            bool timerWheel = false; // slab/保留日志之后是否有延迟消息时间轮
+            EnumNumaPolicy numaPolicy = EnumNumaPolicy::Default; // 创建时请求的NUMA策略
+            // 3) 拷贝调优参数,所有attach的进程共享
+            int prefetchLines = DEFAULT_PREFETCH_LINES;         // 消费后预取下一条记录的缓存行数 0不预取
+            int16_t numaNode = -1;                              // 绑定的节点 -1表示没有(Default/Interleave)
+            bool numaApplied = false;                           // NUMA策略是否生效(单节点机器/mbind失败时为false)
+            bool compactHeader = false;                         // 记录头部是否是8字节的紧凑格式
+            size_t ntCopyThreshold = DEFAULT_NT_COPY_THRESHOLD; // 消息长度>=该值时使用非临时存储写入队列
+            // 4) 初始化完成标记---文件后端重启时据此判断控制块是否可以直接复用
+            uint32_t magic = 0;
+            // 5) 在线扩缩容(只支持System V后端): 每个ring的控制块记录下一个ring的shmid
+            //    根控制块(ftok key对应的段)额外记录当前生产/消费所在ring的shmid,新attach的句柄据此定位
+            std::atomic<int> nextShmId{-1}; // 本ring之后的新ring -1表示没有
+            std::atomic<int> headShmId{-1}; // 根控制块: 消费者所在的ring
+            std::atomic<int> tailShmId{-1}; // 根控制块: 生产者所在的ring
+            std::atomic<size_t> curQueSize{0}; // 根控制块: 生产者所在ring的大小
         } ALIGNED_CACHELINE_SIZE;
+        static_assert(sizeof(ShmQueControlBlock) == 3 * CPU_CACHELINE_SIZE, "ShmQueControlBlock should be 3 cachelines");
+        // registry段直接在自己的arena中构造控制块和队列
+        friend class ShmQueueRegistry;
+        // 最新值表复用共享内存的获取/销毁接口
+        friend class ShmLatestTable;
+        // RPC通道在一个段中构造请求/回复两个队列,直接放入带帧头部的记录
+        friend class ShmRpcChannel;
+        // poller在控制块中登记自己的段和槽位
+        friend class ShmQueuePoller;
+        // 合并写句柄在本地按记录格式暂存,整块放入ring
+        friend class ShmQueueWriter;
+        // 溢出层回放时绕过溢出判断直接放入
+        friend class ShmSpill;
 
     public:
         typedef std::shared_ptr<ShmQueue> ptr;
@@ -82,62 +336,359 @@ namespace xten
         // 获取一个进程安全共享内存消息队列实例(非单例)---智能指针
         // queSize会被对齐到2的n次幂
         static std::shared_ptr<ShmQueue> GetShmQueuePtr(const std::string &pathname, int proj_id,
-                                                        size_t quesize, EnumVisitModel visitModule = EnumVisitModel::MulitPushMulitPop);
+                                                        size_t quesize, EnumVisitModel visitModule = EnumVisitModel::MulitPushMulitPop,
+                                                        const ShmQueOptions &options = ShmQueOptions());
         // 获取一个进程安全共享内存消息队列实例(非单例)---裸指针
         // queSize会被对齐到2的n次幂
         static ShmQueue *GetShmQueue(const std::string &pathname, int proj_id,
-                                     size_t quesize, EnumVisitModel visitModule = EnumVisitModel::MulitPushMulitPop);
+                                     size_t quesize, EnumVisitModel visitModule = EnumVisitModel::MulitPushMulitPop,
+                                     const ShmQueOptions &options = ShmQueOptions());
+        // 获取一个文件映射的持久化消息队列实例---裸指针
+        // 文件中已经有合法的控制块时直接复用(O(1)热启动,不拷贝数据),此时quesize被忽略
+        // proj_id只用于和文件路径一起生成锁的key
+        // 热启动时没有其他句柄打开着文件(主机重启/所有进程已经退出),之前的poller注册被清除,需要重新Register
+        static ShmQueue *GetFileShmQueue(const std::string &filepath, int proj_id,
+                                         size_t quesize, EnumVisitModel visitModule = EnumVisitModel::MulitPushMulitPop,
+                                         const ShmQueOptions &options = ShmQueOptions());
+        // 获取一个文件映射的持久化消息队列实例---智能指针
+        static std::shared_ptr<ShmQueue> GetFileShmQueuePtr(const std::string &filepath, int proj_id,
+                                                            size_t quesize, EnumVisitModel visitModule = EnumVisitModel::MulitPushMulitPop,
+                                                            const ShmQueOptions &options = ShmQueOptions());
+        // 创建一个匿名(memfd)消息队列---不占用全局IPC名字空间,锁内联在控制块中
+        // name只用于/proc/<pid>/fd中的显示; 最后一个fd关闭并且所有进程解除映射后自动释放
+        // 其他进程通过fork继承fd或者SendFd/RecvMemfdShmQueue获得fd后attach
+        static ShmQueue *CreateMemfdShmQueue(const std::string &name, size_t quesize,
+                                             EnumVisitModel visitModule = EnumVisitModel::MulitPushMulitPop,
+                                             const ShmQueOptions &options = ShmQueOptions());
+        static std::shared_ptr<ShmQueue> CreateMemfdShmQueuePtr(const std::string &name, size_t quesize,
+                                                                EnumVisitModel visitModule = EnumVisitModel::MulitPushMulitPop,
+                                                                const ShmQueOptions &options = ShmQueOptions());
+        // 通过memfd attach到已经存在的匿名队列---fd的所有权交给队列 (一次mmap)
+        static ShmQueue *AttachMemfdShmQueue(int fd);
+        static std::shared_ptr<ShmQueue> AttachMemfdShmQueuePtr(int fd);
+        // 从unix domain socket接收memfd(SCM_RIGHTS)并attach
+        static ShmQueue *RecvMemfdShmQueue(int sockfd);
 
         // 析构
         ~ShmQueue();
 
         // 一些获取属性接口
         // QueSize
-        size_t GetQueueSize() const { return _controlBlock->queSize; }
+        size_t GetQueueSize() const { return _controlBlock->curQueSize.load(std::memory_order_relaxed); }
         // shmid
         int GetShmId() const { return _controlBlock->shmId; }
         // visitModule
         EnumVisitModel GetVisitModel() const { return _controlBlock->vtModule; }
         // 创建或者链接
         EnumCreateModel GetCreateModel() const { return _newOrLink; }
+        // 内存后端
+        EnumShmBackend GetBackend() const { return _backend; }
+        // 文件/memfd后端的fd
+        int GetFd() const { return _fd; }
+        // 非临时存储阈值
+        size_t GetNtCopyThreshold() const { return _controlBlock->ntCopyThreshold; }
+        // 预取缓存行数
+        int GetPrefetchLines() const { return _controlBlock->prefetchLines; }
+        // 记录头部是否带crc
+        bool GetHeaderCrc() const { return _controlBlock->headerCrc; }
+        // 记录头部是否是紧凑格式,以及ring中每条记录头部的字节数
+        bool GetCompactHeader() const { return _controlBlock->compactHeader; }
+        size_t GetRecordHeaderSize() const { return recordHeaderSize(); }
+        // NUMA策略和绑定的节点---节点>=0时消费者线程可以ShmNumaPinThread(GetNumaNode())固定到段所在的节点
+        EnumNumaPolicy GetNumaPolicy() const { return _controlBlock->numaPolicy; }
+        int GetNumaNode() const { return _controlBlock->numaApplied ? _controlBlock->numaNode : -1; }
+
+        // 拷贝调优接口---修改写在控制块中,对所有attach该队列的进程生效
+        // 设置使用非临时存储的消息长度阈值 (SIZE_MAX表示总是使用memcpy)
+        void SetNtCopyThreshold(size_t threshold) { _controlBlock->ntCopyThreshold = threshold; }
+        // 设置消费端预取下一条记录的缓存行数
+        void SetPrefetchLines(int lines) { _controlBlock->prefetchLines = lines < 0 ? 0 : lines; }
+        // 设置压缩阈值 (0表示不压缩)
+        void SetCompressThreshold(size_t threshold)
+        {
+            _controlBlock->compressThreshold.store(clampCompressThreshold(threshold), std::memory_order_relaxed);
+        }
+        size_t GetCompressThreshold() const { return _controlBlock->compressThreshold.load(std::memory_order_relaxed); }
 
         // 放入消息 on succecss ret=0 ; on failed ret<0
-        int PushMessage(const void *msg, DATA_SIZE_TYPE msglength);
+        // topic: 写入记录头部的主题id,广播游标据此过滤
+        int PushMessage(const void *msg, DATA_SIZE_TYPE msglength, uint16_t topic = SHM_TOPIC_NONE);
+        // 放入延迟消息: deliverAt之前消费者看不到这条消息 on succecss ret=0 ; on failed ret<0
+        // 消息先放入共享内存中的时间轮(O(1)),到期后由下一个检查的消费者放入ring; 已经到期时直接PushMessage
+        // 同一个tick内到期的消息之间不保证顺序; 时间轮节点用完时返回QueueNoFreeSize
+        // 多生产者模式下到期的消息由消费者的Pop/Peek/ReadCursor放入,消费者阻塞在poller上时超时不要超过一个tick;
+        // 单生产者模式下只能由生产者放入(PushMessage/PushMessageAt时检查),生产者空闲时需要定期调用AdvanceTimers
+        int PushMessageAt(const void *msg, DATA_SIZE_TYPE msglength, std::chrono::steady_clock::time_point deliverAt,
+                          uint16_t topic = SHM_TOPIC_NONE);
+        // 把时间轮中已经到期的消息放入ring ret=本次放入的消息数 ; on failed ret<0
+        // 单生产者模式下和PushMessage一样只能由生产者线程调用
+        int AdvanceTimers();
         // 取出消息 on succecss ret=sizeof(message) ; on failed ret<0
         int PopMessage(void *buffer, size_t bufLength);
         // 获取头部消息拷贝---不改变索引位置 on succecss ret=sizeof(message) ; on failed ret<0
         int PeekHeadMessage(void *buffer, size_t bufLength);
         // 删除头部消息---改变索引位置 on succecss ret=sizeof(message) ; on failed ret<0
         int DelHeadMessage();
+        // 零拷贝取出消息 on succecss ret=sizeof(message) 没有消息ret=0 ; on failed ret<0
+        // 大消息的数据留在slab中直到ReleaseView
+        int PopMessageView(ShmMsgView &view);
+        // 释放PopMessageView/AllocMessageView得到的视图
+        void ReleaseView(ShmMsgView &view);
+        // 生产者在slab中分配length字节,原地写入view.data on success ret=0 ; on failed ret<0
+        int AllocMessageView(size_t length, ShmMsgView &view);
+        // 把AllocMessageView得到的消息放入队列(只放描述符) on success ret=0 ; on failed ret<0 视图仍归调用者
+        int PushMessageView(ShmMsgView &view, uint16_t topic = SHM_TOPIC_NONE);
+        // 从fd读取最多maxLen字节作为一条消息放入 on success ret=读到的字节数 fd暂时没有数据ret=0 ; on failed ret<0
+        // 直接readv到ring中预留的空间(头尾两段),不经过用户态缓冲区; 读到多少发布多少,没有读到数据时不发布记录
+        // 最多读取当前空闲空间大小(且不超过INT_MAX)的数据,ring满时返回QueueNoFreeSize且不读取fd; 对端关闭返回QueueFdClosed
+        // 覆盖模式下先读到本线程的临时缓冲区,按实际读到的长度放入---没有读到数据时不丢弃旧记录
+        // readv期间持有tail锁---多生产者共享队列时fd应该是非阻塞的
+        int PushFromFd(int fd, size_t maxLen, uint16_t topic = SHM_TOPIC_NONE);
+        // 取出一条消息直接writev到fd on success ret=消息长度 没有消息ret=0 ; on failed ret<0
+        // 头尾两段数据一次writev写出,大消息直接从slab写出; 消息写完之后才移动head
+        // 第一个字节都没有写出(例如非阻塞fd的EAGAIN)时返回QueueFdError,消息留在队列中;
+        // 写出一部分之后等待fd可写继续写完,保证字节流中的消息不被截断; 写socket时调用者应该忽略SIGPIPE
+        // 等待持有head锁,超过SHM_FD_WRITE_TIMEOUT_MS仍不可写时丢弃这条消息并返回QueueTimeout(字节流已经不完整)
+        // 覆盖模式和保留日志不支持
+        int PopToFd(int fd);
+        // 流式放入超过队列容量的大消息 on success ret=0 ; on failed ret<0
+        // 按当前空闲空间把数据切成分片依次放入,空间不足时等待消费者腾出空间(自然背压)
+        // flags: 本次数据是否是流的开始/结束,数据不在内存中时可以分多次调用 (FIRST ... 0 ... LAST)
+        // timeoutMs<0一直等待; 超时返回QueueNoFreeSize,已经放入的分片不会撤回
+        // 不同生产者的分片可以交错,消费者按streamId区分; 覆盖模式不支持
+        int PushStream(uint32_t streamId, const void *data, size_t length,
+                       uint32_t flags = SHM_FRAME_FIRST | SHM_FRAME_LAST, int timeoutMs = -1);
+        // 取出一条记录,把数据直接在队列中交给回调,不拷贝 on success ret=sizeof(data) 没有消息ret=0 ; on failed ret<0
+        // 记录分布在队列头尾时分两次回调; 回调在持有头部锁时执行,不能在回调中再Pop这个队列
+        // 流的分片必须由同一个消费者取出(单pop或者只有一个消费者调用流接口)
+        int PopStream(const ShmStreamCallback &cb);
+        // 取出记录并重组流,直到一个流(或者一条普通消息)完整 on success ret=sizeof(message) 没有完整的消息ret=0 ; on failed ret<0
+        // 未完成的流缓存在本句柄中,下次调用继续重组; 重组需要缓存整个消息,不需要时用PopStream
+        int PopStreamMessage(std::vector<BYTE> &message, uint32_t &streamId);
+        // 打开广播游标 on success ret=0 ; on failed ret<0
+        // fromHead=true从队列中最老的数据开始读,否则只读之后放入的消息; 扩缩容过的队列不支持
+        int OpenCursor(ShmCursor &cursor, bool fromHead = false);
+        // 用游标读取下一条订阅主题的消息,不删除消息 on success ret=sizeof(message) 没有消息ret=0 ; on failed ret<0
+        // topics为空表示订阅全部主题; 不匹配的记录只读头部跳过,不拷贝数据,整批头部扫描完后只校验一次
+        // 游标不加锁,任意多个游标互不影响; 被套圈时跳到最老的数据并累加cursor.lapped
+        // 配合覆盖模式就是生产者不等待读者的广播; 普通模式下游标不能越过普通消费者已经取走的数据
+        int ReadCursor(ShmCursor &cursor, void *buffer, size_t bufLength,
+                       const ShmTopicSet *topics = nullptr, uint16_t *topic = nullptr);
+        // 保留日志模式: 把游标移动到序号为seq的记录 on success ret=0 ; on failed ret<0
+        // 稀疏索引直接定位到seq之前最近的索引点(O(1)),再跳过不到indexInterval条记录的头部
+        // seq==tailSeq时游标停在tail,等待之后放入的记录; 不在保留范围内时返回QueueSeqNotRetained
+        int Seek(ShmCursor &cursor, uint64_t seq);
+        // 保留日志模式: 推进保留水位,序号<seq的记录允许被生产者回收(水位只增不减) on success ret=0 ; on failed ret<0
+        // 多个消费者时由调用者取所有消费者已经处理完的最小序号
+        int SetRetainSeq(uint64_t seq);
+        // 保留日志模式: 当前保留的序号范围[headSeq, tailSeq) on success ret=0 ; on failed ret<0
+        int GetLogRange(uint64_t &headSeq, uint64_t &tailSeq) const;
+        // 在线扩缩容(System V后端) on success ret=0 ; on failed ret<0
+        // 新建一个newQuesize大小的ring链接在当前ring之后,生产者立即切换到新ring,
+        // 消费者读完旧ring后跟随---所有attach的句柄在下一次Push/Pop时自动重新映射,不需要停止生产消费
+        // 单生产者模式下没有tail锁,必须由生产者线程自己调用
+        int Resize(size_t newQuesize);
+        // 为本句柄开启溢出层 on success ret=0 ; on failed ret<0
+        // ring满时PushMessage不再返回QueueNoFreeSize,而是把消息交给后台线程写入filepath,消费者追上后按顺序回放
+        // 溢出层中还有消息时之后的消息也进入溢出层,本句柄放入的消息始终有序:
+        // PushStream等待回放完,PushMessageView/PushFromFd返回QueueNoFreeSize; 到期的延迟消息不参与这个顺序
+        // maxSpillBytes: 溢出深度上限(0不限),超过时返回QueueNoFreeSize; 溢出文件只属于这个句柄,
+        // 析构时没有回放完的消息留在文件中,下次对同一个文件EnableSpill时最先回放
+        // 回放线程是另一个生产者,单生产者模式和覆盖模式不支持(QueueNotSupported)
+        int EnableSpill(const std::string &filepath, size_t maxSpillBytes = 0);
+        // 文件后端: 同步把整个映射刷到文件 on success ret=0 ; on failed ret<0
+        int SyncFile();
+        // memfd后端: 通过unix domain socket把队列的fd发给其他进程 on success ret=0 ; on failed ret<0
+        int SendFd(int sockfd) const;
+        // 获取统计信息
+        ShmQueStats GetStats() const;
         // 打印共享内存消息队列的属性信息
         std::string PrintShmQueInfo() const;
 
     private:
         ShmQueue(key_t key, size_t quesize, int shmId, void *shmPtr,
-                 EnumCreateModel newOrLink, EnumVisitModel visitModule = EnumVisitModel::MulitPushMulitPop);
+                 EnumCreateModel newOrLink, EnumVisitModel visitModule = EnumVisitModel::MulitPushMulitPop,
+                 const ShmQueOptions &options = ShmQueOptions());
         // 如果是link链接到一个已经启动的消息队列,应该调用这个构造函数---防止 [控制块] 的值被重置
         ShmQueue(ShmQueControlBlock *cblock, EnumCreateModel newOrLink);
+        // 大小对齐到2的n次幂
+        static size_t roundUpToPowerOfTwo(size_t v);
         // 获取共享内存的接口--系统分配内存大小为4KB的整数倍
         static void *getSharedMemory(key_t key, int &shmid, EnumCreateModel &newOrLink, size_t size);
         // 删除共享内存----detach and rmid
         static bool destroySharedMemory(void *shmPtr, key_t key);
+        // 映射文件---文件大小为 控制块+队列大小, 文件中控制块合法时为Link
+        static void *getFileMemory(const std::string &filepath, int &fd, EnumCreateModel &newOrLink, size_t &size);
+        // 文件后端: 启动/停止后台msync线程
+        void startMsync(const ShmQueOptions &options);
+        void stopMsync();
+        // 后台msync线程
+        void msyncLoop();
+        // msync队列中[begin,end)的区域,可能分布在头尾
+        void msyncRing(uint64_t begin, uint64_t end);
+        // msync映射中[offset,offset+len)的区域 (按页对齐)
+        void msyncRange(size_t offset, size_t len);
         // 根据访问模式决定锁的init
         void initLock();
+        // 扩缩容: 定位生产/消费所在的ring
+        void initRingView();
+        // attach/detach一个扩容产生的ring (根ring不detach)
+        ShmQueControlBlock *attachRing(int shmId);
+        void detachRing(ShmQueControlBlock *cblock);
+        // 生产者切换到根控制块记录的最新ring
+        bool followTailRing();
+        // 当前ring已经读完并且后面还有新ring时切换过去 on switched ret=true
+        bool followHeadRing(uint64_t head);
         // 获取空闲空间的大小
-        size_t getFreeSize() const;
+        size_t getFreeSize(uint64_t head, uint64_t tail) const;
         // 获取数据大小
-        size_t getDataSize() const;
+        size_t getDataSize(uint64_t head, uint64_t tail) const;
+        // 按位置读写记录头部---头部可能分布在队列头尾
+        void readRecordHeader(uint64_t pos, ShmRecordHeader &header) const;
+        void writeRecordHeader(uint64_t pos, const ShmRecordHeader &header);
+        // 记录头部在ring中的字节数和ring中单条记录的最大长度---由创建时的头部格式决定
+        size_t recordHeaderSize() const
+        {
+            return _controlBlock->compactHeader ? SHM_COMPACT_HEADER_SIZE : sizeof(ShmRecordHeader);
+        }
+        size_t recordMaxLength() const
+        {
+            return _controlBlock->compactHeader ? SHM_COMPACT_MAX_LENGTH : SHM_RECORD_MAX_LENGTH;
+        }
+        // 按ring中的格式编码头部 ret=写入out的字节数(recordHeaderSize)
+        size_t encodeRecordHeader(const ShmRecordHeader &header, BYTE *out) const;
+        // 从按ring格式编码的内存中解码头部
+        void decodeRecordHeader(const BYTE *in, ShmRecordHeader &header) const;
+        // 压缩阈值: 0保持不压缩,其余限制在[SHM_COMPRESS_MIN_THRESHOLD, UINT32_MAX]
+        static uint32_t clampCompressThreshold(size_t threshold)
+        {
+            if (threshold == 0)
+                return 0;
+            return (uint32_t)std::min(std::max(threshold, (size_t)SHM_COMPRESS_MIN_THRESHOLD), (size_t)UINT32_MAX);
+        }
+        // 放入消息(不经过溢出层): 大消息放入slab,其余放入ring
+        int pushMessage(const void *msg, DATA_SIZE_TYPE msglength, uint16_t topic);
+        // 加锁后放入一条记录 commit为记录的提交标记 prefix非空时放在消息数据之前(流分片的帧头部)
+        int pushRecord(const void *msg, DATA_SIZE_TYPE msglength, uint32_t commit, uint16_t topic = SHM_TOPIC_NONE,
+                       const void *prefix = nullptr, size_t prefixLength = 0);
+        // 持有tail锁时调用: 预留need字节(必要时切换ring/覆盖/回收) on success ret=0 tail=记录开始的位置 ; on failed ret<0
+        int reserveTail(size_t need, uint64_t &tail);
+        // 持有tail锁时调用: 发布[pos, end)处已经写好的一条记录,通知poller并累计刷盘字节数
+        void publishRecord(uint64_t pos, uint64_t end);
+        // 加锁后放入一块已经是记录格式的数据(多条记录),只发布一次tail on success ret=0 ; on failed ret<0
+        int pushBlock(const void *block, size_t length);
+        // 向生产者ring的pos位置拷贝length字节---数据可能分布在头尾
+        void copyToQueue(uint64_t pos, const void *data, size_t length, bool streaming);
+        // 读取并校验dataPos处的大消息描述符,buffer非空时拷贝数据 on success ret=sizeof(message) ; on failed ret<0
+        int readLarge(uint64_t dataPos, size_t recordLength, void *buffer, size_t bufLength, ShmLargeDesc &desc);
+        // 从pos位置拷贝length字节消息数据
+        void copyFromQueue(void *buffer, uint64_t pos, size_t length) const;
+        // ring中一条记录(大消息描述符以外)的消息长度: 流分片去掉帧头部,压缩记录是原始长度
+        size_t recordMessageLength(const ShmRecordHeader &header, uint64_t dataPos) const;
+        // 读取ring中一条记录(大消息描述符以外)的消息数据: 流分片跳过帧头部,压缩记录解压到buffer
+        // on success ret=sizeof(message) ; on failed ret<0 (缓冲区不足QueueBufferLengthInsufficient,数据损坏QueueDataLengthError)
+        int readRecordData(const ShmRecordHeader &header, uint64_t dataPos, void *buffer, size_t bufLength);
+        // 覆盖模式: 丢弃最老的记录直到空闲空间>=need on success ret=true
+        bool dropOldest(uint64_t head, uint64_t tail, size_t need);
+        // 保留日志: 回收保留水位之前最老的记录直到空闲空间>=need on success ret=true
+        bool reclaimLog(uint64_t head, uint64_t tail, size_t need);
+        // 保留日志: seq是索引点时登记 序号->位置 (在发布tail之前调用)
+        void logIndex(uint64_t seq, uint64_t pos);
+        // 保留日志: 生产者修改head/tail位置和序号前后调用的seqlock
+        void logWriteBegin();
+        void logWriteEnd();
+        // 保留日志: 生产者在seqlock中间崩溃后修复序号、seqlock和索引(持有tail锁时调用)
+        void logRecover();
+        // 保留日志: 读取一致的head/tail位置和序号
+        void logSnapshot(uint64_t &head, uint64_t &headSeq, uint64_t &tail, uint64_t &tailSeq) const;
+        // 延迟消息: 有到期的消息时放入ring---没有时间轮的队列只多一次指针判断,时间轮为空时不读时钟
+        // 单生产者模式没有tail锁,只能由生产者自己放入(producer=true),多生产者模式由消费者放入
+        void deliverTimers(bool producer)
+        {
+            if (_timer && producer == (_tailMtx == nullptr) && _timer->GetPending() != 0 &&
+                _timer->Due(ShmTimerWheel::NowNs()))
+                advanceTimers(false);
+        }
+        // 推进时间轮并把到期的消息放入ring ret=放入的消息数
+        int advanceTimers(bool wait);
+        // 覆盖模式: 读取(remove时同时删除)head处的记录
+        int readHeadOverwrite(void *buffer, size_t bufLength, bool remove);
+        // 移动head---覆盖模式下使用CAS
+        void advanceHead(uint64_t from, uint64_t to);
+        // 放入消息后通知注册的poller---按需attach poller段
+        void notifyPoller();
+        // 移动head后通知等待空闲空间的poller---没有登记时只多一次relaxed读
+        void notifySpace()
+        {
+            if (_controlBlock->spacePollerShmId.load(std::memory_order_relaxed) != -1)
+                notifySpacePoller();
+        }
+        void notifySpacePoller();
+        // 按控制块中记录的shmid切换attach的poller段 ret=段地址 失败返回nullptr
+        static void *attachPoller(int shmId, void *&seg, int &segShmId);
+        // 计算记录头部的crc
+        uint32_t recordHeaderCrc(const ShmRecordHeader &header) const;
+        // 校验head处的记录 on success ret=0 dataPos为消息数据的起始位置
+        // 记录损坏时只跳过这一条记录,不清空整个队列
+        int checkHeadRecord(uint64_t head, uint64_t tail, ShmRecordHeader &header, uint64_t &dataPos);
+        // 记录头部损坏(长度不可信)时,从head之后逐字节查找下一条合法记录并移动head
+        void resyncHead(uint64_t head, uint64_t tail);
 
     private:
         ShmQueControlBlock *_controlBlock; // 头部控制块地址
         void *_shmPtr;                     // 共享内存起始地址
         BYTE *_quePtr;                     // 消息队列的起始地址 (两个地址相隔一个控制块距离)
+        // 生产者/消费者看到的ring---没有扩缩容时都指向根控制块
+        ShmQueControlBlock *_headCb; // 消费者所在ring的控制块
+        BYTE *_headQue;              // 消费者所在ring的起始地址
+        ShmQueControlBlock *_tailCb; // 生产者所在ring的控制块
+        BYTE *_tailQue;              // 生产者所在ring的起始地址
 
-        SemRWMutex *_headMtx = nullptr; // 头部锁
-        SemRWMutex *_tailMtx = nullptr; // 尾部锁
+        ProcessMutex *_headMtx = nullptr; // 头部锁
+        ProcessMutex *_tailMtx = nullptr; // 尾部锁
+        ShmSlab *_slab = nullptr;         // 大消息slab
+        ShmLogHeader *_log = nullptr;     // 保留日志区域
+        ShmLogIndexEntry *_logIndex = nullptr; // 保留日志的稀疏索引
+        ShmTimerWheel *_timer = nullptr;  // 延迟消息时间轮
 
         EnumCreateModel _newOrLink; // 创建或者链接
+
+        EnumShmBackend _backend = EnumShmBackend::SysVShm; // 内存后端
+        int _fd = -1;                                      // 文件/memfd后端的文件描述符
+        size_t _mapSize = 0;                               // 文件/memfd后端的映射长度
+        std::string _filepath;                             // 文件后端的文件路径
+        std::shared_ptr<void> _owner;                      // registry后端: 持有registry,保证段在队列之后才detach
+        std::unordered_map<uint32_t, std::vector<BYTE>> _streams; // PopStreamMessage中未完成的流
+        void *_pollerSeg = nullptr;                        // 已经attach的poller段
+        int _pollerShmId = -1;                             // _pollerSeg对应的shmid (attach失败时也记录,不再重试)
+        void *_spacePollerSeg = nullptr;                   // 已经attach的等待空闲空间的poller段
+        int _spacePollerShmId = -1;                        // _spacePollerSeg对应的shmid
+        std::unique_ptr<ShmSpill> _spill;                  // 本句柄的溢出层
+
+        // 文件后端的批量msync
+        std::thread _msyncThread;
+        std::mutex _msyncMtx;
+        std::condition_variable _msyncCond;
+        bool _msyncStop = false;
+        size_t _msyncIntervalMs = 0;
+        size_t _msyncBytes = 0;                 // 0表示不按字节数触发
+        std::atomic<size_t> _unsyncedBytes{0};  // 本句柄写入但还没有刷盘的字节数
+        // 压缩统计(本句柄)
+        struct ZipCounters
+        {
+            std::atomic<uint64_t> compressed{0};
+            std::atomic<uint64_t> skipped{0};
+            std::atomic<uint64_t> rawBytes{0};
+            std::atomic<uint64_t> storedBytes{0};
+            std::atomic<uint64_t> compressNs{0};
+            std::atomic<uint64_t> decompressed{0};
+            std::atomic<uint64_t> decompressNs{0};
+        };
+        ZipCounters _zip;
     };
+    // 索引在共享内存中被多个进程访问,必须是无锁(地址无关)的原子类型
+    static_assert(std::atomic<int>::is_always_lock_free, "ShmQueue requires lock-free std::atomic<int>");
+    static_assert(std::atomic<uint64_t>::is_always_lock_free, "ShmQueue requires lock-free std::atomic<uint64_t>");
     std::ostream &operator<<(std::ostream &os, const ShmQueue &queue);
 } // namespace xten
 #endif
\ No newline at end of file
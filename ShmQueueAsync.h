@@ -0,0 +1,260 @@
+#ifndef __XTEN_SHM_QUEUE_ASYNC_H__
+#define __XTEN_SHM_QUEUE_ASYNC_H__
+#if !defined(__cpp_impl_coroutine)
+#error "ShmQueueAsync.h requires C++20 coroutines (-std=c++20)"
+#endif
+#include <coroutine>
+#include <deque>
+#include <exception>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+#include <stdint.h>
+#include <unistd.h>
+#include "ShmQueue.h"
+#include "ShmQueuePoller.h"
+// C++20协程接口---co_await que.Pop(buffer, len) / co_await que.Push(msg, len)
+// 快速路径: await_ready直接尝试PopMessage/PushMessage,成功时协程不挂起,和同步调用的开销相同
+// 慢速路径: 把操作登记到执行器,队列有新消息/消费者腾出空间时由执行器重试,完成后恢复协程
+// 通知来自ShmQueuePoller: 生产者放入消息后置位消息就绪,消费者移动head后置位空间就绪,挂起的协程不占用cpu
+// 只有这个头文件需要C++20,库本身仍然按C++17编译
+namespace xten
+{
+// 队列没有注册到执行器的poller时(已经注册到其他poller),退化为每隔多少毫秒重试一次
+#define SHM_ASYNC_POLL_MS 1
+    // 一个挂起中的队列操作---放在协程帧中,挂起期间地址不变
+    struct ShmAsyncOp
+    {
+        virtual ~ShmAsyncOp() {}
+        // 重试操作 ret=true已经完成(成功或者失败) ; ret=false仍然需要等待
+        virtual bool TryComplete() = 0;
+        std::coroutine_handle<> handle; // 完成后恢复的协程
+    };
+    // 执行器接口---实现这两个函数就可以把队列接入已有的调度器
+    class ShmAsyncExecutor
+    {
+    public:
+        virtual ~ShmAsyncExecutor() {}
+        // 恢复一个就绪的协程
+        virtual void Post(std::coroutine_handle<> handle) = 0;
+        // 登记等待: que有新消息(readable=true)/有空闲空间(readable=false)时调用op->TryComplete,完成后Post(op->handle)
+        virtual void Await(ShmQueue *que, bool readable, ShmAsyncOp *op) = 0;
+    };
+    // 即发即忘的协程---创建时挂起,交给执行器的Spawn开始运行,结束时自动释放协程帧
+    struct ShmAsyncTask
+    {
+        struct promise_type
+        {
+            ShmAsyncTask get_return_object() { return ShmAsyncTask{std::coroutine_handle<promise_type>::from_promise(*this)}; }
+            std::suspend_always initial_suspend() noexcept { return {}; }
+            std::suspend_never final_suspend() noexcept { return {}; }
+            void return_void() {}
+            void unhandled_exception() { std::terminate(); }
+        };
+        std::coroutine_handle<promise_type> handle;
+    };
+    // 队列的协程包装---不拥有执行器,执行器的生命周期必须覆盖所有挂起的操作
+    class ShmAsyncQueue
+    {
+    public:
+        // co_await Pop ret=sizeof(message) ; on failed ret<0 (不会返回0,没有消息时挂起)
+        struct PopAwaiter : public ShmAsyncOp
+        {
+            ShmQueue *que;
+            ShmAsyncExecutor *executor;
+            void *buffer;
+            size_t bufLength;
+            int result = 0;
+            bool TryComplete() override
+            {
+                result = que->PopMessage(buffer, bufLength);
+                return result != 0;
+            }
+            bool await_ready() { return TryComplete(); }
+            void await_suspend(std::coroutine_handle<> h)
+            {
+                handle = h;
+                executor->Await(que, true, this);
+            }
+            int await_resume() { return result; }
+        };
+        // co_await Push on success ret=0 ; on failed ret<0 (队列满时挂起,不返回QueueNoFreeSize)
+        struct PushAwaiter : public ShmAsyncOp
+        {
+            ShmQueue *que;
+            ShmAsyncExecutor *executor;
+            const void *msg;
+            DATA_SIZE_TYPE length;
+            uint16_t topic;
+            int result = 0;
+            bool TryComplete() override
+            {
+                result = que->PushMessage(msg, length, topic);
+                return result != (int)(ShmQueErrorCode::QueueNoFreeSize);
+            }
+            bool await_ready() { return TryComplete(); }
+            void await_suspend(std::coroutine_handle<> h)
+            {
+                handle = h;
+                executor->Await(que, false, this);
+            }
+            int await_resume() { return result; }
+        };
+
+        ShmAsyncQueue(const ShmQueue::ptr &que, ShmAsyncExecutor &executor)
+            : _que(que), _executor(&executor)
+        {
+        }
+        // 取出消息---buffer在co_await完成之前必须有效
+        PopAwaiter Pop(void *buffer, size_t bufLength)
+        {
+            PopAwaiter awaiter;
+            awaiter.que = _que.get();
+            awaiter.executor = _executor;
+            awaiter.buffer = buffer;
+            awaiter.bufLength = bufLength;
+            return awaiter;
+        }
+        // 放入消息---msg在co_await完成之前必须有效
+        PushAwaiter Push(const void *msg, DATA_SIZE_TYPE length, uint16_t topic = SHM_TOPIC_NONE)
+        {
+            PushAwaiter awaiter;
+            awaiter.que = _que.get();
+            awaiter.executor = _executor;
+            awaiter.msg = msg;
+            awaiter.length = length;
+            awaiter.topic = topic;
+            return awaiter;
+        }
+        const ShmQueue::ptr &GetQueue() const { return _que; }
+
+    private:
+        ShmQueue::ptr _que;
+        ShmAsyncExecutor *_executor;
+    };
+    // 单线程执行器示例---所有协程在调用Run的线程中运行
+    // 挂起的操作按队列分组,队列第一次被等待时注册到本执行器的poller(消息就绪/空间就绪各占一个槽位)
+    // 没有就绪的协程时睡眠在poller的futex上,直到生产者/消费者置位
+    class ShmAsyncLoop : public ShmAsyncExecutor, public nocopyable
+    {
+    public:
+        // capacity: 最多等待的队列个数(每个队列的消息/空间等待各占一个槽位)
+        explicit ShmAsyncLoop(uint32_t capacity = 1024)
+            : _poller(ShmQueuePoller::CreateShmQueuePoller(capacity))
+        {
+        }
+        // 析构---注销所有注册的队列; 还挂起的协程不会再被恢复(协程帧泄漏),应该先让它们结束
+        ~ShmAsyncLoop()
+        {
+            if (!_poller)
+                return;
+            for (auto &it : _waiters)
+            {
+                if (it.second.readRegistered)
+                    _poller->Unregister(it.first);
+                if (it.second.writeRegistered)
+                    _poller->UnregisterWritable(it.first);
+            }
+        }
+        // 开始运行一个协程
+        void Spawn(ShmAsyncTask task) { Post(task.handle); }
+        void Post(std::coroutine_handle<> handle) override { _ready.push_back(handle); }
+        void Await(ShmQueue *que, bool readable, ShmAsyncOp *op) override
+        {
+            Waiters &waiters = _waiters[que];
+            bool &registered = readable ? waiters.readRegistered : waiters.writeRegistered;
+            bool &polling = readable ? waiters.readPolling : waiters.writePolling;
+            if (!registered && !polling)
+            {
+                // 注册时已经就绪会直接置位---登记之前发生的放入/取出不会丢失
+                int ret = _poller ? (readable ? _poller->Register(que) : _poller->RegisterWritable(que)) : -1;
+                registered = ret >= 0;
+                polling = ret < 0;
+                if (polling)
+                    _polling++;
+            }
+            (readable ? waiters.readers : waiters.writers).push_back(op);
+            _suspended++;
+        }
+        // 运行直到没有就绪的协程也没有挂起的操作,或者被Stop
+        void Run()
+        {
+            _stop = false;
+            std::vector<ShmQueue *> readable, writable;
+            while (!_stop)
+            {
+                // 1.恢复所有就绪的协程---恢复过程中新Post的协程在本轮一起运行
+                while (!_ready.empty() && !_stop)
+                {
+                    std::coroutine_handle<> handle = _ready.front();
+                    _ready.pop_front();
+                    handle.resume();
+                }
+                if (_stop || _suspended == 0)
+                    break;
+                // 2.睡眠直到有队列就绪
+                if (_poller && _poller->GetQueueCount() > 0)
+                {
+                    _poller->Wait(readable, writable, _polling > 0 ? SHM_ASYNC_POLL_MS : -1);
+                    _wakeups++;
+                }
+                else
+                {
+                    readable.clear();
+                    writable.clear();
+                    usleep(SHM_ASYNC_POLL_MS * 1000);
+                }
+                // 3.按顺序重试就绪队列上挂起的操作---第一个没有完成的操作之后的都继续等待
+                for (ShmQueue *que : readable)
+                    complete(_waiters[que].readers);
+                for (ShmQueue *que : writable)
+                    complete(_waiters[que].writers);
+                if (_polling > 0)
+                {
+                    for (auto &it : _waiters)
+                    {
+                        if (it.second.readPolling)
+                            complete(it.second.readers);
+                        if (it.second.writePolling)
+                            complete(it.second.writers);
+                    }
+                }
+            }
+        }
+        // 在协程中调用---当前协程返回(挂起)后Run退出
+        void Stop() { _stop = true; }
+        // 统计
+        size_t GetSuspended() const { return _suspended; }
+        uint64_t GetWakeups() const { return _wakeups; }
+
+    private:
+        struct Waiters
+        {
+            std::deque<ShmAsyncOp *> readers; // 等待消息的操作
+            std::deque<ShmAsyncOp *> writers; // 等待空闲空间的操作
+            bool readRegistered = false;
+            bool writeRegistered = false;
+            bool readPolling = false; // 注册失败---定时重试
+            bool writePolling = false;
+        };
+        void complete(std::deque<ShmAsyncOp *> &ops)
+        {
+            while (!ops.empty() && ops.front()->TryComplete())
+            {
+                Post(ops.front()->handle);
+                ops.pop_front();
+                _suspended--;
+            }
+        }
+
+    private:
+        std::unique_ptr<ShmQueuePoller> _poller;
+        std::deque<std::coroutine_handle<>> _ready;
+        std::unordered_map<ShmQueue *, Waiters> _waiters;
+        size_t _suspended = 0; // 挂起中的操作数
+        size_t _polling = 0;   // 退化为定时重试的等待个数
+        uint64_t _wakeups = 0; // 从poller返回的次数
+        bool _stop = false;
+    };
+} // namespace xten
+#endif
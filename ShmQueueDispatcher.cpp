@@ -0,0 +1,191 @@
+#include "ShmQueueDispatcher.h"
+#include <iostream>
+#include <unistd.h>
+namespace xten
+{
+// 队列为空时分发线程先yield多少次,之后每次sleep
+#define SHM_DISPATCH_SPIN_COUNT 64
+#define SHM_DISPATCH_SLEEP_US 50
+// 工作线程没有任务时的等待时间---超时后重新尝试窃取
+#define SHM_DISPATCH_IDLE_WAIT_MS 1
+    ShmQueueDispatcher::ShmQueueDispatcher(const ShmQueue::ptr &que, size_t workers, const Handler &handler,
+                                           const KeyFunc &key, size_t batch, size_t maxPending)
+        : _que(que),
+          _handler(handler),
+          _key(key),
+          _batch(batch > 0 ? batch : 1),
+          _maxPending(maxPending > 0 ? maxPending : 1)
+    {
+        for (size_t i = 0; i < (workers > 0 ? workers : 1); i++)
+            _workers.emplace_back(new Worker());
+    }
+    ShmQueueDispatcher::~ShmQueueDispatcher()
+    {
+        Stop();
+    }
+    void ShmQueueDispatcher::Start()
+    {
+        if (_started || !_que || !_handler)
+            return;
+        _started = true;
+        _stop.store(false, std::memory_order_relaxed);
+        for (size_t i = 0; i < _workers.size(); i++)
+            _workers[i]->thread = std::thread(&ShmQueueDispatcher::workerLoop, this, i);
+        _dispatcher = std::thread(&ShmQueueDispatcher::dispatchLoop, this);
+    }
+    void ShmQueueDispatcher::Stop()
+    {
+        if (!_started)
+            return;
+        _stop.store(true, std::memory_order_release);
+        _pendingCond.notify_all();
+        _dispatcher.join();
+        // 分发线程退出后不会再有新任务---唤醒工作线程处理完剩余任务后退出
+        for (auto &worker : _workers)
+        {
+            {
+                std::lock_guard<std::mutex> lock(worker->mtx);
+            }
+            worker->cond.notify_all();
+        }
+        for (auto &worker : _workers)
+            worker->thread.join();
+        _started = false;
+    }
+    // 分发线程: 批量取出消息,按key分配到固定队列,其余轮转分配到共享队列
+    void ShmQueueDispatcher::dispatchLoop()
+    {
+        size_t workerCount = _workers.size();
+        // 每个工作线程本批次的任务---一批结束后每个工作线程只加一次锁
+        std::vector<std::vector<ShmMsgView>> pinned(workerCount), shared(workerCount);
+        int idle = 0;
+        while (!_stop.load(std::memory_order_acquire))
+        {
+            // 1.背压: 工作线程处理不过来时不再取出,消息留在共享内存队列中
+            if (_pending.load(std::memory_order_acquire) >= _maxPending)
+            {
+                std::unique_lock<std::mutex> lock(_pendingMtx);
+                _pendingCond.wait(lock, [this]
+                                  { return _pending.load(std::memory_order_acquire) < _maxPending ||
+                                           _stop.load(std::memory_order_acquire); });
+                continue;
+            }
+            // 2.批量取出
+            size_t count = 0;
+            size_t limit = std::min(_batch, _maxPending - _pending.load(std::memory_order_acquire));
+            while (count < limit)
+            {
+                ShmMsgView view;
+                int ret = _que->PopMessageView(view);
+                if (ret <= 0)
+                {
+                    if (ret < 0)
+                        std::cout << "ShmQueueDispatcher pop failed, ret=" << ret << std::endl;
+                    break;
+                }
+                size_t index;
+                if (_key)
+                {
+                    index = std::hash<uint64_t>()(_key(view.data, view.length)) % workerCount;
+                    pinned[index].push_back(std::move(view));
+                }
+                else
+                {
+                    index = _nextWorker++ % workerCount;
+                    shared[index].push_back(std::move(view));
+                }
+                count++;
+            }
+            if (count == 0)
+            {
+                // 队列为空---退避
+                if (++idle < SHM_DISPATCH_SPIN_COUNT)
+                    std::this_thread::yield();
+                else
+                    usleep(SHM_DISPATCH_SLEEP_US);
+                continue;
+            }
+            idle = 0;
+            _pending.fetch_add(count, std::memory_order_acq_rel);
+            _dispatched.fetch_add(count, std::memory_order_relaxed);
+            // 3.把这一批任务交给工作线程
+            for (size_t i = 0; i < workerCount; i++)
+            {
+                if (pinned[i].empty() && shared[i].empty())
+                    continue;
+                Worker &worker = *_workers[i];
+                {
+                    std::lock_guard<std::mutex> lock(worker.mtx);
+                    for (auto &view : pinned[i])
+                        worker.pinned.push_back(std::move(view));
+                    for (auto &view : shared[i])
+                        worker.shared.push_back(std::move(view));
+                }
+                worker.cond.notify_one();
+                pinned[i].clear();
+                shared[i].clear();
+            }
+        }
+    }
+    // 工作线程
+    void ShmQueueDispatcher::workerLoop(size_t index)
+    {
+        Worker &worker = *_workers[index];
+        ShmMsgView view;
+        while (true)
+        {
+            if (takeTask(index, view))
+            {
+                _handler(view);
+                // slab中的大消息在处理完后才释放
+                _que->ReleaseView(view);
+                _processed.fetch_add(1, std::memory_order_relaxed);
+                if (_pending.fetch_sub(1, std::memory_order_acq_rel) == _maxPending)
+                {
+                    std::lock_guard<std::mutex> lock(_pendingMtx);
+                    _pendingCond.notify_one();
+                }
+                continue;
+            }
+            // 没有任务: 分发线程已经退出并且所有任务都处理完时退出
+            if (_stop.load(std::memory_order_acquire) && _pending.load(std::memory_order_acquire) == 0)
+                break;
+            std::unique_lock<std::mutex> lock(worker.mtx);
+            if (worker.pinned.empty() && worker.shared.empty())
+                worker.cond.wait_for(lock, std::chrono::milliseconds(SHM_DISPATCH_IDLE_WAIT_MS));
+        }
+    }
+    bool ShmQueueDispatcher::takeTask(size_t index, ShmMsgView &view)
+    {
+        Worker &worker = *_workers[index];
+        {
+            std::lock_guard<std::mutex> lock(worker.mtx);
+            std::deque<ShmMsgView> &tasks = !worker.pinned.empty() ? worker.pinned : worker.shared;
+            if (!tasks.empty())
+            {
+                view = std::move(tasks.front());
+                tasks.pop_front();
+                return true;
+            }
+        }
+        return steal(index, view);
+    }
+    // 窃取: 从其他线程的共享队列尾部取---和所有者从头部取的位置相反,减少冲突
+    bool ShmQueueDispatcher::steal(size_t index, ShmMsgView &view)
+    {
+        size_t workerCount = _workers.size();
+        for (size_t i = 1; i < workerCount; i++)
+        {
+            Worker &victim = *_workers[(index + i) % workerCount];
+            // try_lock: 所有者或者其他窃取者正在访问时跳过,不在别人的锁上等待
+            std::unique_lock<std::mutex> lock(victim.mtx, std::try_to_lock);
+            if (!lock.owns_lock() || victim.shared.empty())
+                continue;
+            view = std::move(victim.shared.back());
+            victim.shared.pop_back();
+            _stolen.fetch_add(1, std::memory_order_relaxed);
+            return true;
+        }
+        return false;
+    }
+} // namespace xten
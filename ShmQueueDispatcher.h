@@ -0,0 +1,88 @@
+#ifndef __XTEN_SHM_QUEUE_DISPATCHER_H__
+#define __XTEN_SHM_QUEUE_DISPATCHER_H__
+#include <memory>
+#include <atomic>
+#include <deque>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <stdint.h>
+#include "ShmQueue.h"
+// 进程内的消息分发器---一个线程批量取出消息,分发给N个工作线程并行处理
+// 只有分发线程访问队列的头部(单pop),工作线程之间不竞争队列的头部锁
+// 每个工作线程有两个本地双端队列:
+//   固定队列: 按key哈希分配的消息,只由这个工作线程按顺序处理,保证同一个key的消息有序
+//   共享队列: 不需要顺序的消息,空闲的工作线程可以从其他线程的共享队列尾部窃取
+// 工作线程拿到的是ShmMsgView: slab中的大消息不拷贝,处理完后由分发器释放
+namespace xten
+{
+    class ShmQueueDispatcher : public nocopyable
+    {
+    public:
+        typedef std::shared_ptr<ShmQueueDispatcher> ptr;
+        // 消息处理函数---在工作线程中执行,view只在调用期间有效
+        typedef std::function<void(ShmMsgView &view)> Handler;
+        // 提取消息的顺序key---同一个key的消息按队列中的顺序处理
+        typedef std::function<uint64_t(const void *data, size_t length)> KeyFunc;
+
+        // que: 被分发的队列(分发线程是它在本进程中唯一的消费者) workers: 工作线程数
+        // key为空时不保证顺序,所有消息都可以被窃取
+        // batch: 分发线程一次最多取出的消息数 maxPending: 已取出还没处理完的消息上限(背压)
+        ShmQueueDispatcher(const ShmQueue::ptr &que, size_t workers, const Handler &handler,
+                           const KeyFunc &key = nullptr, size_t batch = 64, size_t maxPending = 4096);
+        // 析构---停止并等待已经取出的消息处理完
+        ~ShmQueueDispatcher();
+
+        // 启动分发线程和工作线程
+        void Start();
+        // 停止从队列取消息,处理完已经取出的消息后退出所有线程
+        void Stop();
+
+        // 统计
+        uint64_t GetDispatched() const { return _dispatched.load(std::memory_order_relaxed); }
+        uint64_t GetProcessed() const { return _processed.load(std::memory_order_relaxed); }
+        uint64_t GetStolen() const { return _stolen.load(std::memory_order_relaxed); }
+        size_t GetPending() const { return _pending.load(std::memory_order_relaxed); }
+
+    private:
+        // 工作线程的本地队列
+        struct Worker
+        {
+            std::mutex mtx;
+            std::condition_variable cond;
+            std::deque<ShmMsgView> pinned; // 按key分配,只有自己处理
+            std::deque<ShmMsgView> shared; // 可以被窃取
+            std::thread thread;
+        };
+        // 分发线程
+        void dispatchLoop();
+        // 工作线程
+        void workerLoop(size_t index);
+        // 取一条消息: 自己的固定队列 -> 自己的共享队列 -> 窃取其他线程的共享队列
+        bool takeTask(size_t index, ShmMsgView &view);
+        // 从其他工作线程的共享队列尾部窃取
+        bool steal(size_t index, ShmMsgView &view);
+
+    private:
+        ShmQueue::ptr _que;
+        Handler _handler;
+        KeyFunc _key;
+        size_t _batch;
+        size_t _maxPending;
+        std::vector<std::unique_ptr<Worker>> _workers;
+        std::thread _dispatcher;
+        std::atomic<bool> _stop{false};
+        bool _started = false;
+        size_t _nextWorker = 0;              // 无key消息的轮转分配
+        // 背压: 已取出还没处理完的消息数达到上限时分发线程等待
+        std::atomic<size_t> _pending{0};
+        std::mutex _pendingMtx;
+        std::condition_variable _pendingCond;
+        std::atomic<uint64_t> _dispatched{0};
+        std::atomic<uint64_t> _processed{0};
+        std::atomic<uint64_t> _stolen{0};
+    };
+} // namespace xten
+#endif
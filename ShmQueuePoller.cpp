@@ -0,0 +1,292 @@
+#include "ShmQueuePoller.h"
+#include <iostream>
+#include <sstream>
+#include <chrono>
+#include <string.h>
+#include <sys/ipc.h>
+#include <sys/shm.h>
+namespace xten
+{
+    ShmQueuePoller::ShmQueuePoller(void *shmPtr)
+        : _header((PollerHeader *)shmPtr),
+          _bits(bitmap(shmPtr))
+    {
+    }
+    ShmQueuePoller::~ShmQueuePoller()
+    {
+        for (size_t slot = 0; slot < _queues.size(); slot++)
+        {
+            if (_queues[slot] && _writable[slot])
+                UnregisterWritable(_queues[slot]);
+            else if (_queues[slot])
+                Unregister(_queues[slot]);
+        }
+        if (_header)
+        {
+            shmctl(_header->shmId, IPC_RMID, NULL);
+            shmdt((void *)_header);
+        }
+    }
+    // 创建一个poller
+    ShmQueuePoller *ShmQueuePoller::CreateShmQueuePoller(uint32_t capacity)
+    {
+        if (capacity == 0)
+        {
+            std::cout << "CreateShmQueuePoller failed, capacity must > 0" << std::endl;
+            return nullptr;
+        }
+        // 1.私有段---生产者通过控制块中的shmid attach,不占用ftok的key
+        capacity = (capacity + 63) & ~63u;
+        size_t segSize = sizeof(PollerHeader) + capacity / 8;
+        int shmId = shmget(IPC_PRIVATE, segSize, 0666 | IPC_CREAT);
+        if (shmId == -1)
+        {
+            std::cout << "CreateShmQueuePoller shmget failed,errstr=" << strerror(errno) << std::endl;
+            return nullptr;
+        }
+        void *shmPtr = shmat(shmId, NULL, 0);
+        if (shmPtr == (void *)-1)
+        {
+            std::cout << "CreateShmQueuePoller shmat failed,errstr=" << strerror(errno) << std::endl;
+            shmctl(shmId, IPC_RMID, NULL);
+            return nullptr;
+        }
+        // 2.初始化---新段已经被内核清零,位图为空
+        PollerHeader *header = new (shmPtr) PollerHeader();
+        header->capacity = capacity;
+        header->shmId = shmId;
+        header->magic = SHM_POLLER_MAGIC;
+        ShmQueuePoller *poller = new ShmQueuePoller(shmPtr);
+        poller->_queues.resize(capacity, nullptr);
+        poller->_writable.resize(capacity, 0);
+        for (uint32_t slot = capacity; slot > 0; slot--)
+            poller->_freeSlots.push_back(slot - 1);
+        return poller;
+    }
+    std::shared_ptr<ShmQueuePoller> ShmQueuePoller::CreateShmQueuePollerPtr(uint32_t capacity)
+    {
+        return std::shared_ptr<ShmQueuePoller>(CreateShmQueuePoller(capacity));
+    }
+    // 注册队列
+    int ShmQueuePoller::Register(ShmQueue *que)
+    {
+        if (!que)
+        {
+            std::cout << "ShmQueuePoller Register failed, invalid queue" << std::endl;
+            return (int)(ShmQueErrorCode::QueueParameterInvaild);
+        }
+        ShmQueue::ShmQueControlBlock *cblock = que->_controlBlock;
+        if (cblock->pollerShmId.load(std::memory_order_acquire) != -1)
+        {
+            std::cout << "ShmQueuePoller Register failed, queue is already registered to a poller" << std::endl;
+            return (int)(ShmQueErrorCode::QueueParameterInvaild);
+        }
+        int ret = allocSlot(que, false);
+        if (ret < 0)
+            return ret;
+        uint32_t slot = (uint32_t)ret;
+        // 先写槽位再release发布shmid---生产者看到shmid时槽位一定有效
+        cblock->pollerSlot = slot;
+        cblock->pollerShmId.store(_header->shmId, std::memory_order_release);
+        // 注册之前放入的消息没有通知过poller
+        SetReady(que);
+        return (int)slot;
+    }
+    // 注销队列
+    int ShmQueuePoller::Unregister(ShmQueue *que)
+    {
+        if (!que || que->_controlBlock->pollerShmId.load(std::memory_order_relaxed) != _header->shmId)
+        {
+            std::cout << "ShmQueuePoller Unregister failed, queue is not registered to this poller" << std::endl;
+            return (int)(ShmQueErrorCode::QueueParameterInvaild);
+        }
+        uint32_t slot = que->_controlBlock->pollerSlot;
+        que->_controlBlock->pollerShmId.store(-1, std::memory_order_release);
+        freeSlot(slot);
+        return (int)(ShmQueErrorCode::QueueOk);
+    }
+    // 注册等待空闲空间
+    int ShmQueuePoller::RegisterWritable(ShmQueue *que)
+    {
+        if (!que)
+        {
+            std::cout << "ShmQueuePoller RegisterWritable failed, invalid queue" << std::endl;
+            return (int)(ShmQueErrorCode::QueueParameterInvaild);
+        }
+        ShmQueue::ShmQueControlBlock *cblock = que->_controlBlock;
+        if (cblock->spacePollerShmId.load(std::memory_order_acquire) != -1)
+        {
+            std::cout << "ShmQueuePoller RegisterWritable failed, queue is already registered to a poller" << std::endl;
+            return (int)(ShmQueErrorCode::QueueParameterInvaild);
+        }
+        int ret = allocSlot(que, true);
+        if (ret < 0)
+            return ret;
+        uint32_t slot = (uint32_t)ret;
+        cblock->spacePollerSlot = slot;
+        cblock->spacePollerShmId.store(_header->shmId, std::memory_order_seq_cst);
+        // 注册之前消费者腾出的空间没有通知过poller
+        if (que->getFreeSize(que->_tailCb->headIdx.load(std::memory_order_seq_cst), que->_tailCb->tailIdx.load(std::memory_order_acquire)) > 0)
+            NotifyReady(_header, slot);
+        return (int)slot;
+    }
+    // 注销等待空闲空间
+    int ShmQueuePoller::UnregisterWritable(ShmQueue *que)
+    {
+        if (!que || que->_controlBlock->spacePollerShmId.load(std::memory_order_relaxed) != _header->shmId)
+        {
+            std::cout << "ShmQueuePoller UnregisterWritable failed, queue is not registered to this poller" << std::endl;
+            return (int)(ShmQueErrorCode::QueueParameterInvaild);
+        }
+        uint32_t slot = que->_controlBlock->spacePollerSlot;
+        que->_controlBlock->spacePollerShmId.store(-1, std::memory_order_release);
+        freeSlot(slot);
+        return (int)(ShmQueErrorCode::QueueOk);
+    }
+    int ShmQueuePoller::allocSlot(ShmQueue *que, bool writable)
+    {
+        if (_freeSlots.empty())
+        {
+            std::cout << "ShmQueuePoller register failed, poller is full, capacity=" << _header->capacity << std::endl;
+            return (int)(ShmQueErrorCode::QueueNoFreeSize);
+        }
+        uint32_t slot = _freeSlots.back();
+        _freeSlots.pop_back();
+        _queues[slot] = que;
+        _writable[slot] = writable ? 1 : 0;
+        _count++;
+        return (int)slot;
+    }
+    void ShmQueuePoller::freeSlot(uint32_t slot)
+    {
+        // 清除残留的就绪位---槽位复用时不会误报
+        _bits[slot / 64].fetch_and(~(1ull << (slot % 64)), std::memory_order_relaxed);
+        _queues[slot] = nullptr;
+        _writable[slot] = 0;
+        _freeSlots.push_back(slot);
+        _count--;
+    }
+    // 重新标记就绪
+    void ShmQueuePoller::SetReady(ShmQueue *que)
+    {
+        if (!que || que->_controlBlock->pollerShmId.load(std::memory_order_relaxed) != _header->shmId)
+            return;
+        ShmQueue::ShmQueControlBlock *cblock = que->_controlBlock;
+        if (que->getDataSize(cblock->headIdx.load(std::memory_order_acquire), cblock->tailIdx.load(std::memory_order_acquire)) > 0 ||
+            cblock->nextShmId.load(std::memory_order_acquire) != -1)
+            NotifyReady(_header, cblock->pollerSlot);
+    }
+    void ShmQueuePoller::SetSpinUs(int maxSpinUs)
+    {
+        _maxSpinUs = maxSpinUs < 0 ? 0 : maxSpinUs;
+        _spinUs = _maxSpinUs;
+    }
+    // 生产者标记就绪
+    // 生产者先置位再检查等待者,poller先登记等待者再读seq和位图(都是seq_cst): 不会丢失唤醒
+    void ShmQueuePoller::NotifyReady(void *seg, uint32_t slot)
+    {
+        PollerHeader *header = (PollerHeader *)seg;
+        if (slot >= header->capacity)
+            return;
+        std::atomic<uint64_t> &word = bitmap(seg)[slot / 64];
+        uint64_t bit = 1ull << (slot % 64);
+        // 已经置位(poller还没有取走)时只读不写,不会使poller的缓存行失效
+        if (word.load(std::memory_order_relaxed) & bit)
+            return;
+        word.fetch_or(bit, std::memory_order_seq_cst);
+        if (header->waiters.load(std::memory_order_seq_cst) > 0)
+        {
+            header->seq.fetch_add(1, std::memory_order_seq_cst);
+            ShmFutexWake(&header->seq);
+        }
+    }
+    // 取走就绪位
+    void ShmQueuePoller::drain(std::vector<ShmQueue *> &readable, std::vector<ShmQueue *> &writable)
+    {
+        uint32_t words = _header->capacity / 64;
+        for (uint32_t w = 0; w < words; w++)
+        {
+            // 没有就绪位的字只读不写
+            if (_bits[w].load(std::memory_order_relaxed) == 0)
+                continue;
+            uint64_t bits = _bits[w].exchange(0, std::memory_order_acquire);
+            while (bits)
+            {
+                uint32_t slot = w * 64 + __builtin_ctzll(bits);
+                bits &= bits - 1;
+                if (_queues[slot])
+                    (_writable[slot] ? writable : readable).push_back(_queues[slot]);
+            }
+        }
+    }
+    bool ShmQueuePoller::anyReady() const
+    {
+        uint32_t words = _header->capacity / 64;
+        for (uint32_t w = 0; w < words; w++)
+        {
+            if (_bits[w].load(std::memory_order_seq_cst) != 0)
+                return true;
+        }
+        return false;
+    }
+    // 等待就绪队列
+    int ShmQueuePoller::Wait(std::vector<ShmQueue *> &ready, int timeoutMs)
+    {
+        return Wait(ready, _unusedWritable, timeoutMs);
+    }
+    int ShmQueuePoller::Wait(std::vector<ShmQueue *> &readable, std::vector<ShmQueue *> &writable, int timeoutMs)
+    {
+        readable.clear();
+        writable.clear();
+        auto start = std::chrono::steady_clock::now();
+        // 1.自适应自旋
+        if (_maxSpinUs > 0)
+        {
+            auto spinEnd = start + std::chrono::microseconds(_spinUs > 0 ? _spinUs : 1);
+            bool got = false;
+            do
+            {
+                if (anyReady())
+                {
+                    got = true;
+                    break;
+                }
+                ShmCpuRelax();
+            } while (std::chrono::steady_clock::now() < spinEnd);
+            _spinUs = got ? std::min(_spinUs * 2 + 1, _maxSpinUs) : _spinUs / 2;
+        }
+        // 2.取走就绪位,没有时在futex上睡眠
+        while (true)
+        {
+            drain(readable, writable);
+            if (!readable.empty() || !writable.empty())
+                return (int)(readable.size() + writable.size());
+            int waitMs = -1;
+            if (timeoutMs >= 0)
+            {
+                auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start).count();
+                if (elapsed >= timeoutMs)
+                    return 0;
+                waitMs = timeoutMs - (int)elapsed;
+            }
+            _header->waiters.fetch_add(1, std::memory_order_seq_cst);
+            uint32_t seq = _header->seq.load(std::memory_order_seq_cst);
+            if (!anyReady())
+                ShmFutexWait(&_header->seq, seq, waitMs);
+            _header->waiters.fetch_sub(1, std::memory_order_relaxed);
+        }
+    }
+    std::string ShmQueuePoller::PrintPollerInfo() const
+    {
+        std::stringstream ss;
+        ss << "=== 共享内存队列poller信息 ===" << std::endl;
+        ss << "shmid: " << _header->shmId << std::endl;
+        ss << "已注册队列: " << _count << "/" << _header->capacity << std::endl;
+        ss << "自旋: " << _spinUs << "/" << _maxSpinUs << " us" << std::endl;
+        uint32_t readyCount = 0;
+        for (uint32_t w = 0; w < _header->capacity / 64; w++)
+            readyCount += __builtin_popcountll(_bits[w].load(std::memory_order_relaxed));
+        ss << "就绪队列: " << readyCount << std::endl;
+        return ss.str();
+    }
+} // namespace xten
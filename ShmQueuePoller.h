@@ -0,0 +1,99 @@
+#ifndef __XTEN_SHM_QUEUE_POLLER_H__
+#define __XTEN_SHM_QUEUE_POLLER_H__
+#include <memory>
+#include <string>
+#include <atomic>
+#include <vector>
+#include <stdint.h>
+#include "ShmQueue.h"
+#include "ShmFutex.h"
+// 多队列poller---一个消费者线程等待成百上千个队列
+// poller创建一个私有共享内存段: [头部(futex字)][就绪位图],注册队列时把段的shmid和槽位写入队列的控制块
+// 生产者放入消息后检查自己的就绪位,没有置位时置位并在有等待者时唤醒poller
+// Wait只返回就绪位被置位的队列,开销和活跃队列数成正比,和注册的队列总数无关
+// 生产者也可以等待空闲空间: RegisterWritable占用另一个槽位,消费者移动head后置位,Wait通过writable返回
+namespace xten
+{
+// poller段初始化完成标记
+#define SHM_POLLER_MAGIC 0x4C504D53u
+    class ShmQueuePoller : public nocopyable
+    {
+    public:
+        // poller段头部
+        struct PollerHeader
+        {
+            uint32_t magic = 0;                                        // 初始化完成标记
+            uint32_t capacity = 0;                                     // 槽位个数(64的倍数)
+            int shmId = -1;                                            // 私有段的shmid
+            alignas(CPU_CACHELINE_SIZE) std::atomic<uint32_t> seq{0}; // futex字: 有等待者时生产者置位后+1
+            std::atomic<uint32_t> waiters{0};                          // 在seq上睡眠的poller个数
+        } ALIGNED_CACHELINE_SIZE;
+        typedef std::shared_ptr<ShmQueuePoller> ptr;
+
+        // 创建一个poller capacity:最多注册的队列个数
+        static ShmQueuePoller *CreateShmQueuePoller(uint32_t capacity = 1024);
+        static std::shared_ptr<ShmQueuePoller> CreateShmQueuePollerPtr(uint32_t capacity = 1024);
+        // 析构---注销所有队列并删除段(已经attach的生产者之后的置位不再有人读取)
+        ~ShmQueuePoller();
+
+        // 注册队列 on success ret=槽位 ; on failed ret<0
+        // 一个队列同时只能注册到一个poller; 注册时队列已经有数据则直接标记就绪
+        int Register(ShmQueue *que);
+        // 注销队列 on success ret=0 ; on failed ret<0
+        int Unregister(ShmQueue *que);
+        // 等待至少一个队列有新消息 ret=就绪队列个数 超时ret=0 (注册了RegisterWritable时使用两个vector的版本)
+        // 取走就绪位(取走即清除): 返回的队列应该被取空,没有取空时调用SetReady,否则剩余的消息要等下一次放入才会再次就绪
+        // timeoutMs<0一直等待
+        int Wait(std::vector<ShmQueue *> &ready, int timeoutMs = -1);
+        // 消费者没有取空队列时重新标记就绪
+        void SetReady(ShmQueue *que);
+        // 注册等待空闲空间 on success ret=槽位 ; on failed ret<0
+        // 一个队列同时只能有一个poller等待空闲空间(可以和等待消息的poller不同); 注册时已经有空闲空间则直接标记就绪
+        int RegisterWritable(ShmQueue *que);
+        // 注销等待空闲空间 on success ret=0 ; on failed ret<0
+        int UnregisterWritable(ShmQueue *que);
+        // 同时等待消息和空闲空间 ret=就绪队列个数(两者之和) 超时ret=0
+        // readable: 有新消息的队列(Register) writable: 消费者腾出了空间的队列(RegisterWritable)
+        int Wait(std::vector<ShmQueue *> &readable, std::vector<ShmQueue *> &writable, int timeoutMs = -1);
+        // 自适应自旋: 进入futex之前最多自旋maxSpinUs微秒 (0关闭)
+        // 自旋期间等到数据时下次的自旋时间加倍,没有等到时减半,空闲时自动退化为直接睡眠
+        void SetSpinUs(int maxSpinUs);
+
+        // 一些获取属性接口
+        uint32_t GetCapacity() const { return _header->capacity; }
+        int GetShmId() const { return _header->shmId; }
+        uint32_t GetQueueCount() const { return _count; }
+        // 打印poller的属性信息
+        std::string PrintPollerInfo() const;
+
+        // 生产者: 标记poller段seg中的槽位就绪,必要时唤醒poller
+        static void NotifyReady(void *seg, uint32_t slot);
+
+    private:
+        explicit ShmQueuePoller(void *shmPtr);
+        // 就绪位图
+        static std::atomic<uint64_t> *bitmap(void *seg)
+        {
+            return (std::atomic<uint64_t> *)((BYTE *)seg + sizeof(PollerHeader));
+        }
+        // 取走所有就绪位,把对应的队列放入readable/writable
+        void drain(std::vector<ShmQueue *> &readable, std::vector<ShmQueue *> &writable);
+        // 分配一个槽位 on success ret=槽位 ; on failed ret<0
+        int allocSlot(ShmQueue *que, bool writable);
+        void freeSlot(uint32_t slot);
+        // 是否有就绪位
+        bool anyReady() const;
+
+    private:
+        PollerHeader *_header;           // 段头部
+        std::atomic<uint64_t> *_bits;    // 就绪位图
+        std::vector<ShmQueue *> _queues; // 槽位对应的队列
+        std::vector<uint8_t> _writable;  // 槽位是否是等待空闲空间的注册
+        std::vector<ShmQueue *> _unusedWritable; // 单vector的Wait丢弃的空闲空间就绪
+        std::vector<uint32_t> _freeSlots; // 空闲槽位
+        uint32_t _count = 0;             // 已经注册的队列个数
+        int _maxSpinUs = 0;              // 自旋时间上限
+        int _spinUs = 0;                 // 当前的自旋时间
+    };
+} // namespace xten
+#endif
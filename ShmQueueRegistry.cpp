@@ -0,0 +1,215 @@
+#include "ShmQueueRegistry.h"
+#include <iostream>
+#include <sstream>
+#include <string.h>
+#include <unistd.h>
+#include <sys/ipc.h>
+#include <sys/shm.h>
+namespace xten
+{
+// 链接者等待创建者完成初始化的最长时间
+#define SHM_REGISTRY_INIT_WAIT_MS 1000
+    // 构造函数---头部的初始化/等待在GetShmQueueRegistryPtr中完成
+    ShmQueueRegistry::ShmQueueRegistry(void *shmPtr, EnumCreateModel newOrLink)
+        : _header((RegistryHeader *)shmPtr),
+          _entries((RegistryEntry *)((BYTE *)shmPtr + sizeof(RegistryHeader))),
+          _arena(nullptr),
+          _dirMtx(&((RegistryHeader *)shmPtr)->dirLock),
+          _newOrLink(newOrLink)
+    {
+    }
+    ShmQueueRegistry::~ShmQueueRegistry()
+    {
+        if (_header && shmdt((void *)_header) == -1)
+        {
+            std::cout << "ShmQueueRegistry shmdt failed,errstr=" << strerror(errno) << std::endl;
+        }
+    }
+    // 获取一个registry段
+    ShmQueueRegistry::ptr ShmQueueRegistry::GetShmQueueRegistryPtr(const std::string &pathname, int proj_id,
+                                                                   size_t arenaSize, uint32_t maxQueues)
+    {
+        if (arenaSize == 0 || maxQueues == 0)
+        {
+            std::cout << "GetShmQueueRegistryPtr failed, arenaSize and maxQueues must > 0" << std::endl;
+            return nullptr;
+        }
+        // 1.生成key
+        key_t key = ftok(pathname.c_str(), proj_id);
+        if (key == -1)
+        {
+            std::cout << "GetShmQueueRegistryPtr ftok failed,errstr=" << strerror(errno) << std::endl;
+            return nullptr;
+        }
+        // 2.获取共享内存---目录槽位数是maxQueues的2倍,保证开放寻址的探测长度很短
+        uint32_t dirCapacity = (uint32_t)ShmQueue::roundUpToPowerOfTwo((size_t)maxQueues * 2);
+        arenaSize = (arenaSize + CPU_CACHELINE_SIZE - 1) & ~(size_t)(CPU_CACHELINE_SIZE - 1);
+        size_t segSize = sizeof(RegistryHeader) + sizeof(RegistryEntry) * dirCapacity + arenaSize;
+        EnumCreateModel createM;
+        int shmid = -1;
+        void *shmPtr = ShmQueue::getSharedMemory(key, shmid, createM, segSize);
+        if (shmPtr == nullptr)
+        {
+            std::cout << "GetShmQueueRegistryPtr getSharedMemory failed" << std::endl;
+            return nullptr;
+        }
+        ShmQueueRegistry::ptr registry(new ShmQueueRegistry(shmPtr, createM));
+        RegistryHeader *header = registry->_header;
+        if (createM == EnumCreateModel::NewShmQue)
+        {
+            // 3.创建者初始化---新段已经被内核清零,目录项全部是空闲状态
+            new (header) RegistryHeader();
+            header->dirCapacity = dirCapacity;
+            header->maxQueues = maxQueues;
+            header->arenaSize = arenaSize;
+            header->key = key;
+            header->shmId = shmid;
+            ShmMutex::Init(&header->dirLock);
+            header->magic.store(SHM_REGISTRY_MAGIC, std::memory_order_release);
+        }
+        else
+        {
+            // 3.链接者等待创建者初始化完成
+            int waitMs = 0;
+            while (header->magic.load(std::memory_order_acquire) != SHM_REGISTRY_MAGIC)
+            {
+                if (waitMs++ >= SHM_REGISTRY_INIT_WAIT_MS)
+                {
+                    std::cout << "GetShmQueueRegistryPtr failed, segment is not a ShmQueueRegistry" << std::endl;
+                    return nullptr;
+                }
+                usleep(1000);
+            }
+        }
+        registry->_arena = (BYTE *)registry->_entries + sizeof(RegistryEntry) * header->dirCapacity;
+        return registry;
+    }
+    // 名字的哈希(FNV-1a)
+    uint32_t ShmQueueRegistry::hashName(const std::string &name)
+    {
+        uint32_t hash = 2166136261u;
+        for (unsigned char c : name)
+        {
+            hash ^= c;
+            hash *= 16777619u;
+        }
+        return hash;
+    }
+    // 查找名字对应的目录项---线性探测,遇到空闲槽位说明不存在
+    // 已发布的目录项不会再被修改,查找不需要加锁
+    ShmQueueRegistry::RegistryEntry *ShmQueueRegistry::findEntry(const std::string &name, uint32_t hash) const
+    {
+        uint32_t mask = _header->dirCapacity - 1;
+        for (uint32_t i = 0; i < _header->dirCapacity; i++)
+        {
+            RegistryEntry *entry = &_entries[(hash + i) & mask];
+            if (entry->state.load(std::memory_order_acquire) == 0)
+                return nullptr;
+            if (entry->hash == hash && strncmp(entry->name, name.c_str(), SHM_REGISTRY_NAME_SIZE) == 0)
+                return entry;
+        }
+        return nullptr;
+    }
+    // 包装队列句柄
+    ShmQueue::ptr ShmQueueRegistry::wrapQueue(ShmQueue *shmque, const std::string &name)
+    {
+        shmque->_backend = EnumShmBackend::Registry;
+        shmque->_filepath = name;
+        shmque->_owner = shared_from_this();
+        return std::shared_ptr<ShmQueue>(shmque);
+    }
+    // 在registry中创建一个队列
+    ShmQueue::ptr ShmQueueRegistry::CreateQueue(const std::string &name, size_t quesize,
+                                                EnumVisitModel visitModule, const ShmQueOptions &options)
+    {
+        if (name.empty() || name.size() >= SHM_REGISTRY_NAME_SIZE || quesize == 0)
+        {
+            std::cout << "CreateQueue failed, invalid name or quesize, name=" << name << std::endl;
+            return nullptr;
+        }
+        uint32_t hash = hashName(name);
+        // 已经存在---直接链接,不需要加锁
+        RegistryEntry *entry = findEntry(name, hash);
+        if (entry)
+            return OpenQueue(name);
+        WLockGuard lock(&_dirMtx);
+        // 加锁后再查一次,防止其他进程刚刚创建了同名队列
+        if ((entry = findEntry(name, hash)) != nullptr)
+        {
+            lock.UnLock();
+            return OpenQueue(name);
+        }
+        if (_header->queueCount.load(std::memory_order_relaxed) >= _header->maxQueues)
+        {
+            std::cout << "CreateQueue failed, registry is full, maxQueues=" << _header->maxQueues << std::endl;
+            return nullptr;
+        }
+        // 1.从arena中切出 控制块+队列,按缓存行对齐
+        quesize = ShmQueue::roundUpToPowerOfTwo(quesize);
+        size_t need = (sizeof(ShmQueue::ShmQueControlBlock) + quesize + CPU_CACHELINE_SIZE - 1) & ~(size_t)(CPU_CACHELINE_SIZE - 1);
+        size_t offset = _header->arenaUsed.load(std::memory_order_relaxed);
+        if (offset + need > _header->arenaSize)
+        {
+            std::cout << "CreateQueue failed, arena has no free size, need=" << need
+                      << " bytes, free=" << _header->arenaSize - offset << " bytes" << std::endl;
+            return nullptr;
+        }
+        _header->arenaUsed.store(offset + need, std::memory_order_release);
+        // 2.构造控制块---锁内联在控制块中,没有额外的IPC对象
+        ShmQueOptions regOptions = options;
+        regOptions.inlineLock = true;
+        // arena中的队列大小固定,不带slab、保留日志和时间轮; NUMA放置跟随registry段
+        regOptions.slabSize = 0;
+        regOptions.retainedLog = false;
+        regOptions.timerSlots = 0;
+        regOptions.numaPolicy = EnumNumaPolicy::Default;
+        ShmQueue *shmque = new ShmQueue(-1, quesize, _header->shmId, _arena + offset,
+                                        EnumCreateModel::NewShmQue, visitModule, regOptions);
+        // 3.发布目录项---state最后release写入,无锁查找者看到state时其他字段一定完整
+        uint32_t mask = _header->dirCapacity - 1;
+        for (uint32_t i = 0; i < _header->dirCapacity; i++)
+        {
+            entry = &_entries[(hash + i) & mask];
+            if (entry->state.load(std::memory_order_relaxed) == 0)
+                break;
+        }
+        entry->hash = hash;
+        entry->offset = offset;
+        strncpy(entry->name, name.c_str(), SHM_REGISTRY_NAME_SIZE);
+        entry->state.store(1, std::memory_order_release);
+        _header->queueCount.fetch_add(1, std::memory_order_release);
+        return wrapQueue(shmque, name);
+    }
+    // 按名字链接已经存在的队列
+    ShmQueue::ptr ShmQueueRegistry::OpenQueue(const std::string &name)
+    {
+        RegistryEntry *entry = findEntry(name, hashName(name));
+        if (!entry)
+            return nullptr;
+        ShmQueue::ShmQueControlBlock *cblock = (ShmQueue::ShmQueControlBlock *)(_arena + entry->offset);
+        return wrapQueue(new ShmQueue(cblock, EnumCreateModel::LinkShmQue), name);
+    }
+    // 标记删除整个registry段
+    bool ShmQueueRegistry::RemoveRegistry()
+    {
+        if (shmctl(_header->shmId, IPC_RMID, NULL) == -1)
+        {
+            std::cout << "RemoveRegistry failed,errstr=" << strerror(errno) << std::endl;
+            return false;
+        }
+        return true;
+    }
+    std::string ShmQueueRegistry::PrintRegistryInfo() const
+    {
+        std::stringstream ss;
+        ss << "=== 共享内存队列Registry信息 ===" << std::endl;
+        ss << "Key: " << _header->key << ", shmid=" << _header->shmId << std::endl;
+        ss << "创建模式: " << ((_newOrLink == EnumCreateModel::NewShmQue) ? "NewShmQue" : "LinkShmQue") << std::endl;
+        ss << "队列个数: " << GetQueueCount() << "/" << _header->maxQueues
+           << ", 目录槽位: " << _header->dirCapacity << std::endl;
+        ss << "Arena: " << GetArenaUsed() << "/" << _header->arenaSize << " bytes" << std::endl;
+        ss << "每个队列额外开销: " << sizeof(ShmQueue::ShmQueControlBlock) << " bytes(控制块) + "
+           << sizeof(RegistryEntry) << " bytes(目录项)" << std::endl;
+        return ss.str();
+    }
+} // namespace xten
@@ -0,0 +1,92 @@
+#ifndef __XTEN_SHM_QUEUE_REGISTRY_H__
+#define __XTEN_SHM_QUEUE_REGISTRY_H__
+#include <memory>
+#include <string>
+#include <atomic>
+#include <stdint.h>
+#include "ShmQueue.h"
+// 多队列registry段---一个System V共享内存段中打包成千上万个小队列
+// 段布局: [registry头部][名字目录(开放寻址哈希表)][arena: 控制块+队列 控制块+队列 ...]
+// 按名字查找/attach是O(1)的无锁哈希查找; 每个队列的锁内联在自己的控制块中(robust mutex)
+// 每个队列的额外开销 = 控制块3个缓存行 + 目录项1个缓存行,创建队列不需要任何系统调用
+namespace xten
+{
+// registry段初始化完成标记
+#define SHM_REGISTRY_MAGIC 0x47524D53u
+// 队列名字的最大长度(包含结尾的'\0')
+#define SHM_REGISTRY_NAME_SIZE 48
+    class ShmQueueRegistry : public nocopyable, public std::enable_shared_from_this<ShmQueueRegistry>
+    {
+    private:
+        // registry头部---在段的起始位置
+        struct RegistryHeader
+        {
+            std::atomic<uint32_t> magic{0};        // 初始化完成后由创建者最后写入
+            uint32_t dirCapacity = 0;              // 目录槽位数(2的n次幂,至少是maxQueues的2倍)
+            uint32_t maxQueues = 0;                // 最多容纳的队列个数
+            std::atomic<uint32_t> queueCount{0};   // 已经创建的队列个数
+            size_t arenaSize = 0;                  // arena大小/Byte
+            std::atomic<size_t> arenaUsed{0};      // arena已经分配的字节数(只增不减)
+            key_t key = -1;                        // key值
+            int shmId = -1;                        // key对应的shmid
+            alignas(CPU_CACHELINE_SIZE) pthread_mutex_t dirLock; // 创建队列时的目录锁(robust mutex)
+        } ALIGNED_CACHELINE_SIZE;
+        // 目录项---一个缓存行
+        struct RegistryEntry
+        {
+            std::atomic<uint32_t> state{0};    // 0空闲 1已发布---发布后其余字段不再修改
+            uint32_t hash = 0;                 // 名字的哈希值
+            uint64_t offset = 0;               // 队列控制块在arena中的偏移
+            char name[SHM_REGISTRY_NAME_SIZE]; // 队列名字
+        };
+        static_assert(sizeof(RegistryEntry) == CPU_CACHELINE_SIZE, "RegistryEntry should be 1 cacheline");
+
+    public:
+        typedef std::shared_ptr<ShmQueueRegistry> ptr;
+
+        // 获取一个registry段---不存在时创建,已经存在时链接(此时arenaSize/maxQueues以段中的为准)
+        // arenaSize: 所有队列共享的空间大小 maxQueues: 最多容纳的队列个数
+        // 从registry得到的队列句柄持有registry,registry段在最后一个句柄释放后才detach
+        static ptr GetShmQueueRegistryPtr(const std::string &pathname, int proj_id,
+                                          size_t arenaSize, uint32_t maxQueues);
+        // 析构---只detach,不删除段(段中的队列在进程重启后仍然可用)
+        ~ShmQueueRegistry();
+
+        // 在registry中创建一个队列,同名队列已经存在时直接链接 失败返回nullptr
+        // quesize会被对齐到2的n次幂; 锁总是内联在控制块中
+        ShmQueue::ptr CreateQueue(const std::string &name, size_t quesize,
+                                  EnumVisitModel visitModule = EnumVisitModel::MulitPushMulitPop,
+                                  const ShmQueOptions &options = ShmQueOptions());
+        // 按名字链接已经存在的队列 O(1) 不存在返回nullptr
+        ShmQueue::ptr OpenQueue(const std::string &name);
+        // 标记删除整个registry段---最后一个进程detach后释放,之后同样的key会创建新段
+        bool RemoveRegistry();
+
+        // 一些获取属性接口
+        uint32_t GetQueueCount() const { return _header->queueCount.load(std::memory_order_acquire); }
+        uint32_t GetMaxQueues() const { return _header->maxQueues; }
+        size_t GetArenaSize() const { return _header->arenaSize; }
+        size_t GetArenaUsed() const { return _header->arenaUsed.load(std::memory_order_acquire); }
+        int GetShmId() const { return _header->shmId; }
+        EnumCreateModel GetCreateModel() const { return _newOrLink; }
+        // 打印registry的属性信息
+        std::string PrintRegistryInfo() const;
+
+    private:
+        ShmQueueRegistry(void *shmPtr, EnumCreateModel newOrLink);
+        // 名字的哈希(FNV-1a)
+        static uint32_t hashName(const std::string &name);
+        // 查找名字对应的目录项 不存在返回nullptr
+        RegistryEntry *findEntry(const std::string &name, uint32_t hash) const;
+        // 把构造好的队列标记为registry后端并包装成智能指针
+        ShmQueue::ptr wrapQueue(ShmQueue *shmque, const std::string &name);
+
+    private:
+        RegistryHeader *_header;   // registry头部
+        RegistryEntry *_entries;   // 目录起始地址
+        BYTE *_arena;              // arena起始地址
+        ShmMutex _dirMtx;          // 目录锁
+        EnumCreateModel _newOrLink; // 创建或者链接
+    };
+} // namespace xten
+#endif
@@ -0,0 +1,165 @@
+#include "ShmQueueWriter.h"
+#include "ShmSpill.h"
+#include <iostream>
+#include <string.h>
+namespace xten
+{
+    ShmQueueWriter::ShmQueueWriter(const ShmQueue::ptr &que, const ShmWriterOptions &options)
+        : _que(que),
+          _options(options)
+    {
+        // 整块一次放入ring---暂存区不能超过队列能容纳的大小
+        size_t maxBuffer = _que->GetQueueSize() / 2;
+        if (_options.bufferSize == 0 || _options.bufferSize > maxBuffer)
+            _options.bufferSize = maxBuffer;
+        if (_options.flushBytes == 0 || _options.flushBytes > _options.bufferSize)
+            _options.flushBytes = _options.bufferSize;
+        _buffer.resize(_options.bufferSize);
+        if (_options.maxDelayUs > 0)
+            _timer = std::thread(&ShmQueueWriter::timerLoop, this);
+    }
+    ShmQueueWriter::~ShmQueueWriter()
+    {
+        if (_timer.joinable())
+        {
+            {
+                std::lock_guard<std::mutex> lock(_mtx);
+                _stop = true;
+            }
+            _cond.notify_one();
+            _timer.join();
+        }
+        std::lock_guard<std::mutex> lock(_mtx);
+        if (_records > 0 && flushLocked() < 0)
+            std::cout << "ShmQueueWriter drop " << _records << " staged records, queue has no free size" << std::endl;
+    }
+    // 追加一条消息
+    int ShmQueueWriter::Append(const void *msg, size_t msglength, uint16_t topic)
+    {
+        if (!msg || msglength == 0)
+        {
+            std::cout << "ShmQueueWriter Append failed, invalid parameter" << std::endl;
+            return (int)(ShmQueErrorCode::QueueParameterInvaild);
+        }
+        std::lock_guard<std::mutex> lock(_mtx);
+        size_t need = _que->recordHeaderSize() + msglength;
+        // 大消息(或者slab中的消息)不暂存---先刷出之前的记录保证顺序
+        if (need > _options.bufferSize || msglength > _que->recordMaxLength() ||
+            (_que->_slab && msglength >= _que->_slab->GetThreshold()))
+        {
+            if (_records > 0)
+            {
+                int ret = flushLocked();
+                if (ret < 0)
+                    return ret;
+            }
+            return _que->PushMessage(msg, msglength, topic);
+        }
+        if (_staged + need > _options.bufferSize)
+        {
+            int ret = flushLocked();
+            if (ret < 0)
+                return ret;
+        }
+        // 按ring中的记录格式追加---头部直接带提交标记,整块发布时才对消费者可见
+        ShmRecordHeader header;
+        header.commit = RECORD_COMMIT_MAGIC;
+        header.length = (uint32_t)msglength;
+        header.topic = topic;
+        header.reserved = 0;
+        header.crc = _que->recordHeaderCrc(header);
+        size_t headerSize = _que->encodeRecordHeader(header, &_buffer[_staged]);
+        memcpy(&_buffer[_staged + headerSize], msg, msglength);
+        if (_records == 0)
+        {
+            _firstStaged = std::chrono::steady_clock::now();
+            if (_options.maxDelayUs > 0)
+                _cond.notify_one();
+        }
+        _staged += need;
+        _records++;
+        if (_staged >= _options.flushBytes || _records >= _options.flushRecords)
+        {
+            // 阈值触发的刷出失败(队列满)不影响这条消息---已经暂存,下次再刷
+            flushLocked();
+        }
+        return (int)(ShmQueErrorCode::QueueOk);
+    }
+    int ShmQueueWriter::Flush()
+    {
+        std::lock_guard<std::mutex> lock(_mtx);
+        return flushLocked();
+    }
+    int ShmQueueWriter::flushLocked()
+    {
+        if (_records == 0)
+            return 0;
+        // 和PushMessage一样经过溢出层: 溢出层中还有更早的消息时排在它们后面,ring满时溢出
+        ShmSpill *spill = _que->_spill.get();
+        int ret;
+        if (spill && spill->Active())
+            ret = spillLocked(spill);
+        else
+        {
+            ret = _que->pushBlock(_buffer.data(), _staged);
+            if (ret == (int)(ShmQueErrorCode::QueueNoFreeSize) && spill)
+                ret = spillLocked(spill);
+        }
+        if (ret != 0)
+            return ret;
+        int records = (int)_records;
+        _flushes++;
+        _flushedRecords += _records;
+        _staged = 0;
+        _records = 0;
+        return records;
+    }
+    // 把暂存的记录逐条交给溢出层 on success ret=0 ; on failed ret<0 已经交出的记录从暂存区移除
+    int ShmQueueWriter::spillLocked(ShmSpill *spill)
+    {
+        size_t headerSize = _que->recordHeaderSize();
+        size_t offset = 0;
+        size_t records = 0;
+        while (offset < _staged)
+        {
+            ShmRecordHeader header;
+            _que->decodeRecordHeader(&_buffer[offset], header);
+            int ret = spill->Append(&_buffer[offset + headerSize], header.length, header.topic);
+            if (ret != 0)
+            {
+                memmove(_buffer.data(), _buffer.data() + offset, _staged - offset);
+                _staged -= offset;
+                _records -= records;
+                _flushedRecords += records;
+                return ret;
+            }
+            offset += headerSize + header.length;
+            records++;
+        }
+        return 0;
+    }
+    // 定时刷出: 第一条暂存记录等待超过maxDelayUs后刷出
+    void ShmQueueWriter::timerLoop()
+    {
+        std::unique_lock<std::mutex> lock(_mtx);
+        while (!_stop)
+        {
+            if (_records == 0)
+            {
+                _cond.wait(lock);
+                continue;
+            }
+            auto deadline = _firstStaged + std::chrono::microseconds(_options.maxDelayUs);
+            if (std::chrono::steady_clock::now() >= deadline)
+            {
+                if (flushLocked() < 0)
+                {
+                    // 队列满---稍后重试
+                    _cond.wait_for(lock, std::chrono::microseconds(_options.maxDelayUs));
+                }
+                continue;
+            }
+            _cond.wait_until(lock, deadline);
+        }
+    }
+} // namespace xten
@@ -0,0 +1,76 @@
+#ifndef __XTEN_SHM_QUEUE_WRITER_H__
+#define __XTEN_SHM_QUEUE_WRITER_H__
+#include <memory>
+#include <atomic>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+#include <stdint.h>
+#include "ShmQueue.h"
+// 合并写的生产者句柄---每个生产者线程一个
+// 小消息先按记录格式([头部][数据])追加到私有的暂存缓冲区,
+// 达到字节数/记录数阈值、超过最大延迟或者显式Flush时,在一次tail锁内把整块拷贝进ring并只发布一次tail
+// 消费者看到的仍然是一条条普通记录,PopMessage不需要任何修改
+// 队列开启了溢出层时刷出和PushMessage一样经过溢出层,暂存的记录不会越过已经溢出的消息
+namespace xten
+{
+    // 合并写参数
+    struct ShmWriterOptions
+    {
+        size_t bufferSize = 64 * 1024;  // 暂存缓冲区大小 (不超过队列大小的一半)
+        size_t flushBytes = 16 * 1024;  // 暂存字节数达到该值时刷出
+        size_t flushRecords = 64;       // 暂存记录数达到该值时刷出
+        // 第一条暂存记录最多等待多少微秒 0表示不启动定时刷出线程
+        // 定时线程也会放入ring: 单生产者模式下这个写句柄必须是队列唯一的生产者,
+        // 不能再直接调用队列的PushMessage/PushStream等接口(写句柄内部有锁,Append和定时刷出不会冲突)
+        size_t maxDelayUs = 0;
+    };
+    class ShmQueueWriter : public nocopyable
+    {
+    public:
+        typedef std::shared_ptr<ShmQueueWriter> ptr;
+
+        explicit ShmQueueWriter(const ShmQueue::ptr &que, const ShmWriterOptions &options = ShmWriterOptions());
+        // 析构---刷出剩余的记录(队列满时丢弃)并停止定时线程
+        ~ShmQueueWriter();
+
+        // 追加一条消息 on success ret=0 ; on failed ret<0
+        // 暂存区满并且刷出失败(队列空间不足)时返回QueueNoFreeSize,消息没有被追加
+        // 放不进暂存区的大消息先刷出已有记录再直接PushMessage,保证顺序
+        int Append(const void *msg, size_t msglength, uint16_t topic = SHM_TOPIC_NONE);
+        // 把暂存的记录整块放入队列 on success ret=刷出的记录数 ; on failed ret<0 (记录仍然暂存)
+        int Flush();
+
+        // 统计
+        size_t GetStagedBytes() const { return _staged; }
+        size_t GetStagedRecords() const { return _records; }
+        uint64_t GetFlushCount() const { return _flushes; }
+        uint64_t GetRecordCount() const { return _flushedRecords; }
+
+    private:
+        // 持有_mtx时刷出
+        int flushLocked();
+        // 持有_mtx时把暂存的记录逐条交给溢出层
+        int spillLocked(ShmSpill *spill);
+        // 定时刷出线程
+        void timerLoop();
+
+    private:
+        ShmQueue::ptr _que;
+        ShmWriterOptions _options;
+        std::vector<BYTE> _buffer;           // 暂存缓冲区
+        size_t _staged = 0;                  // 已暂存的字节数
+        size_t _records = 0;                 // 已暂存的记录数
+        std::chrono::steady_clock::time_point _firstStaged; // 第一条暂存记录的时间
+        uint64_t _flushes = 0;
+        uint64_t _flushedRecords = 0;
+        // 定时刷出---只有maxDelayUs>0时才需要和追加线程互斥
+        std::mutex _mtx;
+        std::condition_variable _cond;
+        std::thread _timer;
+        bool _stop = false;
+    };
+} // namespace xten
+#endif
@@ -0,0 +1,306 @@
+#include "ShmRpcChannel.h"
+#include <iostream>
+#include <sstream>
+#include <string.h>
+#include <unistd.h>
+#include <sys/ipc.h>
+#include <sys/shm.h>
+#include <thread>
+namespace xten
+{
+// 链接者等待创建者完成初始化的最长时间
+#define SHM_RPC_INIT_WAIT_MS 1000
+// 等待数据时进入futex之前的自旋次数---覆盖一次往返的典型延迟(几微秒)
+#define SHM_RPC_SPIN_COUNT 4000
+// 客户端id的个数 (回复记录的主题id,0保留)
+#define SHM_RPC_MAX_CLIENTS (SHM_TOPIC_COUNT - 1)
+    ShmRpcChannel::ShmRpcChannel(void *shmPtr, EnumCreateModel newOrLink)
+        : _header((RpcHeader *)shmPtr),
+          _newOrLink(newOrLink)
+    {
+    }
+    ShmRpcChannel::~ShmRpcChannel()
+    {
+        // 先释放嵌在段中的队列句柄,再detach段
+        _request.reset();
+        _response.reset();
+        if (_header)
+        {
+            key_t key = _header->key;
+            ShmQueue::destroySharedMemory((void *)_header, key);
+        }
+    }
+    // 获取一个RPC通道
+    ShmRpcChannel *ShmRpcChannel::GetShmRpcChannel(const std::string &pathname, int proj_id, size_t quesize)
+    {
+        if (quesize == 0)
+        {
+            std::cout << "GetShmRpcChannel failed, quesize must > 0" << std::endl;
+            return nullptr;
+        }
+        // 1.生成key
+        key_t key = ftok(pathname.c_str(), proj_id);
+        if (key == -1)
+        {
+            std::cout << "GetShmRpcChannel ftok failed,errstr=" << strerror(errno) << std::endl;
+            return nullptr;
+        }
+        // 2.获取共享内存 [头部][请求控制块+ring][回复控制块+ring]
+        quesize = ShmQueue::roundUpToPowerOfTwo(quesize);
+        size_t ringSize = sizeof(ShmQueue::ShmQueControlBlock) + quesize;
+        size_t segSize = sizeof(RpcHeader) + ringSize * 2;
+        EnumCreateModel createM;
+        int shmid = -1;
+        void *shmPtr = ShmQueue::getSharedMemory(key, shmid, createM, segSize);
+        if (shmPtr == nullptr)
+        {
+            std::cout << "GetShmRpcChannel getSharedMemory failed" << std::endl;
+            return nullptr;
+        }
+        ShmRpcChannel *channel = new ShmRpcChannel(shmPtr, createM);
+        RpcHeader *header = channel->_header;
+        BYTE *reqPtr = (BYTE *)shmPtr + sizeof(RpcHeader);
+        if (createM == EnumCreateModel::NewShmQue)
+        {
+            // 3.创建者初始化---锁内联在各自的控制块中,没有额外的IPC对象
+            new (header) RpcHeader();
+            header->queSize = quesize;
+            header->key = key;
+            header->shmId = shmid;
+            ShmQueOptions options;
+            options.inlineLock = true;
+            channel->_request.reset(new ShmQueue(-1, quesize, shmid, reqPtr, EnumCreateModel::NewShmQue,
+                                                 EnumVisitModel::MulitPushMulitPop, options));
+            // 回复ring没有消费者移动head,覆盖模式下服务端永远不等待客户端
+            options.overwrite = true;
+            channel->_response.reset(new ShmQueue(-1, quesize, shmid, reqPtr + ringSize, EnumCreateModel::NewShmQue,
+                                                  EnumVisitModel::MulitPushMulitPop, options));
+            header->magic.store(SHM_RPC_CHANNEL_MAGIC, std::memory_order_release);
+        }
+        else
+        {
+            // 3.链接者等待创建者初始化完成
+            int waitMs = 0;
+            while (header->magic.load(std::memory_order_acquire) != SHM_RPC_CHANNEL_MAGIC)
+            {
+                if (waitMs++ >= SHM_RPC_INIT_WAIT_MS)
+                {
+                    std::cout << "GetShmRpcChannel failed, segment is not a ShmRpcChannel" << std::endl;
+                    shmdt(shmPtr);
+                    channel->_header = nullptr;
+                    delete channel;
+                    return nullptr;
+                }
+                usleep(1000);
+            }
+            ringSize = sizeof(ShmQueue::ShmQueControlBlock) + header->queSize;
+            channel->_request.reset(new ShmQueue((ShmQueue::ShmQueControlBlock *)reqPtr, EnumCreateModel::LinkShmQue));
+            channel->_response.reset(new ShmQueue((ShmQueue::ShmQueControlBlock *)(reqPtr + ringSize), EnumCreateModel::LinkShmQue));
+        }
+        // 内存属于通道段,队列析构时不detach
+        channel->_request->_backend = EnumShmBackend::Registry;
+        channel->_request->_filepath = "rpc-request";
+        channel->_response->_backend = EnumShmBackend::Registry;
+        channel->_response->_filepath = "rpc-response";
+        channel->_recvBuf.resize(header->queSize);
+        channel->_serveBuf.resize(header->queSize);
+        return channel;
+    }
+    std::shared_ptr<ShmRpcChannel> ShmRpcChannel::GetShmRpcChannelPtr(const std::string &pathname, int proj_id, size_t quesize)
+    {
+        return std::shared_ptr<ShmRpcChannel>(ShmRpcChannel::GetShmRpcChannel(pathname, proj_id, quesize));
+    }
+    // 客户端调用
+    int ShmRpcChannel::Call(const void *request, size_t length, void *response, size_t respLength, int timeoutMs)
+    {
+        if (!request || length == 0 || !response || respLength == 0)
+        {
+            std::cout << "ShmRpcChannel Call failed, invalid parameter" << std::endl;
+            return (int)(ShmQueErrorCode::QueueParameterInvaild);
+        }
+        std::lock_guard<std::mutex> lock(_callMtx);
+        TimePoint deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeoutMs < 0 ? 0 : timeoutMs);
+        const TimePoint *pdeadline = timeoutMs < 0 ? nullptr : &deadline;
+        if (_clientId == 0)
+        {
+            // 第一次调用: 分配客户端id,游标从回复ring的当前tail开始(之前的回复都不是发给自己的)
+            // 客户端id超过SHM_RPC_MAX_CLIENTS后回绕---同时存活的两个客户端可能id相同,回复按nonce区分
+            static std::atomic<uint32_t> handleCount{0};
+            _clientId = _header->nextClientId.fetch_add(1, std::memory_order_relaxed) % SHM_RPC_MAX_CLIENTS + 1;
+            _nonce = ((uint64_t)getpid() << 32) | handleCount.fetch_add(1, std::memory_order_relaxed);
+            _topics.Add((uint16_t)_clientId);
+            int ret = _response->OpenCursor(_cursor);
+            if (ret != 0)
+                return ret;
+        }
+        // 1.放入请求---请求ring满时等待服务端取走
+        RpcFrame frame;
+        frame.callId = ++_nextCallId;
+        frame.clientId = _clientId;
+        frame.status = 0;
+        frame.nonce = _nonce;
+        int ret;
+        while ((ret = _request->pushRecord(request, length, RECORD_COMMIT_MAGIC, SHM_TOPIC_NONE, &frame, sizeof(frame))) ==
+               (int)(ShmQueErrorCode::QueueNoFreeSize))
+        {
+            if (pdeadline && std::chrono::steady_clock::now() >= deadline)
+            {
+                _header->timeouts.fetch_add(1, std::memory_order_relaxed);
+                return (int)(ShmQueErrorCode::QueueTimeout);
+            }
+            std::this_thread::yield();
+        }
+        if (ret != 0)
+            return ret;
+        _header->calls.fetch_add(1, std::memory_order_relaxed);
+        notify(&_header->reqSeq, &_header->serverWaiters);
+        // 2.等待匹配的回复---游标只读取主题id为自己的记录,迟到的旧回复和id相同的其他客户端的回复按nonce+callId丢弃
+        while (true)
+        {
+            ret = _response->ReadCursor(_cursor, _recvBuf.data(), _recvBuf.size(), &_topics);
+            if (ret < 0)
+                return ret;
+            if (ret >= (int)sizeof(RpcFrame))
+            {
+                RpcFrame reply;
+                memcpy(&reply, _recvBuf.data(), sizeof(reply));
+                if (reply.callId != frame.callId || reply.nonce != _nonce)
+                    continue;
+                if (reply.status != 0)
+                    return reply.status;
+                size_t replyLength = ret - sizeof(RpcFrame);
+                if (replyLength > respLength)
+                {
+                    std::cout << "ShmRpcChannel Call failed, buffer length insufficient, need=" << replyLength << std::endl;
+                    return (int)(ShmQueErrorCode::QueueBufferLengthInsufficient);
+                }
+                memcpy(response, _recvBuf.data() + sizeof(RpcFrame), replyLength);
+                return (int)replyLength;
+            }
+            if (ret > 0)
+                continue;
+            if (!waitData(_response.get(), _cursor.pos, &_header->respSeq, &_header->clientWaiters, pdeadline))
+            {
+                _header->timeouts.fetch_add(1, std::memory_order_relaxed);
+                return (int)(ShmQueErrorCode::QueueTimeout);
+            }
+        }
+    }
+    // 服务端批量处理请求
+    int ShmRpcChannel::Serve(const RpcHandler &handler, int maxBatch, int timeoutMs)
+    {
+        if (!handler || maxBatch <= 0)
+        {
+            std::cout << "ShmRpcChannel Serve failed, invalid parameter" << std::endl;
+            return (int)(ShmQueErrorCode::QueueParameterInvaild);
+        }
+        std::lock_guard<std::mutex> lock(_serveMtx);
+        TimePoint deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeoutMs < 0 ? 0 : timeoutMs);
+        const TimePoint *pdeadline = timeoutMs < 0 ? nullptr : &deadline;
+        int handled = 0;
+        int ret = 0;
+        std::string response;
+        while (handled < maxBatch)
+        {
+            ret = _request->PopMessage(_serveBuf.data(), _serveBuf.size());
+            if (ret == 0)
+            {
+                // 这一批已经取空---先把回复发出去
+                if (handled > 0)
+                    break;
+                uint64_t head = _request->_controlBlock->headIdx.load(std::memory_order_acquire);
+                if (!waitData(_request.get(), head, &_header->reqSeq, &_header->serverWaiters, pdeadline))
+                    return 0;
+                continue;
+            }
+            if (ret < 0)
+            {
+                if (handled > 0)
+                    break;
+                return ret;
+            }
+            if (ret < (int)sizeof(RpcFrame))
+            {
+                // 不是通过Call放入的请求---丢弃
+                continue;
+            }
+            RpcFrame frame;
+            memcpy(&frame, _serveBuf.data(), sizeof(frame));
+            response.clear();
+            handler(_serveBuf.data() + sizeof(RpcFrame), ret - sizeof(RpcFrame), response);
+            // 回复的主题id是客户端id,其他客户端的游标只读头部跳过
+            // 整个回复ring都放不下的回复直接拒绝---覆盖模式下不能为它丢弃其他客户端的回复
+            int pr = (int)(ShmQueErrorCode::QueueNoFreeSize);
+            if (sizeof(frame) + response.size() + _response->recordHeaderSize() + REMAIN_SIZE <= _response->GetQueueSize())
+                pr = _response->pushRecord(response.data(), response.size(), RECORD_COMMIT_MAGIC,
+                                           (uint16_t)frame.clientId, &frame, sizeof(frame));
+            if (pr != 0)
+            {
+                // 回复一个只有帧的错误---客户端不会一直等待
+                std::cout << "ShmRpcChannel Serve push response failed, ret=" << pr << ", length=" << response.size() << std::endl;
+                frame.status = pr;
+                _response->pushRecord(response.data(), 0, RECORD_COMMIT_MAGIC, (uint16_t)frame.clientId, &frame, sizeof(frame));
+            }
+            handled++;
+        }
+        // 一批回复只通知一次
+        notify(&_header->respSeq, &_header->clientWaiters);
+        return handled;
+    }
+    // 等待que中出现pos之后的数据
+    // 等待者先登记再读序号和tail,通知者先发布数据再修改序号再检查等待者(都是seq_cst):
+    // 要么通知者看到登记并唤醒,要么等待者看到新数据或者新序号(futex立即返回),不会丢失唤醒
+    bool ShmRpcChannel::waitData(ShmQueue *que, uint64_t pos, std::atomic<uint32_t> *seq,
+                                 std::atomic<uint32_t> *waiters, const TimePoint *deadline)
+    {
+        std::atomic<uint64_t> &tail = que->_controlBlock->tailIdx;
+        // 1.自旋---对端通常在几微秒内回复,不值得进入内核
+        for (int i = 0; i < SHM_RPC_SPIN_COUNT; i++)
+        {
+            if (tail.load(std::memory_order_acquire) != pos)
+                return true;
+            ShmCpuRelax();
+        }
+        // 2.在futex上睡眠
+        while (true)
+        {
+            int waitMs = -1;
+            if (deadline)
+            {
+                auto remain = std::chrono::duration_cast<std::chrono::milliseconds>(*deadline - std::chrono::steady_clock::now()).count();
+                if (remain < 0)
+                    return false;
+                // 不足1毫秒时向上取整,超时后下一轮返回false
+                waitMs = (int)remain + 1;
+            }
+            waiters->fetch_add(1, std::memory_order_seq_cst);
+            uint32_t cur = seq->load(std::memory_order_seq_cst);
+            bool ready = tail.load(std::memory_order_seq_cst) != pos;
+            if (!ready)
+                ShmFutexWait(seq, cur, waitMs);
+            waiters->fetch_sub(1, std::memory_order_relaxed);
+            if (ready || tail.load(std::memory_order_acquire) != pos)
+                return true;
+        }
+    }
+    // 通知等待者
+    void ShmRpcChannel::notify(std::atomic<uint32_t> *seq, std::atomic<uint32_t> *waiters)
+    {
+        seq->fetch_add(1, std::memory_order_seq_cst);
+        if (waiters->load(std::memory_order_seq_cst) > 0)
+            ShmFutexWake(seq);
+    }
+    std::string ShmRpcChannel::PrintRpcChannelInfo() const
+    {
+        std::stringstream ss;
+        ss << "=== 共享内存RPC通道信息 ===" << std::endl;
+        ss << "Key: " << _header->key << ", shmid=" << _header->shmId << std::endl;
+        ss << "创建模式: " << ((_newOrLink == EnumCreateModel::NewShmQue) ? "NewShmQue" : "LinkShmQue") << std::endl;
+        ss << "ring大小: " << _header->queSize << " bytes x 2 (请求/回复)" << std::endl;
+        ss << "客户端: " << _header->nextClientId.load(std::memory_order_relaxed) << " 个, 本句柄id=" << _clientId << std::endl;
+        ss << "调用: " << GetCallCount() << " 次, 超时: " << GetTimeoutCount() << " 次" << std::endl;
+        ss << "等待中: 服务端 " << _header->serverWaiters.load(std::memory_order_relaxed)
+           << ", 客户端 " << _header->clientWaiters.load(std::memory_order_relaxed) << std::endl;
+        return ss.str();
+    }
+} // namespace xten
@@ -0,0 +1,104 @@
+#ifndef __XTEN_SHM_RPC_CHANNEL_H__
+#define __XTEN_SHM_RPC_CHANNEL_H__
+#include <memory>
+#include <string>
+#include <atomic>
+#include <mutex>
+#include <chrono>
+#include <functional>
+#include <vector>
+#include <stdint.h>
+#include "ShmQueue.h"
+#include "ShmFutex.h"
+// 同一主机上的请求/回复RPC通道---一个System V段中放请求ring和回复ring
+// 段布局: [通道头部(关联id/futex字)][请求队列控制块+ring][回复队列控制块+ring]
+// 请求ring: 多个客户端放入,多个服务端竞争取出
+// 回复ring: 覆盖模式,服务端放入时主题id=客户端id,每个客户端用自己的广播游标只读取发给自己的回复
+// 等待方先自旋,没有数据时在头部的futex字上睡眠; 通知方只在有等待者时才进入内核
+namespace xten
+{
+// RPC通道初始化完成标记
+#define SHM_RPC_CHANNEL_MAGIC 0x43504D53u
+    class ShmRpcChannel : public nocopyable
+    {
+    private:
+        // 通道头部---在段的起始位置,每组字段独占一个缓存行
+        struct RpcHeader
+        {
+            std::atomic<uint32_t> magic{0};         // 初始化完成后由创建者最后写入
+            std::atomic<uint32_t> nextClientId{0};  // 分配客户端id (回复记录的主题id)
+            size_t queSize = 0;                     // 每个ring的大小/Byte
+            key_t key = -1;                         // key值
+            int shmId = -1;                         // key对应的shmid
+            alignas(CPU_CACHELINE_SIZE) std::atomic<uint32_t> reqSeq{0}; // futex字: 每批请求+1
+            std::atomic<uint32_t> serverWaiters{0}; // 在reqSeq上睡眠的服务端个数
+            std::atomic<uint64_t> calls{0};         // 累计请求数
+            alignas(CPU_CACHELINE_SIZE) std::atomic<uint32_t> respSeq{0}; // futex字: 每批回复+1
+            std::atomic<uint32_t> clientWaiters{0}; // 在respSeq上睡眠的客户端个数
+            std::atomic<uint64_t> timeouts{0};      // 累计超时的调用数
+        } ALIGNED_CACHELINE_SIZE;
+        // 请求/回复记录数据开头的帧
+        struct RpcFrame
+        {
+            uint64_t callId;   // 客户端内唯一的关联id
+            uint32_t clientId; // 发起调用的客户端 (回复的主题id,超过SHM_RPC_MAX_CLIENTS个客户端后会重复)
+            int32_t status;    // 回复: 0成功 ; <0服务端没能放入回复(ShmQueErrorCode),没有回复数据
+            uint64_t nonce;    // 客户端句柄的随机数(pid+进程内计数) 客户端id重复时据此区分回复
+        };
+        typedef std::chrono::steady_clock::time_point TimePoint;
+
+    public:
+        typedef std::shared_ptr<ShmRpcChannel> ptr;
+        // 服务端处理函数 request/length:请求数据(只在调用期间有效) response:由处理函数填写回复
+        typedef std::function<void(const void *request, size_t length, std::string &response)> RpcHandler;
+
+        // 获取一个RPC通道(非单例)---不存在时创建,已经存在时链接(此时quesize以段中的为准)
+        // quesize: 请求/回复ring各自的大小,会被对齐到2的n次幂
+        static ShmRpcChannel *GetShmRpcChannel(const std::string &pathname, int proj_id, size_t quesize);
+        static std::shared_ptr<ShmRpcChannel> GetShmRpcChannelPtr(const std::string &pathname, int proj_id, size_t quesize);
+        // 析构---和ShmQueue一样detach并标记删除
+        ~ShmRpcChannel();
+
+        // 客户端: 发送请求并等待匹配的回复 on success ret=sizeof(response) ; on failed ret<0 超时ret=QueueTimeout
+        // timeoutMs<0一直等待; 同一个句柄上的调用串行执行,并发调用请使用多个句柄
+        // 回复超过回复ring能放下的大小时服务端回复错误,返回QueueNoFreeSize
+        int Call(const void *request, size_t length, void *response, size_t respLength, int timeoutMs);
+        // 服务端: 等待请求并批量处理,最多maxBatch个 ret=处理的请求数 超时ret=0 ; on failed ret<0
+        // 一批回复放完后才唤醒等待的客户端; 多个服务端(线程/进程)可以同时调用
+        int Serve(const RpcHandler &handler, int maxBatch = 64, int timeoutMs = -1);
+
+        // 一些获取属性接口
+        size_t GetQueueSize() const { return _header->queSize; }
+        int GetShmId() const { return _header->shmId; }
+        EnumCreateModel GetCreateModel() const { return _newOrLink; }
+        uint64_t GetCallCount() const { return _header->calls.load(std::memory_order_relaxed); }
+        uint64_t GetTimeoutCount() const { return _header->timeouts.load(std::memory_order_relaxed); }
+        // 打印RPC通道的属性信息
+        std::string PrintRpcChannelInfo() const;
+
+    private:
+        ShmRpcChannel(void *shmPtr, EnumCreateModel newOrLink);
+        // 先自旋,再在futex上睡眠,直到que的tail离开pos on success ret=true ; 超时ret=false
+        bool waitData(ShmQueue *que, uint64_t pos, std::atomic<uint32_t> *seq,
+                      std::atomic<uint32_t> *waiters, const TimePoint *deadline);
+        // 放入数据后通知等待者---没有等待者时不进入内核
+        static void notify(std::atomic<uint32_t> *seq, std::atomic<uint32_t> *waiters);
+
+    private:
+        RpcHeader *_header;                  // 通道头部
+        std::unique_ptr<ShmQueue> _request;  // 请求队列
+        std::unique_ptr<ShmQueue> _response; // 回复队列 (覆盖模式)
+        EnumCreateModel _newOrLink;          // 创建或者链接
+        // 客户端状态---第一次Call时分配客户端id并打开回复游标
+        std::mutex _callMtx;
+        uint32_t _clientId = 0;
+        uint64_t _nonce = 0;
+        uint64_t _nextCallId = 0;
+        ShmCursor _cursor;
+        ShmTopicSet _topics;
+        std::vector<BYTE> _recvBuf;          // 接收缓冲区(一个ring的大小,放得下任意一条记录)
+        std::mutex _serveMtx;                // 保护服务端使用的_serveBuf
+        std::vector<BYTE> _serveBuf;
+    };
+} // namespace xten
+#endif
@@ -0,0 +1,143 @@
+#include "ShmSlab.h"
+#include <new>
+#include <string.h>
+#include <stdio.h>
+namespace xten
+{
+    // 对齐到缓存行
+    static inline uint64_t alignCacheline(uint64_t v)
+    {
+        return (v + sizeof(ShmSlabBlock) - 1) & ~(uint64_t)(sizeof(ShmSlabBlock) - 1);
+    }
+    size_t ShmSlab::AlignSize(size_t slabSize)
+    {
+        return alignCacheline(slabSize);
+    }
+    bool ShmSlab::CheckSize(size_t slabSize)
+    {
+        return AlignSize(slabSize) > alignCacheline(sizeof(ShmSlabHeader)) + SHM_SLAB_MIN_BLOCK;
+    }
+    bool ShmSlab::Init(void *mem, size_t slabSize, size_t threshold)
+    {
+        if (!CheckSize(slabSize))
+        {
+            printf("ShmSlab init failed: slabSize=%zu is too small\n", slabSize);
+            return false;
+        }
+        slabSize = AlignSize(slabSize);
+        uint64_t dataStart = alignCacheline(sizeof(ShmSlabHeader));
+        ShmSlabHeader *header = new (mem) ShmSlabHeader();
+        header->totalSize = slabSize;
+        header->threshold = threshold;
+        // 最小级别要放得下阈值大小的消息,之后每一级翻倍,最大一级不超过整个数据区
+        uint64_t blockSize = SHM_SLAB_MIN_BLOCK;
+        while (blockSize < threshold + sizeof(ShmSlabBlock))
+            blockSize <<= 1;
+        header->classCount = 0;
+        while (header->classCount < SHM_SLAB_MAX_CLASSES && blockSize <= slabSize - dataStart)
+        {
+            header->classSize[header->classCount++] = blockSize;
+            blockSize <<= 1;
+        }
+        header->bump.store(dataStart, std::memory_order_relaxed);
+        header->allocCount.store(0, std::memory_order_relaxed);
+        header->allocFailed.store(0, std::memory_order_relaxed);
+        header->usedBytes.store(0, std::memory_order_relaxed);
+        for (uint32_t i = 0; i < SHM_SLAB_MAX_CLASSES; i++)
+            header->freeHead[i].store(0, std::memory_order_relaxed);
+        header->magic = SHM_SLAB_MAGIC;
+        return true;
+    }
+    size_t ShmSlab::TotalSize(const void *mem)
+    {
+        const ShmSlabHeader *header = (const ShmSlabHeader *)mem;
+        return header->magic == SHM_SLAB_MAGIC ? header->totalSize : 0;
+    }
+    ShmSlab::ShmSlab(void *mem)
+        : _header((ShmSlabHeader *)mem)
+    {
+    }
+    // Treiber栈出栈---栈顶带ABA计数,读到已经被别人取走的块的next也没关系,CAS一定失败
+    ShmSlabBlock *ShmSlab::popFree(uint32_t cls)
+    {
+        uint64_t head = _header->freeHead[cls].load(std::memory_order_acquire);
+        while ((uint32_t)head != 0)
+        {
+            ShmSlabBlock *block = blockAt((uint32_t)head - 1);
+            uint64_t next = (head & 0xFFFFFFFF00000000ull) + (1ull << 32) + (uint32_t)block->next.load(std::memory_order_relaxed);
+            if (_header->freeHead[cls].compare_exchange_weak(head, next, std::memory_order_acq_rel, std::memory_order_acquire))
+                return block;
+        }
+        return nullptr;
+    }
+    // 从未分配区域切出新块---CAS推进,失败时不会越界
+    ShmSlabBlock *ShmSlab::carve(uint32_t cls)
+    {
+        uint64_t size = _header->classSize[cls];
+        uint64_t offset = _header->bump.load(std::memory_order_relaxed);
+        do
+        {
+            if (offset + size > _header->totalSize)
+                return nullptr;
+        } while (!_header->bump.compare_exchange_weak(offset, offset + size, std::memory_order_relaxed));
+        ShmSlabBlock *block = (ShmSlabBlock *)Ptr(offset);
+        block->cls = cls;
+        block->magic = SHM_SLAB_BLOCK_MAGIC;
+        return block;
+    }
+    void *ShmSlab::Alloc(size_t length)
+    {
+        uint32_t cls = 0;
+        while (cls < _header->classCount && _header->classSize[cls] < length + sizeof(ShmSlabBlock))
+            cls++;
+        ShmSlabBlock *block = nullptr;
+        if (cls < _header->classCount)
+        {
+            // 本级空闲链表 -> 新切一块 -> 借用更大级别的空闲块
+            block = popFree(cls);
+            if (!block)
+                block = carve(cls);
+            for (uint32_t i = cls + 1; !block && i < _header->classCount; i++)
+                block = popFree(i);
+        }
+        if (!block)
+        {
+            _header->allocFailed.fetch_add(1, std::memory_order_relaxed);
+            return nullptr;
+        }
+        block->length = length;
+        _header->allocCount.fetch_add(1, std::memory_order_relaxed);
+        _header->usedBytes.fetch_add(_header->classSize[block->cls], std::memory_order_relaxed);
+        return (char *)block + sizeof(ShmSlabBlock);
+    }
+    void ShmSlab::Free(void *data)
+    {
+        ShmSlabBlock *block = (ShmSlabBlock *)((char *)data - sizeof(ShmSlabBlock));
+        if (block->magic != SHM_SLAB_BLOCK_MAGIC || block->cls >= _header->classCount)
+        {
+            printf("ShmSlab free failed: invalid block offset=%lu\n", (unsigned long)Offset(data));
+            return;
+        }
+        uint32_t cls = block->cls;
+        _header->usedBytes.fetch_sub(_header->classSize[cls], std::memory_order_relaxed);
+        // Treiber栈入栈---release保证块的next在栈顶更新之前写入
+        uint32_t index = blockIndex(block) + 1;
+        uint64_t head = _header->freeHead[cls].load(std::memory_order_relaxed);
+        uint64_t next;
+        do
+        {
+            block->next.store((uint32_t)head, std::memory_order_relaxed);
+            next = (head & 0xFFFFFFFF00000000ull) + (1ull << 32) + index;
+        } while (!_header->freeHead[cls].compare_exchange_weak(head, next, std::memory_order_release, std::memory_order_relaxed));
+    }
+    bool ShmSlab::Check(uint64_t offset, size_t length) const
+    {
+        uint64_t dataStart = alignCacheline(sizeof(ShmSlabHeader)) + sizeof(ShmSlabBlock);
+        if (offset < dataStart || offset >= _header->totalSize || offset % sizeof(ShmSlabBlock) != 0)
+            return false;
+        const ShmSlabBlock *block = (const ShmSlabBlock *)((const char *)_header + offset - sizeof(ShmSlabBlock));
+        return block->magic == SHM_SLAB_BLOCK_MAGIC && block->cls < _header->classCount &&
+               length + sizeof(ShmSlabBlock) <= _header->classSize[block->cls] &&
+               offset - sizeof(ShmSlabBlock) + _header->classSize[block->cls] <= _header->totalSize;
+    }
+} // namespace xten
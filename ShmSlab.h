@@ -0,0 +1,87 @@
+#ifndef __XTEN_SHM_SLAB_H__
+#define __XTEN_SHM_SLAB_H__
+#include <atomic>
+#include <stddef.h>
+#include <stdint.h>
+#include "nocopyable.hpp"
+// 共享内存中的大消息slab分配器---放在队列ring之后的同一个段中
+// 块大小按2的n次幂分级,每一级一个无锁空闲链表(Treiber栈,头部带ABA计数)
+// 空闲链表为空时从未分配区域顺序切出新块; 块只在所属的级别之间复用,不合并
+// 所有地址都用相对slab起始位置的偏移表示,不同进程映射到不同地址也能使用
+namespace xten
+{
+// slab初始化完成标记
+#define SHM_SLAB_MAGIC 0x42414C53u
+// 块头部标记---校验描述符中的偏移是否指向一个合法的块
+#define SHM_SLAB_BLOCK_MAGIC 0x4B4C4253u
+// 最多的块大小级别
+#define SHM_SLAB_MAX_CLASSES 32
+// 最小的块大小
+#define SHM_SLAB_MIN_BLOCK 4096
+    // slab区域头部
+    struct ShmSlabHeader
+    {
+        uint32_t magic;                          // 初始化完成标记
+        uint32_t classCount;                     // 块大小级别个数
+        uint64_t totalSize;                      // slab区域总大小(包含头部)
+        uint64_t threshold;                      // 大消息阈值: 长度>=该值的消息放入slab
+        uint64_t classSize[SHM_SLAB_MAX_CLASSES]; // 每一级的块大小(包含块头部)
+        alignas(64) std::atomic<uint64_t> bump;  // 未分配区域的起始偏移
+        std::atomic<uint64_t> allocCount;        // 累计分配次数
+        std::atomic<uint64_t> allocFailed;       // 累计分配失败次数
+        std::atomic<uint64_t> usedBytes;         // 当前已经分配出去的字节数
+        // 每一级空闲链表的栈顶 [高32位ABA计数|低32位块序号+1] 0表示空
+        alignas(64) std::atomic<uint64_t> freeHead[SHM_SLAB_MAX_CLASSES];
+    };
+    // 块头部---独占一个缓存行,数据从缓存行边界开始(非临时存储需要对齐)
+    struct alignas(64) ShmSlabBlock
+    {
+        uint32_t magic;            // SHM_SLAB_BLOCK_MAGIC
+        uint32_t cls;              // 所属的级别
+        std::atomic<uint64_t> next; // 在空闲链表中时: 下一个块的序号+1
+        uint64_t length;           // 分配时请求的长度
+    };
+    class ShmSlab : public nocopyable
+    {
+    public:
+        // 需要的slab区域大小---对齐到缓存行
+        static size_t AlignSize(size_t slabSize);
+        // slabSize是否放得下头部和至少一个最小的块---不合法时Init失败
+        static bool CheckSize(size_t slabSize);
+        // 在mem处初始化一个slab区域 threshold:大消息阈值,决定最小的块大小
+        static bool Init(void *mem, size_t slabSize, size_t threshold);
+        // 读取mem处slab区域的总大小---不是合法的slab时返回0
+        static size_t TotalSize(const void *mem);
+
+        explicit ShmSlab(void *mem);
+        // 分配一个至少length字节的块 on success ret=数据地址 ; on failed ret=nullptr
+        void *Alloc(size_t length);
+        // 释放Alloc返回的数据地址
+        void Free(void *data);
+        // 数据地址和偏移的转换
+        uint64_t Offset(const void *data) const { return (const char *)data - (const char *)_header; }
+        void *Ptr(uint64_t offset) const { return (char *)_header + offset; }
+        // 校验描述符: offset处是否是一个已分配的块并且能容纳length字节
+        bool Check(uint64_t offset, size_t length) const;
+        // 大消息阈值
+        size_t GetThreshold() const { return _header->threshold; }
+        // 统计
+        uint64_t GetAllocCount() const { return _header->allocCount.load(std::memory_order_relaxed); }
+        uint64_t GetAllocFailed() const { return _header->allocFailed.load(std::memory_order_relaxed); }
+        uint64_t GetUsedBytes() const { return _header->usedBytes.load(std::memory_order_relaxed); }
+        uint64_t GetTotalSize() const { return _header->totalSize; }
+
+    private:
+        // 块序号(偏移/缓存行)和块地址的转换
+        ShmSlabBlock *blockAt(uint32_t index) const { return (ShmSlabBlock *)((char *)_header + (uint64_t)index * sizeof(ShmSlabBlock)); }
+        uint32_t blockIndex(const ShmSlabBlock *block) const { return (uint32_t)(((const char *)block - (const char *)_header) / sizeof(ShmSlabBlock)); }
+        // 从cls级别的空闲链表弹出一个块
+        ShmSlabBlock *popFree(uint32_t cls);
+        // 从未分配区域切出一个cls级别的块
+        ShmSlabBlock *carve(uint32_t cls);
+
+    private:
+        ShmSlabHeader *_header;
+    };
+} // namespace xten
+#endif
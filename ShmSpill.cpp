@@ -0,0 +1,271 @@
+#include "ShmSpill.h"
+#include <iostream>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+namespace xten
+{
+// 回放时每次从文件读取的大小
+#define SHM_SPILL_READ_SIZE (1024 * 1024)
+// ring满时后台线程等待消费者的时间
+#define SHM_SPILL_RETRY_US 200
+// 写文件失败(比如磁盘满)后重试的间隔
+#define SHM_SPILL_WRITE_RETRY_MS 200
+// 析构时等待溢出层回放完的最长时间
+#define SHM_SPILL_DRAIN_MS 1000
+    ShmSpill::ShmSpill(ShmQueue *que, const std::string &filepath, size_t maxBytes)
+        : _que(que),
+          _filepath(filepath),
+          _maxBytes(maxBytes)
+    {
+    }
+    ShmSpill::~ShmSpill()
+    {
+        if (_thread.joinable())
+        {
+            std::unique_lock<std::mutex> lock(_mtx);
+            // 先等待后台线程把溢出的消息回放到ring(有界等待)---消费者还在时通常很快追上
+            _idleCond.wait_for(lock, std::chrono::milliseconds(SHM_SPILL_DRAIN_MS), [this]
+                               { return !_active.load(std::memory_order_relaxed); });
+            _stop = true;
+            lock.unlock();
+            _cond.notify_one();
+            _thread.join();
+        }
+        if (_fd != -1)
+        {
+            if (!_pending.empty() && writeFile(_pending))
+            {
+                _writeOffset += _pending.size();
+                _pending.clear();
+            }
+            if (_depthRecords.load(std::memory_order_relaxed) > 0)
+            {
+                // 没有回放完: 把剩余的记录移到文件开头,下次对这个文件EnableSpill时先回放
+                bool kept = _pending.empty() && compactFile();
+                std::cout << "ShmSpill stop failed: " << _depthRecords.load(std::memory_order_relaxed) << " records ("
+                          << _depthBytes.load(std::memory_order_relaxed) << " bytes) not replayed within "
+                          << SHM_SPILL_DRAIN_MS << "ms, " << (kept ? "kept in" : "LOST, file write failed:")
+                          << " file=" << _filepath << std::endl;
+            }
+            close(_fd);
+        }
+    }
+    bool ShmSpill::Open()
+    {
+        // 不清空文件---上一个句柄没有回放完的记录排在最前面回放
+        _fd = open(_filepath.c_str(), O_RDWR | O_CREAT, 0666);
+        if (_fd == -1)
+        {
+            std::cout << "ShmSpill open failed,errstr=" << strerror(errno) << ", file=" << _filepath << std::endl;
+            return false;
+        }
+        if (!recoverFile())
+        {
+            close(_fd);
+            _fd = -1;
+            return false;
+        }
+        _thread = std::thread(&ShmSpill::spillLoop, this);
+        return true;
+    }
+    // 登记文件中已有的完整记录---末尾不完整(写入时崩溃)或者这个队列放不下的记录截断
+    bool ShmSpill::recoverFile()
+    {
+        struct stat st;
+        if (fstat(_fd, &st) != 0)
+        {
+            std::cout << "ShmSpill stat failed,errstr=" << strerror(errno) << ", file=" << _filepath << std::endl;
+            return false;
+        }
+        uint64_t offset = 0;
+        uint64_t records = 0, bytes = 0;
+        ShmSpillRecord record;
+        while (offset + sizeof(record) <= (uint64_t)st.st_size &&
+               pread(_fd, &record, sizeof(record), offset) == (ssize_t)sizeof(record))
+        {
+            if (offset + sizeof(record) + record.length > (uint64_t)st.st_size ||
+                record.length + _que->recordHeaderSize() + REMAIN_SIZE > _que->GetQueueSize())
+                break;
+            offset += sizeof(record) + record.length;
+            records++;
+            bytes += record.length;
+        }
+        if (offset < (uint64_t)st.st_size)
+        {
+            std::cout << "ShmSpill truncate " << (uint64_t)st.st_size - offset << " invalid bytes, file=" << _filepath << std::endl;
+            if (ftruncate(_fd, offset) != 0)
+                return false;
+        }
+        _writeOffset = offset;
+        _readOffset = 0;
+        if (records > 0)
+        {
+            _depthRecords.store(records, std::memory_order_relaxed);
+            _depthBytes.store(bytes, std::memory_order_relaxed);
+            _active.store(true, std::memory_order_release);
+        }
+        return true;
+    }
+    // 把还没有回放的[_readOffset, _writeOffset)移到文件开头 (后台线程已经停止)
+    bool ShmSpill::compactFile()
+    {
+        uint64_t remain = _writeOffset - _readOffset;
+        for (uint64_t done = 0; _readOffset > 0 && done < remain;)
+        {
+            size_t want = std::min((uint64_t)SHM_SPILL_READ_SIZE, remain - done);
+            _readBuf.resize(want);
+            ssize_t n = pread(_fd, _readBuf.data(), want, _readOffset + done);
+            if (n <= 0 || pwrite(_fd, _readBuf.data(), n, done) != n)
+                return false;
+            done += n;
+        }
+        if (ftruncate(_fd, remain) != 0)
+            return false;
+        _readOffset = 0;
+        _writeOffset = remain;
+        return true;
+    }
+    // 生产者追加消息---只拷贝到待写缓冲区
+    int ShmSpill::Append(const void *msg, size_t msglength, uint16_t topic)
+    {
+        // 回放时要整条放入ring
+        if (msglength + _que->recordHeaderSize() + REMAIN_SIZE > _que->GetQueueSize())
+            return (int)(ShmQueErrorCode::QueueNoFreeSize);
+        std::lock_guard<std::mutex> lock(_mtx);
+        if (_maxBytes > 0 && _depthBytes.load(std::memory_order_relaxed) + msglength > _maxBytes)
+            return (int)(ShmQueErrorCode::QueueNoFreeSize);
+        ShmSpillRecord record;
+        record.length = (uint32_t)msglength;
+        record.topic = topic;
+        record.reserved = 0;
+        _pending.insert(_pending.end(), (const BYTE *)&record, (const BYTE *)&record + sizeof(record));
+        _pending.insert(_pending.end(), (const BYTE *)msg, (const BYTE *)msg + msglength);
+        _depthBytes.fetch_add(msglength, std::memory_order_relaxed);
+        _depthRecords.fetch_add(1, std::memory_order_relaxed);
+        _spilledBytes.fetch_add(msglength, std::memory_order_relaxed);
+        _spilledRecords.fetch_add(1, std::memory_order_relaxed);
+        if (!_active.load(std::memory_order_relaxed))
+        {
+            _active.store(true, std::memory_order_release);
+            _cond.notify_one();
+        }
+        return (int)(ShmQueErrorCode::QueueOk);
+    }
+    // 后台线程: 待写缓冲区 -> 文件 -> ring
+    void ShmSpill::spillLoop()
+    {
+        std::vector<BYTE> buf;
+        std::unique_lock<std::mutex> lock(_mtx);
+        while (!_stop)
+        {
+            // 1.把待写记录追加到文件---写文件时不持锁,生产者可以继续追加
+            if (!_pending.empty())
+            {
+                buf.swap(_pending);
+                lock.unlock();
+                bool ok = writeFile(buf);
+                lock.lock();
+                if (ok)
+                    _writeOffset += buf.size();
+                else
+                    _pending.insert(_pending.begin(), buf.begin(), buf.end());
+                buf.clear();
+                if (!ok)
+                {
+                    // 写失败(比如磁盘满)---稍后重试,继续回放已经写入的部分
+                    _cond.wait_for(lock, std::chrono::milliseconds(SHM_SPILL_WRITE_RETRY_MS));
+                }
+            }
+            // 2.按顺序回放文件中的记录
+            size_t replayed = 0;
+            if (_readOffset < _writeOffset)
+            {
+                lock.unlock();
+                replayed = replay();
+                lock.lock();
+            }
+            // 3.全部回放完---清空文件,之后的消息重新直接放入ring
+            //   必须持锁判断: 生产者看到非active之前,溢出层中一定没有比它更早的消息
+            if (_readOffset == _writeOffset && _pending.empty())
+            {
+                if (_active.load(std::memory_order_relaxed))
+                {
+                    if (ftruncate(_fd, 0) == 0)
+                        _readOffset = _writeOffset = 0;
+                    _active.store(false, std::memory_order_release);
+                    _idleCond.notify_all();
+                }
+                _cond.wait(lock, [this]
+                           { return _stop || !_pending.empty(); });
+                continue;
+            }
+            // ring满---等待消费者
+            if (replayed == 0 && _pending.empty())
+                _cond.wait_for(lock, std::chrono::microseconds(SHM_SPILL_RETRY_US));
+        }
+    }
+    bool ShmSpill::writeFile(const std::vector<BYTE> &buf)
+    {
+        size_t done = 0;
+        while (done < buf.size())
+        {
+            ssize_t n = pwrite(_fd, buf.data() + done, buf.size() - done, _writeOffset + done);
+            if (n < 0)
+            {
+                if (errno == EINTR)
+                    continue;
+                std::cout << "ShmSpill write failed,errstr=" << strerror(errno) << ", file=" << _filepath << std::endl;
+                return false;
+            }
+            done += n;
+        }
+        return true;
+    }
+    // 回放---只有后台线程访问_readOffset之后的文件内容,_writeOffset只在持锁时增长
+    size_t ShmSpill::replay()
+    {
+        size_t replayed = 0;
+        uint64_t writeOffset;
+        {
+            std::lock_guard<std::mutex> lock(_mtx);
+            writeOffset = _writeOffset;
+        }
+        while (_readOffset < writeOffset)
+        {
+            // 读一块,逐条放入ring; 块末尾不完整的记录下次从记录开头重新读
+            size_t want = std::min((uint64_t)SHM_SPILL_READ_SIZE, writeOffset - _readOffset);
+            ShmSpillRecord record;
+            if (pread(_fd, &record, sizeof(record), _readOffset) != (ssize_t)sizeof(record))
+                return replayed;
+            want = std::max(want, sizeof(record) + (size_t)record.length);
+            _readBuf.resize(want);
+            ssize_t n = pread(_fd, _readBuf.data(), want, _readOffset);
+            if (n <= 0)
+                return replayed;
+            size_t pos = 0;
+            while (pos + sizeof(ShmSpillRecord) <= (size_t)n)
+            {
+                memcpy(&record, _readBuf.data() + pos, sizeof(record));
+                if (pos + sizeof(record) + record.length > (size_t)n)
+                    break;
+                int ret = _que->pushMessage(_readBuf.data() + pos + sizeof(record), record.length, record.topic);
+                if (ret != 0)
+                {
+                    // ring满(或者出错)---停在这条记录,稍后重试
+                    std::lock_guard<std::mutex> lock(_mtx);
+                    _readOffset += pos;
+                    return replayed;
+                }
+                pos += sizeof(record) + record.length;
+                replayed++;
+                _depthBytes.fetch_sub(record.length, std::memory_order_relaxed);
+                _depthRecords.fetch_sub(1, std::memory_order_relaxed);
+            }
+            std::lock_guard<std::mutex> lock(_mtx);
+            _readOffset += pos;
+        }
+        return replayed;
+    }
+} // namespace xten
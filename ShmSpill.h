@@ -0,0 +1,80 @@
+#ifndef __XTEN_SHM_SPILL_H__
+#define __XTEN_SHM_SPILL_H__
+#include <string>
+#include <atomic>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <stdint.h>
+#include "ShmQueue.h"
+// 生产者句柄的溢出层---ring满时把消息写入本地文件,消费者追上后按顺序回放到ring
+// 生产者只把消息追加到内存中的待写缓冲区(一次加锁+拷贝),写文件和回放都在后台线程中完成
+// 溢出层中还有数据时,这个句柄之后的消息也进入溢出层,保证 ring中的 -> 溢出的 -> 之后的 顺序
+// 回放线程是第二个生产者,只能用于多生产者模式(有tail锁)的队列
+namespace xten
+{
+    // 溢出文件中每条记录的头部
+    struct ShmSpillRecord
+    {
+        uint32_t length;   // 消息长度
+        uint16_t topic;    // 主题id
+        uint16_t reserved;
+    };
+    class ShmSpill : public nocopyable
+    {
+    public:
+        // que: 回放的目标队列 filepath: 溢出文件 maxBytes: 溢出深度上限 0表示不限
+        ShmSpill(ShmQueue *que, const std::string &filepath, size_t maxBytes);
+        // 析构---最多等待SHM_SPILL_DRAIN_MS让溢出的消息回放完再停止后台线程
+        // 仍然没有回放的消息移到文件开头保留,并打印失败信息
+        ~ShmSpill();
+        // 打开溢出文件并启动后台线程 on success ret=true
+        // 文件中上一个句柄留下的消息先于之后溢出的消息回放
+        bool Open();
+        // 溢出层中是否还有没有回放的消息
+        bool Active() const { return _active.load(std::memory_order_acquire); }
+        // 追加一条放不进ring的消息 on success ret=0 ; on failed ret<0
+        int Append(const void *msg, size_t msglength, uint16_t topic);
+
+        // 统计
+        uint64_t GetDepthBytes() const { return _depthBytes.load(std::memory_order_relaxed); }
+        uint64_t GetDepthRecords() const { return _depthRecords.load(std::memory_order_relaxed); }
+        uint64_t GetSpilledBytes() const { return _spilledBytes.load(std::memory_order_relaxed); }
+        uint64_t GetSpilledRecords() const { return _spilledRecords.load(std::memory_order_relaxed); }
+        const std::string &GetFilePath() const { return _filepath; }
+
+    private:
+        // 后台线程
+        void spillLoop();
+        // 把待写缓冲区追加到文件 on success ret=true
+        bool writeFile(const std::vector<BYTE> &buf);
+        // 从文件回放到ring,直到文件读完或者ring满 ret=回放的记录数
+        size_t replay();
+        // 打开时登记文件中已有的完整记录 on success ret=true
+        bool recoverFile();
+        // 停止时把没有回放的记录移到文件开头 on success ret=true
+        bool compactFile();
+
+    private:
+        ShmQueue *_que;
+        std::string _filepath;
+        size_t _maxBytes;
+        int _fd = -1;
+        uint64_t _writeOffset = 0;           // 文件中已经写入的位置
+        uint64_t _readOffset = 0;            // 文件中已经回放的位置
+        std::vector<BYTE> _pending;          // 还没有写入文件的记录
+        std::vector<BYTE> _readBuf;          // 回放的读缓冲区
+        std::atomic<bool> _active{false};
+        std::atomic<uint64_t> _depthBytes{0};     // 溢出层中的消息字节数(待写+文件中未回放)
+        std::atomic<uint64_t> _depthRecords{0};   // 溢出层中的消息数
+        std::atomic<uint64_t> _spilledBytes{0};   // 累计溢出的消息字节数
+        std::atomic<uint64_t> _spilledRecords{0}; // 累计溢出的消息数
+        std::mutex _mtx;
+        std::condition_variable _cond;
+        std::condition_variable _idleCond; // 溢出层回放完(非active)时通知
+        std::thread _thread;
+        bool _stop = false;
+    };
+} // namespace xten
+#endif
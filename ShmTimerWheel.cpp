@@ -0,0 +1,276 @@
+#include "ShmTimerWheel.h"
+#include <new>
+#include <string.h>
+#include <stdio.h>
+#include <time.h>
+#include <vector>
+namespace xten
+{
+    // 对齐到缓存行
+    static inline uint64_t alignCacheline(uint64_t v)
+    {
+        return (v + 63) & ~(uint64_t)63;
+    }
+    size_t ShmTimerWheel::AlignSize(size_t nodeCount, size_t maxMsgSize)
+    {
+        return alignCacheline(sizeof(ShmTimerHeader)) + nodeCount * alignCacheline(sizeof(ShmTimerNode) + maxMsgSize);
+    }
+    bool ShmTimerWheel::CheckParams(size_t nodeCount, size_t maxMsgSize, uint64_t tickNs)
+    {
+        return nodeCount > 0 && nodeCount < UINT32_MAX && maxMsgSize > 0 && tickNs > 0;
+    }
+    bool ShmTimerWheel::Init(void *mem, size_t nodeCount, size_t maxMsgSize, uint64_t tickNs, uint64_t nowNs)
+    {
+        if (!CheckParams(nodeCount, maxMsgSize, tickNs))
+        {
+            printf("ShmTimerWheel init failed: nodeCount=%zu maxMsgSize=%zu tickNs=%lu\n",
+                   nodeCount, maxMsgSize, (unsigned long)tickNs);
+            return false;
+        }
+        ShmTimerHeader *header = new (mem) ShmTimerHeader();
+        header->nodeCount = (uint32_t)nodeCount;
+        header->nodeStride = alignCacheline(sizeof(ShmTimerNode) + maxMsgSize);
+        header->maxMsgSize = header->nodeStride - sizeof(ShmTimerNode);
+        header->tickNs = tickNs;
+        header->totalSize = AlignSize(nodeCount, maxMsgSize);
+        if (!ShmMutex::Init(&header->lock))
+            return false;
+        header->curTick = nowNs / tickNs;
+        header->nextTick.store(UINT64_MAX, std::memory_order_relaxed);
+        memset(header->bitmap, 0, sizeof(header->bitmap));
+        memset(header->slots, 0, sizeof(header->slots));
+        // 所有节点串成空闲链表
+        char *nodes = (char *)mem + alignCacheline(sizeof(ShmTimerHeader));
+        for (uint32_t i = 1; i <= nodeCount; i++)
+        {
+            ShmTimerNode *node = (ShmTimerNode *)(nodes + (uint64_t)(i - 1) * header->nodeStride);
+            node->next = i < nodeCount ? i + 1 : 0;
+        }
+        header->freeHead = 1;
+        header->magic = SHM_TIMER_MAGIC;
+        return true;
+    }
+    size_t ShmTimerWheel::TotalSize(const void *mem)
+    {
+        const ShmTimerHeader *header = (const ShmTimerHeader *)mem;
+        return header->magic == SHM_TIMER_MAGIC ? header->totalSize : 0;
+    }
+    uint64_t ShmTimerWheel::NowNs()
+    {
+        struct timespec ts;
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+    }
+    ShmTimerWheel::ShmTimerWheel(void *mem)
+        : _header((ShmTimerHeader *)mem),
+          _nodeStart(alignCacheline(sizeof(ShmTimerHeader))),
+          _mtx(&((ShmTimerHeader *)mem)->lock)
+    {
+        _mtx.SetRecoverHandler([this]()
+                               { recover(); });
+    }
+    // 差值<64^(l+1)的节点放在第l层,槽位取到期tick在这一层的下标
+    // 超出最高层范围的节点先放在最高层最远的位置,降级时按真实的到期tick重新挂
+    void ShmTimerWheel::link(uint32_t index)
+    {
+        ShmTimerNode *node = nodeAt(index);
+        uint64_t cur = _header->curTick;
+        uint64_t deadline = node->deadline > cur ? node->deadline : cur;
+        uint64_t maxDelta = (1ull << (SHM_TIMER_SLOT_BITS * SHM_TIMER_LEVELS)) - 1;
+        if (deadline - cur > maxDelta)
+            deadline = cur + maxDelta;
+        int level = 0;
+        while (level < SHM_TIMER_LEVELS - 1 && deadline - cur >= (1ull << (SHM_TIMER_SLOT_BITS * (level + 1))))
+            level++;
+        uint32_t slot = (uint32_t)(deadline >> (SHM_TIMER_SLOT_BITS * level)) & (SHM_TIMER_SLOTS - 1);
+        ShmTimerSlot &s = _header->slots[level][slot];
+        node->next = 0;
+        if (s.tail)
+            nodeAt(s.tail)->next = index;
+        else
+            s.head = index;
+        s.tail = index;
+        _header->bitmap[level] |= 1ull << slot;
+    }
+    void ShmTimerWheel::cascade(int level, uint32_t slot)
+    {
+        ShmTimerSlot &s = _header->slots[level][slot];
+        uint32_t index = s.head;
+        s.head = s.tail = 0;
+        _header->bitmap[level] &= ~(1ull << slot);
+        while (index)
+        {
+            uint32_t next = nodeAt(index)->next;
+            link(index);
+            index = next;
+        }
+    }
+    // 每层取当前下标之后第一个非空槽位; 只剩当前窗口之前的槽位(属于下一个窗口)时取下一个窗口的起点
+    uint64_t ShmTimerWheel::nextEvent() const
+    {
+        uint64_t cur = _header->curTick;
+        uint64_t best = UINT64_MAX;
+        for (int level = 0; level < SHM_TIMER_LEVELS; level++)
+        {
+            uint64_t bitmap = _header->bitmap[level];
+            if (!bitmap)
+                continue;
+            int shift = SHM_TIMER_SLOT_BITS * level;
+            uint32_t idx = (uint32_t)(cur >> shift) & (SHM_TIMER_SLOTS - 1);
+            uint64_t later = idx == SHM_TIMER_SLOTS - 1 ? 0 : bitmap & (~0ull << (idx + 1));
+            uint64_t windowStart = (cur >> (shift + SHM_TIMER_SLOT_BITS)) << (shift + SHM_TIMER_SLOT_BITS);
+            uint64_t tick = later ? windowStart + ((uint64_t)__builtin_ctzll(later) << shift)
+                                  : windowStart + (1ull << (shift + SHM_TIMER_SLOT_BITS));
+            if (tick < best)
+                best = tick;
+        }
+        return best;
+    }
+    // 崩溃者可能停在Insert/Advance/cascade中间: 槽位链表、位图、空闲链表和pending都不可信
+    // 以槽位链表为准重建: 从槽位能走到的合法节点按到期tick重新挂入,其他节点全部放回空闲链表
+    // 正在降级(已经从高层摘下)的节点会丢失; 已经交付但还没有摘下的节点会再交付一次
+    void ShmTimerWheel::recover()
+    {
+        uint32_t nodeCount = _header->nodeCount;
+        std::vector<uint8_t> seen(nodeCount + 1, 0);
+        std::vector<uint32_t> linked;
+        for (int level = 0; level < SHM_TIMER_LEVELS; level++)
+        {
+            for (uint32_t slot = 0; slot < SHM_TIMER_SLOTS; slot++)
+            {
+                uint32_t index = _header->slots[level][slot].head;
+                while (index && index <= nodeCount && !seen[index])
+                {
+                    ShmTimerNode *node = nodeAt(index);
+                    if (node->length == 0 || node->length > _header->maxMsgSize)
+                    {
+                        // 节点内容不可信,链表剩下的部分也不可信
+                        seen[index] = 2;
+                        break;
+                    }
+                    seen[index] = 1;
+                    linked.push_back(index);
+                    index = node->next;
+                }
+            }
+        }
+        memset(_header->bitmap, 0, sizeof(_header->bitmap));
+        memset(_header->slots, 0, sizeof(_header->slots));
+        uint32_t lost = _header->pending.load(std::memory_order_relaxed);
+        lost = lost > linked.size() ? lost - (uint32_t)linked.size() : 0;
+        for (uint32_t index : linked)
+            link(index);
+        _header->freeHead = 0;
+        for (uint32_t index = nodeCount; index > 0; index--)
+        {
+            if (seen[index] == 1)
+                continue;
+            nodeAt(index)->next = _header->freeHead;
+            _header->freeHead = index;
+        }
+        _header->pending.store((uint32_t)linked.size(), std::memory_order_relaxed);
+        // 下一次检查立即推进,由Advance重新计算nextTick
+        _header->nextTick.store(linked.empty() ? UINT64_MAX : _header->curTick, std::memory_order_relaxed);
+        printf("ShmTimerWheel recovered from dead owner: pending=%zu lost=%u\n", linked.size(), lost);
+    }
+    int ShmTimerWheel::Insert(const void *msg, size_t length, uint16_t topic, uint64_t deadlineNs, uint64_t nowNs)
+    {
+        if (length == 0 || length > _header->maxMsgSize)
+            return SHM_TIMER_TOO_LARGE;
+        // 向上取整---消息不会早于deadlineNs交付
+        uint64_t deadline = (deadlineNs + _header->tickNs - 1) / _header->tickNs;
+        if (deadlineNs <= nowNs)
+            return SHM_TIMER_DUE;
+        _mtx.WLock();
+        // 时间轮为空时当前tick直接跟上现在的时间
+        uint64_t nowTick = nowNs / _header->tickNs;
+        if (_header->pending.load(std::memory_order_relaxed) == 0 && _header->curTick < nowTick)
+            _header->curTick = nowTick;
+        if (_header->freeHead == 0)
+        {
+            _mtx.WUnLock();
+            return SHM_TIMER_NO_NODE;
+        }
+        uint32_t index = _header->freeHead;
+        ShmTimerNode *node = nodeAt(index);
+        _header->freeHead = node->next;
+        node->length = (uint32_t)length;
+        node->topic = topic;
+        node->deadline = deadline;
+        memcpy((char *)node + sizeof(ShmTimerNode), msg, length);
+        link(index);
+        _header->pending.fetch_add(1, std::memory_order_relaxed);
+        // 其他进程已经推进到更晚的tick时节点挂在当前槽位上,下一次检查立即交付
+        uint64_t next = deadline <= _header->curTick ? _header->curTick : nextEvent();
+        if (next < _header->nextTick.load(std::memory_order_relaxed))
+            _header->nextTick.store(next, std::memory_order_relaxed);
+        _mtx.WUnLock();
+        return SHM_TIMER_OK;
+    }
+    int ShmTimerWheel::Advance(uint64_t nowNs, const DeliverCallback &cb, bool wait)
+    {
+        if (wait)
+            _mtx.WLock();
+        else if (!_mtx.TryWLock())
+            return 0;
+        uint64_t nowTick = nowNs / _header->tickNs;
+        int delivered = 0;
+        bool full = false;
+        while (true)
+        {
+            // 1.交付当前tick的第0层槽位---队列满时剩下的节点留在槽位头部,下次继续
+            uint32_t slot = (uint32_t)_header->curTick & (SHM_TIMER_SLOTS - 1);
+            ShmTimerSlot &s = _header->slots[0][slot];
+            while (s.head)
+            {
+                uint32_t index = s.head;
+                ShmTimerNode *node = nodeAt(index);
+                if (!cb((char *)node + sizeof(ShmTimerNode), node->length, node->topic))
+                {
+                    full = true;
+                    break;
+                }
+                s.head = node->next;
+                if (!s.head)
+                    s.tail = 0;
+                node->next = _header->freeHead;
+                _header->freeHead = index;
+                _header->pending.fetch_sub(1, std::memory_order_relaxed);
+                delivered++;
+            }
+            if (full)
+                break;
+            _header->bitmap[0] &= ~(1ull << slot);
+            if (_header->pending.load(std::memory_order_relaxed) == 0)
+            {
+                if (_header->curTick < nowTick)
+                    _header->curTick = nowTick;
+                break;
+            }
+            // 2.跳到下一个事件: 第0层的非空槽位或者高层的降级边界
+            uint64_t next = nextEvent();
+            if (next > nowTick)
+            {
+                // 中间没有任何需要处理的槽位
+                if (_header->curTick < nowTick)
+                    _header->curTick = nowTick;
+                break;
+            }
+            _header->curTick = next;
+            // 3.从高层到低层依次降级边界上的槽位
+            for (int level = SHM_TIMER_LEVELS - 1; level > 0; level--)
+            {
+                int shift = SHM_TIMER_SLOT_BITS * level;
+                if ((next & ((1ull << shift) - 1)) == 0)
+                    cascade(level, (uint32_t)(next >> shift) & (SHM_TIMER_SLOTS - 1));
+            }
+        }
+        // 队列满时保持nextTick不变,下一次检查立即重试
+        if (!full)
+            _header->nextTick.store(_header->pending.load(std::memory_order_relaxed) ? nextEvent() : UINT64_MAX,
+                                    std::memory_order_relaxed);
+        _header->delivered.fetch_add(delivered, std::memory_order_relaxed);
+        _mtx.WUnLock();
+        return delivered;
+    }
+} // namespace xten
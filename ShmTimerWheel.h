@@ -0,0 +1,116 @@
+#ifndef __XTEN_SHM_TIMER_WHEEL_H__
+#define __XTEN_SHM_TIMER_WHEEL_H__
+#include <atomic>
+#include <functional>
+#include <pthread.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "ShmMutex.h"
+#include "nocopyable.hpp"
+// 共享内存中的分层时间轮---延迟消息在到期之前放在这里,到期后才放入队列ring
+// SHM_TIMER_LEVELS层,每层SHM_TIMER_SLOTS个槽位,第l层一个槽位覆盖64^l个tick
+// 插入: 按到期tick和当前tick的差值选择层和槽位,挂到槽位链表尾部 O(1)
+// 推进: 每层一个64位占用位图,直接跳到下一个非空槽位(或者层窗口的边界),高层槽位到期时整体降级到低层
+// 消息数据放在固定大小的节点池中(空闲链表),所有地址都用节点序号表示,不同进程映射到不同地址也能使用
+namespace xten
+{
+// 时间轮初始化完成标记
+#define SHM_TIMER_MAGIC 0x524D4954u
+#define SHM_TIMER_LEVELS 4
+#define SHM_TIMER_SLOT_BITS 6
+#define SHM_TIMER_SLOTS (1 << SHM_TIMER_SLOT_BITS)
+// Insert的返回值
+#define SHM_TIMER_OK 0         // 已经放入时间轮
+#define SHM_TIMER_DUE 1        // 已经到期,调用者直接放入队列
+#define SHM_TIMER_NO_NODE -1   // 节点池已满
+#define SHM_TIMER_TOO_LARGE -2 // 消息超过节点能放下的最大长度
+    // 槽位链表---节点序号+1 0表示空
+    struct ShmTimerSlot
+    {
+        uint32_t head;
+        uint32_t tail;
+    };
+    // 节点头部---后面紧跟消息数据
+    struct ShmTimerNode
+    {
+        uint32_t next;     // 链表中下一个节点的序号+1
+        uint32_t length;   // 消息长度
+        uint64_t deadline; // 到期tick
+        uint16_t topic;    // 主题id
+        uint16_t reserved[3];
+    };
+    // 时间轮头部
+    struct ShmTimerHeader
+    {
+        uint32_t magic;      // 初始化完成标记
+        uint32_t nodeCount;  // 节点个数
+        uint64_t nodeStride; // 节点间隔(包含节点头部,按缓存行对齐)
+        uint64_t maxMsgSize; // 节点能放下的最大消息长度
+        uint64_t tickNs;     // 一个tick的纳秒数
+        uint64_t totalSize;  // 区域总大小(包含头部和节点池)
+        alignas(64) pthread_mutex_t lock;       // 保护以下所有字段
+        uint64_t curTick;                       // 已经处理到的tick
+        uint32_t freeHead;                      // 空闲节点链表
+        std::atomic<uint32_t> pending{0};       // 时间轮中的消息数---消费者不加锁判断是否需要推进
+        std::atomic<uint64_t> nextTick{0};      // 下一次需要推进的tick---消费者不加锁判断
+        std::atomic<uint64_t> delivered{0};     // 累计到期放入队列的消息数
+        uint64_t bitmap[SHM_TIMER_LEVELS];      // 每层的槽位占用位图
+        ShmTimerSlot slots[SHM_TIMER_LEVELS][SHM_TIMER_SLOTS];
+    };
+    class ShmTimerWheel : public nocopyable
+    {
+    public:
+        // 到期消息放入队列的回调 on success ret=true; 返回false时停止推进(队列满),消息留在时间轮中下次重试
+        typedef std::function<bool(const void *msg, size_t length, uint16_t topic)> DeliverCallback;
+
+        // 需要的区域大小---对齐到缓存行
+        static size_t AlignSize(size_t nodeCount, size_t maxMsgSize);
+        // 参数是否合法---不合法时Init失败
+        static bool CheckParams(size_t nodeCount, size_t maxMsgSize, uint64_t tickNs);
+        // 在mem处初始化一个时间轮 nowNs: 当前时间(CLOCK_MONOTONIC)
+        static bool Init(void *mem, size_t nodeCount, size_t maxMsgSize, uint64_t tickNs, uint64_t nowNs);
+        // 读取mem处时间轮的总大小---不是合法的时间轮时返回0
+        static size_t TotalSize(const void *mem);
+        // 当前时间(CLOCK_MONOTONIC,和std::chrono::steady_clock相同)
+        static uint64_t NowNs();
+
+        explicit ShmTimerWheel(void *mem);
+        // 放入一条延迟消息 ret=SHM_TIMER_OK/SHM_TIMER_DUE ; on failed ret<0 (SHM_TIMER_NO_NODE/SHM_TIMER_TOO_LARGE)
+        int Insert(const void *msg, size_t length, uint16_t topic, uint64_t deadlineNs, uint64_t nowNs);
+        // 不加锁判断是否有到期(或者需要降级)的消息---消费者的快速路径
+        bool Due(uint64_t nowNs) const
+        {
+            return _header->pending.load(std::memory_order_relaxed) != 0 &&
+                   nowNs / _header->tickNs >= _header->nextTick.load(std::memory_order_relaxed);
+        }
+        // 推进到nowNs,把到期的消息交给cb ret=放入队列的消息数
+        // wait=false时其他进程正在推进则直接返回0(消费者不互相等待)
+        int Advance(uint64_t nowNs, const DeliverCallback &cb, bool wait);
+        // 统计
+        uint32_t GetPending() const { return _header->pending.load(std::memory_order_relaxed); }
+        uint64_t GetDelivered() const { return _header->delivered.load(std::memory_order_relaxed); }
+        uint32_t GetNodeCount() const { return _header->nodeCount; }
+        size_t GetMaxMsgSize() const { return _header->maxMsgSize; }
+        uint64_t GetTickNs() const { return _header->tickNs; }
+
+    private:
+        ShmTimerNode *nodeAt(uint32_t index) const
+        {
+            return (ShmTimerNode *)((char *)_header + _nodeStart + (uint64_t)(index - 1) * _header->nodeStride);
+        }
+        // 按到期tick把节点挂到对应的层和槽位
+        void link(uint32_t index);
+        // 把某一层的一个槽位整体降级(重新挂到低层)
+        void cascade(int level, uint32_t slot);
+        // 当前tick之后下一个需要处理的tick
+        uint64_t nextEvent() const;
+        // 持锁进程崩溃后重建槽位链表/位图/空闲链表---由_mtx在标记一致之前调用
+        void recover();
+
+    private:
+        ShmTimerHeader *_header;
+        uint64_t _nodeStart; // 节点池相对头部的偏移
+        ShmMutex _mtx;
+    };
+} // namespace xten
+#endif
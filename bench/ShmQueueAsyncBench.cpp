@@ -0,0 +1,174 @@
+// ShmQueue协程接口示例和性能测试 (C++20)
+// ./async.out idle [queues] [seconds]   queues个消费者协程挂起seconds秒,报告挂起期间消费者进程的cpu时间和唤醒延迟
+// ./async.out pingpong [count]          生产者进程和消费者进程都使用协程,小队列频繁满/空,报告吞吐和双方的cpu时间
+#include <iostream>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <time.h>
+#include <unistd.h>
+#include <stdlib.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include "ShmQueueAsync.h"
+
+using namespace xten;
+
+// 测试消息: 发送时间+是否是最后一条
+struct AsyncBenchMsg
+{
+    uint64_t sendNs;
+    uint32_t quit;
+    uint32_t seq;
+};
+
+static uint64_t nowNs(clockid_t clock = CLOCK_MONOTONIC)
+{
+    struct timespec ts;
+    clock_gettime(clock, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+// 消费者协程: 取出消息直到收到quit,记录第一条消息到达时进程的cpu时间
+static ShmAsyncTask consumeTask(ShmAsyncQueue &que, std::vector<uint64_t> &latency, uint64_t &firstWakeCpuNs, int &running)
+{
+    AsyncBenchMsg msg;
+    while (true)
+    {
+        int ret = co_await que.Pop(&msg, sizeof(msg));
+        if (ret != (int)sizeof(msg))
+        {
+            std::cout << "Pop failed, ret=" << ret << std::endl;
+            break;
+        }
+        if (!firstWakeCpuNs)
+            firstWakeCpuNs = nowNs(CLOCK_PROCESS_CPUTIME_ID);
+        if (msg.quit)
+            break;
+        latency.push_back(nowNs() - msg.sendNs);
+    }
+    running--;
+}
+
+// 挂起的消费者是否占用cpu: 消费者在futex上睡眠,生产者seconds秒后才放入消息
+static void benchIdle(int queues, int seconds)
+{
+    std::vector<std::shared_ptr<ShmAsyncQueue>> asyncQues;
+    std::vector<ShmQueue::ptr> ques;
+    for (int i = 0; i < queues; i++)
+    {
+        ShmQueue::ptr que = ShmQueue::CreateMemfdShmQueuePtr("async-idle", 64 * 1024, EnumVisitModel::SinglePushSinglePop);
+        if (!que)
+            return;
+        ques.push_back(que);
+    }
+    pid_t pid = fork();
+    if (pid == 0)
+    {
+        // 生产者进程: 等待seconds秒后向每个队列放入一条消息和结束标记
+        sleep(seconds);
+        for (int i = 0; i < queues; i++)
+        {
+            AsyncBenchMsg msg = {nowNs(), 0, (uint32_t)i};
+            ques[i]->PushMessage(&msg, sizeof(msg));
+            msg.quit = 1;
+            ques[i]->PushMessage(&msg, sizeof(msg));
+        }
+        _exit(0);
+    }
+    ShmAsyncLoop loop(queues);
+    std::vector<uint64_t> latency;
+    uint64_t firstWakeCpuNs = 0;
+    int running = queues;
+    for (int i = 0; i < queues; i++)
+    {
+        asyncQues.push_back(std::make_shared<ShmAsyncQueue>(ques[i], loop));
+        loop.Spawn(consumeTask(*asyncQues.back(), latency, firstWakeCpuNs, running));
+    }
+    uint64_t wallBegin = nowNs();
+    uint64_t cpuBegin = nowNs(CLOCK_PROCESS_CPUTIME_ID);
+    loop.Run();
+    uint64_t wallCost = nowNs() - wallBegin;
+    waitpid(pid, nullptr, 0);
+    std::sort(latency.begin(), latency.end());
+    double idleCpuMs = (firstWakeCpuNs - cpuBegin) / 1e6;
+    printf("idle: %d consumers suspended %.2f s, consumer cpu while suspended %.3f ms (%.4f%% of one core), wakeups=%lu\n",
+           queues, wallCost / 1e9, idleCpuMs, idleCpuMs / (wallCost / 1e6) * 100, (unsigned long)loop.GetWakeups());
+    if (!latency.empty())
+        printf("wake latency(us): p50=%.1f max=%.1f, finished=%d/%d\n", latency[latency.size() / 2] / 1e3,
+               latency.back() / 1e3, queues - running, queues);
+}
+
+// 生产者协程: 放入count条消息和结束标记,队列满时挂起
+static ShmAsyncTask produceTask(ShmAsyncQueue &que, long count)
+{
+    AsyncBenchMsg msg = {0, 0, 0};
+    for (long i = 0; i <= count; i++)
+    {
+        msg.sendNs = nowNs();
+        msg.quit = i == count;
+        msg.seq = (uint32_t)i;
+        int ret = co_await que.Push(&msg, sizeof(msg));
+        if (ret != 0)
+        {
+            std::cout << "Push failed, ret=" << ret << std::endl;
+            break;
+        }
+    }
+}
+
+// 小队列上的双向挂起: 生产者等待空闲空间,消费者等待消息
+static void benchPingpong(long count)
+{
+    ShmQueue::ptr que = ShmQueue::CreateMemfdShmQueuePtr("async-pingpong", 4096, EnumVisitModel::SinglePushSinglePop);
+    if (!que)
+        return;
+    uint64_t wallBegin = nowNs();
+    pid_t pid = fork();
+    if (pid == 0)
+    {
+        ShmAsyncLoop loop(4);
+        ShmAsyncQueue asyncQue(que, loop);
+        loop.Spawn(produceTask(asyncQue, count));
+        loop.Run();
+        printf("producer: wakeups=%lu\n", (unsigned long)loop.GetWakeups());
+        fflush(stdout);
+        _exit(0);
+    }
+    ShmAsyncLoop loop(4);
+    ShmAsyncQueue asyncQue(que, loop);
+    std::vector<uint64_t> latency;
+    latency.reserve(count);
+    uint64_t firstWakeCpuNs = 0;
+    int running = 1;
+    loop.Spawn(consumeTask(asyncQue, latency, firstWakeCpuNs, running));
+    loop.Run();
+    uint64_t wallCost = nowNs() - wallBegin;
+    waitpid(pid, nullptr, 0);
+    struct rusage self, children;
+    getrusage(RUSAGE_SELF, &self);
+    getrusage(RUSAGE_CHILDREN, &children);
+    auto cpuMs = [](const struct rusage &ru)
+    {
+        return (ru.ru_utime.tv_sec + ru.ru_stime.tv_sec) * 1e3 + (ru.ru_utime.tv_usec + ru.ru_stime.tv_usec) / 1e3;
+    };
+    std::sort(latency.begin(), latency.end());
+    printf("pingpong: %zu msgs in %.3f s, %.0f msgs/s, consumer wakeups=%lu\n", latency.size(), wallCost / 1e9,
+           latency.size() / (wallCost / 1e9), (unsigned long)loop.GetWakeups());
+    printf("cpu: consumer %.1f ms, producer %.1f ms\n", cpuMs(self), cpuMs(children));
+    if (!latency.empty())
+        printf("latency(us): p50=%.1f p99=%.1f max=%.1f\n", latency[latency.size() / 2] / 1e3,
+               latency[latency.size() * 99 / 100] / 1e3, latency.back() / 1e3);
+}
+
+int main(int argc, char **argv)
+{
+    std::string mode = argc > 1 ? argv[1] : "idle";
+    if (mode == "idle")
+        benchIdle(argc > 2 ? atoi(argv[2]) : 64, argc > 3 ? atoi(argv[3]) : 2);
+    else if (mode == "pingpong")
+        benchPingpong(argc > 2 ? atol(argv[2]) : 1000000);
+    else
+        std::cout << "usage: " << argv[0] << " [idle [queues] [seconds] | pingpong [count]]" << std::endl;
+    return 0;
+}
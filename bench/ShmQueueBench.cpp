@@ -0,0 +1,296 @@
+// ShmQueue性能测试
+// ./bench.out throughput            不同消息大小下 memcpy vs 流式拷贝 的吞吐
+// ./bench.out cache                 大帧写入时对生产者进程自身工作集的cache影响
+// ./bench.out spsc                  单生产者进程/单消费者进程的小消息吞吐
+// ./bench.out header                16字节头部 vs 8字节紧凑头部: 每GB ring能放下的小消息数和放入/取出吞吐
+// ./bench.out compress              压缩 vs 不压缩: 重复的JSON快照和随机数据的吞吐、ring占用和压缩率
+#include <iostream>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <unistd.h>
+#include <string.h>
+#include <stdint.h>
+#include <signal.h>
+#include <sys/wait.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#include "ShmQueue.h"
+
+using namespace xten;
+
+static const char *BENCH_PATH = "/tmp";
+
+static double nowSec()
+{
+    return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// 硬件cache miss计数器---容器/虚拟机中可能不可用
+class CacheMissCounter
+{
+public:
+    CacheMissCounter()
+    {
+        struct perf_event_attr attr;
+        memset(&attr, 0, sizeof(attr));
+        attr.size = sizeof(attr);
+        attr.type = PERF_TYPE_HARDWARE;
+        attr.config = PERF_COUNT_HW_CACHE_MISSES;
+        attr.disabled = 1;
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+        _fd = (int)syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0);
+    }
+    ~CacheMissCounter()
+    {
+        if (_fd >= 0)
+            close(_fd);
+    }
+    bool Valid() const { return _fd >= 0; }
+    void Start()
+    {
+        if (_fd >= 0)
+            ioctl(_fd, PERF_EVENT_IOC_ENABLE, 0);
+    }
+    void Stop()
+    {
+        if (_fd >= 0)
+            ioctl(_fd, PERF_EVENT_IOC_DISABLE, 0);
+    }
+    uint64_t Read() const
+    {
+        uint64_t val = 0;
+        if (_fd >= 0 && read(_fd, &val, sizeof(val)) != sizeof(val))
+            val = 0;
+        return val;
+    }
+
+private:
+    int _fd = -1;
+};
+
+// 单线程push+pop,测量纯拷贝路径的吞吐
+static void benchThroughput()
+{
+    const size_t queSize = 16 * 1024 * 1024;
+    const size_t sizes[] = {64, 1024, 16 * 1024, 64 * 1024, 256 * 1024, 1024 * 1024};
+    ShmQueue::ptr que = ShmQueue::GetShmQueuePtr(BENCH_PATH, 110, queSize, EnumVisitModel::SinglePushSinglePop);
+    if (!que)
+        return;
+    std::cout << "stream kernel: " << CopyKernel2String(GetStreamCopyKernel()) << std::endl;
+    std::vector<char> msg(1024 * 1024, 'x');
+    std::vector<char> buffer(1024 * 1024);
+    for (size_t size : sizes)
+    {
+        for (int streaming = 0; streaming < 2; streaming++)
+        {
+            que->SetNtCopyThreshold(streaming ? 0 : SIZE_MAX);
+            const size_t totalBytes = 1024UL * 1024 * 1024;
+            size_t count = totalBytes / size;
+            double begin = nowSec();
+            for (size_t i = 0; i < count; i++)
+            {
+                que->PushMessage(msg.data(), size);
+                que->PopMessage(buffer.data(), buffer.size());
+            }
+            double cost = nowSec() - begin;
+            printf("size=%8zu %-9s %10.0f msgs/s %8.2f GB/s\n", size, streaming ? "streaming" : "memcpy",
+                   count / cost, totalBytes / cost / 1e9);
+        }
+    }
+}
+
+// 生产者循环: 写入一个大帧,然后遍历自身工作集;消费者是另一个进程
+// 统计遍历工作集的耗时和cache miss,体现大帧对生产者cache的污染
+// 流式拷贝减少cache miss的效果还没有在有硬件计数器的机器上验证过: 目前只在1个vCPU的虚拟机上跑过,
+// 计数器不可用(n/a),生产者和消费者共用一个cpu,两种拷贝的遍历耗时差异在多次运行之间的噪声范围内
+static void benchCache()
+{
+    const size_t queSize = 8 * 1024 * 1024;
+    const size_t frameSize = 256 * 1024;
+    const size_t workingSet = 512 * 1024;
+    const int rounds = 4000;
+    for (int streaming = 0; streaming < 2; streaming++)
+    {
+        ShmQueue::ptr que = ShmQueue::GetShmQueuePtr(BENCH_PATH, 111 + streaming, queSize, EnumVisitModel::SinglePushSinglePop);
+        if (!que)
+            return;
+        que->SetNtCopyThreshold(streaming ? DEFAULT_NT_COPY_THRESHOLD : SIZE_MAX);
+        pid_t pid = fork();
+        if (pid == 0)
+        {
+            // 同机器上的消费进程
+            ShmQueue *consumer = ShmQueue::GetShmQueue(BENCH_PATH, 111 + streaming, queSize, EnumVisitModel::SinglePushSinglePop);
+            std::vector<char> buffer(frameSize);
+            for (int i = 0; i < rounds;)
+            {
+                if (consumer->PopMessage(buffer.data(), buffer.size()) > 0)
+                    i++;
+            }
+            _exit(0);
+        }
+        std::vector<char> frame(frameSize, 'f');
+        std::vector<uint64_t> ws(workingSet / sizeof(uint64_t), 1);
+        CacheMissCounter counter;
+        uint64_t sum = 0;
+        double walkCost = 0;
+        for (int i = 0; i < rounds;)
+        {
+            if (que->PushMessage(frame.data(), frame.size()) != 0)
+                continue;
+            i++;
+            double begin = nowSec();
+            counter.Start();
+            for (size_t j = 0; j < ws.size(); j += CPU_CACHELINE_SIZE / sizeof(uint64_t))
+                sum += ws[j];
+            counter.Stop();
+            walkCost += nowSec() - begin;
+        }
+        waitpid(pid, nullptr, 0);
+        printf("%-9s working-set walk %8.1f us/round, cache-misses %s (sum=%lu)\n", streaming ? "streaming" : "memcpy",
+               walkCost / rounds * 1e6, counter.Valid() ? std::to_string(counter.Read() / rounds).c_str() : "n/a",
+               (unsigned long)sum);
+    }
+}
+
+// 生产者和消费者在不同进程,测量索引发布协议本身的开销
+static void benchSpsc()
+{
+    const size_t queSize = 1024 * 1024;
+    const size_t sizes[] = {16, 64, 256};
+    const long count = 20000000;
+    for (size_t size : sizes)
+    {
+        ShmQueue::ptr que = ShmQueue::GetShmQueuePtr(BENCH_PATH, 113, queSize, EnumVisitModel::SinglePushSinglePop);
+        if (!que)
+            return;
+        pid_t pid = fork();
+        if (pid == 0)
+        {
+            ShmQueue *consumer = ShmQueue::GetShmQueue(BENCH_PATH, 113, queSize, EnumVisitModel::SinglePushSinglePop);
+            char buffer[1024];
+            for (long i = 0; i < count;)
+            {
+                if (consumer->PopMessage(buffer, sizeof(buffer)) > 0)
+                    i++;
+            }
+            _exit(0);
+        }
+        std::vector<char> msg(size, 'm');
+        double begin = nowSec();
+        for (long i = 0; i < count;)
+        {
+            if (que->PushMessage(msg.data(), size) == 0)
+                i++;
+        }
+        waitpid(pid, nullptr, 0);
+        double cost = nowSec() - begin;
+        printf("size=%4zu %10.0f msgs/s\n", size, count / cost);
+    }
+}
+
+// 小消息的头部开销: 填满ring计数消息条数,再整批取出,反复测量吞吐
+static void benchHeader()
+{
+    const size_t queSize = 1024 * 1024;
+    const size_t sizes[] = {12, 16, 24, 64};
+    const int rounds = 200;
+    for (size_t size : sizes)
+    {
+        for (int compact = 0; compact <= 1; compact++)
+        {
+            ShmQueOptions options;
+            options.compactHeader = compact;
+            ShmQueue::ptr que = ShmQueue::CreateMemfdShmQueuePtr("bench-header", queSize, EnumVisitModel::SinglePushSinglePop,
+                                                                 options);
+            if (!que)
+                return;
+            std::vector<char> msg(size, 'h');
+            char buffer[256];
+            long perRing = 0, total = 0;
+            double begin = nowSec();
+            for (int r = 0; r < rounds; r++)
+            {
+                long n = 0;
+                while (que->PushMessage(msg.data(), size) == 0)
+                    n++;
+                while (que->PopMessage(buffer, sizeof(buffer)) > 0)
+                    ;
+                perRing = n;
+                total += n;
+            }
+            double cost = nowSec() - begin;
+            printf("size=%3zu header=%2zu msgs/GB=%10.0f %10.0f msgs/s\n", size, que->GetRecordHeaderSize(),
+                   perRing * (1024.0 * 1024 * 1024 / queSize), total / cost);
+        }
+    }
+}
+
+// 大消息压缩: ring能放下的消息数、放入/取出吞吐和编解码耗时
+static void benchCompress()
+{
+    const size_t queSize = 4 * 1024 * 1024;
+    const size_t msgSize = 16 * 1024;
+    const int rounds = 50;
+    // 订单簿快照样式的JSON / 随机数据
+    std::string json;
+    for (int i = 0; json.size() < msgSize; i++)
+        json += "{\"px\":" + std::to_string(1500000 + (i * 7) % 91) + ",\"qty\":" + std::to_string((i * 13) % 500) + ",\"side\":\"" +
+                (i % 2 ? "bid" : "ask") + "\"},";
+    json.resize(msgSize);
+    std::string noise(msgSize, 0);
+    for (size_t i = 0; i < msgSize; i++)
+        noise[i] = (char)(rand() & 0xFF);
+    const std::pair<const char *, std::string *> payloads[] = {{"json", &json}, {"random", &noise}};
+    for (auto &payload : payloads)
+    {
+        for (int compress = 0; compress <= 1; compress++)
+        {
+            ShmQueOptions options;
+            options.compressThreshold = compress ? 1024 : 0;
+            ShmQueue::ptr que = ShmQueue::CreateMemfdShmQueuePtr("bench-compress", queSize, EnumVisitModel::SinglePushSinglePop,
+                                                                 options);
+            if (!que)
+                return;
+            std::vector<char> buffer(msgSize);
+            long perRing = 0, total = 0;
+            double begin = nowSec();
+            for (int r = 0; r < rounds; r++)
+            {
+                long n = 0;
+                while (que->PushMessage(payload.second->data(), msgSize) == 0)
+                    n++;
+                while (que->PopMessage(buffer.data(), buffer.size()) > 0)
+                    ;
+                perRing = n;
+                total += n;
+            }
+            double cost = nowSec() - begin;
+            ShmQueStats stats = que->GetStats();
+            printf("%-6s compress=%d msgs/ring=%6ld %9.0f msgs/s ratio=%5.2f compress=%.2f us/msg decompress=%.2f us/msg\n",
+                   payload.first, compress, perRing, total / cost,
+                   stats.compressStoredBytes ? (double)stats.compressRawBytes / stats.compressStoredBytes : 1.0,
+                   stats.compressNs / 1e3 / (total ? total : 1), stats.decompressNs / 1e3 / (total ? total : 1));
+        }
+    }
+}
+
+int main(int argc, char **argv)
+{
+    std::string mode = argc > 1 ? argv[1] : "throughput";
+    if (mode == "throughput")
+        benchThroughput();
+    else if (mode == "cache")
+        benchCache();
+    else if (mode == "spsc")
+        benchSpsc();
+    else if (mode == "header")
+        benchHeader();
+    else if (mode == "compress")
+        benchCompress();
+    else
+        std::cout << "usage: " << argv[0] << " [throughput|cache|spsc|header|compress]" << std::endl;
+    return 0;
+}
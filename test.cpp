@@ -4,8 +4,27 @@
 #include <thread>
 #include <string>
 #include <atomic>
+#include <vector>
+#include <mutex>
+#include <chrono>
 #include <assert.h>
+#include <string.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <sys/socket.h>
 #include "ShmQueue.h"
+#include "ShmQueueWriter.h"
+#include "ShmRpcChannel.h"
+#include "ShmQueueRegistry.h"
+#include "ShmLatestTable.h"
+#include "ShmQueuePoller.h"
+#include "ShmQueueDispatcher.h"
+#include "tools/ShmTrafficFile.h"
+#if defined(__cpp_impl_coroutine)
+#include "ShmQueueAsync.h"
+#endif
 static int tmp = 0;
 #define KEY 120
 static std::atomic_ulong count = 0;
@@ -115,8 +134,1055 @@ void test()
     //确保消息没有丢失
     std::cout << "count=" << count << std::endl;
 }
+// 压缩: 阈值被限制在最小值之上,短消息(包括16字节以下)和可压缩的大消息都能原样取回
+void testCompress()
+{
+    xten::ShmQueOptions options;
+    options.compressThreshold = 1;
+    xten::ShmQueue::ptr shmque = xten::ShmQueue::CreateMemfdShmQueuePtr("testCompress", 1 << 16, xten::EnumVisitModel::SinglePushSinglePop, options);
+    assert(shmque);
+    assert(shmque->GetCompressThreshold() == SHM_COMPRESS_MIN_THRESHOLD);
+    shmque->SetCompressThreshold(3);
+    assert(shmque->GetCompressThreshold() == SHM_COMPRESS_MIN_THRESHOLD);
+    std::string big;
+    for (int i = 0; big.size() < 16384; i++)
+        big += "{\"seq\":" + std::to_string(i % 100) + ",\"name\":\"shmQueueTest\"}";
+    char buffer[20000];
+    for (size_t len = 1; len <= 40; len++)
+    {
+        assert(shmque->PushMessage(big.data(), len) == 0);
+        assert(shmque->PopMessage(buffer, sizeof(buffer)) == (int)len);
+        assert(memcmp(buffer, big.data(), len) == 0);
+    }
+    assert(shmque->PushMessage(big.data(), big.size()) == 0);
+    assert(shmque->PopMessage(buffer, sizeof(buffer)) == (int)big.size());
+    assert(memcmp(buffer, big.data(), big.size()) == 0);
+    xten::ShmQueStats stats = shmque->GetStats();
+    assert(stats.compressedMessages >= 1);
+    assert(stats.compressStoredBytes < stats.compressRawBytes);
+    std::cout << "testCompress ok" << std::endl;
+}
+// 溢出层: 单生产者模式不支持; ring满时溢出的消息按顺序回放; 没有回放完的消息留在文件中,下次EnableSpill时回放
+void testSpill()
+{
+    const char *file = "/tmp/shmque_test_spill.dat";
+    unlink(file);
+    xten::ShmQueue::ptr single = xten::ShmQueue::CreateMemfdShmQueuePtr("testSpill", 1024, xten::EnumVisitModel::SinglePushSinglePop);
+    assert(single->EnableSpill(file) == (int)xten::ShmQueErrorCode::QueueNotSupported);
+    char buffer[64];
+    {
+        xten::ShmQueue::ptr shmque = xten::ShmQueue::CreateMemfdShmQueuePtr("testSpill", 1024, xten::EnumVisitModel::MulitPushMulitPop);
+        assert(shmque->EnableSpill(file) == 0);
+        for (int i = 0; i < 200; i++)
+        {
+            std::string msg = "spill" + std::to_string(i);
+            assert(shmque->PushMessage(msg.data(), msg.size()) == 0);
+        }
+        assert(shmque->GetStats().spilledBytes > 0);
+        for (int i = 0; i < 200;)
+        {
+            int ret = shmque->PopMessage(buffer, sizeof(buffer));
+            assert(ret >= 0);
+            if (ret == 0)
+            {
+                usleep(100);
+                continue;
+            }
+            assert(std::string(buffer, ret) == "spill" + std::to_string(i));
+            i++;
+        }
+        // 再溢出一批,只取出一部分就关闭---ring中的随memfd释放,溢出层中没有回放的留在文件中
+        for (int i = 0; i < 200; i++)
+        {
+            std::string msg = "spill" + std::to_string(i);
+            assert(shmque->PushMessage(msg.data(), msg.size()) == 0);
+        }
+        for (int i = 0; i < 60;)
+        {
+            int ret = shmque->PopMessage(buffer, sizeof(buffer));
+            assert(ret >= 0);
+            if (ret == 0)
+                usleep(100);
+            else
+                assert(std::string(buffer, ret) == "spill" + std::to_string(i++));
+        }
+    }
+    xten::ShmQueue::ptr shmque = xten::ShmQueue::CreateMemfdShmQueuePtr("testSpill", 1024, xten::EnumVisitModel::MulitPushMulitPop);
+    assert(shmque->EnableSpill(file) == 0);
+    int next = -1;
+    for (int idle = 0; next < 200; idle++)
+    {
+        int ret = shmque->PopMessage(buffer, sizeof(buffer));
+        assert(ret >= 0 && idle < 100000);
+        if (ret == 0)
+        {
+            usleep(100);
+            continue;
+        }
+        int seq = atoi(std::string(buffer + 5, ret - 5).c_str());
+        assert(next == -1 || seq == next);
+        next = seq + 1;
+        if (next == 200)
+            break;
+    }
+    assert(shmque->GetStats().spillDepthRecords == 0);
+    unlink(file);
+    std::cout << "testSpill ok" << std::endl;
+}
+// 延迟消息: slab参数不合法时拒绝创建; 按到期时间取出,超过第0层的消息降级后到期; attach的句柄定位到同一个时间轮
+void testTimer()
+{
+    xten::ShmQueOptions options;
+    options.slabSize = 100;
+    options.timerSlots = 16;
+    assert(!xten::ShmQueue::CreateMemfdShmQueue("testTimer", 1 << 16, xten::EnumVisitModel::MulitPushMulitPop, options));
+    options.slabSize = 1 << 16;
+    xten::ShmQueue::ptr shmque = xten::ShmQueue::CreateMemfdShmQueuePtr("testTimer", 1 << 16, xten::EnumVisitModel::MulitPushMulitPop, options);
+    assert(shmque);
+    xten::ShmQueue::ptr attached = xten::ShmQueue::AttachMemfdShmQueuePtr(dup(shmque->GetFd()));
+    assert(attached);
+    auto now = std::chrono::steady_clock::now();
+    assert(attached->PushMessageAt("c", 1, now + std::chrono::milliseconds(150)) == 0);
+    assert(shmque->PushMessageAt("b", 1, now + std::chrono::milliseconds(30)) == 0);
+    assert(shmque->PushMessageAt("a", 1, now + std::chrono::milliseconds(5)) == 0);
+    assert(attached->PushMessage("0", 1) == 0);
+    assert(shmque->GetStats().timerPending == 3);
+    std::string order;
+    char buffer[16];
+    while (order.size() < 4 && std::chrono::steady_clock::now() - now < std::chrono::seconds(2))
+    {
+        int ret = shmque->PopMessage(buffer, sizeof(buffer));
+        assert(ret >= 0);
+        if (ret > 0)
+            order.append(buffer, ret);
+        else
+            usleep(100);
+    }
+    assert(order == "0abc");
+    assert(std::chrono::steady_clock::now() - now >= std::chrono::milliseconds(150));
+    assert(attached->GetStats().timerDelivered == 3);
+    std::cout << "testTimer ok" << std::endl;
+}
+// 合并写: 多条记录一次刷出; 队列开启溢出层时ring满的刷出进入溢出层,消费者看到的顺序不变
+void testWriter()
+{
+    const char *file = "/tmp/shmque_test_writer.dat";
+    unlink(file);
+    xten::ShmQueue::ptr shmque = xten::ShmQueue::CreateMemfdShmQueuePtr("testWriter", 4096, xten::EnumVisitModel::MulitPushMulitPop);
+    assert(shmque->EnableSpill(file) == 0);
+    xten::ShmWriterOptions options;
+    options.flushRecords = 8;
+    xten::ShmQueueWriter writer(shmque, options);
+    for (int i = 0; i < 1000; i++)
+    {
+        std::string msg = "writer" + std::to_string(i);
+        assert(writer.Append(msg.data(), msg.size()) == 0);
+    }
+    assert(writer.Flush() >= 0);
+    assert(writer.GetFlushCount() > 0 && writer.GetFlushCount() < 1000 / 8 + 1);
+    char buffer[64];
+    for (int i = 0, idle = 0; i < 1000; idle++)
+    {
+        int ret = shmque->PopMessage(buffer, sizeof(buffer));
+        assert(ret >= 0 && idle < 100000);
+        if (ret == 0)
+        {
+            usleep(100);
+            continue;
+        }
+        assert(std::string(buffer, ret) == "writer" + std::to_string(i));
+        i++;
+    }
+    unlink(file);
+    std::cout << "testWriter ok" << std::endl;
+}
+// RPC: 回复按调用匹配; 回复ring放不下的回复返回错误,一直等待的客户端不会挂住
+void testRpc()
+{
+    xten::ShmRpcChannel::ptr server = xten::ShmRpcChannel::GetShmRpcChannelPtr("/tmp", 101, 4096);
+    assert(server);
+    std::atomic<bool> stop(false);
+    std::thread t = std::thread([&]()
+                                {
+        while (!stop)
+            server->Serve([](const void *request, size_t length, std::string &response)
+                          {
+                              if (length == 3 && memcmp(request, "big", 3) == 0)
+                                  response.assign(8192, 'x');
+                              else
+                                  response.assign((const char *)request, length);
+                          }, 64, 10); });
+    xten::ShmRpcChannel::ptr client1 = xten::ShmRpcChannel::GetShmRpcChannelPtr("/tmp", 101, 4096);
+    xten::ShmRpcChannel::ptr client2 = xten::ShmRpcChannel::GetShmRpcChannelPtr("/tmp", 101, 4096);
+    char buffer[64];
+    for (int i = 0; i < 100; i++)
+    {
+        std::string req = "call" + std::to_string(i);
+        xten::ShmRpcChannel::ptr client = i % 2 ? client1 : client2;
+        assert(client->Call(req.data(), req.size(), buffer, sizeof(buffer), -1) == (int)req.size());
+        assert(std::string(buffer, req.size()) == req);
+    }
+    assert(client1->Call("big", 3, buffer, sizeof(buffer), -1) == (int)xten::ShmQueErrorCode::QueueNoFreeSize);
+    assert(client1->Call("ok", 2, buffer, sizeof(buffer), -1) == 2);
+    stop = true;
+    t.join();
+    std::cout << "testRpc ok" << std::endl;
+}
+// fd桥接: 覆盖模式下没有读到数据时不丢弃旧记录; 普通模式最多读取空闲空间大小,剩余数据留在fd中
+void testFdBridge()
+{
+    int in[2], out[2];
+    assert(pipe(in) == 0 && pipe(out) == 0);
+    fcntl(in[0], F_SETFL, O_NONBLOCK);
+    xten::ShmQueOptions options;
+    options.overwrite = true;
+    xten::ShmQueue::ptr ring = xten::ShmQueue::CreateMemfdShmQueuePtr("testFdBridge", 4096, xten::EnumVisitModel::MulitPushMulitPop, options);
+    for (int i = 0; i < 100; i++)
+        assert(ring->PushMessage("0123456789abcdef0123456789abcdef", 32) == 0);
+    uint64_t dropped = ring->GetStats().droppedRecords;
+    assert(dropped > 0);
+    assert(ring->PushFromFd(in[0], 2048) == 0);
+    assert(ring->GetStats().droppedRecords == dropped);
+    assert(write(in[1], "hello", 5) == 5);
+    assert(ring->PushFromFd(in[0], 2048) == 5);
+    assert(ring->GetStats().droppedRecords - dropped <= 1);
+
+    xten::ShmQueue::ptr shmque = xten::ShmQueue::CreateMemfdShmQueuePtr("testFdBridge", 4096, xten::EnumVisitModel::SinglePushSinglePop);
+    std::string msg(1000, 'm');
+    for (int i = 0; i < 3; i++)
+        assert(shmque->PushMessage(msg.data(), msg.size()) == 0);
+    std::string data(3000, 'd');
+    assert(write(in[1], data.data(), data.size()) == (ssize_t)data.size());
+    int n = shmque->PushFromFd(in[0], data.size());
+    assert(n > 0 && n < (int)data.size());
+    for (int i = 0; i < 3; i++)
+        assert(shmque->PopToFd(out[1]) == (int)msg.size());
+    assert(shmque->PopToFd(out[1]) == n);
+    assert(shmque->PushFromFd(in[0], data.size()) == (int)data.size() - n);
+    assert(shmque->PopToFd(out[1]) == (int)data.size() - n);
+    std::string result(3000 + data.size(), 0);
+    assert(read(out[0], &result[0], result.size()) == (ssize_t)result.size());
+    assert(result == msg + msg + msg + data);
+    // 对端一直不读: 写出一部分后等待超时,丢弃这条消息并释放head锁
+    fcntl(out[1], F_SETPIPE_SZ, 4096);
+    fcntl(out[1], F_SETFL, O_NONBLOCK);
+    xten::ShmQueue::ptr bigque = xten::ShmQueue::CreateMemfdShmQueuePtr("testFdBridge", 1 << 16, xten::EnumVisitModel::SinglePushMulitPop);
+    std::string large(16000, 'l');
+    assert(bigque->PushMessage(large.data(), large.size()) == 0);
+    assert(bigque->PushMessage("next", 4) == 0);
+    auto start = std::chrono::steady_clock::now();
+    assert(bigque->PopToFd(out[1]) == (int)xten::ShmQueErrorCode::QueueTimeout);
+    assert(std::chrono::steady_clock::now() - start >= std::chrono::milliseconds(SHM_FD_WRITE_TIMEOUT_MS));
+    char buffer[16];
+    assert(bigque->PopMessage(buffer, sizeof(buffer)) == 4 && memcmp(buffer, "next", 4) == 0);
+    close(in[0]);
+    close(in[1]);
+    close(out[0]);
+    close(out[1]);
+    std::cout << "testFdBridge ok" << std::endl;
+}
+// 覆盖模式: 队列满时放入不失败,丢弃最老的记录并计数,消费者读到的是最新的一段连续消息
+void testOverwrite()
+{
+    xten::ShmQueOptions options;
+    options.overwrite = true;
+    xten::ShmQueue::ptr shmque = xten::ShmQueue::CreateMemfdShmQueuePtr("testOverwrite", 1024, xten::EnumVisitModel::MulitPushMulitPop, options);
+    for (int i = 0; i < 100; i++)
+    {
+        std::string msg = "ow" + std::to_string(i);
+        assert(shmque->PushMessage(msg.data(), msg.size()) == 0);
+    }
+    uint64_t dropped = shmque->GetStats().droppedRecords;
+    assert(dropped > 0 && dropped < 100);
+    char buffer[64];
+    int ret;
+    uint64_t next = dropped;
+    while ((ret = shmque->PopMessage(buffer, sizeof(buffer))) > 0)
+    {
+        assert(std::string(buffer, ret) == "ow" + std::to_string(next));
+        next++;
+    }
+    assert(ret == 0 && next == 100);
+    // head处的记录头部损坏: 剩余数据整体丢弃,计数只加1
+    xten::ShmQueue::ptr corruptque = xten::ShmQueue::CreateMemfdShmQueuePtr("testOverwrite", 1024, xten::EnumVisitModel::MulitPushMulitPop, options);
+    for (int i = 0; i < 10; i++)
+        assert(corruptque->PushMessage("old", 3) == 0);
+    size_t mapSize = 3 * CPU_CACHELINE_SIZE + corruptque->GetQueueSize();
+    unsigned char *mem = (unsigned char *)mmap(nullptr, mapSize, PROT_READ | PROT_WRITE, MAP_SHARED, corruptque->GetFd(), 0);
+    assert(mem != MAP_FAILED);
+    xten::ShmRecordHeader header;
+    memcpy(&header, mem + 3 * CPU_CACHELINE_SIZE, sizeof(header));
+    header.commit = 0;
+    memcpy(mem + 3 * CPU_CACHELINE_SIZE, &header, sizeof(header));
+    munmap(mem, mapSize);
+    std::string fill(100, 'f');
+    int pushed = 0;
+    while (corruptque->GetStats().droppedRecords == 0)
+    {
+        std::string msg = std::to_string(pushed++) + fill;
+        assert(corruptque->PushMessage(msg.data(), msg.size()) == 0);
+    }
+    assert(corruptque->GetStats().droppedRecords == 1);
+    // 损坏的记录和之后放入的记录全部丢弃,只剩触发丢弃的这一条
+    char large[256];
+    ret = corruptque->PopMessage(large, sizeof(large));
+    assert(std::string(large, ret) == std::to_string(pushed - 1) + fill);
+    assert(corruptque->PopMessage(large, sizeof(large)) == 0);
+    std::cout << "testOverwrite ok" << std::endl;
+}
+// 拷贝内核: 流式拷贝对各种长度和未对齐的地址结果都和memcpy相同; 大消息按非临时存储放入队列后数据正确
+void testCopy()
+{
+    std::vector<unsigned char> src(70000), dst(70000 + 64);
+    for (size_t i = 0; i < src.size(); i++)
+        src[i] = (unsigned char)(i * 131 + 7);
+    size_t lens[] = {0, 1, 15, 16, 63, 64, 65, 255, 4096, 65537, 69999};
+    for (size_t len : lens)
+        for (size_t offset = 0; offset < 3; offset++)
+        {
+            memset(dst.data(), 0, dst.size());
+            xten::ShmCopyToQueue(dst.data() + offset, src.data() + 1, len, true);
+            xten::ShmStreamFence();
+            assert(memcmp(dst.data() + offset, src.data() + 1, len) == 0);
+            assert(dst[offset + len] == 0);
+        }
+    xten::ShmQueue::ptr shmque = xten::ShmQueue::CreateMemfdShmQueuePtr("testCopy", 1 << 18, xten::EnumVisitModel::SinglePushSinglePop);
+    shmque->SetNtCopyThreshold(1024);
+    std::vector<unsigned char> buffer(src.size());
+    for (int i = 0; i < 10; i++)
+    {
+        size_t len = 60000 + i * 1000;
+        assert(shmque->PushMessage(src.data() + i, len) == 0);
+        assert(shmque->PopMessage(buffer.data(), buffer.size()) == (int)len);
+        assert(memcmp(buffer.data(), src.data() + i, len) == 0);
+    }
+    std::cout << "testCopy ok (" << xten::CopyKernel2String(xten::GetStreamCopyKernel()) << ")" << std::endl;
+}
+// 索引发布: 单生产单消费两个线程并发,消费者看到新的tail时消息数据一定已经完整写入
+void testPublish()
+{
+    xten::ShmQueue::ptr shmque = xten::ShmQueue::CreateMemfdShmQueuePtr("testPublish", 4096, xten::EnumVisitModel::SinglePushSinglePop);
+    const uint64_t total = 200000;
+    std::thread producer = std::thread([&]()
+                                       {
+        for (uint64_t i = 0; i < total;)
+        {
+            uint64_t msg[4] = {i, i * 3, i * 5, i * 7};
+            if (shmque->PushMessage(msg, sizeof(msg)) == 0)
+                i++;
+        } });
+    for (uint64_t i = 0; i < total;)
+    {
+        uint64_t msg[4];
+        int ret = shmque->PopMessage(msg, sizeof(msg));
+        assert(ret >= 0);
+        if (ret == 0)
+            continue;
+        assert(ret == (int)sizeof(msg) && msg[0] == i && msg[1] == i * 3 && msg[2] == i * 5 && msg[3] == i * 7);
+        i++;
+    }
+    producer.join();
+    std::cout << "testPublish ok" << std::endl;
+}
+// 记录校验: 头部损坏/没有提交的记录只跳过这一条; 持有tail锁的生产者进程崩溃后其他生产者可以继续放入
+void testRecovery()
+{
+    xten::ShmQueOptions options;
+    options.headerCrc = true;
+    xten::ShmQueue::ptr shmque = xten::ShmQueue::CreateMemfdShmQueuePtr("testRecovery", 4096, xten::EnumVisitModel::MulitPushMulitPop, options);
+    const char *msgs[] = {"first", "second", "third", "fourth"};
+    for (const char *msg : msgs)
+        assert(shmque->PushMessage(msg, strlen(msg)) == 0);
+    // 控制块之后就是ring,第一条记录的头部在ring的开头
+    size_t mapSize = 3 * CPU_CACHELINE_SIZE + shmque->GetQueueSize();
+    unsigned char *mem = (unsigned char *)mmap(nullptr, mapSize, PROT_READ | PROT_WRITE, MAP_SHARED, shmque->GetFd(), 0);
+    assert(mem != MAP_FAILED);
+    unsigned char *ring = mem + 3 * CPU_CACHELINE_SIZE;
+    xten::ShmRecordHeader header;
+    memcpy(&header, ring, sizeof(header));
+    header.length += 100;
+    memcpy(ring, &header, sizeof(header));
+    char buffer[64];
+    assert(shmque->PopMessage(buffer, sizeof(buffer)) == (int)xten::ShmQueErrorCode::QueueRecordCrcError);
+    assert(shmque->PopMessage(buffer, sizeof(buffer)) == 6 && memcmp(buffer, "second", 6) == 0);
+    // 第三条记录去掉提交标记---长度可信,准确跳过
+    size_t third = 2 * sizeof(header) + 5 + 6;
+    memcpy(&header, ring + third, sizeof(header));
+    header.commit = 0;
+    memcpy(ring + third, &header, sizeof(header));
+    assert(shmque->PopMessage(buffer, sizeof(buffer)) == (int)xten::ShmQueErrorCode::QueueRecordUncommitted);
+    assert(shmque->PopMessage(buffer, sizeof(buffer)) == 6 && memcmp(buffer, "fourth", 6) == 0);
+    munmap(mem, mapSize);
+    // 子进程阻塞在PushFromFd中(持有tail锁)时被杀死
+    int fds[2];
+    assert(pipe(fds) == 0);
+    pid_t pid = fork();
+    if (pid == 0)
+    {
+        shmque->PushFromFd(fds[0], 64);
+        _exit(0);
+    }
+    usleep(100 * 1000);
+    kill(pid, SIGKILL);
+    waitpid(pid, nullptr, 0);
+    assert(shmque->PushMessage("alive", 5) == 0);
+    assert(shmque->PopMessage(buffer, sizeof(buffer)) == 5 && memcmp(buffer, "alive", 5) == 0);
+    close(fds[0]);
+    close(fds[1]);
+    // 持锁进程崩溃后,下一个加锁者在锁恢复可用之前调用修复回调
+    pthread_mutex_t *lockMem = (pthread_mutex_t *)mmap(nullptr, sizeof(pthread_mutex_t), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    assert(lockMem != MAP_FAILED && xten::ShmMutex::Init(lockMem));
+    pid = fork();
+    if (pid == 0)
+    {
+        xten::ShmMutex(lockMem).WLock();
+        _exit(0);
+    }
+    waitpid(pid, nullptr, 0);
+    int repaired = 0;
+    xten::ShmMutex mtx(lockMem);
+    mtx.SetRecoverHandler([&]()
+                          { repaired++; });
+    mtx.WLock();
+    mtx.WUnLock();
+    assert(mtx.TryWLock());
+    mtx.WUnLock();
+    assert(repaired == 1);
+    munmap(lockMem, sizeof(pthread_mutex_t));
+    std::cout << "testRecovery ok" << std::endl;
+}
+// 文件后端: 关闭后重新打开直接复用文件中的控制块和数据
+void testFileBackend()
+{
+    const char *file = "/tmp/shmque_test_file.dat";
+    unlink(file);
+    xten::ShmQueOptions options;
+    options.msyncBytes = 1024;
+    {
+        xten::ShmQueue::ptr shmque = xten::ShmQueue::GetFileShmQueuePtr(file, 102, 4096, xten::EnumVisitModel::SinglePushSinglePop, options);
+        assert(shmque && shmque->GetCreateModel() == xten::EnumCreateModel::NewShmQue);
+        assert(shmque->GetBackend() == xten::EnumShmBackend::FileMmap);
+        for (int i = 0; i < 10; i++)
+        {
+            std::string msg = "file" + std::to_string(i);
+            assert(shmque->PushMessage(msg.data(), msg.size()) == 0);
+        }
+        char buffer[64];
+        assert(shmque->PopMessage(buffer, sizeof(buffer)) == 5);
+    }
+    xten::ShmQueue::ptr shmque = xten::ShmQueue::GetFileShmQueuePtr(file, 102, 1 << 20, xten::EnumVisitModel::SinglePushSinglePop, options);
+    assert(shmque && shmque->GetCreateModel() == xten::EnumCreateModel::LinkShmQue);
+    assert(shmque->GetQueueSize() == 4096);
+    char buffer[64];
+    for (int i = 1; i < 10; i++)
+    {
+        int ret = shmque->PopMessage(buffer, sizeof(buffer));
+        assert(std::string(buffer, ret) == "file" + std::to_string(i));
+    }
+    assert(shmque->PopMessage(buffer, sizeof(buffer)) == 0);
+    assert(shmque->SyncFile() == 0);
+    // 其他句柄打开文件时保留poller注册; 没有存活的句柄时文件中的poller shmid被清除
+    xten::ShmQueuePoller::ptr poller = xten::ShmQueuePoller::CreateShmQueuePollerPtr(64);
+    assert(poller && poller->Register(shmque.get()) >= 0);
+    std::string info = shmque->PrintShmQueInfo();
+    size_t at = info.find("poller: shmid=");
+    assert(at != std::string::npos);
+    int pollerShmId = atoi(info.c_str() + at + strlen("poller: shmid="));
+    {
+        xten::ShmQueue::ptr other = xten::ShmQueue::GetFileShmQueuePtr(file, 102, 4096, xten::EnumVisitModel::SinglePushSinglePop, options);
+        assert(other && other->PrintShmQueInfo().find("poller: shmid=") != std::string::npos);
+    }
+    // 找到控制块中记录poller shmid的位置,注销并关闭后写回旧值---模拟重启之前留下的注册
+    int fd = open(file, O_RDWR);
+    assert(fd >= 0);
+    int *cblock = (int *)mmap(nullptr, 4096, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    assert(cblock != MAP_FAILED);
+    std::vector<size_t> candidates;
+    for (size_t i = 0; i < 3 * CPU_CACHELINE_SIZE / sizeof(int); i++)
+    {
+        if (cblock[i] == pollerShmId)
+            candidates.push_back(i);
+    }
+    assert(poller->Unregister(shmque.get()) == 0);
+    size_t slot = SIZE_MAX;
+    for (size_t i : candidates)
+    {
+        if (cblock[i] == -1)
+            slot = i;
+    }
+    assert(slot != SIZE_MAX);
+    shmque.reset();
+    cblock[slot] = pollerShmId;
+    shmque = xten::ShmQueue::GetFileShmQueuePtr(file, 102, 4096, xten::EnumVisitModel::SinglePushSinglePop, options);
+    assert(shmque && shmque->GetCreateModel() == xten::EnumCreateModel::LinkShmQue);
+    assert(cblock[slot] == -1 && shmque->PrintShmQueInfo().find("poller: shmid=") == std::string::npos);
+    munmap(cblock, 4096);
+    close(fd);
+    unlink(file);
+    std::cout << "testFileBackend ok" << std::endl;
+}
+// memfd后端: 通过unix socket传递fd后attach的句柄和创建者共享同一个队列
+void testMemfd()
+{
+    xten::ShmQueue::ptr shmque = xten::ShmQueue::CreateMemfdShmQueuePtr("testMemfd", 4096, xten::EnumVisitModel::MulitPushMulitPop);
+    assert(shmque && shmque->GetBackend() == xten::EnumShmBackend::Memfd);
+    int sv[2];
+    assert(socketpair(AF_UNIX, SOCK_STREAM, 0, sv) == 0);
+    assert(shmque->SendFd(sv[0]) == 0);
+    xten::ShmQueue::ptr peer(xten::ShmQueue::RecvMemfdShmQueue(sv[1]));
+    assert(peer && peer->GetCreateModel() == xten::EnumCreateModel::LinkShmQue);
+    assert(peer->GetQueueSize() == shmque->GetQueueSize());
+    assert(peer->PushMessage("memfd", 5) == 0);
+    char buffer[64];
+    assert(shmque->PopMessage(buffer, sizeof(buffer)) == 5 && memcmp(buffer, "memfd", 5) == 0);
+    // 不是队列的fd不能attach
+    int fds[2];
+    assert(pipe(fds) == 0);
+    assert(!xten::ShmQueue::AttachMemfdShmQueue(fds[0]));
+    close(fds[0]);
+    close(fds[1]);
+    close(sv[0]);
+    close(sv[1]);
+    std::cout << "testMemfd ok" << std::endl;
+}
+// registry: 一个段中创建大量小队列,按名字打开的句柄和创建的句柄是同一个队列; 超过上限时创建失败
+void testRegistry()
+{
+    xten::ShmQueueRegistry::ptr registry = xten::ShmQueueRegistry::GetShmQueueRegistryPtr("/tmp", 103, 1 << 20, 64);
+    assert(registry);
+    for (int i = 0; i < 64; i++)
+        assert(registry->CreateQueue("queue" + std::to_string(i), 1024));
+    assert(registry->GetQueueCount() == 64);
+    assert(!registry->CreateQueue("queue64", 1024));
+    assert(!registry->OpenQueue("missing"));
+    for (int i = 0; i < 64; i += 7)
+    {
+        std::string name = "queue" + std::to_string(i);
+        xten::ShmQueue::ptr writer = registry->OpenQueue(name);
+        assert(writer && writer->PushMessage(name.data(), name.size()) == 0);
+    }
+    for (int i = 0; i < 64; i++)
+    {
+        std::string name = "queue" + std::to_string(i);
+        char buffer[64];
+        int ret = registry->CreateQueue(name, 1024)->PopMessage(buffer, sizeof(buffer));
+        assert(i % 7 ? ret == 0 : std::string(buffer, ret) == name);
+    }
+    assert(registry->RemoveRegistry());
+    std::cout << "testRegistry ok" << std::endl;
+}
+// 在线扩容: 旧ring中的消息先被读完,之后跟随到新ring; 另一个句柄在下一次Pop时自动切换
+void testResize()
+{
+    xten::ShmQueue::ptr shmque = xten::ShmQueue::GetShmQueuePtr("/tmp", 104, 1024, xten::EnumVisitModel::MulitPushMulitPop);
+    xten::ShmQueue::ptr consumer = xten::ShmQueue::GetShmQueuePtr("/tmp", 104, 1024, xten::EnumVisitModel::MulitPushMulitPop);
+    assert(shmque && consumer);
+    int pushed = 0;
+    while (true)
+    {
+        std::string msg = "resize" + std::to_string(pushed);
+        if (shmque->PushMessage(msg.data(), msg.size()) != 0)
+            break;
+        pushed++;
+    }
+    assert(pushed > 10);
+    assert(shmque->Resize(8192) == 0);
+    assert(shmque->GetQueueSize() == 8192);
+    std::string big(2000, 'b');
+    assert(shmque->PushMessage(big.data(), big.size()) == 0);
+    char buffer[4096];
+    for (int i = 0; i < pushed; i++)
+    {
+        int ret = consumer->PopMessage(buffer, sizeof(buffer));
+        assert(std::string(buffer, ret) == "resize" + std::to_string(i));
+    }
+    assert(consumer->PopMessage(buffer, sizeof(buffer)) == (int)big.size());
+    assert(consumer->GetQueueSize() == 8192);
+    std::cout << "testResize ok" << std::endl;
+}
+// 最新值表: 读者和写者并发时读到的快照不会撕裂,版本号单调递增; 脏位图取走即清除
+void testLatestTable()
+{
+    xten::ShmLatestTable::ptr table = xten::ShmLatestTable::GetShmLatestTablePtr("/tmp", 105, 16, 64, true);
+    assert(table);
+    uint64_t value[8];
+    assert(table->Read(3, value, sizeof(value)) == 0);
+    const uint64_t total = 100000;
+    std::thread writer = std::thread([&]()
+                                     {
+        for (uint64_t i = 1; i <= total; i++)
+        {
+            uint64_t v[8];
+            for (int k = 0; k < 8; k++)
+                v[k] = i;
+            assert(table->Update(0, v, sizeof(v)) == 0);
+        } });
+    uint64_t lastVersion = 0;
+    while (lastVersion < total)
+    {
+        uint64_t version = 0;
+        int ret = table->Read(0, value, sizeof(value), &version);
+        assert(ret == 0 || ret == (int)sizeof(value));
+        if (ret == 0)
+            continue;
+        for (int k = 1; k < 8; k++)
+            assert(value[k] == value[0]);
+        assert(version >= lastVersion);
+        lastVersion = version;
+    }
+    writer.join();
+    assert(value[0] == total);
+    assert(table->Update(5, "five", 4) == 0);
+    std::vector<uint32_t> changed;
+    assert(table->ReadChanged([&](uint32_t slot, const void *, size_t)
+                              { changed.push_back(slot); }) == 2);
+    assert(changed.size() == 2 && changed[0] == 0 && changed[1] == 5);
+    assert(table->ReadChanged([](uint32_t, const void *, size_t) {}) == 0);
+    std::cout << "testLatestTable ok" << std::endl;
+}
+// 大消息slab: 队列中只放描述符,零拷贝视图读写,释放后块回到slab可以重复使用
+void testSlab()
+{
+    xten::ShmQueOptions options;
+    options.slabSize = 1 << 16;
+    options.largeMsgThreshold = 512;
+    xten::ShmQueue::ptr shmque = xten::ShmQueue::CreateMemfdShmQueuePtr("testSlab", 4096, xten::EnumVisitModel::SinglePushSinglePop, options);
+    assert(shmque);
+    std::string big(3000, 0);
+    for (size_t i = 0; i < big.size(); i++)
+        big[i] = (char)(i * 7);
+    for (int i = 0; i < 100; i++)
+    {
+        assert(shmque->PushMessage(big.data(), big.size()) == 0);
+        xten::ShmMsgView view;
+        assert(shmque->PopMessageView(view) == (int)big.size());
+        assert(view.block != 0 && memcmp(view.data, big.data(), big.size()) == 0);
+        assert(shmque->GetStats().slabUsedBytes > 0);
+        shmque->ReleaseView(view);
+        assert(shmque->GetStats().slabUsedBytes == 0);
+    }
+    assert(shmque->GetStats().largeMessages == 100);
+    xten::ShmMsgView view;
+    assert(shmque->AllocMessageView(big.size(), view) == 0);
+    memcpy(view.data, big.data(), big.size());
+    assert(shmque->PushMessageView(view) == 0 && view.block == 0);
+    std::vector<char> buffer(4096);
+    assert(shmque->PopMessage(buffer.data(), buffer.size()) == (int)big.size());
+    assert(memcmp(buffer.data(), big.data(), big.size()) == 0);
+    assert(shmque->GetStats().slabUsedBytes == 0);
+    std::cout << "testSlab ok" << std::endl;
+}
+// 流: 比队列大得多的消息按空闲空间分片放入,消费者重组出完整的消息; 普通消息的streamId为SHM_STREAM_NONE
+void testStream()
+{
+    xten::ShmQueue::ptr shmque = xten::ShmQueue::CreateMemfdShmQueuePtr("testStream", 4096, xten::EnumVisitModel::SinglePushSinglePop);
+    std::string data(100000, 0);
+    for (size_t i = 0; i < data.size(); i++)
+        data[i] = (char)(i * 13 + i / 256);
+    std::thread producer = std::thread([&]()
+                                       {
+        assert(shmque->PushStream(7, data.data(), data.size()) == 0);
+        assert(shmque->PushMessage("tail", 4) == 0); });
+    std::vector<unsigned char> message;
+    uint32_t streamId = 0;
+    int ret;
+    while ((ret = shmque->PopStreamMessage(message, streamId)) == 0)
+        ;
+    assert(ret == (int)data.size() && streamId == 7);
+    assert(memcmp(message.data(), data.data(), data.size()) == 0);
+    while ((ret = shmque->PopStreamMessage(message, streamId)) == 0)
+        ;
+    assert(ret == 4 && streamId == SHM_STREAM_NONE && memcmp(message.data(), "tail", 4) == 0);
+    producer.join();
+    std::cout << "testStream ok" << std::endl;
+}
+// 主题游标: 只读到订阅的主题,跳过的记录计数; 覆盖模式下被套圈的游标跳到最老的数据继续读
+void testTopicCursor()
+{
+    xten::ShmQueOptions options;
+    options.overwrite = true;
+    xten::ShmQueue::ptr shmque = xten::ShmQueue::CreateMemfdShmQueuePtr("testTopicCursor", 1024, xten::EnumVisitModel::SinglePushMulitPop, options);
+    xten::ShmCursor cursor;
+    assert(shmque->OpenCursor(cursor, true) == 0);
+    xten::ShmTopicSet topics;
+    topics.Add(2);
+    for (int i = 0; i < 20; i++)
+    {
+        std::string msg = "topic" + std::to_string(i);
+        assert(shmque->PushMessage(msg.data(), msg.size(), i % 2 + 1) == 0);
+    }
+    char buffer[64];
+    uint16_t topic = 0;
+    for (int i = 1; i < 20; i += 2)
+    {
+        int ret = shmque->ReadCursor(cursor, buffer, sizeof(buffer), &topics, &topic);
+        assert(topic == 2 && std::string(buffer, ret) == "topic" + std::to_string(i));
+    }
+    assert(shmque->ReadCursor(cursor, buffer, sizeof(buffer), &topics) == 0);
+    assert(cursor.skipped == 10 && cursor.lapped == 0);
+    // 生产者写满几圈,游标落后的数据已经被覆盖
+    for (int i = 20; i < 400; i++)
+    {
+        std::string msg = "topic" + std::to_string(i);
+        assert(shmque->PushMessage(msg.data(), msg.size(), i % 2 + 1) == 0);
+    }
+    int last = -1;
+    int ret;
+    while ((ret = shmque->ReadCursor(cursor, buffer, sizeof(buffer), &topics, &topic)) > 0)
+    {
+        int seq = atoi(std::string(buffer + 5, ret - 5).c_str());
+        assert(topic == 2 && seq % 2 == 1 && seq > last);
+        assert(last == -1 ? seq > 21 : seq == last + 2);
+        last = seq;
+    }
+    assert(ret == 0 && last == 399 && cursor.lapped > 0);
+    std::cout << "testTopicCursor ok" << std::endl;
+}
+// poller: 只返回有新消息的队列,其他线程放入时唤醒等待; 消费者腾出空间后通过writable返回
+void testPoller()
+{
+    xten::ShmQueuePoller::ptr poller = xten::ShmQueuePoller::CreateShmQueuePollerPtr(64);
+    assert(poller);
+    std::vector<xten::ShmQueue::ptr> queues;
+    for (int i = 0; i < 3; i++)
+    {
+        queues.push_back(xten::ShmQueue::CreateMemfdShmQueuePtr("testPoller", 1024, xten::EnumVisitModel::SinglePushSinglePop));
+        assert(poller->Register(queues[i].get()) >= 0);
+    }
+    std::vector<xten::ShmQueue *> ready;
+    assert(poller->Wait(ready, 10) == 0);
+    std::thread producer = std::thread([&]()
+                                       {
+        usleep(20 * 1000);
+        assert(queues[1]->PushMessage("poll", 4) == 0); });
+    assert(poller->Wait(ready, 2000) == 1 && ready.size() == 1 && ready[0] == queues[1].get());
+    producer.join();
+    char buffer[64];
+    assert(queues[1]->PopMessage(buffer, sizeof(buffer)) == 4);
+    // 写满queues[2]后等待空闲空间
+    std::string msg(100, 'p');
+    while (queues[2]->PushMessage(msg.data(), msg.size()) == 0)
+        ;
+    assert(poller->RegisterWritable(queues[2].get()) >= 0);
+    std::vector<xten::ShmQueue *> readable, writable;
+    // 先取走已有的就绪位(队列有数据,注册时还有不足一条消息的空闲空间)
+    poller->Wait(readable, writable, 10);
+    assert(readable.size() == 1 && readable[0] == queues[2].get());
+    assert(poller->Wait(readable, writable, 10) == 0);
+    assert(queues[2]->DelHeadMessage() == (int)msg.size());
+    assert(poller->Wait(readable, writable, 1000) == 1 && writable.size() == 1 && writable[0] == queues[2].get());
+    assert(poller->UnregisterWritable(queues[2].get()) == 0);
+    for (auto &que : queues)
+        assert(poller->Unregister(que.get()) == 0);
+    std::cout << "testPoller ok" << std::endl;
+}
+// 分发器: 所有消息都被处理一次,同一个key的消息按队列中的顺序处理
+void testDispatcher()
+{
+    xten::ShmQueue::ptr shmque = xten::ShmQueue::CreateMemfdShmQueuePtr("testDispatcher", 1 << 16, xten::EnumVisitModel::MulitPushSinglePop);
+    std::mutex mtx;
+    int next[4] = {0, 0, 0, 0};
+    xten::ShmQueueDispatcher dispatcher(shmque, 4, [&](xten::ShmMsgView &view)
+                                        {
+        const char *data = (const char *)view.data;
+        int key = data[0] - '0';
+        int seq = atoi(std::string(data + 2, view.length - 2).c_str());
+        std::lock_guard<std::mutex> lock(mtx);
+        assert(seq == next[key]);
+        next[key]++; },
+                                        [](const void *data, size_t)
+                                        { return (uint64_t)(((const char *)data)[0] - '0'); });
+    dispatcher.Start();
+    const int total = 2000;
+    for (int i = 0; i < total;)
+    {
+        std::string msg = std::to_string(i % 4) + ":" + std::to_string(i / 4);
+        if (shmque->PushMessage(msg.data(), msg.size()) == 0)
+            i++;
+    }
+    for (int idle = 0; dispatcher.GetProcessed() < (uint64_t)total; idle++)
+    {
+        assert(idle < 10000);
+        usleep(1000);
+    }
+    dispatcher.Stop();
+    assert(dispatcher.GetDispatched() == (uint64_t)total);
+    for (int key = 0; key < 4; key++)
+        assert(next[key] == total / 4);
+    std::cout << "testDispatcher ok" << std::endl;
+}
+// 录制文件: 录制工具写入的记录能被回放工具完整解析,最后一条不完整的记录被丢弃
+void testTrafficFile()
+{
+    std::string path = "/tmp/testTrafficFile.sqtr";
+    FILE *fp = fopen(path.c_str(), "wb");
+    assert(fp);
+    xten::ShmTrafficHeader header;
+    memset(&header, 0, sizeof(header));
+    header.magic = SHM_TRAFFIC_MAGIC;
+    header.version = SHM_TRAFFIC_VERSION;
+    fwrite(&header, sizeof(header), 1, fp);
+    uint64_t deltas[3] = {0, 300, 1000000000ull};
+    std::string msgs[3] = {"a", std::string(200, 'b'), "ccc"};
+    for (int i = 0; i < 3; i++)
+    {
+        uint8_t prefix[30];
+        size_t n = xten::ShmTrafficPutVarint(prefix, deltas[i]);
+        n += xten::ShmTrafficPutVarint(prefix + n, msgs[i].size());
+        n += xten::ShmTrafficPutVarint(prefix + n, i + 1);
+        fwrite(prefix, n, 1, fp);
+        fwrite(msgs[i].data(), msgs[i].size(), 1, fp);
+    }
+    // 录制进程被杀死时留下的半条记录
+    uint8_t prefix[30];
+    size_t n = xten::ShmTrafficPutVarint(prefix, 5);
+    n += xten::ShmTrafficPutVarint(prefix + n, 100);
+    fwrite(prefix, n, 1, fp);
+    fwrite("dd", 2, 1, fp);
+    fclose(fp);
+
+    xten::ShmTrafficHeader loaded;
+    std::vector<uint8_t> content;
+    std::vector<xten::ShmTrafficRecord> records;
+    assert(xten::ShmTrafficLoad(path, loaded, content, records));
+    assert(records.size() == 3);
+    uint64_t timeNs = 0;
+    for (int i = 0; i < 3; i++)
+    {
+        timeNs += deltas[i];
+        assert(records[i].timeNs == timeNs);
+        assert(records[i].topic == i + 1);
+        assert(std::string((const char *)content.data() + records[i].offset, records[i].length) == msgs[i]);
+    }
+    // 不是录制文件
+    fp = fopen(path.c_str(), "wb");
+    header.magic = 0;
+    fwrite(&header, sizeof(header), 1, fp);
+    fclose(fp);
+    records.clear();
+    assert(!xten::ShmTrafficLoad(path, loaded, content, records));
+    unlink(path.c_str());
+    std::cout << "testTrafficFile ok" << std::endl;
+}
+// 保留日志: 游标Seek到任意保留范围内的序号重读,水位之前的记录被回收后不能再Seek
+void testRetainedLog()
+{
+    xten::ShmQueOptions options;
+    options.retainedLog = true;
+    options.logIndexInterval = 4;
+    xten::ShmQueue::ptr shmque = xten::ShmQueue::CreateMemfdShmQueuePtr("testRetainedLog", 1024, xten::EnumVisitModel::SinglePushMulitPop, options);
+    uint64_t headSeq, tailSeq;
+    assert(shmque->GetLogRange(headSeq, tailSeq) == 0 && headSeq == tailSeq);
+    uint64_t first = headSeq;
+    int count = 0;
+    while (true)
+    {
+        std::string msg = "log" + std::to_string(count);
+        int ret = shmque->PushMessage(msg.data(), msg.size());
+        if (ret != 0)
+        {
+            // 没有推进水位,生产者不能回收任何记录
+            assert(ret == (int)xten::ShmQueErrorCode::QueueNoFreeSize);
+            break;
+        }
+        count++;
+    }
+    assert(count > 10);
+    assert(shmque->GetLogRange(headSeq, tailSeq) == 0 && headSeq == first && tailSeq == first + count);
+    char buffer[64];
+    xten::ShmCursor cursor;
+    for (int i : {7, 0, count - 1})
+    {
+        assert(shmque->Seek(cursor, first + i) == 0);
+        int ret = shmque->ReadCursor(cursor, buffer, sizeof(buffer));
+        assert(std::string(buffer, ret) == "log" + std::to_string(i));
+        assert(cursor.seq == first + i + 1);
+    }
+    assert(shmque->Seek(cursor, tailSeq) == 0 && shmque->ReadCursor(cursor, buffer, sizeof(buffer)) == 0);
+    assert(shmque->Seek(cursor, tailSeq + 1) == (int)xten::ShmQueErrorCode::QueueSeqNotRetained);
+    // 推进水位后生产者回收老记录继续写入
+    assert(shmque->SetRetainSeq(first + count / 2) == 0);
+    int more = 0;
+    for (; more < count / 4; more++)
+    {
+        std::string msg = "log" + std::to_string(count + more);
+        assert(shmque->PushMessage(msg.data(), msg.size()) == 0);
+    }
+    assert(shmque->GetLogRange(headSeq, tailSeq) == 0);
+    assert(headSeq > first && headSeq <= first + count / 2 && tailSeq == first + count + more);
+    assert(shmque->Seek(cursor, first) == (int)xten::ShmQueErrorCode::QueueSeqNotRetained);
+    assert(shmque->Seek(cursor, tailSeq - 1) == 0);
+    int ret = shmque->ReadCursor(cursor, buffer, sizeof(buffer));
+    assert(std::string(buffer, ret) == "log" + std::to_string(count + more - 1));
+    // 生产者在seqlock中间崩溃(tailSeq已经写入,tail还没有发布): 下一个生产者恢复锁时修复,读者不再自旋
+    xten::ShmQueue::ptr crashque = xten::ShmQueue::CreateMemfdShmQueuePtr("testRetainedLog", 1024, xten::EnumVisitModel::MulitPushMulitPop, options);
+    for (int i = 0; i < 10; i++)
+    {
+        std::string msg = "log" + std::to_string(i);
+        assert(crashque->PushMessage(msg.data(), msg.size()) == 0);
+    }
+    int fds[2];
+    assert(pipe(fds) == 0);
+    pid_t pid = fork();
+    if (pid == 0)
+    {
+        crashque->PushFromFd(fds[0], 64);
+        _exit(0);
+    }
+    usleep(100 * 1000);
+    size_t mapSize = 3 * CPU_CACHELINE_SIZE + crashque->GetQueueSize() + sizeof(xten::ShmLogHeader);
+    unsigned char *mem = (unsigned char *)mmap(nullptr, mapSize, PROT_READ | PROT_WRITE, MAP_SHARED, crashque->GetFd(), 0);
+    assert(mem != MAP_FAILED);
+    xten::ShmLogHeader *log = (xten::ShmLogHeader *)(mem + 3 * CPU_CACHELINE_SIZE + crashque->GetQueueSize());
+    log->version.fetch_add(1);
+    log->tailSeq.fetch_add(1);
+    kill(pid, SIGKILL);
+    waitpid(pid, nullptr, 0);
+    assert(crashque->PushMessage("log10", 5) == 0);
+    assert((log->version.load() & 1) == 0);
+    assert(crashque->GetLogRange(headSeq, tailSeq) == 0 && tailSeq - headSeq == 11);
+    for (int i : {10, 4})
+    {
+        assert(crashque->Seek(cursor, headSeq + i) == 0);
+        ret = crashque->ReadCursor(cursor, buffer, sizeof(buffer));
+        assert(std::string(buffer, ret) == "log" + std::to_string(i));
+    }
+    munmap(mem, mapSize);
+    close(fds[0]);
+    close(fds[1]);
+    std::cout << "testRetainedLog ok" << std::endl;
+}
+#if defined(__cpp_impl_coroutine)
+static xten::ShmAsyncTask asyncProduce(xten::ShmAsyncQueue &que, int total)
+{
+    for (int i = 0; i < total; i++)
+    {
+        std::string msg = "async" + std::to_string(i);
+        assert(co_await que.Push(msg.data(), msg.size()) == 0);
+    }
+}
+static xten::ShmAsyncTask asyncConsume(xten::ShmAsyncQueue &que, int total, int &received)
+{
+    char buffer[64];
+    for (; received < total; received++)
+    {
+        int ret = co_await que.Pop(buffer, sizeof(buffer));
+        assert(std::string(buffer, ret) == "async" + std::to_string(received));
+    }
+}
+// 协程接口: 同一个线程中的生产者/消费者协程在队列满/空时挂起,由执行器在对方操作后恢复
+void testAsync()
+{
+    xten::ShmQueue::ptr shmque = xten::ShmQueue::CreateMemfdShmQueuePtr("testAsync", 256, xten::EnumVisitModel::SinglePushSinglePop);
+    xten::ShmAsyncLoop loop(4);
+    xten::ShmAsyncQueue asyncQue(shmque, loop);
+    const int total = 1000;
+    int received = 0;
+    // 消费者先运行,队列为空时挂起
+    loop.Spawn(asyncConsume(asyncQue, total, received));
+    loop.Spawn(asyncProduce(asyncQue, total));
+    loop.Run();
+    assert(received == total && loop.GetSuspended() == 0);
+    // 队列只能放下几条消息,双方都挂起过
+    assert(loop.GetWakeups() > 0);
+    std::cout << "testAsync ok" << std::endl;
+}
+#endif
+// NUMA放置: 策略记录在控制块中,单节点机器上不生效; 放置之后队列照常使用
+void testNuma()
+{
+    int nodes = xten::ShmNumaNodeCount();
+    assert(nodes >= 1);
+    for (xten::EnumNumaPolicy policy : {xten::EnumNumaPolicy::Default, xten::EnumNumaPolicy::Bind, xten::EnumNumaPolicy::Interleave})
+    {
+        xten::ShmQueOptions options;
+        options.numaPolicy = policy;
+        xten::ShmQueue::ptr shmque = xten::ShmQueue::CreateMemfdShmQueuePtr("testNuma", 4096, xten::EnumVisitModel::SinglePushSinglePop, options);
+        assert(shmque && shmque->GetNumaPolicy() == policy);
+        int node = shmque->GetNumaNode();
+        // 只有生效的Bind/Preferred有绑定的节点
+        if (nodes == 1 || policy != xten::EnumNumaPolicy::Bind)
+            assert(node == -1);
+        else
+            assert(node >= -1 && node < nodes);
+        assert(xten::ShmNumaPinThread(node) == 0);
+        char buffer[64];
+        for (int i = 0; i < 100; i++)
+        {
+            std::string msg = "numa" + std::to_string(i);
+            assert(shmque->PushMessage(msg.data(), msg.size()) == 0);
+            int ret = shmque->PopMessage(buffer, sizeof(buffer));
+            assert(std::string(buffer, ret) == msg);
+        }
+    }
+    std::cout << "testNuma ok" << std::endl;
+}
+// 紧凑记录头部: 8字节头部,主题和crc照常保留; ring中的记录不能超过SHM_COMPACT_MAX_LENGTH
+void testCompactHeader()
+{
+    xten::ShmQueOptions options;
+    options.compactHeader = true;
+    options.headerCrc = true;
+    xten::ShmQueue::ptr shmque = xten::ShmQueue::CreateMemfdShmQueuePtr("testCompactHeader", 1024, xten::EnumVisitModel::SinglePushMulitPop, options);
+    assert(shmque->GetCompactHeader() && shmque->GetRecordHeaderSize() == SHM_COMPACT_HEADER_SIZE);
+    xten::ShmCursor cursor;
+    assert(shmque->OpenCursor(cursor) == 0);
+    char buffer[64];
+    uint16_t topic = 0;
+    // 绕过ring尾部很多圈
+    for (int i = 0; i < 1000; i++)
+    {
+        std::string msg = "compact" + std::to_string(i);
+        assert(shmque->PushMessage(msg.data(), msg.size(), (uint16_t)(i % 7 + 1)) == 0);
+        int ret = shmque->ReadCursor(cursor, buffer, sizeof(buffer), nullptr, &topic);
+        assert(std::string(buffer, ret) == msg && topic == i % 7 + 1);
+        ret = shmque->PopMessage(buffer, sizeof(buffer));
+        assert(std::string(buffer, ret) == msg);
+    }
+    // 16字节头部时8字节的消息占24字节,紧凑头部只占16字节
+    int count = 0;
+    while (shmque->PushMessage("12345678", 8) == 0)
+        count++;
+    assert((size_t)count * 16 > 1024 - 16 - 2 * 24);
+    // 超过24位长度的消息不能放入ring
+    xten::ShmQueue::ptr bigque = xten::ShmQueue::CreateMemfdShmQueuePtr("testCompactHeader", 32 << 20, xten::EnumVisitModel::SinglePushSinglePop, options);
+    std::vector<char> big(SHM_COMPACT_MAX_LENGTH + 1, 'c');
+    assert(bigque->PushMessage(big.data(), big.size()) == (int)xten::ShmQueErrorCode::QueueParameterInvaild);
+    assert(bigque->PushMessage(big.data(), SHM_COMPACT_MAX_LENGTH) == 0);
+    std::vector<char> out(SHM_COMPACT_MAX_LENGTH);
+    assert(bigque->PopMessage(out.data(), out.size()) == (int)SHM_COMPACT_MAX_LENGTH);
+    assert(memcmp(out.data(), big.data(), out.size()) == 0);
+    std::cout << "testCompactHeader ok" << std::endl;
+}
 int main()
 {
+    testCopy();
+    testPublish();
+    testRecovery();
+    testFileBackend();
+    testMemfd();
+    testRegistry();
+    testResize();
+    testOverwrite();
+    testLatestTable();
+    testSlab();
+    testStream();
+    testTopicCursor();
+    testSpill();
+    testCompress();
+    testTimer();
+    testWriter();
+    testRpc();
+    testPoller();
+    testDispatcher();
+    testTrafficFile();
+    testRetainedLog();
+    testNuma();
+    testCompactHeader();
+#if defined(__cpp_impl_coroutine)
+    testAsync();
+#endif
+    testFdBridge();
     test();
     // std::thread t1 = std::thread([]()
     //  {
@@ -0,0 +1,154 @@
+// ShmQueue流量录制工具---把线上队列的消息和到达时间写入录制文件,之后用replay.out离线回放
+// ./record.out <pathname> <proj_id> <outfile> [-m tap|consume] [-t seconds] [-n count]
+//   tap      旁路游标(默认): 不取走消息,不影响线上的消费者; 游标被套圈时丢失的消息无法录制,结束时报告套圈次数
+//   consume  作为消费者取出消息(替代原来的消费者,或者在镜像队列上使用); 取出的消息不带主题id
+// Ctrl+C结束录制
+#include <iostream>
+#include <string>
+#include <vector>
+#include <unistd.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <sys/ipc.h>
+#include <sys/shm.h>
+#include "ShmQueue.h"
+#include "ShmFutex.h"
+#include "ShmTrafficFile.h"
+
+using namespace xten;
+
+// 没有消息时先自旋多少次再睡眠---睡眠会让录制的时间戳变粗
+#define RECORD_SPIN_COUNT 4096
+#define RECORD_SLEEP_US 20
+
+static volatile sig_atomic_t g_stop = 0;
+
+static void onSignal(int)
+{
+    g_stop = 1;
+}
+
+static void usage(const char *prog)
+{
+    std::cout << "usage: " << prog << " <pathname> <proj_id> <outfile> [-m tap|consume] [-t seconds] [-n count]" << std::endl;
+}
+
+int main(int argc, char **argv)
+{
+    if (argc < 4)
+    {
+        usage(argv[0]);
+        return 1;
+    }
+    std::string pathname = argv[1];
+    int projId = atoi(argv[2]);
+    std::string outfile = argv[3];
+    bool tap = true;
+    double seconds = 0;
+    uint64_t maxCount = 0;
+    int opt;
+    optind = 4;
+    while ((opt = getopt(argc, argv, "m:t:n:")) != -1)
+    {
+        switch (opt)
+        {
+        case 'm':
+            tap = std::string(optarg) != "consume";
+            break;
+        case 't':
+            seconds = atof(optarg);
+            break;
+        case 'n':
+            maxCount = strtoull(optarg, nullptr, 10);
+            break;
+        default:
+            usage(argv[0]);
+            return 1;
+        }
+    }
+    // 只链接已经存在的队列---不存在时GetShmQueue会创建新队列
+    key_t key = ftok(pathname.c_str(), projId);
+    if (key == -1 || shmget(key, 0, 0666) == -1)
+    {
+        std::cout << "queue " << pathname << ":" << projId << " does not exist" << std::endl;
+        return 1;
+    }
+    // 传入最小的大小链接---队列大小以控制块中的为准(传入更大的值会使GetShmQueue删除重建)
+    ShmQueue *que = ShmQueue::GetShmQueue(pathname, projId, 1);
+    if (!que)
+        return 1;
+    ShmCursor cursor;
+    if (tap && que->OpenCursor(cursor) != 0)
+    {
+        std::cout << "OpenCursor failed, queue does not support tap mode" << std::endl;
+        return 1;
+    }
+    FILE *fp = fopen(outfile.c_str(), "wb");
+    if (!fp)
+    {
+        std::cout << "open " << outfile << " failed,errstr=" << strerror(errno) << std::endl;
+        return 1;
+    }
+    setvbuf(fp, nullptr, _IOFBF, 1024 * 1024);
+    ShmTrafficHeader header;
+    memset(&header, 0, sizeof(header));
+    header.magic = SHM_TRAFFIC_MAGIC;
+    header.version = SHM_TRAFFIC_VERSION;
+    header.mode = tap ? 0 : 1;
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    header.startTimeNs = (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+    fwrite(&header, sizeof(header), 1, fp);
+
+    signal(SIGINT, onSignal);
+    signal(SIGTERM, onSignal);
+    std::vector<BYTE> buffer(que->GetQueueSize());
+    uint64_t count = 0, bytes = 0, fileBytes = sizeof(header);
+    uint64_t beginNs = ShmTrafficNowNs();
+    uint64_t lastNs = 0;
+    int idle = 0;
+    while (!g_stop && (maxCount == 0 || count < maxCount))
+    {
+        uint16_t topic = SHM_TOPIC_NONE;
+        int ret = tap ? que->ReadCursor(cursor, buffer.data(), buffer.size(), nullptr, &topic)
+                      : que->PopMessage(buffer.data(), buffer.size());
+        if (ret == (int)(ShmQueErrorCode::QueueBufferLengthInsufficient))
+        {
+            // slab中的大消息可能比队列大
+            buffer.resize(buffer.size() * 2);
+            continue;
+        }
+        if (ret <= 0)
+        {
+            if (seconds > 0 && (ShmTrafficNowNs() - beginNs) / 1e9 >= seconds)
+                break;
+            if (++idle < RECORD_SPIN_COUNT)
+                ShmCpuRelax();
+            else
+                usleep(RECORD_SLEEP_US);
+            continue;
+        }
+        idle = 0;
+        uint64_t nowNs = ShmTrafficNowNs();
+        uint8_t prefix[30];
+        size_t n = ShmTrafficPutVarint(prefix, lastNs ? nowNs - lastNs : 0);
+        n += ShmTrafficPutVarint(prefix + n, (uint64_t)ret);
+        n += ShmTrafficPutVarint(prefix + n, topic);
+        lastNs = nowNs;
+        fwrite(prefix, n, 1, fp);
+        fwrite(buffer.data(), ret, 1, fp);
+        count++;
+        bytes += ret;
+        fileBytes += n + ret;
+    }
+    fclose(fp);
+    double cost = (ShmTrafficNowNs() - beginNs) / 1e9;
+    printf("recorded %lu records, %lu bytes in %.2f s (%.0f msgs/s), file %lu bytes",
+           (unsigned long)count, (unsigned long)bytes, cost, count / cost, (unsigned long)fileBytes);
+    if (tap)
+        printf(", lapped %lu times", (unsigned long)cursor.lapped);
+    printf("\n");
+    fflush(stdout);
+    // 只是链接者---不删除线上的队列
+    _exit(0);
+}
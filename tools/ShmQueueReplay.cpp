@@ -0,0 +1,262 @@
+// ShmQueue流量回放工具---把record.out录制的流量放入一个测试队列,离线比较不同的队列配置
+// ./replay.out <infile> <pathname> <proj_id> [-s quesize] [-x speed] [-p producers] [-l loops]
+//   -s 测试队列大小(默认1MB,创建新队列)
+//   -x 回放速度: 1按原始节奏(默认) N为N倍速 0为不等待尽快放入
+//   -p 生产者进程个数(默认1): 第i条记录由第i%p个进程按原来的时间点放入
+//   -l 重复回放的次数(默认1)
+// 本进程作为消费者取出所有消息,报告吞吐和端到端延迟
+// 延迟: 生产者把放入时间写入消息的前8字节(消息长度不变),短于8字节的消息不参与延迟统计
+#include <iostream>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <unistd.h>
+#include <stdlib.h>
+#include <sched.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include "ShmQueue.h"
+#include "ShmFutex.h"
+#include "ShmTrafficFile.h"
+
+using namespace xten;
+
+// 队列满或者队列空时先自旋多少次再让出cpu
+#define REPLAY_SPIN_COUNT 64
+// 离计划时间还有多久时睡眠而不是自旋
+#define REPLAY_SLEEP_NS 200000
+// fork完所有生产者后延迟多久开始回放
+#define REPLAY_START_DELAY_NS 200000000ull
+
+// 每个生产者进程的统计---放在fork前映射的共享匿名内存中
+struct ProducerStats
+{
+    uint64_t sent;        // 放入的消息数
+    uint64_t failed;      // 放入失败(除队列满以外的错误)的消息数
+    uint64_t fullRetries; // 队列满重试的次数
+    uint64_t lagSumNs;    // 实际放入时间落后计划时间的总和
+    uint64_t lagMaxNs;    // 落后计划时间的最大值
+};
+
+static void usage(const char *prog)
+{
+    std::cout << "usage: " << prog << " <infile> <pathname> <proj_id> [-s quesize] [-x speed] [-p producers] [-l loops]" << std::endl;
+}
+
+// 生产者进程: 按计划时间放入分配给自己的记录
+static void runProducer(int index, int producers, int loops, double speed, uint64_t startNs,
+                        const std::string &pathname, int projId, size_t queSize, EnumVisitModel model,
+                        const std::vector<uint8_t> &content, const std::vector<ShmTrafficRecord> &records,
+                        ProducerStats *stats)
+{
+    ShmQueue *que = ShmQueue::GetShmQueue(pathname, projId, queSize, model);
+    if (!que)
+        _exit(1);
+    uint64_t traceNs = records.back().timeNs;
+    std::vector<uint8_t> msg;
+    for (int loop = 0; loop < loops; loop++)
+    {
+        for (size_t i = index; i < records.size(); i += producers)
+        {
+            const ShmTrafficRecord &record = records[i];
+            uint64_t dueNs = startNs;
+            if (speed > 0)
+            {
+                dueNs += (uint64_t)((loop * traceNs + record.timeNs) / speed);
+                uint64_t nowNs;
+                while ((nowNs = ShmTrafficNowNs()) < dueNs)
+                {
+                    if (dueNs - nowNs > REPLAY_SLEEP_NS)
+                        usleep((dueNs - nowNs - REPLAY_SLEEP_NS / 2) / 1000);
+                    else
+                        ShmCpuRelax();
+                }
+            }
+            msg.assign(content.begin() + record.offset, content.begin() + record.offset + record.length);
+            uint64_t pushNs = ShmTrafficNowNs();
+            if (msg.size() >= sizeof(pushNs))
+                memcpy(msg.data(), &pushNs, sizeof(pushNs));
+            int ret;
+            for (int retry = 1; (ret = que->PushMessage(msg.data(), msg.size(), record.topic)) ==
+                                (int)(ShmQueErrorCode::QueueNoFreeSize);
+                 retry++)
+            {
+                // 队列满---消费者跟不上,这段时间计入落后计划的时间
+                stats->fullRetries++;
+                if (retry % REPLAY_SPIN_COUNT == 0)
+                    sched_yield();
+                else
+                    ShmCpuRelax();
+            }
+            if (ret != 0)
+            {
+                stats->failed++;
+                continue;
+            }
+            stats->sent++;
+            if (speed > 0)
+            {
+                uint64_t lagNs = ShmTrafficNowNs() - dueNs;
+                stats->lagSumNs += lagNs;
+                stats->lagMaxNs = std::max(stats->lagMaxNs, lagNs);
+            }
+        }
+    }
+    _exit(0);
+}
+
+static double percentileUs(const std::vector<uint64_t> &sorted, double p)
+{
+    if (sorted.empty())
+        return 0;
+    size_t idx = std::min(sorted.size() - 1, (size_t)(sorted.size() * p));
+    return sorted[idx] / 1e3;
+}
+
+int main(int argc, char **argv)
+{
+    if (argc < 4)
+    {
+        usage(argv[0]);
+        return 1;
+    }
+    std::string infile = argv[1];
+    std::string pathname = argv[2];
+    int projId = atoi(argv[3]);
+    size_t queSize = 1024 * 1024;
+    double speed = 1;
+    int producers = 1;
+    int loops = 1;
+    int opt;
+    optind = 4;
+    while ((opt = getopt(argc, argv, "s:x:p:l:")) != -1)
+    {
+        switch (opt)
+        {
+        case 's':
+            queSize = strtoull(optarg, nullptr, 10);
+            break;
+        case 'x':
+            speed = atof(optarg);
+            break;
+        case 'p':
+            producers = std::max(1, atoi(optarg));
+            break;
+        case 'l':
+            loops = std::max(1, atoi(optarg));
+            break;
+        default:
+            usage(argv[0]);
+            return 1;
+        }
+    }
+    ShmTrafficHeader header;
+    std::vector<uint8_t> content;
+    std::vector<ShmTrafficRecord> records;
+    if (!ShmTrafficLoad(infile, header, content, records))
+        return 1;
+    if (records.empty())
+    {
+        std::cout << infile << " has no records" << std::endl;
+        return 1;
+    }
+    uint64_t traceBytes = 0;
+    size_t maxLength = 0;
+    for (const ShmTrafficRecord &record : records)
+    {
+        traceBytes += record.length;
+        maxLength = std::max(maxLength, (size_t)record.length);
+    }
+    double traceSec = records.back().timeNs / 1e9;
+    printf("trace: %zu records, %lu bytes, %.3f s, %.0f msgs/s, recorded by %s\n", records.size(),
+           (unsigned long)traceBytes, traceSec, traceSec > 0 ? records.size() / traceSec : 0.0,
+           header.mode == 0 ? "tap" : "consumer");
+
+    EnumVisitModel model = producers > 1 ? EnumVisitModel::MulitPushSinglePop : EnumVisitModel::SinglePushSinglePop;
+    ShmQueue *que = ShmQueue::GetShmQueue(pathname, projId, queSize, model);
+    if (!que)
+        return 1;
+    ProducerStats *stats = (ProducerStats *)mmap(nullptr, sizeof(ProducerStats) * producers, PROT_READ | PROT_WRITE,
+                                                 MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (stats == MAP_FAILED)
+    {
+        std::cout << "mmap failed,errstr=" << strerror(errno) << std::endl;
+        delete que;
+        return 1;
+    }
+    memset(stats, 0, sizeof(ProducerStats) * producers);
+    uint64_t startNs = ShmTrafficNowNs() + REPLAY_START_DELAY_NS;
+    for (int i = 0; i < producers; i++)
+    {
+        if (fork() == 0)
+            runProducer(i, producers, loops, speed, startNs, pathname, projId, queSize, model, content, records, &stats[i]);
+    }
+
+    // 消费者: 取出所有消息,直到所有生产者退出并且队列为空
+    uint64_t total = (uint64_t)records.size() * loops;
+    std::vector<uint8_t> buffer(std::max(maxLength, que->GetQueueSize()));
+    std::vector<uint64_t> latency;
+    latency.reserve(total);
+    uint64_t received = 0, bytes = 0, lastNs = startNs;
+    int running = producers;
+    int idle = 0;
+    while (received < total)
+    {
+        int ret = que->PopMessage(buffer.data(), buffer.size());
+        if (ret > 0)
+        {
+            lastNs = ShmTrafficNowNs();
+            received++;
+            bytes += ret;
+            uint64_t pushNs;
+            if ((size_t)ret >= sizeof(pushNs))
+            {
+                memcpy(&pushNs, buffer.data(), sizeof(pushNs));
+                latency.push_back(lastNs - pushNs);
+            }
+            idle = 0;
+            continue;
+        }
+        if (ret < 0)
+            continue;
+        if (running == 0)
+            break;
+        while (running > 0 && waitpid(-1, nullptr, WNOHANG) > 0)
+            running--;
+        if (++idle % REPLAY_SPIN_COUNT == 0)
+            sched_yield();
+        else
+            ShmCpuRelax();
+    }
+    while (running > 0 && waitpid(-1, nullptr, 0) > 0)
+        running--;
+
+    // 报告
+    ProducerStats sum;
+    memset(&sum, 0, sizeof(sum));
+    for (int i = 0; i < producers; i++)
+    {
+        sum.sent += stats[i].sent;
+        sum.failed += stats[i].failed;
+        sum.fullRetries += stats[i].fullRetries;
+        sum.lagSumNs += stats[i].lagSumNs;
+        sum.lagMaxNs = std::max(sum.lagMaxNs, stats[i].lagMaxNs);
+    }
+    double cost = lastNs > startNs ? (lastNs - startNs) / 1e9 : 0;
+    char speedStr[32] = "max";
+    if (speed > 0)
+        snprintf(speedStr, sizeof(speedStr), "%gx", speed);
+    printf("replay: queue=%zu bytes, producers=%d, loops=%d, speed=%s\n", que->GetQueueSize(), producers, loops, speedStr);
+    printf("throughput: %lu/%lu records in %.3f s, %.0f msgs/s, %.2f MB/s, failed=%lu, full retries=%lu\n",
+           (unsigned long)received, (unsigned long)total, cost, cost > 0 ? received / cost : 0.0,
+           cost > 0 ? bytes / cost / 1e6 : 0.0, (unsigned long)sum.failed, (unsigned long)sum.fullRetries);
+    std::sort(latency.begin(), latency.end());
+    printf("latency(us): samples=%zu p50=%.1f p90=%.1f p99=%.1f p99.9=%.1f max=%.1f\n", latency.size(),
+           percentileUs(latency, 0.5), percentileUs(latency, 0.9), percentileUs(latency, 0.99),
+           percentileUs(latency, 0.999), latency.empty() ? 0.0 : latency.back() / 1e3);
+    if (speed > 0 && sum.sent > 0)
+        printf("schedule lag(us): avg=%.1f max=%.1f\n", sum.lagSumNs / 1e3 / sum.sent, sum.lagMaxNs / 1e3);
+    munmap(stats, sizeof(ProducerStats) * producers);
+    delete que;
+    return 0;
+}
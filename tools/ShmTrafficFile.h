@@ -0,0 +1,116 @@
+#ifndef __XTEN_SHM_TRAFFIC_FILE_H__
+#define __XTEN_SHM_TRAFFIC_FILE_H__
+#include <string>
+#include <vector>
+#include <errno.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+// 流量录制文件格式---录制工具和回放工具共用
+// [文件头部] 之后每条记录: [varint 距上一条的纳秒][varint 消息长度][varint 主题id][消息数据]
+// 时间戳用差值+varint编码,小消息的记录开销通常只有3~5字节
+namespace xten
+{
+// 文件头部标记 "SQTR"
+#define SHM_TRAFFIC_MAGIC 0x52545153u
+#define SHM_TRAFFIC_VERSION 1
+    struct ShmTrafficHeader
+    {
+        uint32_t magic;       // SHM_TRAFFIC_MAGIC
+        uint16_t version;     // SHM_TRAFFIC_VERSION
+        uint16_t mode;        // 录制方式 0:旁路游标 1:消费者
+        uint64_t startTimeNs; // 开始录制时的系统时间(CLOCK_REALTIME) 只用于显示
+        uint64_t reserved;
+    };
+    // 解析后的一条记录
+    struct ShmTrafficRecord
+    {
+        uint64_t timeNs;  // 相对第一条记录的时间
+        uint32_t length;  // 消息长度
+        uint16_t topic;   // 主题id
+        uint64_t offset;  // 数据在文件内容中的偏移
+    };
+    inline uint64_t ShmTrafficNowNs()
+    {
+        struct timespec ts;
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+    }
+    // varint编码 ret=写入的字节数(最多10)
+    inline size_t ShmTrafficPutVarint(uint8_t *p, uint64_t v)
+    {
+        size_t n = 0;
+        while (v >= 0x80)
+        {
+            p[n++] = (uint8_t)(v | 0x80);
+            v >>= 7;
+        }
+        p[n++] = (uint8_t)v;
+        return n;
+    }
+    // varint解码 on success ret=true
+    inline bool ShmTrafficGetVarint(const uint8_t *&p, const uint8_t *end, uint64_t &v)
+    {
+        v = 0;
+        for (int shift = 0; shift < 64 && p < end; shift += 7)
+        {
+            uint8_t b = *p++;
+            v |= (uint64_t)(b & 0x7F) << shift;
+            if (!(b & 0x80))
+                return true;
+        }
+        return false;
+    }
+    // 读取整个录制文件并解析记录索引 on success ret=true
+    inline bool ShmTrafficLoad(const std::string &path, ShmTrafficHeader &header,
+                               std::vector<uint8_t> &content, std::vector<ShmTrafficRecord> &records)
+    {
+        FILE *fp = fopen(path.c_str(), "rb");
+        if (!fp)
+        {
+            printf("open %s failed,errstr=%s\n", path.c_str(), strerror(errno));
+            return false;
+        }
+        bool ok = fread(&header, sizeof(header), 1, fp) == 1 && header.magic == SHM_TRAFFIC_MAGIC &&
+                  header.version == SHM_TRAFFIC_VERSION;
+        if (ok)
+        {
+            fseek(fp, 0, SEEK_END);
+            long size = ftell(fp) - (long)sizeof(header);
+            fseek(fp, sizeof(header), SEEK_SET);
+            content.resize(size > 0 ? size : 0);
+            ok = content.empty() || fread(content.data(), content.size(), 1, fp) == 1;
+        }
+        fclose(fp);
+        if (!ok)
+        {
+            printf("%s is not a traffic record file\n", path.c_str());
+            return false;
+        }
+        const uint8_t *p = content.data();
+        const uint8_t *end = p + content.size();
+        uint64_t timeNs = 0;
+        while (p < end)
+        {
+            uint64_t delta, length, topic;
+            if (!ShmTrafficGetVarint(p, end, delta) || !ShmTrafficGetVarint(p, end, length) ||
+                !ShmTrafficGetVarint(p, end, topic) || length > (uint64_t)(end - p))
+            {
+                // 录制进程被杀死时最后一条记录可能不完整
+                printf("%s truncated after %zu records\n", path.c_str(), records.size());
+                break;
+            }
+            timeNs += delta;
+            ShmTrafficRecord record;
+            record.timeNs = timeNs;
+            record.length = (uint32_t)length;
+            record.topic = (uint16_t)topic;
+            record.offset = p - content.data();
+            records.push_back(record);
+            p += length;
+        }
+        return true;
+    }
+} // namespace xten
+#endif